@@ -41,6 +41,73 @@ pim_inline float4 VEC_CALL rgba8_f4(u32 c)
     return f4_v((r + 0.5f) * s, (g + 0.5f) * s, (b + 0.5f) * s, (a + 0.5f) * s);
 }
 
+// IEEE half precision, rounded to nearest even
+// https://gist.github.com/rygorous/2156668
+pim_inline u16 VEC_CALL f1_half(float x)
+{
+    typedef union { float f; u32 u; } f32_t;
+    const f32_t f32infty = { .u = 255u << 23 };
+    const f32_t f16max = { .u = (127u + 16u) << 23 };
+    const f32_t denormMagic = { .u = ((127u - 15u) + (23u - 10u) + 1u) << 23 };
+    f32_t f = { .f = x };
+    const u32 sign = f.u & 0x80000000u;
+    f.u ^= sign;
+    u16 h;
+    if (f.u >= f16max.u)
+    {
+        // overflow is infinity, nan stays nan
+        h = (f.u > f32infty.u) ? 0x7e00 : 0x7c00;
+    }
+    else if (f.u < (113u << 23))
+    {
+        // denormal, the addition rounds
+        f.f += denormMagic.f;
+        h = (u16)(f.u - denormMagic.u);
+    }
+    else
+    {
+        const u32 mantOdd = (f.u >> 13) & 1u;
+        f.u += (u32)(15 - 127) << 23;
+        f.u += 0xfffu + mantOdd;
+        h = (u16)(f.u >> 13);
+    }
+    return h | (u16)(sign >> 16);
+}
+
+pim_inline float VEC_CALL half_f1(u16 h)
+{
+    typedef union { float f; u32 u; } f32_t;
+    const f32_t magic = { .u = 113u << 23 };
+    const u32 shiftedExp = 0x7c00u << 13;
+    f32_t o = { .u = (h & 0x7fffu) << 13 };
+    const u32 exp = shiftedExp & o.u;
+    o.u += (u32)(127 - 15) << 23;
+    if (exp == shiftedExp)
+    {
+        // infinity or nan
+        o.u += (u32)(128 - 16) << 23;
+    }
+    else if (exp == 0)
+    {
+        // zero or denormal
+        o.u += 1u << 23;
+        o.f -= magic.f;
+    }
+    o.u |= (h & 0x8000u) << 16;
+    return o.f;
+}
+
+pim_inline ushort4 VEC_CALL f4_half4(float4 v)
+{
+    ushort4 h = { f1_half(v.x), f1_half(v.y), f1_half(v.z), f1_half(v.w) };
+    return h;
+}
+
+pim_inline float4 VEC_CALL half4_f4(ushort4 h)
+{
+    return f4_v(half_f1(h.x), half_f1(h.y), half_f1(h.z), half_f1(h.w));
+}
+
 // reference sRGB -> Linear conversion (no approximation)
 pim_inline float VEC_CALL sRGBToLinear(float c)
 {
@@ -131,6 +198,39 @@ pim_inline float4 VEC_CALL Xy16ToNormalTs(short2 xy)
     return n;
 }
 
+// octahedral encoding of a unit vector, 16 bits per axis
+// https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+pim_inline short2 VEC_CALL NormalToOct16(float4 n)
+{
+    float s = f1_abs(n.x) + f1_abs(n.y) + f1_abs(n.z);
+    float x = n.x / f1_max(s, kEpsilon);
+    float y = n.y / f1_max(s, kEpsilon);
+    if (n.z < 0.0f)
+    {
+        float ox = (1.0f - f1_abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float oy = (1.0f - f1_abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = ox;
+        y = oy;
+    }
+    short2 oct;
+    oct.x = (i16)f1_round(x * 32767.0f);
+    oct.y = (i16)f1_round(y * 32767.0f);
+    return oct;
+}
+
+pim_inline float4 VEC_CALL Oct16ToNormal(short2 oct)
+{
+    float4 n;
+    n.x = oct.x * (1.0f / 32767.0f);
+    n.y = oct.y * (1.0f / 32767.0f);
+    n.z = 1.0f - f1_abs(n.x) - f1_abs(n.y);
+    n.w = 0.0f;
+    float t = f1_max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return f4_normalize3(n);
+}
+
 pim_inline u32 VEC_CALL LinearToColor(float4 lin)
 {
     float4 sRGB = f4_tosrgb(lin);
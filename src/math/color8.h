@@ -0,0 +1,81 @@
+#pragma once
+
+#include "math/float8_funcs.h"
+#include "math/color.h"
+
+PIM_C_BEGIN
+
+// 8 wide versions of the color.h helpers
+
+pim_inline float8 VEC_CALL f4x8_perlum(float4x8 x)
+{
+    return f8_fmadd(x.x, f8_s(0.2126f), f8_fmadd(x.y, f8_s(0.7152f), f8_mul(x.z, f8_s(0.0722f))));
+}
+
+// cubic root fit Linear -> sRGB conversion
+// max error = 0.003662
+pim_inline float8 VEC_CALL f8_tosrgb(float8 c)
+{
+    float8 s1 = f8_sqrt(c);
+    float8 s2 = f8_sqrt(s1);
+    float8 s3 = f8_sqrt(s2);
+    return f8_fmadd(s1, f8_s(0.658444f), f8_fmadd(s2, f8_s(0.643378f), f8_mul(s3, f8_s(-0.298148f))));
+}
+
+pim_inline float4x8 VEC_CALL f4x8_tosrgb(float4x8 c)
+{
+    float4x8 y = { f8_tosrgb(c.x), f8_tosrgb(c.y), f8_tosrgb(c.z), f8_tosrgb(c.w) };
+    return y;
+}
+
+pim_inline float4x8 VEC_CALL tmap4x8_reinhard(float4x8 x)
+{
+    return f4x8_div(x, f4x8_addvs(x, f8_s(1.0f)));
+}
+
+pim_inline float8 VEC_CALL tmap8_aces(float8 x)
+{
+    const float8 a = f8_s(2.51f);
+    const float8 b = f8_s(0.03f);
+    const float8 c = f8_s(2.43f);
+    const float8 d = f8_s(0.59f);
+    const float8 e = f8_s(0.14f);
+    float8 n = f8_mul(x, f8_fmadd(a, x, b));
+    float8 m = f8_fmadd(x, f8_fmadd(c, x, d), e);
+    return f8_div(n, m);
+}
+
+pim_inline float4x8 VEC_CALL tmap4x8_aces(float4x8 x)
+{
+    float4x8 y = { tmap8_aces(x.x), tmap8_aces(x.y), tmap8_aces(x.z), f8_s(1.0f) };
+    return y;
+}
+
+pim_inline float8 VEC_CALL tmap8_hable(float8 x, float4 params)
+{
+    const float8 A = f8_s(params.x);
+    const float8 CB = f8_s(params.z * params.y);
+    const float8 B = f8_s(params.y);
+    const float8 DE = f8_s(params.w * 0.02f);
+    const float8 DF = f8_s(params.w * 0.3f);
+    const float8 EoF = f8_s(0.02f / 0.3f);
+    float8 n = f8_fmadd(x, f8_fmadd(A, x, CB), DE);
+    float8 m = f8_fmadd(x, f8_fmadd(A, x, B), DF);
+    return f8_sub(f8_div(n, m), EoF);
+}
+
+// as tmap4_hable with a white point of x.w for every lane
+pim_inline float4x8 VEC_CALL tmap4x8_hable(float4x8 x, float white, float4 params)
+{
+    float8 rcpWhite = f8_s(1.0f / tmap1_hable(white, params));
+    float4x8 y =
+    {
+        f8_mul(tmap8_hable(x.x, params), rcpWhite),
+        f8_mul(tmap8_hable(x.y, params), rcpWhite),
+        f8_mul(tmap8_hable(x.z, params), rcpWhite),
+        f8_s(1.0f),
+    };
+    return y;
+}
+
+PIM_C_END
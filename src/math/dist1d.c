@@ -2,7 +2,18 @@
 #include "allocator/allocator.h"
 #include "math/scalar.h"
 #include "common/atomics.h"
+#include "common/random.h"
+#include "common/time.h"
+#include "common/console.h"
+#include "common/cmd.h"
+#include "threading/task.h"
 #include <string.h>
+#include <stdlib.h>
+
+// tables at least this long are baked by the task system
+#define kAliasParallelLen   (1 << 16)
+// entries per work item of the parallel bake
+#define kAliasBlockLen      (1 << 12)
 
 void dist1d_new(dist1d_t *const dist, i32 length)
 {
@@ -15,6 +26,8 @@ void dist1d_new(dist1d_t *const dist, i32 length)
         dist->pdf = perm_calloc(sizeof(dist->pdf[0]) * pdfLen);
         dist->cdf = perm_calloc(sizeof(dist->cdf[0]) * cdfLen);
         dist->live = perm_calloc(sizeof(dist->live[0]) * pdfLen);
+        dist->aliasProb = perm_calloc(sizeof(dist->aliasProb[0]) * pdfLen);
+        dist->aliasIdx = perm_calloc(sizeof(dist->aliasIdx[0]) * pdfLen);
         dist->integral = 0.0f;
     }
 }
@@ -26,10 +39,370 @@ void dist1d_del(dist1d_t *const dist)
         pim_free(dist->pdf);
         pim_free(dist->cdf);
         pim_free(dist->live);
+        pim_free(dist->aliasProb);
+        pim_free(dist->aliasIdx);
         memset(dist, 0, sizeof(*dist));
     }
 }
 
+// worklists of BakeAlias, one per thread. grown to the longest table
+// baked so far and kept, so rebakes do not allocate.
+static i32* ms_aliasWork[kMaxThreads];
+static i32 ms_aliasWorkLen[kMaxThreads];
+
+static double* ms_aliasSums[kMaxThreads];
+static i32 ms_aliasSumsLen[kMaxThreads];
+
+static i32* AliasWork(i32 len)
+{
+    const i32 tid = task_thread_id();
+    if (ms_aliasWorkLen[tid] < len)
+    {
+        PermReserve(ms_aliasWork[tid], len);
+        ms_aliasWorkLen[tid] = len;
+    }
+    return ms_aliasWork[tid];
+}
+
+static double* AliasSums(i32 len)
+{
+    const i32 tid = task_thread_id();
+    if (ms_aliasSumsLen[tid] < len)
+    {
+        PermReserve(ms_aliasSums[tid], len);
+        ms_aliasSumsLen[tid] = len;
+    }
+    return ms_aliasSums[tid];
+}
+
+// pdf must be normalized to a mean of 1, or all zero
+static void BakeAlias(dist1d_t *const dist)
+{
+    const i32 len = dist->length;
+    float const *const pim_noalias pdf = dist->pdf;
+    float *const pim_noalias prob = dist->aliasProb;
+    i32 *const pim_noalias alias = dist->aliasIdx;
+
+    // small entries stack up from the front, large from the back
+    i32 *const pim_noalias work = AliasWork(len);
+    i32 smallBack = 0;
+    i32 largeFront = len;
+    for (i32 i = 0; i < len; ++i)
+    {
+        prob[i] = pdf[i];
+        alias[i] = i;
+        if (prob[i] < 1.0f)
+        {
+            work[smallBack++] = i;
+        }
+        else
+        {
+            work[--largeFront] = i;
+        }
+    }
+
+    // an all zero pdf leaves every entry small; sample uniformly
+    if (largeFront == len)
+    {
+        for (i32 i = 0; i < len; ++i)
+        {
+            prob[i] = 1.0f;
+        }
+        return;
+    }
+
+    // the stacks never overlap, as each pass retires one small entry
+    i32 smallFront = 0;
+    while ((smallFront < smallBack) && (largeFront < len))
+    {
+        i32 s = work[smallFront++];
+        i32 l = work[largeFront];
+        alias[s] = l;
+        prob[l] = (prob[l] + prob[s]) - 1.0f;
+        if (prob[l] < 1.0f)
+        {
+            // l moves to the small stack, into the slot s vacated
+            ++largeFront;
+            work[--smallFront] = l;
+        }
+    }
+
+    // leftovers are 1 up to rounding error
+    while (smallFront < smallBack)
+    {
+        prob[work[smallFront++]] = 1.0f;
+    }
+    while (largeFront < len)
+    {
+        prob[work[largeFront++]] = 1.0f;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Parallel alias table bake
+// Hubschle-Schneider and Sanders, Parallel Weighted Random Sampling
+//
+// Sweeps lights (pdf < 1) and heavies (pdf >= 1) in index order. With D(i)
+// the deficit (1 - pdf) of the lights before light i and E(h) the excess
+// (pdf - 1) of the heavies before heavy h, the sweep has a closed form:
+// light i takes its deficit from the first heavy h with E(h + 1) >= D(i),
+// and heavy h drops below 1 once D passes E(h + 1), keeping the remainder
+// and aliasing the next heavy. Each entry then needs only a search of the
+// other prefix sum, so blocks of entries pair up independently.
+
+typedef struct task_BakeAlias
+{
+    task_t task;
+    dist1d_t* dist;
+    // lights, then heavies
+    i32* work;
+    // D[0..lightCount], then E[0..heavyCount]
+    double* sums;
+    // per block counts and sums, exclusive prefixes once scanned
+    i32* lightCounts;
+    double* deficits;
+    double* excesses;
+    // balances total excess against total deficit
+    double excessScale;
+    i32 lightCount;
+    i32 heavyCount;
+} task_BakeAlias;
+
+static void ClassifyAliasFn(void* pbase, i32 begin, i32 end)
+{
+    task_BakeAlias *const task = (task_BakeAlias*)pbase;
+    const i32 len = task->dist->length;
+    float const *const pim_noalias pdf = task->dist->pdf;
+    float *const pim_noalias prob = task->dist->aliasProb;
+    i32 *const pim_noalias alias = task->dist->aliasIdx;
+    for (i32 iBlock = begin; iBlock < end; ++iBlock)
+    {
+        const i32 a = iBlock * kAliasBlockLen;
+        const i32 b = i1_min(a + kAliasBlockLen, len);
+        i32 lights = 0;
+        double deficit = 0.0;
+        double excess = 0.0;
+        for (i32 i = a; i < b; ++i)
+        {
+            const float p = pdf[i];
+            prob[i] = p;
+            alias[i] = i;
+            if (p < 1.0f)
+            {
+                ++lights;
+                deficit += 1.0 - p;
+            }
+            else
+            {
+                excess += p - 1.0;
+            }
+        }
+        task->lightCounts[iBlock] = lights;
+        task->deficits[iBlock] = deficit;
+        task->excesses[iBlock] = excess;
+    }
+}
+
+static void ScatterAliasFn(void* pbase, i32 begin, i32 end)
+{
+    task_BakeAlias *const task = (task_BakeAlias*)pbase;
+    const i32 len = task->dist->length;
+    float const *const pim_noalias pdf = task->dist->pdf;
+    i32 *const pim_noalias lights = task->work;
+    i32 *const pim_noalias heavies = task->work + task->lightCount;
+    double *const pim_noalias D = task->sums;
+    double *const pim_noalias E = task->sums + task->lightCount + 1;
+    for (i32 iBlock = begin; iBlock < end; ++iBlock)
+    {
+        const i32 a = iBlock * kAliasBlockLen;
+        const i32 b = i1_min(a + kAliasBlockLen, len);
+        i32 iLight = task->lightCounts[iBlock];
+        i32 iHeavy = a - iLight;
+        double deficit = task->deficits[iBlock];
+        double excess = task->excesses[iBlock];
+        const double excessScale = task->excessScale;
+        for (i32 i = a; i < b; ++i)
+        {
+            const float p = pdf[i];
+            if (p < 1.0f)
+            {
+                lights[iLight] = i;
+                D[iLight] = deficit;
+                ++iLight;
+                deficit += 1.0 - p;
+            }
+            else
+            {
+                heavies[iHeavy] = i;
+                E[iHeavy] = excess;
+                ++iHeavy;
+                excess += (p - 1.0) * excessScale;
+            }
+        }
+    }
+}
+
+// first i in [0, len) with key[i] >= x (or > x when strict), else len.
+// key must be nondecreasing.
+pim_inline i32 FindSum(double const *const pim_noalias key, i32 len, double x, bool strict)
+{
+    i32 lo = 0;
+    i32 hi = len;
+    while (lo < hi)
+    {
+        i32 mid = lo + ((hi - lo) >> 1);
+        if ((key[mid] < x) || (strict && (key[mid] == x)))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void PairAliasFn(void* pbase, i32 begin, i32 end)
+{
+    task_BakeAlias *const task = (task_BakeAlias*)pbase;
+    const i32 len = task->dist->length;
+    const i32 lightCount = task->lightCount;
+    const i32 heavyCount = task->heavyCount;
+    float *const pim_noalias prob = task->dist->aliasProb;
+    i32 *const pim_noalias alias = task->dist->aliasIdx;
+    i32 const *const pim_noalias lights = task->work;
+    i32 const *const pim_noalias heavies = task->work + lightCount;
+    double const *const pim_noalias D = task->sums;
+    double const *const pim_noalias E = task->sums + lightCount + 1;
+    const double totalDeficit = D[lightCount];
+
+    // blocks index the lights, then the heavies
+    const i32 a = begin * kAliasBlockLen;
+    const i32 b = i1_min(end * kAliasBlockLen, len);
+
+    const i32 l0 = i1_min(a, lightCount);
+    const i32 l1 = i1_min(b, lightCount);
+    if (l0 < l1)
+    {
+        // first heavy h with E(h + 1) >= D(l0), searched over E[1..]
+        i32 h = FindSum(E + 1, heavyCount, D[l0], false);
+        for (i32 i = l0; i < l1; ++i)
+        {
+            while ((h < heavyCount) && (E[h + 1] < D[i]))
+            {
+                ++h;
+            }
+            const i32 k = lights[i];
+            if (h < heavyCount)
+            {
+                alias[k] = heavies[h];
+            }
+            else
+            {
+                // rounding left no heavy for this light
+                prob[k] = 1.0f;
+            }
+        }
+    }
+
+    const i32 h0 = i1_max(a, lightCount) - lightCount;
+    const i32 h1 = i1_max(b, lightCount) - lightCount;
+    if (h0 < h1)
+    {
+        // first light i with D(i + 1) > E(h0 + 1), searched over D[1..]
+        i32 i = FindSum(D + 1, lightCount, E[h0 + 1], true);
+        for (i32 h = h0; h < h1; ++h)
+        {
+            const i32 k = heavies[h];
+            const double excess = E[h + 1];
+            if ((h + 1 < heavyCount) && (totalDeficit > excess))
+            {
+                while (D[i + 1] <= excess)
+                {
+                    ++i;
+                }
+                const double rem = 1.0 + excess - D[i + 1];
+                prob[k] = f1_clamp((float)rem, 0.0f, 1.0f);
+                alias[k] = heavies[h + 1];
+            }
+            else
+            {
+                // never drops below 1, up to rounding error
+                prob[k] = 1.0f;
+            }
+        }
+    }
+}
+
+static void BakeAliasParallel(dist1d_t *const dist)
+{
+    const i32 len = dist->length;
+    const i32 blockCount = (len + kAliasBlockLen - 1) / kAliasBlockLen;
+
+    task_BakeAlias* task = tmp_calloc(sizeof(*task));
+    task->dist = dist;
+    task->work = AliasWork(len);
+    task->sums = AliasSums(len + 2);
+    task->lightCounts = tmp_calloc(sizeof(task->lightCounts[0]) * blockCount);
+    task->deficits = tmp_calloc(sizeof(task->deficits[0]) * blockCount);
+    task->excesses = tmp_calloc(sizeof(task->excesses[0]) * blockCount);
+    task_run(&task->task, ClassifyAliasFn, blockCount);
+
+    // exclusive scan of the blocks
+    i32 lights = 0;
+    double deficit = 0.0;
+    double excess = 0.0;
+    for (i32 i = 0; i < blockCount; ++i)
+    {
+        i32 n = task->lightCounts[i];
+        double d = task->deficits[i];
+        double e = task->excesses[i];
+        task->lightCounts[i] = lights;
+        task->deficits[i] = deficit;
+        task->excesses[i] = excess;
+        lights += n;
+        deficit += d;
+        excess += e;
+    }
+    task->lightCount = lights;
+    task->heavyCount = len - lights;
+
+    // rounding in the normalized pdf leaves the totals slightly apart.
+    // the sweep would pile the difference onto the last heavy, so it is
+    // spread over all heavies in proportion to their excess instead.
+    task->excessScale = (excess > 0.0) ? (deficit / excess) : 1.0;
+    for (i32 i = 0; i < blockCount; ++i)
+    {
+        task->excesses[i] *= task->excessScale;
+    }
+    excess *= task->excessScale;
+
+    // an all zero pdf leaves every entry light; sample uniformly
+    if (task->heavyCount == 0)
+    {
+        for (i32 i = 0; i < len; ++i)
+        {
+            dist->aliasProb[i] = 1.0f;
+        }
+        return;
+    }
+
+    task->sums[lights] = deficit;
+    task->sums[len + 1] = excess;
+    task_BakeAlias* scatter = tmp_calloc(sizeof(*scatter));
+    *scatter = *task;
+    memset(&scatter->task, 0, sizeof(scatter->task));
+    task_run(&scatter->task, ScatterAliasFn, blockCount);
+
+    task_BakeAlias* pair = tmp_calloc(sizeof(*pair));
+    *pair = *task;
+    memset(&pair->task, 0, sizeof(pair->task));
+    task_run(&pair->task, PairAliasFn, blockCount);
+}
+
+// ----------------------------------------------------------------------------
+
 void dist1d_bake(dist1d_t *const dist)
 {
     const i32 pdfLen = dist->length;
@@ -41,12 +414,16 @@ void dist1d_bake(dist1d_t *const dist)
         float *const pim_noalias pdf = dist->pdf;
         float *const pim_noalias cdf = dist->cdf;
 
+        // the float cdf drifts on long tables; the alias table needs the
+        // normalized pdf to sum to its length, so integrate in double
+        double sum = 0.0;
         cdf[0] = 0.0f;
         for (i32 i = 1; i < cdfLen; ++i)
         {
             cdf[i] = cdf[i - 1] + pdf[i - 1] * rcpLen;
+            sum += pdf[i - 1];
         }
-        float integral = cdf[cdfLen - 1];
+        float integral = (float)(sum / pdfLen);
 
         if (integral == 0.0f)
         {
@@ -58,9 +435,10 @@ void dist1d_bake(dist1d_t *const dist)
         else
         {
             float rcpIntegral = 1.0f / integral;
+            float rcpCdf = 1.0f / cdf[cdfLen - 1];
             for (i32 i = 1; i < cdfLen; ++i)
             {
-                cdf[i] = cdf[i] * rcpIntegral;
+                cdf[i] = cdf[i] * rcpCdf;
             }
             for (i32 i = 0; i < pdfLen; ++i)
             {
@@ -69,6 +447,16 @@ void dist1d_bake(dist1d_t *const dist)
         }
 
         dist->integral = integral;
+
+        // nested tasks could overflow the shallow task queues
+        if ((pdfLen >= kAliasParallelLen) && !task_executing())
+        {
+            BakeAliasParallel(dist);
+        }
+        else
+        {
+            BakeAlias(dist);
+        }
     }
 }
 
@@ -112,7 +500,11 @@ float dist1d_samplec(dist1d_t const *const dist, float u)
 
 i32 dist1d_sampled(dist1d_t const *const dist, float u)
 {
-    return FindInterval(dist->cdf, dist->length + 1, u);
+    const i32 len = dist->length;
+    float x = u * len;
+    i32 i = i1_clamp((i32)x, 0, len - 1);
+    float frac = x - i;
+    return (frac < dist->aliasProb[i]) ? i : dist->aliasIdx[i];
 }
 
 float dist1d_pdfd(dist1d_t const *const dist, i32 i)
@@ -151,3 +543,66 @@ void dist1d_livebake(dist1d_t *const dist, float alpha, u32 minSamples)
         dist1d_bake(dist);
     }
 }
+
+// ----------------------------------------------------------------------------
+
+// times dist1d_bake on random distributions, then discrete sampling through
+// the alias table against inverting the cdf.
+// usage: pt_distbench [entries] [samples]
+static cmdstat_t CmdDistBench(i32 argc, const char** argv)
+{
+    const i32 length = (argc > 1) ? i1_max(1, atoi(argv[1])) : 4096;
+    const i32 samples = (argc > 2) ? i1_max(1, atoi(argv[2])) : (1 << 22);
+    const i32 bakes = 64;
+
+    prng_t rng = prng_create();
+    dist1d_t dist;
+    dist1d_new(&dist, length);
+
+    u64 bakeTicks = 0;
+    for (i32 j = 0; j < bakes; ++j)
+    {
+        for (i32 i = 0; i < length; ++i)
+        {
+            dist.pdf[i] = prng_f32(&rng);
+        }
+        u64 start = time_now();
+        dist1d_bake(&dist);
+        bakeTicks += time_now() - start;
+    }
+
+    // indices are summed so neither loop can be dropped
+    i64 aliasSum = 0;
+    u64 start = time_now();
+    for (i32 i = 0; i < samples; ++i)
+    {
+        aliasSum += dist1d_sampled(&dist, prng_f32(&rng));
+    }
+    const u64 aliasTicks = time_now() - start;
+
+    i64 cdfSum = 0;
+    start = time_now();
+    for (i32 i = 0; i < samples; ++i)
+    {
+        float x = dist1d_samplec(&dist, prng_f32(&rng));
+        cdfSum += i1_clamp((i32)(x * length), 0, length - 1);
+    }
+    const u64 cdfTicks = time_now() - start;
+
+    dist1d_del(&dist);
+
+    const double rcpSamples = 1e6 / samples;
+    con_logf(LogSev_Info, "dist1d", "dist1d_bake of %d entries: %.3f ms%s",
+        length, time_milli(bakeTicks) / bakes,
+        (length >= kAliasParallelLen) ? " (parallel)" : "");
+    con_logf(LogSev_Info, "dist1d", "alias: %.2f ns/sample, cdf: %.2f ns/sample (%lld, %lld)",
+        time_milli(aliasTicks) * rcpSamples,
+        time_milli(cdfTicks) * rcpSamples,
+        (long long)aliasSum, (long long)cdfSum);
+    return cmdstat_ok;
+}
+
+void dist1d_sys_init(void)
+{
+    cmd_reg("pt_distbench", CmdDistBench);
+}
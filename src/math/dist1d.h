@@ -7,10 +7,18 @@ typedef struct dist1d_s
     float* pim_noalias pdf;
     float* pim_noalias cdf;
     u32* pim_noalias live;
+    // alias table for constant time discrete sampling
+    // Vose, A Linear Algorithm For Generating Random Numbers
+    // With a Given Distribution
+    float* pim_noalias aliasProb;
+    i32* pim_noalias aliasIdx;
     i32 length;
     float integral;
 } dist1d_t;
 
+// registers the pt_distbench command
+void dist1d_sys_init(void);
+
 void dist1d_new(dist1d_t *const dist, i32 length);
 void dist1d_del(dist1d_t *const dist);
 
@@ -19,7 +27,7 @@ void dist1d_bake(dist1d_t *const dist);
 // continuous
 float dist1d_samplec(dist1d_t const *const dist, float u);
 
-// discrete
+// discrete, constant time
 i32 dist1d_sampled(dist1d_t const *const dist, float u);
 float dist1d_pdfd(dist1d_t const *const dist, i32 i);
 
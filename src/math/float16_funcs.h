@@ -0,0 +1,385 @@
+#pragma once
+
+#include "math/float8_funcs.h"
+
+// 16 wide structure of arrays math, the float8_funcs.h layer doubled.
+// AVX-512 when the build enables it (-mavx512f), otherwise pairs of float8s.
+#if defined(__AVX512F__)
+#   define PIM_FLOAT16_AVX512 1
+#   include <immintrin.h>
+#else
+#   define PIM_FLOAT16_AVX512 0
+#endif
+
+PIM_C_BEGIN
+
+#define kFloat16Lanes 16
+
+// 16 floats, one per lane
+typedef struct float16_s
+{
+#if PIM_FLOAT16_AVX512
+    __m512 v;
+#else
+    float8 lo;
+    float8 hi;
+#endif
+} float16;
+
+// per lane mask. produced by comparisons.
+typedef struct bool16_s
+{
+#if PIM_FLOAT16_AVX512
+    __mmask16 m;
+#else
+    bool8 lo;
+    bool8 hi;
+#endif
+} bool16;
+
+// 16 float4s, transposed so each component is a float16
+typedef struct float4x16_s
+{
+    float16 x;
+    float16 y;
+    float16 z;
+    float16 w;
+} float4x16;
+
+// ----------------------------------------------------------------------------
+// float16
+
+pim_inline float16 VEC_CALL f16_s(float s)
+{
+    float16 r;
+#if PIM_FLOAT16_AVX512
+    r.v = _mm512_set1_ps(s);
+#else
+    r.lo = f8_s(s);
+    r.hi = r.lo;
+#endif
+    return r;
+}
+
+pim_inline float16 VEC_CALL f16_load(float const *const pim_noalias src)
+{
+    float16 r;
+#if PIM_FLOAT16_AVX512
+    r.v = _mm512_loadu_ps(src);
+#else
+    r.lo = f8_load(src + 0);
+    r.hi = f8_load(src + 8);
+#endif
+    return r;
+}
+
+pim_inline void VEC_CALL f16_store(float *const pim_noalias dst, float16 x)
+{
+#if PIM_FLOAT16_AVX512
+    _mm512_storeu_ps(dst, x.v);
+#else
+    f8_store(dst + 0, x.lo);
+    f8_store(dst + 8, x.hi);
+#endif
+}
+
+// start + lane index in each lane
+pim_inline float16 VEC_CALL f16_lanes(float start)
+{
+    float16 r;
+#if PIM_FLOAT16_AVX512
+    r.v = _mm512_add_ps(_mm512_set1_ps(start), _mm512_setr_ps(
+        0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f,
+        8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f));
+#else
+    r.lo = f8_lanes(start);
+    r.hi = f8_lanes(start + 8.0f);
+#endif
+    return r;
+}
+
+// dst[i] = src[indices[i]]
+pim_inline float16 VEC_CALL f16_gather(
+    float const *const pim_noalias src,
+    i32 const *const pim_noalias indices)
+{
+    float16 r;
+#if PIM_FLOAT16_AVX512
+    r.v = _mm512_i32gather_ps(_mm512_loadu_si512(indices), src, 4);
+#else
+    r.lo = f8_gather(src, indices + 0);
+    r.hi = f8_gather(src, indices + 8);
+#endif
+    return r;
+}
+
+#if PIM_FLOAT16_AVX512
+#   define F16_BINARY(name, avx512, f8) \
+    pim_inline float16 VEC_CALL name(float16 a, float16 b) \
+    { float16 r; r.v = avx512(a.v, b.v); return r; }
+#   define F16_UNARY(name, avx512, f8) \
+    pim_inline float16 VEC_CALL name(float16 a) \
+    { float16 r; r.v = avx512(a.v); return r; }
+#   define F16_CMP(name, pred, f8) \
+    pim_inline bool16 VEC_CALL name(float16 a, float16 b) \
+    { bool16 r; r.m = _mm512_cmp_ps_mask(a.v, b.v, pred); return r; }
+#else
+#   define F16_BINARY(name, avx512, f8) \
+    pim_inline float16 VEC_CALL name(float16 a, float16 b) \
+    { float16 r; r.lo = f8(a.lo, b.lo); r.hi = f8(a.hi, b.hi); return r; }
+#   define F16_UNARY(name, avx512, f8) \
+    pim_inline float16 VEC_CALL name(float16 a) \
+    { float16 r; r.lo = f8(a.lo); r.hi = f8(a.hi); return r; }
+#   define F16_CMP(name, pred, f8) \
+    pim_inline bool16 VEC_CALL name(float16 a, float16 b) \
+    { bool16 r; r.lo = f8(a.lo, b.lo); r.hi = f8(a.hi, b.hi); return r; }
+#endif
+
+F16_BINARY(f16_add, _mm512_add_ps, f8_add)
+F16_BINARY(f16_sub, _mm512_sub_ps, f8_sub)
+F16_BINARY(f16_mul, _mm512_mul_ps, f8_mul)
+F16_BINARY(f16_div, _mm512_div_ps, f8_div)
+F16_BINARY(f16_min, _mm512_min_ps, f8_min)
+F16_BINARY(f16_max, _mm512_max_ps, f8_max)
+F16_UNARY(f16_sqrt, _mm512_sqrt_ps, f8_sqrt)
+
+F16_CMP(f16_eq, _CMP_EQ_OQ, f8_eq)
+F16_CMP(f16_neq, _CMP_NEQ_UQ, f8_neq)
+F16_CMP(f16_lt, _CMP_LT_OQ, f8_lt)
+F16_CMP(f16_gt, _CMP_GT_OQ, f8_gt)
+F16_CMP(f16_lteq, _CMP_LE_OQ, f8_lteq)
+F16_CMP(f16_gteq, _CMP_GE_OQ, f8_gteq)
+
+#undef F16_BINARY
+#undef F16_UNARY
+#undef F16_CMP
+
+pim_inline bool16 VEC_CALL b16_and(bool16 a, bool16 b)
+{
+    bool16 r;
+#if PIM_FLOAT16_AVX512
+    r.m = (__mmask16)(a.m & b.m);
+#else
+    r.lo = b8_and(a.lo, b.lo);
+    r.hi = b8_and(a.hi, b.hi);
+#endif
+    return r;
+}
+pim_inline bool16 VEC_CALL b16_or(bool16 a, bool16 b)
+{
+    bool16 r;
+#if PIM_FLOAT16_AVX512
+    r.m = (__mmask16)(a.m | b.m);
+#else
+    r.lo = b8_or(a.lo, b.lo);
+    r.hi = b8_or(a.hi, b.hi);
+#endif
+    return r;
+}
+// a & ~b
+pim_inline bool16 VEC_CALL b16_andnot(bool16 a, bool16 b)
+{
+    bool16 r;
+#if PIM_FLOAT16_AVX512
+    r.m = (__mmask16)(a.m & ~b.m);
+#else
+    r.lo = b8_andnot(a.lo, b.lo);
+    r.hi = b8_andnot(a.hi, b.hi);
+#endif
+    return r;
+}
+
+// bit i set when lane i of the mask is true
+pim_inline i32 VEC_CALL b16_bits(bool16 m)
+{
+#if PIM_FLOAT16_AVX512
+    return (i32)m.m;
+#else
+    return b8_bits(m.lo) | (b8_bits(m.hi) << 8);
+#endif
+}
+pim_inline bool VEC_CALL b16_any(bool16 m) { return b16_bits(m) != 0; }
+pim_inline bool VEC_CALL b16_all(bool16 m) { return b16_bits(m) == 0xffff; }
+
+// lanes of 'b' where the mask is true, otherwise lanes of 'a'
+pim_inline float16 VEC_CALL f16_select(float16 a, float16 b, bool16 m)
+{
+    float16 r;
+#if PIM_FLOAT16_AVX512
+    r.v = _mm512_mask_blend_ps(m.m, a.v, b.v);
+#else
+    r.lo = f8_select(a.lo, b.lo, m.lo);
+    r.hi = f8_select(a.hi, b.hi, m.hi);
+#endif
+    return r;
+}
+
+pim_inline float16 VEC_CALL f16_addvs(float16 a, float s) { return f16_add(a, f16_s(s)); }
+pim_inline float16 VEC_CALL f16_mulvs(float16 a, float s) { return f16_mul(a, f16_s(s)); }
+pim_inline float16 VEC_CALL f16_neg(float16 a) { return f16_sub(f16_s(0.0f), a); }
+pim_inline float16 VEC_CALL f16_rcp(float16 a) { return f16_div(f16_s(1.0f), a); }
+
+// a * b + c
+pim_inline float16 VEC_CALL f16_fmadd(float16 a, float16 b, float16 c)
+{
+    float16 r;
+#if PIM_FLOAT16_AVX512
+    r.v = _mm512_fmadd_ps(a.v, b.v, c.v);
+#else
+    r.lo = f8_fmadd(a.lo, b.lo, c.lo);
+    r.hi = f8_fmadd(a.hi, b.hi, c.hi);
+#endif
+    return r;
+}
+
+// sum of all lanes
+pim_inline float VEC_CALL f16_sum(float16 a)
+{
+#if PIM_FLOAT16_AVX512
+    float8 x;
+#   if PIM_FLOAT8_AVX2
+    x.v = _mm256_add_ps(_mm512_castps512_ps256(a.v), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a.v), 1)));
+#   else
+    x.lo = _mm_add_ps(_mm512_extractf32x4_ps(a.v, 0), _mm512_extractf32x4_ps(a.v, 2));
+    x.hi = _mm_add_ps(_mm512_extractf32x4_ps(a.v, 1), _mm512_extractf32x4_ps(a.v, 3));
+#   endif
+    return f8_sum(x);
+#else
+    return f8_sum(f8_add(a.lo, a.hi));
+#endif
+}
+
+pim_inline float16 VEC_CALL f16_clamp(float16 x, float16 lo, float16 hi)
+{
+    return f16_min(f16_max(x, lo), hi);
+}
+
+pim_inline float16 VEC_CALL f16_sat(float16 x)
+{
+    return f16_clamp(x, f16_s(0.0f), f16_s(1.0f));
+}
+
+pim_inline float16 VEC_CALL f16_lerp(float16 a, float16 b, float16 t)
+{
+    return f16_fmadd(f16_sub(b, a), t, a);
+}
+
+// ----------------------------------------------------------------------------
+// float4x16
+
+pim_inline float4x16 VEC_CALL f4x16_s(float4 v)
+{
+    float4x16 r = { f16_s(v.x), f16_s(v.y), f16_s(v.z), f16_s(v.w) };
+    return r;
+}
+
+// splits into the float4x8 halves, lanes [0, 8) and [8, 16)
+pim_inline void VEC_CALL F4x16_Split(float4x16 v, float4x8* lo, float4x8* hi)
+{
+#if PIM_FLOAT16_AVX512
+    float comps[4][16];
+    f16_store(comps[0], v.x);
+    f16_store(comps[1], v.y);
+    f16_store(comps[2], v.z);
+    f16_store(comps[3], v.w);
+    float4x8 a = { f8_load(&comps[0][0]), f8_load(&comps[1][0]), f8_load(&comps[2][0]), f8_load(&comps[3][0]) };
+    float4x8 b = { f8_load(&comps[0][8]), f8_load(&comps[1][8]), f8_load(&comps[2][8]), f8_load(&comps[3][8]) };
+    *lo = a;
+    *hi = b;
+#else
+    float4x8 a = { v.x.lo, v.y.lo, v.z.lo, v.w.lo };
+    float4x8 b = { v.x.hi, v.y.hi, v.z.hi, v.w.hi };
+    *lo = a;
+    *hi = b;
+#endif
+}
+
+// joins float4x8 halves into lanes [0, 8) and [8, 16)
+pim_inline float4x16 VEC_CALL F4x16_Join(float4x8 lo, float4x8 hi)
+{
+    float4x16 r;
+#if PIM_FLOAT16_AVX512
+    float comps[4][16];
+    f8_store(&comps[0][0], lo.x); f8_store(&comps[0][8], hi.x);
+    f8_store(&comps[1][0], lo.y); f8_store(&comps[1][8], hi.y);
+    f8_store(&comps[2][0], lo.z); f8_store(&comps[2][8], hi.z);
+    f8_store(&comps[3][0], lo.w); f8_store(&comps[3][8], hi.w);
+    r.x = f16_load(comps[0]);
+    r.y = f16_load(comps[1]);
+    r.z = f16_load(comps[2]);
+    r.w = f16_load(comps[3]);
+#else
+    r.x.lo = lo.x; r.x.hi = hi.x;
+    r.y.lo = lo.y; r.y.hi = hi.y;
+    r.z.lo = lo.z; r.z.hi = hi.z;
+    r.w.lo = lo.w; r.w.hi = hi.w;
+#endif
+    return r;
+}
+
+// loads src[0..15]
+pim_inline float4x16 VEC_CALL f4x16_load(float4 const *const pim_noalias src)
+{
+    return F4x16_Join(f4x8_load(src + 0), f4x8_load(src + 8));
+}
+
+// loads src[indices[0..15]]
+pim_inline float4x16 VEC_CALL f4x16_gather(
+    float4 const *const pim_noalias src,
+    i32 const *const pim_noalias indices)
+{
+    return F4x16_Join(f4x8_gather(src, indices + 0), f4x8_gather(src, indices + 8));
+}
+
+// stores to dst[0..15]
+pim_inline void VEC_CALL f4x16_store(float4 *const pim_noalias dst, float4x16 v)
+{
+    float4x8 lo, hi;
+    F4x16_Split(v, &lo, &hi);
+    f4x8_store(dst + 0, lo);
+    f4x8_store(dst + 8, hi);
+}
+
+pim_inline float4x16 VEC_CALL f4x16_add(float4x16 a, float4x16 b)
+{
+    float4x16 r = { f16_add(a.x, b.x), f16_add(a.y, b.y), f16_add(a.z, b.z), f16_add(a.w, b.w) };
+    return r;
+}
+pim_inline float4x16 VEC_CALL f4x16_sub(float4x16 a, float4x16 b)
+{
+    float4x16 r = { f16_sub(a.x, b.x), f16_sub(a.y, b.y), f16_sub(a.z, b.z), f16_sub(a.w, b.w) };
+    return r;
+}
+pim_inline float4x16 VEC_CALL f4x16_mul(float4x16 a, float4x16 b)
+{
+    float4x16 r = { f16_mul(a.x, b.x), f16_mul(a.y, b.y), f16_mul(a.z, b.z), f16_mul(a.w, b.w) };
+    return r;
+}
+pim_inline float4x16 VEC_CALL f4x16_mulvs(float4x16 a, float16 s)
+{
+    float4x16 r = { f16_mul(a.x, s), f16_mul(a.y, s), f16_mul(a.z, s), f16_mul(a.w, s) };
+    return r;
+}
+pim_inline float4x16 VEC_CALL f4x16_select(float4x16 a, float4x16 b, bool16 m)
+{
+    float4x16 r = { f16_select(a.x, b.x, m), f16_select(a.y, b.y, m), f16_select(a.z, b.z, m), f16_select(a.w, b.w, m) };
+    return r;
+}
+
+pim_inline float16 VEC_CALL f4x16_dot3(float4x16 a, float4x16 b)
+{
+    return f16_fmadd(a.x, b.x, f16_fmadd(a.y, b.y, f16_mul(a.z, b.z)));
+}
+pim_inline float16 VEC_CALL f4x16_length3(float4x16 a)
+{
+    return f16_sqrt(f4x16_dot3(a, a));
+}
+
+pim_inline float4x16 VEC_CALL f4x16_normalize3(float4x16 a)
+{
+    float16 rcpLen = f16_rcp(f16_max(f4x16_length3(a), f16_s(kEpsilon)));
+    float4x16 r = { f16_mul(a.x, rcpLen), f16_mul(a.y, rcpLen), f16_mul(a.z, rcpLen), a.w };
+    return r;
+}
+
+PIM_C_END
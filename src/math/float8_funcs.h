@@ -0,0 +1,586 @@
+#pragma once
+
+#include "common/macro.h"
+#include "math/types.h"
+#include "math/scalar.h"
+
+// 8 wide structure of arrays math, for batches of shading samples.
+// AVX2 when the build enables it (/arch:AVX2), otherwise pairs of SSE2 registers.
+#if defined(__AVX2__)
+#   define PIM_FLOAT8_AVX2 1
+#   include <immintrin.h>
+// msvc's /arch:AVX2 implies FMA without defining __FMA__
+#   if defined(__FMA__) || defined(_MSC_VER)
+#       define PIM_FLOAT8_FMA 1
+#   else
+#       define PIM_FLOAT8_FMA 0
+#   endif
+#else
+#   define PIM_FLOAT8_FMA 0
+#   define PIM_FLOAT8_AVX2 0
+#   include <emmintrin.h>
+#endif
+
+PIM_C_BEGIN
+
+#define kFloat8Lanes 8
+
+// 8 floats, one per lane
+typedef struct float8_s
+{
+#if PIM_FLOAT8_AVX2
+    __m256 v;
+#else
+    __m128 lo;
+    __m128 hi;
+#endif
+} float8;
+
+// per lane mask, all bits set when true. produced by comparisons.
+typedef float8 bool8;
+
+// 8 float2s, transposed so each component is a float8
+typedef struct float2x8_s
+{
+    float8 x;
+    float8 y;
+} float2x8;
+
+// 8 float4s, transposed so each component is a float8
+typedef struct float4x8_s
+{
+    float8 x;
+    float8 y;
+    float8 z;
+    float8 w;
+} float4x8;
+
+// ----------------------------------------------------------------------------
+// float8
+
+pim_inline float8 VEC_CALL f8_s(float s)
+{
+    float8 r;
+#if PIM_FLOAT8_AVX2
+    r.v = _mm256_set1_ps(s);
+#else
+    r.lo = _mm_set1_ps(s);
+    r.hi = r.lo;
+#endif
+    return r;
+}
+
+pim_inline float8 VEC_CALL f8_load(float const *const pim_noalias src)
+{
+    float8 r;
+#if PIM_FLOAT8_AVX2
+    r.v = _mm256_loadu_ps(src);
+#else
+    r.lo = _mm_loadu_ps(src + 0);
+    r.hi = _mm_loadu_ps(src + 4);
+#endif
+    return r;
+}
+
+pim_inline void VEC_CALL f8_store(float *const pim_noalias dst, float8 x)
+{
+#if PIM_FLOAT8_AVX2
+    _mm256_storeu_ps(dst, x.v);
+#else
+    _mm_storeu_ps(dst + 0, x.lo);
+    _mm_storeu_ps(dst + 4, x.hi);
+#endif
+}
+
+// start + i in lane i
+pim_inline float8 VEC_CALL f8_lanes(float start)
+{
+    float8 r;
+#if PIM_FLOAT8_AVX2
+    r.v = _mm256_add_ps(_mm256_set1_ps(start), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+#else
+    r.lo = _mm_add_ps(_mm_set1_ps(start), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    r.hi = _mm_add_ps(_mm_set1_ps(start), _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f));
+#endif
+    return r;
+}
+
+// dst[i] = src[indices[i]]
+pim_inline float8 VEC_CALL f8_gather(
+    float const *const pim_noalias src,
+    i32 const *const pim_noalias indices)
+{
+    float8 r;
+#if PIM_FLOAT8_AVX2
+    r.v = _mm256_i32gather_ps(src, _mm256_loadu_si256((const __m256i*)indices), 4);
+#else
+    r.lo = _mm_setr_ps(src[indices[0]], src[indices[1]], src[indices[2]], src[indices[3]]);
+    r.hi = _mm_setr_ps(src[indices[4]], src[indices[5]], src[indices[6]], src[indices[7]]);
+#endif
+    return r;
+}
+
+#if PIM_FLOAT8_AVX2
+#   define F8_BINARY(name, avx, sse) \
+    pim_inline float8 VEC_CALL name(float8 a, float8 b) \
+    { float8 r; r.v = avx(a.v, b.v); return r; }
+#   define F8_UNARY(name, avx, sse) \
+    pim_inline float8 VEC_CALL name(float8 a) \
+    { float8 r; r.v = avx(a.v); return r; }
+#else
+#   define F8_BINARY(name, avx, sse) \
+    pim_inline float8 VEC_CALL name(float8 a, float8 b) \
+    { float8 r; r.lo = sse(a.lo, b.lo); r.hi = sse(a.hi, b.hi); return r; }
+#   define F8_UNARY(name, avx, sse) \
+    pim_inline float8 VEC_CALL name(float8 a) \
+    { float8 r; r.lo = sse(a.lo); r.hi = sse(a.hi); return r; }
+#endif
+
+F8_BINARY(f8_add, _mm256_add_ps, _mm_add_ps)
+F8_BINARY(f8_sub, _mm256_sub_ps, _mm_sub_ps)
+F8_BINARY(f8_mul, _mm256_mul_ps, _mm_mul_ps)
+F8_BINARY(f8_div, _mm256_div_ps, _mm_div_ps)
+F8_BINARY(f8_min, _mm256_min_ps, _mm_min_ps)
+F8_BINARY(f8_max, _mm256_max_ps, _mm_max_ps)
+F8_UNARY(f8_sqrt, _mm256_sqrt_ps, _mm_sqrt_ps)
+
+F8_BINARY(b8_and, _mm256_and_ps, _mm_and_ps)
+F8_BINARY(b8_or, _mm256_or_ps, _mm_or_ps)
+F8_BINARY(b8_xor, _mm256_xor_ps, _mm_xor_ps)
+// a & ~b
+pim_inline bool8 VEC_CALL b8_andnot(bool8 a, bool8 b)
+{
+    bool8 r;
+#if PIM_FLOAT8_AVX2
+    r.v = _mm256_andnot_ps(b.v, a.v);
+#else
+    r.lo = _mm_andnot_ps(b.lo, a.lo);
+    r.hi = _mm_andnot_ps(b.hi, a.hi);
+#endif
+    return r;
+}
+
+#if PIM_FLOAT8_AVX2
+#   define F8_CMP(name, pred, sse) \
+    pim_inline bool8 VEC_CALL name(float8 a, float8 b) \
+    { bool8 r; r.v = _mm256_cmp_ps(a.v, b.v, pred); return r; }
+#else
+#   define F8_CMP(name, pred, sse) \
+    pim_inline bool8 VEC_CALL name(float8 a, float8 b) \
+    { bool8 r; r.lo = sse(a.lo, b.lo); r.hi = sse(a.hi, b.hi); return r; }
+#endif
+
+F8_CMP(f8_eq, _CMP_EQ_OQ, _mm_cmpeq_ps)
+F8_CMP(f8_neq, _CMP_NEQ_UQ, _mm_cmpneq_ps)
+F8_CMP(f8_lt, _CMP_LT_OQ, _mm_cmplt_ps)
+F8_CMP(f8_gt, _CMP_GT_OQ, _mm_cmpgt_ps)
+F8_CMP(f8_lteq, _CMP_LE_OQ, _mm_cmple_ps)
+F8_CMP(f8_gteq, _CMP_GE_OQ, _mm_cmpge_ps)
+
+#undef F8_BINARY
+#undef F8_UNARY
+#undef F8_CMP
+
+// bit i set when lane i of the mask is true
+pim_inline i32 VEC_CALL b8_bits(bool8 m)
+{
+#if PIM_FLOAT8_AVX2
+    return _mm256_movemask_ps(m.v);
+#else
+    return _mm_movemask_ps(m.lo) | (_mm_movemask_ps(m.hi) << 4);
+#endif
+}
+pim_inline bool VEC_CALL b8_any(bool8 m) { return b8_bits(m) != 0; }
+pim_inline bool VEC_CALL b8_all(bool8 m) { return b8_bits(m) == 0xff; }
+
+// lanes of 'b' where the mask is true, otherwise lanes of 'a'
+pim_inline float8 VEC_CALL f8_select(float8 a, float8 b, bool8 m)
+{
+    float8 r;
+#if PIM_FLOAT8_AVX2
+    r.v = _mm256_blendv_ps(a.v, b.v, m.v);
+#else
+    r.lo = _mm_or_ps(_mm_and_ps(m.lo, b.lo), _mm_andnot_ps(m.lo, a.lo));
+    r.hi = _mm_or_ps(_mm_and_ps(m.hi, b.hi), _mm_andnot_ps(m.hi, a.hi));
+#endif
+    return r;
+}
+
+pim_inline float8 VEC_CALL f8_addvs(float8 a, float s) { return f8_add(a, f8_s(s)); }
+pim_inline float8 VEC_CALL f8_mulvs(float8 a, float s) { return f8_mul(a, f8_s(s)); }
+pim_inline float8 VEC_CALL f8_neg(float8 a) { return f8_sub(f8_s(0.0f), a); }
+pim_inline float8 VEC_CALL f8_rcp(float8 a) { return f8_div(f8_s(1.0f), a); }
+
+// a * b + c
+pim_inline float8 VEC_CALL f8_fmadd(float8 a, float8 b, float8 c)
+{
+#if PIM_FLOAT8_FMA
+    float8 r;
+    r.v = _mm256_fmadd_ps(a.v, b.v, c.v);
+    return r;
+#else
+    return f8_add(f8_mul(a, b), c);
+#endif
+}
+
+// sum of all lanes
+pim_inline float VEC_CALL f8_sum(float8 a)
+{
+#if PIM_FLOAT8_AVX2
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+#else
+    __m128 x = _mm_add_ps(a.lo, a.hi);
+#endif
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(x);
+}
+
+pim_inline float8 VEC_CALL f8_abs(float8 a)
+{
+    return b8_andnot(a, f8_s(-0.0f));
+}
+
+pim_inline float8 VEC_CALL f8_clamp(float8 x, float8 lo, float8 hi)
+{
+    return f8_min(f8_max(x, lo), hi);
+}
+
+pim_inline float8 VEC_CALL f8_sat(float8 x)
+{
+    return f8_clamp(x, f8_s(0.0f), f8_s(1.0f));
+}
+
+pim_inline float8 VEC_CALL f8_lerp(float8 a, float8 b, float8 t)
+{
+    return f8_fmadd(f8_sub(b, a), t, a);
+}
+
+// 2^x to about 4e-6 relative error, for x in [-126, 126].
+// splits x into integer and [-0.5, 0.5] parts; the integer part goes
+// straight into the exponent bits, the rest through a polynomial.
+pim_inline float8 VEC_CALL f8_exp2(float8 x)
+{
+    x = f8_clamp(x, f8_s(-126.0f), f8_s(126.0f));
+    float8 r;
+#if PIM_FLOAT8_AVX2
+    __m256i xi = _mm256_cvtps_epi32(x.v);
+    r.v = _mm256_cvtepi32_ps(xi);
+#else
+    __m128i xlo = _mm_cvtps_epi32(x.lo);
+    __m128i xhi = _mm_cvtps_epi32(x.hi);
+    r.lo = _mm_cvtepi32_ps(xlo);
+    r.hi = _mm_cvtepi32_ps(xhi);
+#endif
+    float8 f = f8_mulvs(f8_sub(x, r), 0.69314718f);
+    float8 p = f8_s(1.0f / 120.0f);
+    p = f8_fmadd(p, f, f8_s(1.0f / 24.0f));
+    p = f8_fmadd(p, f, f8_s(1.0f / 6.0f));
+    p = f8_fmadd(p, f, f8_s(0.5f));
+    p = f8_fmadd(p, f, f8_s(1.0f));
+    p = f8_fmadd(p, f, f8_s(1.0f));
+#if PIM_FLOAT8_AVX2
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(xi, _mm256_set1_epi32(127)), 23);
+    r.v = _mm256_mul_ps(p.v, _mm256_castsi256_ps(e));
+#else
+    __m128i elo = _mm_slli_epi32(_mm_add_epi32(xlo, _mm_set1_epi32(127)), 23);
+    __m128i ehi = _mm_slli_epi32(_mm_add_epi32(xhi, _mm_set1_epi32(127)), 23);
+    r.lo = _mm_mul_ps(p.lo, _mm_castsi128_ps(elo));
+    r.hi = _mm_mul_ps(p.hi, _mm_castsi128_ps(ehi));
+#endif
+    return r;
+}
+
+// sine and cosine to about 3e-7 absolute error, for |x| < 1e4.
+// reduces x to r in [-pi/4, pi/4] and quadrant q, evaluates both
+// polynomials on r, then swaps and negates them by q.
+pim_inline void VEC_CALL f8_sincos(float8 x, float8* sinOut, float8* cosOut)
+{
+    float8 qf;
+#if PIM_FLOAT8_AVX2
+    __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x.v, _mm256_set1_ps(2.0f / kPi)));
+    qf.v = _mm256_cvtepi32_ps(q);
+#else
+    __m128i qlo = _mm_cvtps_epi32(_mm_mul_ps(x.lo, _mm_set1_ps(2.0f / kPi)));
+    __m128i qhi = _mm_cvtps_epi32(_mm_mul_ps(x.hi, _mm_set1_ps(2.0f / kPi)));
+    qf.lo = _mm_cvtepi32_ps(qlo);
+    qf.hi = _mm_cvtepi32_ps(qhi);
+#endif
+    // pi / 2 split in two, so r keeps its low bits
+    float8 r = f8_fmadd(qf, f8_s(-1.5703125f), x);
+    r = f8_fmadd(qf, f8_s(-4.8382679e-4f), r);
+    float8 r2 = f8_mul(r, r);
+
+    float8 s = f8_s(-1.0f / 5040.0f);
+    s = f8_fmadd(s, r2, f8_s(1.0f / 120.0f));
+    s = f8_fmadd(s, r2, f8_s(-1.0f / 6.0f));
+    s = f8_fmadd(f8_mul(s, r2), r, r);
+
+    float8 c = f8_s(1.0f / 40320.0f);
+    c = f8_fmadd(c, r2, f8_s(-1.0f / 720.0f));
+    c = f8_fmadd(c, r2, f8_s(1.0f / 24.0f));
+    c = f8_fmadd(c, r2, f8_s(-0.5f));
+    c = f8_fmadd(c, r2, f8_s(1.0f));
+
+    // odd quadrants swap sin and cos; the sign bits come from q
+    bool8 swap;
+    float8 sinSign;
+    float8 cosSign;
+#if PIM_FLOAT8_AVX2
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    swap.v = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+    sinSign.v = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+    cosSign.v = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+#else
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    swap.lo = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qlo, one), one));
+    swap.hi = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qhi, one), one));
+    sinSign.lo = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(qlo, two), 30));
+    sinSign.hi = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(qhi, two), 30));
+    cosSign.lo = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qlo, one), two), 30));
+    cosSign.hi = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qhi, one), two), 30));
+#endif
+    *sinOut = b8_xor(f8_select(s, c, swap), sinSign);
+    *cosOut = b8_xor(f8_select(c, s, swap), cosSign);
+}
+
+// ----------------------------------------------------------------------------
+// float4x8
+
+pim_inline float4x8 VEC_CALL f4x8_s(float4 v)
+{
+    float4x8 r = { f8_s(v.x), f8_s(v.y), f8_s(v.z), f8_s(v.w) };
+    return r;
+}
+
+#if PIM_FLOAT8_AVX2
+// 4x4 transposes within each 128 bit half
+#define F4X8_TRANSPOSE(r0, r1, r2, r3) do { \
+    __m256 t0 = _mm256_unpacklo_ps((r0), (r1)); \
+    __m256 t1 = _mm256_unpacklo_ps((r2), (r3)); \
+    __m256 t2 = _mm256_unpackhi_ps((r0), (r1)); \
+    __m256 t3 = _mm256_unpackhi_ps((r2), (r3)); \
+    (r0) = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)); \
+    (r1) = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)); \
+    (r2) = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)); \
+    (r3) = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2)); \
+} while(0)
+
+pim_inline __m256 VEC_CALL F4x8_Pair(float4 a, float4 b)
+{
+    __m256 r = _mm256_castps128_ps256(_mm_load_ps(&a.x));
+    return _mm256_insertf128_ps(r, _mm_load_ps(&b.x), 1);
+}
+#endif
+
+// transposes src[i0..i7] into structure of arrays
+pim_inline float4x8 VEC_CALL f4x8_set(
+    float4 p0, float4 p1, float4 p2, float4 p3,
+    float4 p4, float4 p5, float4 p6, float4 p7)
+{
+    float4x8 r;
+#if PIM_FLOAT8_AVX2
+    __m256 r0 = F4x8_Pair(p0, p4);
+    __m256 r1 = F4x8_Pair(p1, p5);
+    __m256 r2 = F4x8_Pair(p2, p6);
+    __m256 r3 = F4x8_Pair(p3, p7);
+    F4X8_TRANSPOSE(r0, r1, r2, r3);
+    r.x.v = r0;
+    r.y.v = r1;
+    r.z.v = r2;
+    r.w.v = r3;
+#else
+    __m128 a0 = _mm_load_ps(&p0.x);
+    __m128 a1 = _mm_load_ps(&p1.x);
+    __m128 a2 = _mm_load_ps(&p2.x);
+    __m128 a3 = _mm_load_ps(&p3.x);
+    __m128 b0 = _mm_load_ps(&p4.x);
+    __m128 b1 = _mm_load_ps(&p5.x);
+    __m128 b2 = _mm_load_ps(&p6.x);
+    __m128 b3 = _mm_load_ps(&p7.x);
+    _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+    _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+    r.x.lo = a0; r.x.hi = b0;
+    r.y.lo = a1; r.y.hi = b1;
+    r.z.lo = a2; r.z.hi = b2;
+    r.w.lo = a3; r.w.hi = b3;
+#endif
+    return r;
+}
+
+// loads src[0..7]
+pim_inline float4x8 VEC_CALL f4x8_load(float4 const *const pim_noalias src)
+{
+    return f4x8_set(
+        src[0], src[1], src[2], src[3],
+        src[4], src[5], src[6], src[7]);
+}
+
+// loads src[indices[0..7]]
+pim_inline float4x8 VEC_CALL f4x8_gather(
+    float4 const *const pim_noalias src,
+    i32 const *const pim_noalias indices)
+{
+    return f4x8_set(
+        src[indices[0]], src[indices[1]], src[indices[2]], src[indices[3]],
+        src[indices[4]], src[indices[5]], src[indices[6]], src[indices[7]]);
+}
+
+// stores to dst[0..7]
+pim_inline void VEC_CALL f4x8_store(float4 *const pim_noalias dst, float4x8 v)
+{
+#if PIM_FLOAT8_AVX2
+    __m256 r0 = v.x.v;
+    __m256 r1 = v.y.v;
+    __m256 r2 = v.z.v;
+    __m256 r3 = v.w.v;
+    F4X8_TRANSPOSE(r0, r1, r2, r3);
+    _mm_store_ps(&dst[0].x, _mm256_castps256_ps128(r0));
+    _mm_store_ps(&dst[1].x, _mm256_castps256_ps128(r1));
+    _mm_store_ps(&dst[2].x, _mm256_castps256_ps128(r2));
+    _mm_store_ps(&dst[3].x, _mm256_castps256_ps128(r3));
+    _mm_store_ps(&dst[4].x, _mm256_extractf128_ps(r0, 1));
+    _mm_store_ps(&dst[5].x, _mm256_extractf128_ps(r1, 1));
+    _mm_store_ps(&dst[6].x, _mm256_extractf128_ps(r2, 1));
+    _mm_store_ps(&dst[7].x, _mm256_extractf128_ps(r3, 1));
+#else
+    __m128 a0 = v.x.lo;
+    __m128 a1 = v.y.lo;
+    __m128 a2 = v.z.lo;
+    __m128 a3 = v.w.lo;
+    __m128 b0 = v.x.hi;
+    __m128 b1 = v.y.hi;
+    __m128 b2 = v.z.hi;
+    __m128 b3 = v.w.hi;
+    _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+    _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+    _mm_store_ps(&dst[0].x, a0);
+    _mm_store_ps(&dst[1].x, a1);
+    _mm_store_ps(&dst[2].x, a2);
+    _mm_store_ps(&dst[3].x, a3);
+    _mm_store_ps(&dst[4].x, b0);
+    _mm_store_ps(&dst[5].x, b1);
+    _mm_store_ps(&dst[6].x, b2);
+    _mm_store_ps(&dst[7].x, b3);
+#endif
+}
+
+pim_inline float4x8 VEC_CALL f4x8_add(float4x8 a, float4x8 b)
+{
+    float4x8 r = { f8_add(a.x, b.x), f8_add(a.y, b.y), f8_add(a.z, b.z), f8_add(a.w, b.w) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_sub(float4x8 a, float4x8 b)
+{
+    float4x8 r = { f8_sub(a.x, b.x), f8_sub(a.y, b.y), f8_sub(a.z, b.z), f8_sub(a.w, b.w) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_mul(float4x8 a, float4x8 b)
+{
+    float4x8 r = { f8_mul(a.x, b.x), f8_mul(a.y, b.y), f8_mul(a.z, b.z), f8_mul(a.w, b.w) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_div(float4x8 a, float4x8 b)
+{
+    float4x8 r = { f8_div(a.x, b.x), f8_div(a.y, b.y), f8_div(a.z, b.z), f8_div(a.w, b.w) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_mulvs(float4x8 a, float8 s)
+{
+    float4x8 r = { f8_mul(a.x, s), f8_mul(a.y, s), f8_mul(a.z, s), f8_mul(a.w, s) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_addvs(float4x8 a, float8 s)
+{
+    float4x8 r = { f8_add(a.x, s), f8_add(a.y, s), f8_add(a.z, s), f8_add(a.w, s) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_max(float4x8 a, float4x8 b)
+{
+    float4x8 r = { f8_max(a.x, b.x), f8_max(a.y, b.y), f8_max(a.z, b.z), f8_max(a.w, b.w) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_sqrt(float4x8 a)
+{
+    float4x8 r = { f8_sqrt(a.x), f8_sqrt(a.y), f8_sqrt(a.z), f8_sqrt(a.w) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_sat(float4x8 a)
+{
+    float4x8 r = { f8_sat(a.x), f8_sat(a.y), f8_sat(a.z), f8_sat(a.w) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_lerpvs(float4x8 a, float4x8 b, float8 t)
+{
+    float4x8 r = { f8_lerp(a.x, b.x, t), f8_lerp(a.y, b.y, t), f8_lerp(a.z, b.z, t), f8_lerp(a.w, b.w, t) };
+    return r;
+}
+pim_inline float4x8 VEC_CALL f4x8_select(float4x8 a, float4x8 b, bool8 m)
+{
+    float4x8 r = { f8_select(a.x, b.x, m), f8_select(a.y, b.y, m), f8_select(a.z, b.z, m), f8_select(a.w, b.w, m) };
+    return r;
+}
+
+pim_inline float8 VEC_CALL f4x8_dot3(float4x8 a, float4x8 b)
+{
+    return f8_fmadd(a.x, b.x, f8_fmadd(a.y, b.y, f8_mul(a.z, b.z)));
+}
+pim_inline float8 VEC_CALL f4x8_dotsat(float4x8 a, float4x8 b)
+{
+    return f8_sat(f4x8_dot3(a, b));
+}
+pim_inline float8 VEC_CALL f4x8_length3(float4x8 a)
+{
+    return f8_sqrt(f4x8_dot3(a, a));
+}
+// reflects i about n, as f4_reflect3
+pim_inline float4x8 VEC_CALL f4x8_reflect3(float4x8 i, float4x8 n)
+{
+    float8 nidn2 = f8_mulvs(f4x8_dot3(i, n), 2.0f);
+    float4x8 r = { f8_sub(i.x, f8_mul(n.x, nidn2)), f8_sub(i.y, f8_mul(n.y, nidn2)), f8_sub(i.z, f8_mul(n.z, nidn2)), f8_sub(i.w, f8_mul(n.w, nidn2)) };
+    return r;
+}
+
+pim_inline float4x8 VEC_CALL f4x8_normalize3(float4x8 a)
+{
+    float8 rcpLen = f8_rcp(f8_max(f4x8_length3(a), f8_s(kEpsilon)));
+    float4x8 r = { f8_mul(a.x, rcpLen), f8_mul(a.y, rcpLen), f8_mul(a.z, rcpLen), a.w };
+    return r;
+}
+
+// packs saturated lanes into rgba8, as f4_rgba8
+pim_inline void VEC_CALL f4x8_rgba8(u32 *const pim_noalias dst, float4x8 v)
+{
+    v = f4x8_sat(v);
+    v = f4x8_addvs(f4x8_mulvs(v, f8_s(255.0f)), f8_s(0.5f));
+#if PIM_FLOAT8_AVX2
+    // truncate like the scalar casts
+    __m256i r = _mm256_cvttps_epi32(v.x.v);
+    __m256i g = _mm256_slli_epi32(_mm256_cvttps_epi32(v.y.v), 8);
+    __m256i b = _mm256_slli_epi32(_mm256_cvttps_epi32(v.z.v), 16);
+    __m256i a = _mm256_slli_epi32(_mm256_cvttps_epi32(v.w.v), 24);
+    __m256i c = _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a));
+    _mm256_storeu_si256((__m256i*)dst, c);
+#else
+    __m128i r0 = _mm_cvttps_epi32(v.x.lo);
+    __m128i g0 = _mm_slli_epi32(_mm_cvttps_epi32(v.y.lo), 8);
+    __m128i b0 = _mm_slli_epi32(_mm_cvttps_epi32(v.z.lo), 16);
+    __m128i a0 = _mm_slli_epi32(_mm_cvttps_epi32(v.w.lo), 24);
+    __m128i r1 = _mm_cvttps_epi32(v.x.hi);
+    __m128i g1 = _mm_slli_epi32(_mm_cvttps_epi32(v.y.hi), 8);
+    __m128i b1 = _mm_slli_epi32(_mm_cvttps_epi32(v.z.hi), 16);
+    __m128i a1 = _mm_slli_epi32(_mm_cvttps_epi32(v.w.hi), 24);
+    __m128i c0 = _mm_or_si128(_mm_or_si128(r0, g0), _mm_or_si128(b0, a0));
+    __m128i c1 = _mm_or_si128(_mm_or_si128(r1, g1), _mm_or_si128(b1, a1));
+    _mm_storeu_si128((__m128i*)(dst + 0), c0);
+    _mm_storeu_si128((__m128i*)(dst + 4), c1);
+#endif
+}
+
+#if PIM_FLOAT8_AVX2
+#   undef F4X8_TRANSPOSE
+#endif // PIM_FLOAT8_AVX2
+
+PIM_C_END
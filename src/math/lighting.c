@@ -1,5 +1,7 @@
 #include "math/lighting.h"
 #include "math/sampling.h"
+#include "math/lighting8.h"
+#include "math/sampling8.h"
 #include "rendering/sampler.h"
 #include "allocator/allocator.h"
 #include "threading/task.h"
@@ -7,34 +9,43 @@
 #include <string.h>
 
 // [Karis13]
+// 8 samples at a time; lanes past numSamples or below the horizon add 0
 static float2 VEC_CALL IntegrateBRDF(
     float cosTheta,
     float roughness,
     u32 numSamples)
 {
-    float2 result = { 0.0f, 0.0f };
     const float4 V = SphericalToCartesian(cosTheta, 0.0f);
-    const float4 I = f4_neg(V);
-    const float alpha = BrdfAlpha(roughness);
-    const float weight = 1.0f / numSamples;
-    for (u32 i = 0; i < numSamples; ++i)
+    const float4x8 V8 = f4x8_s(V);
+    const float4x8 I8 = f4x8_s(f4_neg(V));
+    const float8 NoV = f8_s(cosTheta);
+    const float8 alpha = f8_s(BrdfAlpha(roughness));
+    const float8 zero = f8_s(0.0f);
+    float8 scale = zero;
+    float8 bias = zero;
+    for (u32 i = 0; i < numSamples; i += kFloat8Lanes)
     {
-        float4 m = SampleGGXMicrofacet(Hammersley2D(i, numSamples), alpha);
-        float4 L = f4_reflect3(I, m);
-        float NoL = f1_sat(L.z);
-        float NoH = f1_sat(m.z);
-        float HoV = f4_dotsat(m, V);
-        float pdf = GGXPdf(NoH, HoV, alpha);
-        if ((NoL > 0.0f) && (pdf > 0.0f))
+        float4x8 m = SampleGGXMicrofacet8(Hammersley2D8(i, numSamples), alpha);
+        float4x8 L = f4x8_reflect3(I8, m);
+        float8 NoL = f8_sat(L.z);
+        float8 NoH = f8_sat(m.z);
+        float8 HoV = f4x8_dotsat(m, V8);
+        float8 pdf = GGXPdf8(NoH, HoV, alpha);
+        bool8 valid = b8_and(
+            f8_lt(f8_lanes((float)i), f8_s((float)numSamples)),
+            b8_and(f8_gt(NoL, zero), f8_gt(pdf, zero)));
+        if (b8_any(valid))
         {
-            float D = D_GTR(NoH, alpha) / pdf;
-            float G = G_SmithGGX(NoL, cosTheta, alpha);
-            float term = D * G * NoL;
-            float F = F_Schlick1(0.0f, 1.0f, HoV);
-            result.x += weight * ((1.0f - F) * term);
-            result.y += weight * (F * term);
+            float8 D = f8_div(D_GTR8(NoH, alpha), pdf);
+            float8 G = G_SmithGGX8(NoL, NoV, alpha);
+            float8 term = f8_mul(f8_mul(D, G), NoL);
+            float8 F = F_Schlick1_8(zero, f8_s(1.0f), HoV);
+            scale = f8_add(scale, f8_select(zero, f8_mul(f8_sub(f8_s(1.0f), F), term), valid));
+            bias = f8_add(bias, f8_select(zero, f8_mul(F, term), valid));
         }
     }
+    const float weight = 1.0f / numSamples;
+    float2 result = { f8_sum(scale) * weight, f8_sum(bias) * weight };
     return result;
 }
 
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "math/float8_funcs.h"
+#include "math/lighting.h"
+
+PIM_C_BEGIN
+
+// 8 wide versions of the lighting.h helpers
+
+pim_inline float8 VEC_CALL BrdfAlpha8(float8 roughness)
+{
+    return f8_max(f8_mul(roughness, roughness), f8_s(kMinAlpha));
+}
+
+pim_inline float4x8 VEC_CALL F_0_8(float4x8 albedo, float8 metallic)
+{
+    return f4x8_lerpvs(f4x8_s(f4_s(0.04f)), albedo, metallic);
+}
+
+pim_inline float8 VEC_CALL F_90_8(float4x8 F0)
+{
+    return f8_sat(f8_mul(f8_s(50.0f * 0.33f), f8_add(f8_add(F0.x, F0.y), F0.z)));
+}
+
+pim_inline float4x8 VEC_CALL F_Schlick8(float4x8 f0, float8 f90, float8 cosTheta)
+{
+    float8 t = f8_sub(f8_s(1.0f), cosTheta);
+    float8 t2 = f8_mul(t, t);
+    float8 t5 = f8_mul(f8_mul(t2, t2), t);
+    float4x8 f90v = { f90, f90, f90, f90 };
+    return f4x8_lerpvs(f0, f90v, t5);
+}
+
+pim_inline float8 VEC_CALL F_Schlick1_8(float8 f0, float8 f90, float8 cosTheta)
+{
+    float8 t = f8_sub(f8_s(1.0f), cosTheta);
+    float8 t2 = f8_mul(t, t);
+    float8 t5 = f8_mul(f8_mul(t2, t2), t);
+    return f8_lerp(f0, f90, t5);
+}
+
+pim_inline float8 VEC_CALL D_GTR8(float8 NoH, float8 alpha)
+{
+    float8 a2 = f8_mul(alpha, alpha);
+    float8 f = f8_lerp(f8_s(1.0f), a2, f8_mul(NoH, NoH));
+    return f8_div(a2, f8_max(f8_s(kEpsilon), f8_mul(f8_mul(f, f), f8_s(kPi))));
+}
+
+pim_inline float8 VEC_CALL G_SmithGGX8(float8 NoL, float8 NoV, float8 alpha)
+{
+    float8 a2 = f8_mul(alpha, alpha);
+    float8 v = f8_mul(NoL, f8_sqrt(f8_fmadd(f8_sub(NoV, f8_mul(NoV, a2)), NoV, a2)));
+    float8 l = f8_mul(NoV, f8_sqrt(f8_fmadd(f8_sub(NoL, f8_mul(NoL, a2)), NoL, a2)));
+    return f8_div(f8_s(0.5f), f8_max(f8_s(kEpsilon), f8_add(v, l)));
+}
+
+pim_inline float8 VEC_CALL Fd_Burley8(
+    float8 NoL,
+    float8 NoV,
+    float8 HoV,
+    float8 roughness)
+{
+    float8 fd90 = f8_fmadd(f8_mul(f8_mul(HoV, HoV), roughness), f8_s(2.0f), f8_s(0.5f));
+    float8 lightScatter = F_Schlick1_8(f8_s(1.0f), fd90, NoL);
+    float8 viewScatter = F_Schlick1_8(f8_s(1.0f), fd90, NoV);
+    return f8_mul(f8_mul(lightScatter, viewScatter), f8_s(1.0f / kPi));
+}
+
+// multiply output by luminance
+pim_inline float4x8 VEC_CALL DirectBRDF8(
+    float4x8 V,
+    float4x8 L,
+    float4x8 N,
+    float4x8 albedo,
+    float8 roughness,
+    float8 metallic)
+{
+    float4x8 H = f4x8_normalize3(f4x8_add(V, L));
+    float8 NoV = f4x8_dotsat(N, V);
+    float8 NoH = f4x8_dotsat(N, H);
+    float8 NoL = f4x8_dotsat(N, L);
+    float8 HoV = f4x8_dotsat(H, V);
+
+    float8 alpha = BrdfAlpha8(roughness);
+    float4x8 f0 = F_0_8(albedo, metallic);
+    float4x8 F = F_Schlick8(f0, F_90_8(f0), HoV);
+    float8 G = G_SmithGGX8(NoL, NoV, alpha);
+    float8 D = D_GTR8(NoH, alpha);
+    float4x8 Fr = f4x8_mulvs(F, f8_mul(D, G));
+
+    float8 diffuse = f8_mul(
+        f8_sub(f8_s(1.0f), metallic),
+        Fd_Burley8(NoL, NoV, HoV, roughness));
+    // diffuse term is scaled by fresnel refractance
+    float4x8 Fd = f4x8_mulvs(f4x8_sub(f4x8_s(f4_s(1.0f)), F), diffuse);
+    Fd = f4x8_mul(Fd, albedo);
+
+    return f4x8_add(Fr, Fd);
+}
+
+PIM_C_END
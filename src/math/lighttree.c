@@ -0,0 +1,437 @@
+#include "math/lighttree.h"
+#include "math/scalar.h"
+#include "math/float4_funcs.h"
+#include "allocator/allocator.h"
+#include "threading/task.h"
+#include "common/sort.h"
+#include "common/profiler.h"
+#include <string.h>
+
+// the path tracer treats emissive triangles as two sided when sampling them,
+// so lights facing away from a point keep a sliver of probability.
+static const float kMinOrientation = 1.0f / 64.0f;
+
+typedef struct mortonkey_s
+{
+    u32 code;
+    i32 light;
+} mortonkey_t;
+
+typedef struct builder_s
+{
+    lightnode_t* pim_noalias nodes;
+    i32* pim_noalias lightToNode;
+    lightnode_t const* pim_noalias leaves;
+    mortonkey_t const* pim_noalias keys;
+    i32 nodeCount;
+} builder_t;
+
+// spreads the low 10 bits of x out to every third bit
+pim_inline u32 ExpandBits(u32 x)
+{
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// unorm: position within the centroid bounds, in [0, 1]
+pim_inline u32 VEC_CALL MortonCode(float4 unorm)
+{
+    float4 s = f4_mulvs(f4_saturate(unorm), 1023.0f);
+    u32 x = ExpandBits((u32)s.x);
+    u32 y = ExpandBits((u32)s.y);
+    u32 z = ExpandBits((u32)s.z);
+    return (x << 2) | (y << 1) | z;
+}
+
+// a.w, b.w: cone spread angle
+// returns the smallest cone bounding both cones
+pim_inline float4 VEC_CALL ConeUnion(float4 a, float4 b)
+{
+    if (b.w > a.w)
+    {
+        float4 t = a;
+        a = b;
+        b = t;
+    }
+    float thetaD = acosf(f1_clamp(f4_dot3(a, b), -1.0f, 1.0f));
+    if (f1_min(thetaD + b.w, kPi) <= a.w)
+    {
+        return a;
+    }
+    float thetaO = (a.w + thetaD + b.w) * 0.5f;
+    if (thetaO >= kPi)
+    {
+        a.w = kPi;
+        return a;
+    }
+    float4 ortho = f4_sub(b, f4_mulvs(a, f4_dot3(a, b)));
+    float orthoLen = f4_length3(ortho);
+    if (orthoLen < kEpsilon)
+    {
+        // opposing axii, no unique rotation
+        a.w = kPi;
+        return a;
+    }
+    float thetaR = thetaO - a.w;
+    ortho = f4_divvs(ortho, orthoLen);
+    float4 axis = f4_add(f4_mulvs(a, cosf(thetaR)), f4_mulvs(ortho, sinf(thetaR)));
+    axis = f4_normalize3(axis);
+    axis.w = thetaO;
+    return axis;
+}
+
+pim_inline lightnode_t VEC_CALL MergeNodes(
+    lightnode_t const *const pim_noalias lhs,
+    lightnode_t const *const pim_noalias rhs)
+{
+    lightnode_t node = { 0 };
+    node.lo = f4_min(lhs->lo, rhs->lo);
+    node.hi = f4_max(lhs->hi, rhs->hi);
+    node.lo.w = lhs->lo.w + rhs->lo.w;
+    node.hi.w = 0.0f;
+    float4 lcone = lhs->axis;
+    float4 rcone = rhs->axis;
+    lcone.w = lhs->thetaO;
+    rcone.w = rhs->thetaO;
+    float4 cone = ConeUnion(lcone, rcone);
+    node.thetaO = cone.w;
+    cone.w = 0.0f;
+    node.axis = cone;
+    node.thetaE = f1_max(lhs->thetaE, rhs->thetaE);
+    node.parent = -1;
+    node.children[0] = -1;
+    node.children[1] = -1;
+    node.light = -1;
+    return node;
+}
+
+// conservative estimate of the light a node contributes to point P
+pim_inline float VEC_CALL NodeImportance(lightnode_t const *const pim_noalias node, float4 P)
+{
+    const float power = node->lo.w;
+    if (power <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    float4 center = f4_lerpvs(node->lo, node->hi, 0.5f);
+    float radiusSq = f4_lengthsq3(f4_sub(node->hi, center));
+    float4 dir = f4_sub(P, center);
+    float distSq = f4_lengthsq3(dir);
+
+    float cosTheta = f4_dot3(node->axis, dir) / sqrtf(f1_max(distSq, kEpsilon));
+    float theta = acosf(f1_clamp(cosTheta, -1.0f, 1.0f));
+    // angle subtended by the bounding sphere
+    float thetaU = kPi;
+    if (distSq > radiusSq)
+    {
+        thetaU = asinf(sqrtf(radiusSq / distSq));
+    }
+    float thetaP = f1_max(0.0f, theta - node->thetaO - thetaU);
+    float orientation = kMinOrientation;
+    if (thetaP < node->thetaE)
+    {
+        orientation = f1_max(kMinOrientation, cosf(thetaP));
+    }
+
+    return (power * orientation) / f1_max(kEpsilon, f1_max(distSq, radiusSq));
+}
+
+// returns the last index of the left half of [first, last]
+static i32 FindSplit(mortonkey_t const *const pim_noalias keys, i32 first, i32 last)
+{
+    const u32 a = keys[first].code;
+    const u32 b = keys[last].code;
+    if (a == b)
+    {
+        return (first + last) >> 1;
+    }
+
+    // isolate the highest differing bit
+    u32 topBit = a ^ b;
+    while (topBit & (topBit - 1u))
+    {
+        topBit &= topBit - 1u;
+    }
+
+    // keys share every bit above topBit, so those with it unset come first
+    i32 lo = first + 1;
+    i32 hi = last;
+    while (lo < hi)
+    {
+        i32 mid = (lo + hi) >> 1;
+        if (keys[mid].code & topBit)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+    return lo - 1;
+}
+
+static i32 BuildNode(builder_t *const builder, i32 parent, i32 first, i32 last)
+{
+    const i32 iNode = builder->nodeCount++;
+    lightnode_t* pim_noalias nodes = builder->nodes;
+
+    if (first == last)
+    {
+        const i32 light = builder->keys[first].light;
+        lightnode_t leaf = builder->leaves[light];
+        leaf.parent = parent;
+        nodes[iNode] = leaf;
+        builder->lightToNode[light] = iNode;
+        return iNode;
+    }
+
+    const i32 split = FindSplit(builder->keys, first, last);
+    const i32 left = BuildNode(builder, iNode, first, split);
+    const i32 right = BuildNode(builder, iNode, split + 1, last);
+
+    lightnode_t node = MergeNodes(&nodes[left], &nodes[right]);
+    node.parent = parent;
+    node.children[0] = left;
+    node.children[1] = right;
+    nodes[iNode] = node;
+    return iNode;
+}
+
+static i32 CmpMortonKey(const void* lhs, const void* rhs, void* usr)
+{
+    const mortonkey_t* a = lhs;
+    const mortonkey_t* b = rhs;
+    if (a->code != b->code)
+    {
+        return a->code < b->code ? -1 : 1;
+    }
+    return a->light - b->light;
+}
+
+typedef struct task_LightLeaves
+{
+    task_t task;
+    float4 const* positions;
+    float4 const* normals;
+    i32 const* lights;
+    float const* powers;
+    lightnode_t* leaves;
+} task_LightLeaves;
+
+static void LightLeavesFn(void* pbase, i32 begin, i32 end)
+{
+    task_LightLeaves *const task = (task_LightLeaves*)pbase;
+    float4 const *const pim_noalias positions = task->positions;
+    float4 const *const pim_noalias normals = task->normals;
+    i32 const *const pim_noalias lights = task->lights;
+    float const *const pim_noalias powers = task->powers;
+    lightnode_t *const pim_noalias leaves = task->leaves;
+
+    for (i32 i = begin; i < end; ++i)
+    {
+        const i32 iVert = lights[i];
+        float4 A = positions[iVert + 0];
+        float4 B = positions[iVert + 1];
+        float4 C = positions[iVert + 2];
+        float4 N = f4_add(normals[iVert + 0], f4_add(normals[iVert + 1], normals[iVert + 2]));
+        float lenN = f4_length3(N);
+        N = (lenN > kEpsilon) ? f4_divvs(N, lenN) : f4_v(0.0f, 0.0f, 1.0f, 0.0f);
+        N.w = 0.0f;
+
+        lightnode_t leaf = { 0 };
+        leaf.lo = f4_min(A, f4_min(B, C));
+        leaf.hi = f4_max(A, f4_max(B, C));
+        leaf.lo.w = f1_max(0.0f, powers[i]);
+        leaf.hi.w = 0.0f;
+        leaf.axis = N;
+        leaf.thetaO = 0.0f;
+        leaf.thetaE = kPi * 0.5f;
+        leaf.parent = -1;
+        leaf.children[0] = -1;
+        leaf.children[1] = -1;
+        leaf.light = i;
+        leaves[i] = leaf;
+    }
+}
+
+typedef struct task_MortonKeys
+{
+    task_t task;
+    lightnode_t const* leaves;
+    mortonkey_t* keys;
+    float4 lo;
+    float4 rcpRange;
+} task_MortonKeys;
+
+static void MortonKeysFn(void* pbase, i32 begin, i32 end)
+{
+    task_MortonKeys *const task = (task_MortonKeys*)pbase;
+    lightnode_t const *const pim_noalias leaves = task->leaves;
+    mortonkey_t *const pim_noalias keys = task->keys;
+    const float4 lo = task->lo;
+    const float4 rcpRange = task->rcpRange;
+
+    for (i32 i = begin; i < end; ++i)
+    {
+        float4 center = f4_lerpvs(leaves[i].lo, leaves[i].hi, 0.5f);
+        float4 unorm = f4_mul(f4_sub(center, lo), rcpRange);
+        keys[i].code = MortonCode(unorm);
+        keys[i].light = i;
+    }
+}
+
+ProfileMark(pm_lighttree_new, lighttree_new)
+void lighttree_new(
+    lighttree_t *const tree,
+    float4 const *const pim_noalias positions,
+    float4 const *const pim_noalias normals,
+    i32 const *const pim_noalias lights,
+    float const *const pim_noalias powers,
+    i32 lightCount)
+{
+    memset(tree, 0, sizeof(*tree));
+    if (lightCount <= 0)
+    {
+        return;
+    }
+
+    ProfileBegin(pm_lighttree_new);
+
+    task_LightLeaves* leafTask = tmp_calloc(sizeof(*leafTask));
+    leafTask->positions = positions;
+    leafTask->normals = normals;
+    leafTask->lights = lights;
+    leafTask->powers = powers;
+    leafTask->leaves = tmp_malloc(sizeof(leafTask->leaves[0]) * lightCount);
+    task_run(leafTask, LightLeavesFn, lightCount);
+    lightnode_t const *const pim_noalias leaves = leafTask->leaves;
+
+    float4 lo = f4_s(1 << 20);
+    float4 hi = f4_s(-(1 << 20));
+    for (i32 i = 0; i < lightCount; ++i)
+    {
+        float4 center = f4_lerpvs(leaves[i].lo, leaves[i].hi, 0.5f);
+        lo = f4_min(lo, center);
+        hi = f4_max(hi, center);
+    }
+    float4 range = f4_maxvs(f4_sub(hi, lo), kEpsilon);
+
+    task_MortonKeys* keyTask = tmp_calloc(sizeof(*keyTask));
+    keyTask->leaves = leaves;
+    keyTask->keys = tmp_malloc(sizeof(keyTask->keys[0]) * lightCount);
+    keyTask->lo = lo;
+    keyTask->rcpRange = f4_rcp(range);
+    task_run(keyTask, MortonKeysFn, lightCount);
+    pimsort(keyTask->keys, lightCount, sizeof(keyTask->keys[0]), CmpMortonKey, NULL);
+
+    const i32 nodeCount = lightCount * 2 - 1;
+    builder_t builder = { 0 };
+    builder.nodes = perm_calloc(sizeof(builder.nodes[0]) * nodeCount);
+    builder.lightToNode = perm_calloc(sizeof(builder.lightToNode[0]) * lightCount);
+    builder.leaves = leaves;
+    builder.keys = keyTask->keys;
+    BuildNode(&builder, -1, 0, lightCount - 1);
+    ASSERT(builder.nodeCount == nodeCount);
+
+    tree->nodes = builder.nodes;
+    tree->lightToNode = builder.lightToNode;
+    tree->nodeCount = nodeCount;
+    tree->lightCount = lightCount;
+
+    ProfileEnd(pm_lighttree_new);
+}
+
+void lighttree_del(lighttree_t *const tree)
+{
+    if (tree)
+    {
+        pim_free(tree->nodes);
+        pim_free(tree->lightToNode);
+        memset(tree, 0, sizeof(*tree));
+    }
+}
+
+i32 lighttree_sample(
+    lighttree_t const *const tree,
+    float4 position,
+    float u,
+    float *const pim_noalias pdfOut)
+{
+    *pdfOut = 0.0f;
+    if (tree->nodeCount <= 0)
+    {
+        return -1;
+    }
+
+    lightnode_t const *const pim_noalias nodes = tree->nodes;
+    float pdf = 1.0f;
+    i32 iNode = 0;
+    while (nodes[iNode].light < 0)
+    {
+        const i32 iLeft = nodes[iNode].children[0];
+        const i32 iRight = nodes[iNode].children[1];
+        float wLeft = NodeImportance(&nodes[iLeft], position);
+        float wRight = NodeImportance(&nodes[iRight], position);
+        float sum = wLeft + wRight;
+        if (sum <= 0.0f)
+        {
+            return -1;
+        }
+        float pLeft = wLeft / sum;
+        if (u < pLeft)
+        {
+            u = u / pLeft;
+            pdf *= pLeft;
+            iNode = iLeft;
+        }
+        else
+        {
+            u = (u - pLeft) / (1.0f - pLeft);
+            pdf *= wRight / sum;
+            iNode = iRight;
+        }
+        // rescaling can round up to 1
+        u = f1_min(u, 0.99999994f);
+    }
+
+    *pdfOut = pdf;
+    return nodes[iNode].light;
+}
+
+float lighttree_pdf(
+    lighttree_t const *const tree,
+    float4 position,
+    i32 light)
+{
+    if ((light < 0) || (light >= tree->lightCount))
+    {
+        return 0.0f;
+    }
+
+    lightnode_t const *const pim_noalias nodes = tree->nodes;
+    float pdf = 1.0f;
+    i32 iNode = tree->lightToNode[light];
+    i32 iParent = nodes[iNode].parent;
+    while (iParent >= 0)
+    {
+        const i32 iSibling = (nodes[iParent].children[0] == iNode) ?
+            nodes[iParent].children[1] :
+            nodes[iParent].children[0];
+        float w = NodeImportance(&nodes[iNode], position);
+        float sum = w + NodeImportance(&nodes[iSibling], position);
+        if (sum <= 0.0f)
+        {
+            return 0.0f;
+        }
+        pdf *= w / sum;
+        iNode = iParent;
+        iParent = nodes[iNode].parent;
+    }
+    return pdf;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common/macro.h"
+#include "math/types.h"
+
+PIM_C_BEGIN
+
+/*
+    Bounding volume hierarchy over emissive triangles, for many-light sampling.
+    Each node bounds its lights with a box and an orientation cone, and
+    traversal picks a child in proportion to a conservative importance estimate.
+    * Alejandro Conty Estevez and Christopher Kulla,
+      Importance Sampling of Many Lights with Adaptive Tree Splitting
+      - http://www.aconty.com/pdf/many-lights-hpg2018.pdf
+    Built as a linear BVH by sorting lights along a morton curve.
+*/
+
+typedef struct lightnode_s
+{
+    // xyz: bounds minimum
+    //   w: total power
+    float4 lo;
+    // xyz: bounds maximum
+    float4 hi;
+    // xyz: orientation cone axis
+    float4 axis;
+    // orientation cone spread
+    float thetaO;
+    // emission falloff beyond thetaO
+    float thetaE;
+    i32 parent;
+    // -1 for leaves
+    i32 children[2];
+    // light index for leaves, -1 for inner nodes
+    i32 light;
+} lightnode_t;
+
+typedef struct lighttree_s
+{
+    // [nodeCount], root at 0
+    lightnode_t* pim_noalias nodes;
+    // [lightCount]
+    i32* pim_noalias lightToNode;
+    i32 nodeCount;
+    i32 lightCount;
+} lighttree_t;
+
+// positions, normals: triangle list vertex attributes
+// lights: index of the first vertex of each emissive triangle
+// powers: emitted power of each emissive triangle
+void lighttree_new(
+    lighttree_t *const tree,
+    float4 const *const pim_noalias positions,
+    float4 const *const pim_noalias normals,
+    i32 const *const pim_noalias lights,
+    float const *const pim_noalias powers,
+    i32 lightCount);
+void lighttree_del(lighttree_t *const tree);
+
+// returns a light index, or -1 if no light contributes to 'position'
+i32 lighttree_sample(
+    lighttree_t const *const tree,
+    float4 position,
+    float u,
+    float *const pim_noalias pdfOut);
+
+// probability of lighttree_sample selecting 'light' from 'position'
+float lighttree_pdf(
+    lighttree_t const *const tree,
+    float4 position,
+    i32 light);
+
+PIM_C_END
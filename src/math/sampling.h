@@ -52,15 +52,83 @@ pim_inline float4 VEC_CALL TanToWorld(float4 normalWS, float4 normalTS)
     return TbnToWorld(TBN, normalTS);
 }
 
-// Computes a radical inverse with base 2 using bit-twiddling from "Hacker's Delight"
-pim_inline float VEC_CALL RadicalInverseBase2(u32 bits)
+// bit-twiddling from "Hacker's Delight"
+pim_inline u32 VEC_CALL ReverseBits(u32 bits)
 {
     bits = (bits << 16u) | (bits >> 16u);
     bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
     bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
     bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
     bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-    return (float)(bits) * 2.3283064365386963e-10f; // / 0x100000000
+    return bits;
+}
+
+// Computes a radical inverse with base 2
+pim_inline float VEC_CALL RadicalInverseBase2(u32 bits)
+{
+    return (float)ReverseBits(bits) * 2.3283064365386963e-10f; // / 0x100000000
+}
+
+// https://nullprogram.com/blog/2018/07/31/
+pim_inline u32 VEC_CALL HashMix32(u32 x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+// Brent Burley, Practical Hash-based Owen Scrambling
+// https://jcgt.org/published/0009/04/01/
+pim_inline u32 VEC_CALL LaineKarrasPermutation(u32 x, u32 seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+pim_inline u32 VEC_CALL OwenScramble(u32 x, u32 seed)
+{
+    return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+}
+
+// second dimension of the sobol sequence; the first is ReverseBits
+pim_inline u32 VEC_CALL Sobol1(u32 index)
+{
+    u32 x = 0;
+    for (u32 v = 1u << 31u; index; index >>= 1u, v ^= v >> 1u)
+    {
+        x ^= (index & 1u) ? v : 0u;
+    }
+    return x;
+}
+
+// top 24 bits to [0, 1)
+pim_inline float VEC_CALL UnormU32(u32 x)
+{
+    return (float)(x >> 8u) * (1.0f / (1u << 24u));
+}
+
+// owen scrambled sobol, shuffled by seed so that each seed
+// is an independent sequence. pad dimensions with distinct seeds.
+pim_inline float VEC_CALL SobolOwen1D(u32 index, u32 seed)
+{
+    index = OwenScramble(index, seed);
+    u32 x = OwenScramble(ReverseBits(index), HashMix32(seed ^ 0xa511e9b3u));
+    return UnormU32(x);
+}
+
+pim_inline float2 VEC_CALL SobolOwen2D(u32 index, u32 seed)
+{
+    index = OwenScramble(index, seed);
+    u32 x = OwenScramble(ReverseBits(index), HashMix32(seed ^ 0xa511e9b3u));
+    u32 y = OwenScramble(Sobol1(index), HashMix32(seed ^ 0x63d83595u));
+    return f2_v(UnormU32(x), UnormU32(y));
 }
 
 // generates a stratified random 2D variable with range [0, 1]
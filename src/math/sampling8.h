@@ -0,0 +1,122 @@
+#pragma once
+
+#include "math/float8_funcs.h"
+#include "math/lighting8.h"
+#include "math/sampling.h"
+
+PIM_C_BEGIN
+
+// 8 wide versions of the sampling.h helpers
+
+// Hammersley2D(i + lane, N) in each lane
+pim_inline float2x8 VEC_CALL Hammersley2D8(u32 i, u32 N)
+{
+    float2x8 c;
+    c.x = f8_mulvs(f8_lanes((float)i), 1.0f / (float)N);
+#if PIM_FLOAT8_AVX2
+    __m256i bits = _mm256_add_epi32(_mm256_set1_epi32((i32)i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    bits = _mm256_or_si256(_mm256_slli_epi32(bits, 16), _mm256_srli_epi32(bits, 16));
+    bits = _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x55555555)), 1),
+        _mm256_srli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0xAAAAAAAA)), 1));
+    bits = _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x33333333)), 2),
+        _mm256_srli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0xCCCCCCCC)), 2));
+    bits = _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x0F0F0F0F)), 4),
+        _mm256_srli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0xF0F0F0F0)), 4));
+    bits = _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x00FF00FF)), 8),
+        _mm256_srli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0xFF00FF00)), 8));
+    // the conversion is signed, so drop the lowest bit; floats cannot hold it anyway
+    c.y.v = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 1)), _mm256_set1_ps(4.6566128730773926e-10f));
+#else
+    __m128i halves[2] =
+    {
+        _mm_add_epi32(_mm_set1_epi32((i32)i), _mm_setr_epi32(0, 1, 2, 3)),
+        _mm_add_epi32(_mm_set1_epi32((i32)i), _mm_setr_epi32(4, 5, 6, 7)),
+    };
+    for (i32 h = 0; h < 2; ++h)
+    {
+        __m128i bits = halves[h];
+        bits = _mm_or_si128(_mm_slli_epi32(bits, 16), _mm_srli_epi32(bits, 16));
+        bits = _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x55555555)), 1),
+            _mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0xAAAAAAAA)), 1));
+        bits = _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x33333333)), 2),
+            _mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0xCCCCCCCC)), 2));
+        bits = _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x0F0F0F0F)), 4),
+            _mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0xF0F0F0F0)), 4));
+        bits = _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x00FF00FF)), 8),
+            _mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0xFF00FF00)), 8));
+        halves[h] = bits;
+    }
+    // the conversion is signed, so drop the lowest bit; floats cannot hold it anyway
+    c.y.lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(halves[0], 1)), _mm_set1_ps(4.6566128730773926e-10f));
+    c.y.hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(halves[1], 1)), _mm_set1_ps(4.6566128730773926e-10f));
+#endif
+    return c;
+}
+
+pim_inline float8 VEC_CALL PowerHeuristic8(float8 f, float8 g)
+{
+    float8 f2 = f8_mul(f, f);
+    return f8_div(f2, f8_fmadd(g, g, f2));
+}
+
+pim_inline float4x8 VEC_CALL SphericalToCartesian8(float8 cosTheta, float8 phi)
+{
+    float8 sinTheta = f8_sqrt(f8_max(f8_s(0.0f), f8_sub(f8_s(1.0f), f8_mul(cosTheta, cosTheta))));
+    float8 sinPhi, cosPhi;
+    f8_sincos(phi, &sinPhi, &cosPhi);
+    float4x8 dir = { f8_mul(sinTheta, cosPhi), f8_mul(sinTheta, sinPhi), cosTheta, f8_s(0.0f) };
+    return dir;
+}
+
+// samples unit sphere with N = (0, 0, 1)
+pim_inline float4x8 VEC_CALL SampleUnitSphere8(float2x8 Xi)
+{
+    float8 phi = f8_mulvs(Xi.x, kTau);
+    float8 cosTheta = f8_fmadd(Xi.y, f8_s(2.0f), f8_s(-1.0f));
+    return SphericalToCartesian8(cosTheta, phi);
+}
+
+// samples unit hemisphere with N = (0, 0, 1)
+pim_inline float4x8 VEC_CALL SampleUnitHemisphere8(float2x8 Xi)
+{
+    float8 phi = f8_mulvs(Xi.x, kTau);
+    return SphericalToCartesian8(Xi.y, phi);
+}
+
+// returns a microfacet normal of the GGX NDF for given roughness
+// tangent space
+pim_inline float4x8 VEC_CALL SampleGGXMicrofacet8(float2x8 Xi, float8 alpha)
+{
+    float8 a2 = f8_mul(alpha, alpha);
+    float8 phi = f8_mulvs(Xi.x, kTau);
+    float8 den = f8_fmadd(f8_sub(a2, f8_s(1.0f)), Xi.y, f8_s(1.0f));
+    float8 cosTheta = f8_sqrt(f8_div(f8_sub(f8_s(1.0f), Xi.y), den));
+    return SphericalToCartesian8(cosTheta, phi);
+}
+
+pim_inline float8 VEC_CALL LambertPdf8(float8 NoL)
+{
+    return f8_mul(NoL, f8_s(1.0f / kPi));
+}
+
+pim_inline float8 VEC_CALL GGXPdf8(float8 NoH, float8 HoV, float8 alpha)
+{
+    float8 d = D_GTR8(NoH, alpha);
+    return f8_div(f8_mul(d, NoH), f8_max(f8_s(kEpsilon), f8_mul(HoV, f8_s(4.0f))));
+}
+
+// returns pdf of an area light that passes the intersection test
+pim_inline float8 VEC_CALL LightPdf8(float8 area, float8 cosTheta, float8 distSq)
+{
+    return f8_div(distSq, f8_max(f8_s(kEpsilon), f8_mul(cosTheta, area)));
+}
+
+PIM_C_END
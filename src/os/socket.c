@@ -176,7 +176,6 @@ static i32 wsock_send(socket_t sock, const void* src, u32 len)
     if (wsock_isopen(sock))
     {
         rval = send((SOCKET)sock.handle, (const char*)src, len, 0x0);
-        ASSERT(rval != SOCKET_ERROR);
     }
     return rval;
 }
@@ -191,11 +190,251 @@ static i32 wsock_recv(socket_t sock, void* dst, u32 len)
     if (wsock_isopen(sock))
     {
         rval = recv((SOCKET)sock.handle, (char*)dst, len, 0x0);
-        ASSERT(rval != SOCKET_ERROR);
     }
     return rval;
 }
 
+// https://docs.microsoft.com/en-us/windows/win32/api/winsock2/nf-winsock2-select
+static i32 wsock_poll(socket_t sock, i32 timeoutMs)
+{
+    ASSERT(wsock_isopen(sock));
+    if (wsock_isopen(sock))
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET((SOCKET)sock.handle, &readable);
+        struct timeval tv;
+        tv.tv_sec = timeoutMs / 1000;
+        tv.tv_usec = (timeoutMs % 1000) * 1000;
+        i32 rval = select(0, &readable, NULL, NULL, &tv);
+        return rval == SOCKET_ERROR ? -1 : (rval > 0 ? 1 : 0);
+    }
+    return -1;
+}
+
+// https://docs.microsoft.com/en-us/windows/win32/api/winsock/nf-winsock-setsockopt
+static bool wsock_settimeout(socket_t sock, i32 timeoutMs)
+{
+    ASSERT(wsock_isopen(sock));
+    if (wsock_isopen(sock))
+    {
+        DWORD ms = (DWORD)timeoutMs;
+        SOCKET s = (SOCKET)sock.handle;
+        return (setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&ms, sizeof(ms)) != SOCKET_ERROR) &&
+            (setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&ms, sizeof(ms)) != SOCKET_ERROR);
+    }
+    return false;
+}
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <ctype.h>
+
+// keeps a broken connection from raising SIGPIPE in send
+#ifdef MSG_NOSIGNAL
+    #define kSendFlags MSG_NOSIGNAL
+#else
+    #define kSendFlags 0
+#endif // MSG_NOSIGNAL
+
+// descriptors start at 0, so handles hold fd + 1 and NULL is closed
+static i32 ToFd(socket_t sock)
+{
+    return (i32)(intptr_t)sock.handle - 1;
+}
+
+static void* ToHandle(i32 fd)
+{
+    return (void*)(intptr_t)(fd + 1);
+}
+
+static struct sockaddr_in ToSockAddr(u32 addr, u16 port)
+{
+    ASSERT(addr != INADDR_NONE);
+    ASSERT(port);
+
+    struct sockaddr_in name = { 0 };
+    name.sin_family = AF_INET;
+    name.sin_addr.s_addr = addr;
+    name.sin_port = htons(port);
+
+    return name;
+}
+
+static bool psock_url2addr(const char* url, u32* addr)
+{
+    if (!url)
+    {
+        return false;
+    }
+    u32 y = INADDR_NONE;
+    if (isalpha(url[0]))
+    {
+        struct addrinfo hints = { 0 };
+        hints.ai_family = AF_INET;
+        struct addrinfo* info = NULL;
+        if (!getaddrinfo(url, NULL, &hints, &info) && info)
+        {
+            y = ((const struct sockaddr_in*)info->ai_addr)->sin_addr.s_addr;
+            freeaddrinfo(info);
+        }
+    }
+    else
+    {
+        y = inet_addr(url);
+    }
+    *addr = y;
+    return y != INADDR_NONE;
+}
+
+static bool psock_isopen(socket_t sock)
+{
+    return ToFd(sock) >= 0;
+}
+
+static bool psock_open(socket_t* sock, SocketProto proto)
+{
+    bool tcp = proto == SocketProto_TCP;
+    i32 fd = socket(
+        AF_INET,
+        tcp ? SOCK_STREAM : SOCK_DGRAM,
+        tcp ? IPPROTO_TCP : IPPROTO_UDP);
+    sock->handle = fd >= 0 ? ToHandle(fd) : NULL;
+    sock->proto = proto;
+    return psock_isopen(*sock);
+}
+
+static void psock_close(socket_t* sock)
+{
+    if (psock_isopen(*sock))
+    {
+        i32 rval = close(ToFd(*sock));
+        ASSERT(rval == 0);
+    }
+    sock->handle = NULL;
+}
+
+static bool psock_bind(socket_t sock, u32 addr, u16 port)
+{
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        // rebinding a port with connections in TIME_WAIT would fail for minutes
+        i32 reuse = 1;
+        setsockopt(ToFd(sock), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in name = ToSockAddr(addr, port);
+        return bind(ToFd(sock), (const struct sockaddr*)&name, sizeof(name)) == 0;
+    }
+    return false;
+}
+
+static bool psock_listen(socket_t sock)
+{
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        return listen(ToFd(sock), SOMAXCONN) == 0;
+    }
+    return false;
+}
+
+static socket_t psock_accept(socket_t sock, u32* addr)
+{
+    ASSERT(addr);
+    socket_t result;
+    result.handle = NULL;
+    result.proto = sock.proto;
+    *addr = 0;
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        struct sockaddr_in saddr = { 0 };
+        socklen_t len = sizeof(saddr);
+        i32 fd = accept(ToFd(sock), (struct sockaddr*)&saddr, &len);
+        if (fd >= 0)
+        {
+            *addr = saddr.sin_addr.s_addr;
+            result.handle = ToHandle(fd);
+        }
+    }
+    return result;
+}
+
+static bool psock_connect(socket_t sock, u32 addr, u16 port)
+{
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        struct sockaddr_in name = ToSockAddr(addr, port);
+        return connect(ToFd(sock), (const struct sockaddr*)&name, sizeof(name)) == 0;
+    }
+    return false;
+}
+
+static i32 psock_send(socket_t sock, const void* src, u32 len)
+{
+    ASSERT(src);
+    ASSERT(len);
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        return (i32)send(ToFd(sock), src, len, kSendFlags);
+    }
+    return -1;
+}
+
+static i32 psock_recv(socket_t sock, void* dst, u32 len)
+{
+    ASSERT(dst);
+    ASSERT(len);
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        return (i32)recv(ToFd(sock), dst, len, 0x0);
+    }
+    return -1;
+}
+
+static i32 psock_poll(socket_t sock, i32 timeoutMs)
+{
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        struct pollfd pfd = { 0 };
+        pfd.fd = ToFd(sock);
+        pfd.events = POLLIN;
+        i32 rval = poll(&pfd, 1, timeoutMs);
+        if (rval < 0 || (pfd.revents & POLLNVAL))
+        {
+            return -1;
+        }
+        return rval > 0 ? 1 : 0;
+    }
+    return -1;
+}
+
+static bool psock_settimeout(socket_t sock, i32 timeoutMs)
+{
+    ASSERT(psock_isopen(sock));
+    if (psock_isopen(sock))
+    {
+        struct timeval tv;
+        tv.tv_sec = timeoutMs / 1000;
+        tv.tv_usec = (timeoutMs % 1000) * 1000;
+        return (setsockopt(ToFd(sock), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0) &&
+            (setsockopt(ToFd(sock), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0);
+    }
+    return false;
+}
+
 #endif // PLAT_WINDOWS
 
 void network_sys_init(void)
@@ -224,6 +463,8 @@ bool network_url2addr(const char* url, u32* addrOut)
 {
 #if PLAT_WINDOWS
     return wsock_url2addr(url, addrOut);
+#else
+    return psock_url2addr(url, addrOut);
 #endif // PLAT_WINDOWS
 }
 
@@ -231,6 +472,8 @@ bool socket_open(socket_t* sock, SocketProto proto)
 {
 #if PLAT_WINDOWS
     return wsock_open(sock, proto);
+#else
+    return psock_open(sock, proto);
 #endif // PLAT_WINDOWS
 }
 
@@ -238,6 +481,8 @@ void socket_close(socket_t* sock)
 {
 #if PLAT_WINDOWS
     wsock_close(sock);
+#else
+    psock_close(sock);
 #endif // PLAT_WINDOWS
 }
 
@@ -245,6 +490,8 @@ bool socket_isopen(socket_t sock)
 {
 #if PLAT_WINDOWS
     return wsock_isopen(sock);
+#else
+    return psock_isopen(sock);
 #endif // PLAT_WINDOWS
 }
 
@@ -252,6 +499,8 @@ bool socket_bind(socket_t sock, u32 addr, u16 port)
 {
 #if PLAT_WINDOWS
     return wsock_bind(sock, addr, port);
+#else
+    return psock_bind(sock, addr, port);
 #endif // PLAT_WINDOWS
 }
 
@@ -259,6 +508,8 @@ bool socket_listen(socket_t sock)
 {
 #if PLAT_WINDOWS
     return wsock_listen(sock);
+#else
+    return psock_listen(sock);
 #endif // PLAT_WINDOWS
 }
 
@@ -266,6 +517,8 @@ socket_t socket_accept(socket_t sock, u32* addr)
 {
 #if PLAT_WINDOWS
     return wsock_accept(sock, addr);
+#else
+    return psock_accept(sock, addr);
 #endif // PLAT_WINDOWS
 }
 
@@ -273,6 +526,8 @@ bool socket_connect(socket_t sock, u32 addr, u16 port)
 {
 #if PLAT_WINDOWS
     return wsock_connect(sock, addr, port);
+#else
+    return psock_connect(sock, addr, port);
 #endif // PLAT_WINDOWS
 }
 
@@ -280,6 +535,8 @@ i32 socket_send(socket_t sock, const void* src, i32 len)
 {
 #if PLAT_WINDOWS
     return wsock_send(sock, src, len);
+#else
+    return psock_send(sock, src, len);
 #endif // PLAT_WINDOWS
 }
 
@@ -287,5 +544,25 @@ i32 socket_recv(socket_t sock, void* dst, i32 len)
 {
 #if PLAT_WINDOWS
     return wsock_recv(sock, dst, len);
+#else
+    return psock_recv(sock, dst, len);
+#endif // PLAT_WINDOWS
+}
+
+i32 socket_poll(socket_t sock, i32 timeoutMs)
+{
+#if PLAT_WINDOWS
+    return wsock_poll(sock, timeoutMs);
+#else
+    return psock_poll(sock, timeoutMs);
+#endif // PLAT_WINDOWS
+}
+
+bool socket_settimeout(socket_t sock, i32 timeoutMs)
+{
+#if PLAT_WINDOWS
+    return wsock_settimeout(sock, timeoutMs);
+#else
+    return psock_settimeout(sock, timeoutMs);
 #endif // PLAT_WINDOWS
 }
@@ -35,4 +35,11 @@ bool socket_connect(socket_t sock, u32 addr, u16 port);
 i32 socket_send(socket_t sock, const void* src, i32 len);
 i32 socket_recv(socket_t sock, void* dst, i32 len);
 
+// waits up to timeoutMs for data to recv, or for a connection to accept.
+// returns 1 when ready, 0 on timeout, and -1 on error.
+// a closed peer reads as ready, and then recv returns 0.
+i32 socket_poll(socket_t sock, i32 timeoutMs);
+// fails send and recv calls that block longer than timeoutMs, 0 for never
+bool socket_settimeout(socket_t sock, i32 timeoutMs);
+
 PIM_C_END
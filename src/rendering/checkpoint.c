@@ -0,0 +1,579 @@
+#include "rendering/checkpoint.h"
+#include "rendering/path_tracer.h"
+#include "rendering/lightmap.h"
+#include "rendering/camera.h"
+#include "io/fd.h"
+#include "io/fmap.h"
+#include "allocator/allocator.h"
+#include "threading/task.h"
+#include "threading/taskcpy.h"
+#include "math/scalar.h"
+#include "common/console.h"
+#include "common/stringutil.h"
+#include "common/fnv1a.h"
+#include "common/profiler.h"
+#include <string.h>
+
+#define kCkptMagic      0x54504b43 // 'CKPT'
+#define kCkptVersion    1
+#define kCkptSlots      2
+// fd, fmap and the allocators take i32 sizes, so whole files must fit one
+#define kCkptMaxBytes   (0x7fffffffll - (i64)sizeof(dckpt_t))
+
+typedef enum
+{
+    CkptKind_Trace,
+    CkptKind_Lightmap,
+
+    CkptKind_COUNT
+} CkptKind;
+
+static const char* const kCkptKindNames[] =
+{
+    "pt",
+    "lm",
+};
+SASSERT(NELEM(kCkptKindNames) == CkptKind_COUNT);
+
+// file header, followed by dataBytes of the kind's header and payload
+typedef struct dckpt_s
+{
+    i32 magic;
+    i32 version;
+    i32 kind;
+    u32 dataHash;
+    i64 dataBytes;
+    // 0 while the file is being rewritten, otherwise higher is newer
+    u64 sequence;
+} dckpt_t;
+
+// followed by samplerCount samplers, then color, albedo, normal,
+// sampleCounts, lumM2, depth and primIds
+typedef struct dckpt_trace_s
+{
+    int2 imageSize;
+    i32 sampleCount;
+    i32 samplerCount;
+    camera_t camera;
+    dofinfo_t dofinfo;
+} dckpt_trace_t;
+
+// followed by samplerCount samplers, then each lightmap's texels and
+// tile frames
+typedef struct dckpt_lightmap_s
+{
+    i32 lmCount;
+    i32 lmSize;
+    i32 directions;
+    i32 samplerCount;
+    float texelsPerMeter;
+} dckpt_lightmap_t;
+
+typedef struct task_CkptWrite
+{
+    task_t task;
+    char path[PIM_PATH];
+    u64 sequence;
+    CkptKind kind;
+    u8* data;
+    i64 dataBytes;
+    bool success;
+} task_CkptWrite;
+
+static task_CkptWrite ms_write;
+static bool ms_writing;
+
+// ----------------------------------------------------------------------------
+
+static void SlotPath(char* dst, i32 size, CkptKind kind, const char* name, i32 slot)
+{
+    SPrintf(dst, size, "data/%s.%s%d.ckpt", name, kCkptKindNames[kind], slot);
+}
+
+static bool ReadHeader(const char* path, dckpt_t* hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    fd_t fd = fd_open(path, false);
+    if (!fd_isopen(fd))
+    {
+        return false;
+    }
+    bool valid = fd_read(fd, hdr, sizeof(*hdr)) == sizeof(*hdr);
+    valid &= hdr->magic == kCkptMagic;
+    valid &= hdr->version == kCkptVersion;
+    valid &= hdr->sequence != 0;
+    valid &= (hdr->dataBytes >= 0) && (hdr->dataBytes <= kCkptMaxBytes);
+    valid &= fd_size(fd) == (i64)sizeof(*hdr) + hdr->dataBytes;
+    fd_close(&fd);
+    return valid;
+}
+
+// highest sequence among the slots with a complete header, 0 for none
+static u64 NewestSequence(CkptKind kind, const char* name)
+{
+    u64 newest = 0;
+    for (i32 slot = 0; slot < kCkptSlots; ++slot)
+    {
+        char path[PIM_PATH] = { 0 };
+        SlotPath(ARGS(path), kind, name, slot);
+        dckpt_t hdr;
+        if (ReadHeader(path, &hdr) && (hdr.kind == kind))
+        {
+            newest = hdr.sequence > newest ? hdr.sequence : newest;
+        }
+    }
+    return newest;
+}
+
+// maps the newest slot whose contents match its header hash
+static fmap_t OpenNewest(CkptKind kind, const char* name)
+{
+    char paths[kCkptSlots][PIM_PATH] = { 0 };
+    u64 sequences[kCkptSlots] = { 0 };
+    for (i32 slot = 0; slot < kCkptSlots; ++slot)
+    {
+        SlotPath(ARGS(paths[slot]), kind, name, slot);
+        dckpt_t hdr;
+        if (ReadHeader(paths[slot], &hdr) && (hdr.kind == kind))
+        {
+            sequences[slot] = hdr.sequence;
+        }
+    }
+
+    for (i32 attempt = 0; attempt < kCkptSlots; ++attempt)
+    {
+        i32 chosen = -1;
+        for (i32 slot = 0; slot < kCkptSlots; ++slot)
+        {
+            if (sequences[slot] && ((chosen < 0) || (sequences[slot] > sequences[chosen])))
+            {
+                chosen = slot;
+            }
+        }
+        if (chosen < 0)
+        {
+            break;
+        }
+        sequences[chosen] = 0;
+
+        fmap_t map = fmap_open(paths[chosen], false);
+        if (fmap_isopen(map) && (map.size >= (i32)sizeof(dckpt_t)))
+        {
+            const dckpt_t* hdr = map.ptr;
+            // a matching size also bounds dataBytes to i32
+            if (((i64)map.size == (i64)sizeof(*hdr) + hdr->dataBytes) &&
+                (hdr->dataHash == Fnv32Bytes(hdr + 1, (i32)hdr->dataBytes, Fnv32Bias)))
+            {
+                return map;
+            }
+            con_logf(LogSev_Warning, "ckpt", "Skipping torn checkpoint '%s'", paths[chosen]);
+        }
+        fmap_close(&map);
+    }
+    return (fmap_t) { 0 };
+}
+
+// ----------------------------------------------------------------------------
+
+static bool WriteSlot(const task_CkptWrite* task)
+{
+    // BeginSave keeps this within kCkptMaxBytes
+    const i32 fileBytes = (i32)(sizeof(dckpt_t) + task->dataBytes);
+
+    fd_t fd = fd_open(task->path, true);
+    if (fd_isopen(fd) && (fd_size(fd) != fileBytes))
+    {
+        fd_close(&fd);
+    }
+    if (!fd_isopen(fd))
+    {
+        // grow a new file to full size, so all of it can be mapped
+        fd = fd_create(task->path);
+        if (!fd_isopen(fd))
+        {
+            return false;
+        }
+        if (!fd_seek(fd, fileBytes - 1) || (fd_write(fd, "", 1) != 1))
+        {
+            fd_close(&fd);
+            return false;
+        }
+    }
+
+    fmap_t map = fmap_create(fd, true);
+    if (!fmap_isopen(map))
+    {
+        fd_close(&fd);
+        return false;
+    }
+
+    dckpt_t* hdr = map.ptr;
+    // mark the slot incomplete before touching its contents,
+    // so a crash mid write leaves the other slot as the newest
+    hdr->sequence = 0;
+    bool wrote = fmap_flush(map);
+
+    memcpy(hdr + 1, task->data, task->dataBytes);
+    wrote &= fmap_flush(map);
+
+    dckpt_t complete = { 0 };
+    complete.magic = kCkptMagic;
+    complete.version = kCkptVersion;
+    complete.kind = task->kind;
+    complete.dataBytes = task->dataBytes;
+    complete.sequence = task->sequence;
+    complete.dataHash = Fnv32Bytes(task->data, fileBytes - (i32)sizeof(dckpt_t), Fnv32Bias);
+    *hdr = complete;
+    wrote &= fmap_flush(map);
+
+    fmap_close(&map);
+    return wrote;
+}
+
+static void CkptWriteFn(void* pbase, i32 begin, i32 end)
+{
+    task_CkptWrite* task = (task_CkptWrite*)pbase;
+    task->success = WriteSlot(task);
+}
+
+static void Retire(bool wait)
+{
+    if (ms_writing)
+    {
+        if (wait)
+        {
+            task_await(&ms_write);
+        }
+        if (task_stat(&ms_write) == TaskStatus_Complete)
+        {
+            ms_writing = false;
+            if (ms_write.success)
+            {
+                con_logf(LogSev_Verbose, "ckpt", "Wrote checkpoint '%s'", ms_write.path);
+            }
+            else
+            {
+                con_logf(LogSev_Error, "ckpt", "Failed to write checkpoint '%s'", ms_write.path);
+            }
+            pim_free(ms_write.data);
+            ms_write.data = NULL;
+        }
+    }
+}
+
+// returns staging memory for dataBytes, or NULL while a write is pending
+// or when dataBytes is too large to write
+static u8* BeginSave(CkptKind kind, const char* name, i64 dataBytes)
+{
+    ASSERT(name && name[0]);
+    ASSERT(dataBytes > 0);
+    if (dataBytes > kCkptMaxBytes)
+    {
+        static bool s_warned[CkptKind_COUNT];
+        if (!s_warned[kind])
+        {
+            s_warned[kind] = true;
+            con_logf(LogSev_Error, "ckpt", "Skipping %s checkpoints of %lld bytes, the limit is %lld",
+                kCkptKindNames[kind], (long long)dataBytes, (long long)kCkptMaxBytes);
+        }
+        return NULL;
+    }
+    Retire(false);
+    if (ms_writing)
+    {
+        return NULL;
+    }
+
+    task_CkptWrite* task = &ms_write;
+    memset(task, 0, sizeof(*task));
+    task->kind = kind;
+    task->sequence = NewestSequence(kind, name) + 1;
+    SlotPath(ARGS(task->path), kind, name, (i32)(task->sequence % kCkptSlots));
+    task->dataBytes = dataBytes;
+    task->data = perm_malloc((i32)dataBytes);
+    return task->data;
+}
+
+static void EndSave(void)
+{
+    ms_writing = true;
+    task_submit(&ms_write.task, CkptWriteFn, 1);
+    task_sys_schedule();
+}
+
+static u8* SaveBytes(u8* dst, const void* src, i32 sizeOf, i32 length)
+{
+    taskcpy(dst, src, sizeOf, length);
+    return dst + sizeOf * length;
+}
+
+static const u8* LoadBytes(const u8* src, void* dst, i32 sizeOf, i32 length)
+{
+    taskcpy(dst, src, sizeOf, length);
+    return src + sizeOf * length;
+}
+
+static u8* SaveSamplers(u8* dst, i32 count)
+{
+    // staging offsets are not aligned for pt_sampler_t
+    pt_sampler_t* samplers = tmp_malloc(sizeof(samplers[0]) * count);
+    pt_sampler_save(samplers);
+    return SaveBytes(dst, samplers, sizeof(samplers[0]), count);
+}
+
+static const u8* LoadSamplers(const u8* src, i32 count)
+{
+    pt_sampler_t* samplers = tmp_malloc(sizeof(samplers[0]) * i1_max(1, count));
+    src = LoadBytes(src, samplers, sizeof(samplers[0]), count);
+    pt_sampler_load(samplers, count);
+    return src;
+}
+
+// ----------------------------------------------------------------------------
+
+void ckpt_flush(void)
+{
+    Retire(true);
+}
+
+bool ckpt_busy(void)
+{
+    Retire(false);
+    return ms_writing;
+}
+
+static i32 TraceTexelBytes(const pt_trace_t* trace)
+{
+    return
+        sizeof(trace->color[0]) +
+        sizeof(trace->albedo[0]) +
+        sizeof(trace->normal[0]) +
+        sizeof(trace->sampleCounts[0]) +
+        sizeof(trace->lumM2[0]) +
+        sizeof(trace->depth[0]) +
+        sizeof(trace->primIds[0]);
+}
+
+ProfileMark(pm_TraceSave, ckpt_trace_save)
+bool ckpt_trace_save(
+    const char* name,
+    const pt_trace_t* trace,
+    const camera_t* camera,
+    i32 sampleCount)
+{
+    ASSERT(trace);
+    ASSERT(camera);
+    const int2 size = trace->imageSize;
+    const i32 len = size.x * size.y;
+    if (!trace->color || (len <= 0))
+    {
+        return false;
+    }
+
+    ProfileBegin(pm_TraceSave);
+
+    const i32 samplerCount = pt_sampler_count();
+    const i64 dataBytes =
+        (i64)sizeof(dckpt_trace_t) +
+        (i64)sizeof(pt_sampler_t) * samplerCount +
+        (i64)TraceTexelBytes(trace) * len;
+    u8* dst = BeginSave(CkptKind_Trace, name, dataBytes);
+    if (dst)
+    {
+        dckpt_trace_t hdr = { 0 };
+        hdr.imageSize = size;
+        hdr.sampleCount = sampleCount;
+        hdr.samplerCount = samplerCount;
+        hdr.camera = *camera;
+        hdr.dofinfo = trace->dofinfo;
+        memcpy(dst, &hdr, sizeof(hdr));
+        dst += sizeof(hdr);
+
+        dst = SaveSamplers(dst, samplerCount);
+
+        dst = SaveBytes(dst, trace->color, sizeof(trace->color[0]), len);
+        dst = SaveBytes(dst, trace->albedo, sizeof(trace->albedo[0]), len);
+        dst = SaveBytes(dst, trace->normal, sizeof(trace->normal[0]), len);
+        dst = SaveBytes(dst, trace->sampleCounts, sizeof(trace->sampleCounts[0]), len);
+        dst = SaveBytes(dst, trace->lumM2, sizeof(trace->lumM2[0]), len);
+        dst = SaveBytes(dst, trace->depth, sizeof(trace->depth[0]), len);
+        dst = SaveBytes(dst, trace->primIds, sizeof(trace->primIds[0]), len);
+        ASSERT(dst == ms_write.data + dataBytes);
+
+        EndSave();
+    }
+
+    ProfileEnd(pm_TraceSave);
+    return dst != NULL;
+}
+
+ProfileMark(pm_TraceLoad, ckpt_trace_load)
+bool ckpt_trace_load(
+    const char* name,
+    pt_trace_t* trace,
+    camera_t* camera,
+    i32* sampleCount)
+{
+    ASSERT(trace);
+    ASSERT(camera);
+    ASSERT(sampleCount);
+    ProfileBegin(pm_TraceLoad);
+
+    // the pending write may be the newest checkpoint
+    Retire(true);
+
+    bool loaded = false;
+    fmap_t map = OpenNewest(CkptKind_Trace, name);
+    if (fmap_isopen(map))
+    {
+        const u8* src = (const u8*)map.ptr + sizeof(dckpt_t);
+        const i64 dataBytes = ((const dckpt_t*)map.ptr)->dataBytes;
+        dckpt_trace_t hdr;
+        memcpy(&hdr, src, sizeof(hdr));
+        src += sizeof(hdr);
+
+        const int2 size = trace->imageSize;
+        const i32 len = size.x * size.y;
+        const i64 expected =
+            (i64)sizeof(hdr) +
+            (i64)sizeof(pt_sampler_t) * hdr.samplerCount +
+            (i64)TraceTexelBytes(trace) * len;
+        if ((hdr.imageSize.x != size.x) || (hdr.imageSize.y != size.y))
+        {
+            con_logf(LogSev_Error, "ckpt", "Checkpoint is %dx%d, trace is %dx%d",
+                hdr.imageSize.x, hdr.imageSize.y, size.x, size.y);
+        }
+        else if ((dataBytes != expected) || (hdr.samplerCount < 0))
+        {
+            con_logf(LogSev_Error, "ckpt", "Checkpoint layout does not match this build");
+        }
+        else
+        {
+            src = LoadSamplers(src, hdr.samplerCount);
+
+            src = LoadBytes(src, trace->color, sizeof(trace->color[0]), len);
+            src = LoadBytes(src, trace->albedo, sizeof(trace->albedo[0]), len);
+            src = LoadBytes(src, trace->normal, sizeof(trace->normal[0]), len);
+            src = LoadBytes(src, trace->sampleCounts, sizeof(trace->sampleCounts[0]), len);
+            src = LoadBytes(src, trace->lumM2, sizeof(trace->lumM2[0]), len);
+            src = LoadBytes(src, trace->depth, sizeof(trace->depth[0]), len);
+            src = LoadBytes(src, trace->primIds, sizeof(trace->primIds[0]), len);
+
+            trace->dofinfo = hdr.dofinfo;
+            trace->stride = 1;
+            *camera = hdr.camera;
+            *sampleCount = hdr.sampleCount;
+            loaded = true;
+        }
+    }
+    fmap_close(&map);
+
+    ProfileEnd(pm_TraceLoad);
+    return loaded;
+}
+
+ProfileMark(pm_LightmapSave, ckpt_lightmap_save)
+bool ckpt_lightmap_save(const char* name, const lmpack_t* pack)
+{
+    ASSERT(pack);
+    lmpack_stream(true);
+    const i32 lmCount = pack->lmCount;
+    const i32 lmSize = pack->lmSize;
+    if ((lmCount <= 0) || (lmSize <= 0))
+    {
+        return false;
+    }
+
+    ProfileBegin(pm_LightmapSave);
+
+    const i64 lmBytes = (i64)lightmap_texelbytes() * lmSize * lmSize;
+    const i64 frameBytes = lightmap_framebytes(lmSize);
+    const i32 samplerCount = pt_sampler_count();
+    const i64 dataBytes =
+        (i64)sizeof(dckpt_lightmap_t) +
+        (i64)sizeof(pt_sampler_t) * samplerCount +
+        (lmBytes + frameBytes) * lmCount;
+    u8* dst = BeginSave(CkptKind_Lightmap, name, dataBytes);
+    if (dst)
+    {
+        dckpt_lightmap_t hdr = { 0 };
+        hdr.lmCount = lmCount;
+        hdr.lmSize = lmSize;
+        hdr.directions = kGiDirections;
+        hdr.samplerCount = samplerCount;
+        hdr.texelsPerMeter = pack->texelsPerMeter;
+        memcpy(dst, &hdr, sizeof(hdr));
+        dst += sizeof(hdr);
+
+        dst = SaveSamplers(dst, samplerCount);
+
+        for (i32 i = 0; i < lmCount; ++i)
+        {
+            dst = SaveBytes(dst, pack->lightmaps[i].texels, 1, (i32)lmBytes);
+            dst = SaveBytes(dst, pack->lightmaps[i].tileFrames, 1, (i32)frameBytes);
+        }
+        ASSERT(dst == ms_write.data + dataBytes);
+
+        EndSave();
+    }
+
+    ProfileEnd(pm_LightmapSave);
+    return dst != NULL;
+}
+
+ProfileMark(pm_LightmapLoad, ckpt_lightmap_load)
+bool ckpt_lightmap_load(const char* name, lmpack_t* pack)
+{
+    lmpack_stream(true);
+    ASSERT(pack);
+    ProfileBegin(pm_LightmapLoad);
+
+    Retire(true);
+
+    bool loaded = false;
+    fmap_t map = OpenNewest(CkptKind_Lightmap, name);
+    if (fmap_isopen(map))
+    {
+        const u8* src = (const u8*)map.ptr + sizeof(dckpt_t);
+        const i64 dataBytes = ((const dckpt_t*)map.ptr)->dataBytes;
+        dckpt_lightmap_t hdr;
+        memcpy(&hdr, src, sizeof(hdr));
+        src += sizeof(hdr);
+
+        const i64 lmBytes = (i64)lightmap_texelbytes() * hdr.lmSize * hdr.lmSize;
+        const i64 frameBytes = (i64)sizeof(float4) * (hdr.lmSize / kLmTile) * (hdr.lmSize / kLmTile);
+        const i64 expected =
+            (i64)sizeof(hdr) +
+            (i64)sizeof(pt_sampler_t) * hdr.samplerCount +
+            (lmBytes + frameBytes) * hdr.lmCount;
+        if ((hdr.lmCount != pack->lmCount) ||
+            (hdr.lmSize != pack->lmSize) ||
+            (hdr.texelsPerMeter != pack->texelsPerMeter))
+        {
+            con_logf(LogSev_Error, "ckpt", "Checkpoint has %d lightmaps of %d at %f texels per meter, pack has %d of %d at %f",
+                hdr.lmCount, hdr.lmSize, hdr.texelsPerMeter,
+                pack->lmCount, pack->lmSize, pack->texelsPerMeter);
+        }
+        else if ((hdr.directions != kGiDirections) || (dataBytes != expected) || (hdr.samplerCount < 0))
+        {
+            con_logf(LogSev_Error, "ckpt", "Checkpoint layout does not match this build");
+        }
+        else
+        {
+            src = LoadSamplers(src, hdr.samplerCount);
+
+            for (i32 i = 0; i < hdr.lmCount; ++i)
+            {
+                src = LoadBytes(src, pack->lightmaps[i].texels, 1, (i32)lmBytes);
+                src = LoadBytes(src, pack->lightmaps[i].tileFrames, 1, (i32)frameBytes);
+                lightmap_upload(&pack->lightmaps[i]);
+            }
+            lmpack_bake_reset();
+            loaded = true;
+        }
+    }
+    fmap_close(&map);
+
+    ProfileEnd(pm_LightmapLoad);
+    return loaded;
+}
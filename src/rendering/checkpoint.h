@@ -0,0 +1,46 @@
+#pragma once
+
+#include "common/macro.h"
+
+PIM_C_BEGIN
+
+/*
+    Checkpoints of progressive accumulation state, so a crash or restart
+    does not throw away a long render or lightmap bake.
+    Saving copies the state into a staging buffer and returns; a task then
+    writes it into a memory mapped file. Each kind of state alternates
+    between two files, and a file's header is only marked complete once its
+    contents are flushed, so a checkpoint torn by a crash is skipped and the
+    previous one is resumed instead.
+*/
+
+typedef struct pt_trace_s pt_trace_t;
+typedef struct camera_s camera_t;
+typedef struct lmpack_s lmpack_t;
+
+// waits for a pending write to land
+void ckpt_flush(void);
+
+// a checkpoint is still being written, saves are refused until it lands
+bool ckpt_busy(void);
+
+// accumulation buffers, camera, sample count and sampler states of a trace.
+// 'name' identifies the scene, usually the map name.
+bool ckpt_trace_save(
+    const char* name,
+    const pt_trace_t* trace,
+    const camera_t* camera,
+    i32 sampleCount);
+// trace must already have the checkpoint's image size
+bool ckpt_trace_load(
+    const char* name,
+    pt_trace_t* trace,
+    camera_t* camera,
+    i32* sampleCount);
+
+// probes, sample counts and sampler states of a lightmap bake
+bool ckpt_lightmap_save(const char* name, const lmpack_t* pack);
+// pack must already have the checkpoint's layout (same lm_density)
+bool ckpt_lightmap_load(const char* name, lmpack_t* pack);
+
+PIM_C_END
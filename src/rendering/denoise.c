@@ -4,6 +4,12 @@
 #include "common/time.h"
 #include "common/profiler.h"
 #include "common/fnv1a.h"
+#include "allocator/allocator.h"
+#include "threading/task.h"
+#include "threading/spinlock.h"
+#include "math/float3_funcs.h"
+#include "math/float4_funcs.h"
+#include "math/float8_funcs.h"
 #include <OpenImageDenoise/oidn.h>
 #include <string.h>
 
@@ -40,6 +46,8 @@ typedef struct CacheKey_s
 #define kMaxCachedFilters 8
 
 static bool ms_once;
+// Denoise may run on a task thread while the main thread evicts filters
+static spinlock_t ms_lock;
 static oidn_t oidn;
 static OIDNDevice ms_device;
 
@@ -48,6 +56,15 @@ static u32 ms_cacheHashes[kMaxCachedFilters];
 static CacheKey ms_cacheKeys[kMaxCachedFilters];
 static OIDNFilter ms_cacheValues[kMaxCachedFilters];
 
+// a-trous scratch, kept between calls and resized when the image size
+// changes. evicted like the filters once unused for a while.
+static spinlock_t ms_atrousLock;
+static u64 ms_atrousTick;
+static i32 ms_atrousLen;
+static float4* ms_atrousA;
+static float4* ms_atrousB;
+static float4* ms_atrousNormals;
+
 static bool LogErrors(void)
 {
     bool hadError = false;
@@ -228,6 +245,230 @@ static OIDNFilter GetFilter(const CacheKey* key)
     return ms_cacheValues[i];
 }
 
+// ----------------------------------------------------------------------------
+// Edge-avoiding a-trous wavelet filter, the built in fallback for OIDN.
+// Dammertz et al 2010, https://jo.dreggn.org/home/2010_atrous.pdf
+// Color is divided by albedo before filtering so texture detail survives,
+// and each pass widens the 5x5 B3 spline kernel by spacing its taps further
+// apart while tightening the color edge stop.
+
+#define kATrousPasses 5
+#define kATrousSigmaC 1.0f
+#define kATrousSigmaN 0.3f
+#define kATrousAlbedoBias 0.01f
+
+static const float kATrousKernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+typedef struct task_ATrous
+{
+    task_t task;
+    int2 size;
+    i32 step;
+    float invVarC;
+    float invVarN;
+    float4 const *pim_noalias src;
+    float4 const *pim_noalias normals;
+    float4 *pim_noalias dst;
+} task_ATrous;
+
+// workers can still hold a pointer to a finished pass, so the pass
+// tasks live as long as the process; guarded by ms_atrousLock
+static task_ATrous ms_atrousTasks[kATrousPasses];
+
+// filters the 8 pixels of row y starting at x0.
+// when the row is narrower than 8, lanes past the end repeat the last pixel.
+static void VEC_CALL ATrousBlock(task_ATrous const *const task, i32 x0, i32 y)
+{
+    const i32 w = task->size.x;
+    const i32 h = task->size.y;
+    const i32 step = task->step;
+    float4 const *const pim_noalias src = task->src;
+    float4 const *const pim_noalias normals = task->normals;
+    const bool wide = w >= 8;
+
+    i32 indices[8];
+    for (i32 i = 0; i < 8; ++i)
+    {
+        indices[i] = y * w + i1_min(x0 + i, w - 1);
+    }
+    const float4x8 cp = f4x8_gather(src, indices);
+    const float4x8 np = f4x8_gather(normals, indices);
+    const float8 lum = f4x8_dot3(cp, f4x8_s(f4_v(0.2126f, 0.7152f, 0.0722f, 0.0f)));
+    // color distance is relative to the center's brightness, so the edge
+    // stop behaves the same in dim and bright regions of an HDR image
+    const float8 wc = f8_mulvs(
+        f8_rcp(f8_fmadd(lum, lum, f8_s(1e-2f))),
+        -task->invVarC * 1.442695f);
+    const float8 wn = f8_s(-task->invVarN * 1.442695f);
+
+    float4x8 sum = f4x8_s(f4_0);
+    float8 wsum = f8_s(0.0f);
+    for (i32 dy = -2; dy <= 2; ++dy)
+    {
+        const i32 qy = y + dy * step;
+        if (qy < 0 || qy >= h)
+        {
+            continue;
+        }
+        const float ky = kATrousKernel[dy < 0 ? -dy : dy];
+        for (i32 dx = -2; dx <= 2; ++dx)
+        {
+            const i32 ox = x0 + dx * step;
+            const float kxy = ky * kATrousKernel[dx < 0 ? -dx : dx];
+            float4x8 cq, nq;
+            float8 k;
+            if (wide && ox >= 0 && (ox + 7) < w)
+            {
+                cq = f4x8_load(src + qy * w + ox);
+                nq = f4x8_load(normals + qy * w + ox);
+                k = f8_s(kxy);
+            }
+            else
+            {
+                i32 qi[8];
+                float valid[8];
+                for (i32 i = 0; i < 8; ++i)
+                {
+                    const i32 qx = ox + i;
+                    qi[i] = qy * w + i1_clamp(qx, 0, w - 1);
+                    valid[i] = (qx >= 0 && qx < w) ? kxy : 0.0f;
+                }
+                cq = f4x8_gather(src, qi);
+                nq = f4x8_gather(normals, qi);
+                k = f8_load(valid);
+            }
+            const float4x8 dc = f4x8_sub(cq, cp);
+            const float4x8 dn = f4x8_sub(nq, np);
+            const float8 e = f8_fmadd(
+                f4x8_dot3(dc, dc), wc,
+                f8_mul(f4x8_dot3(dn, dn), wn));
+            const float8 wt = f8_mul(k, f8_exp2(e));
+            sum = f4x8_add(sum, f4x8_mulvs(cq, wt));
+            wsum = f8_add(wsum, wt);
+        }
+    }
+
+    // the center tap always has weight, so wsum > 0
+    const float4x8 result = f4x8_mulvs(sum, f8_rcp(wsum));
+    if (wide)
+    {
+        f4x8_store(task->dst + y * w + x0, result);
+    }
+    else
+    {
+        float4 tmp[8];
+        f4x8_store(tmp, result);
+        for (i32 i = 0; i < w; ++i)
+        {
+            task->dst[y * w + i] = tmp[i];
+        }
+    }
+}
+
+static void ATrousFn(void* pbase, i32 begin, i32 end)
+{
+    task_ATrous const *const task = (task_ATrous*)pbase;
+    const i32 w = task->size.x;
+    for (i32 y = begin; y < end; ++y)
+    {
+        for (i32 x = 0; x < w; x += 8)
+        {
+            // the last block shifts back to stay in bounds, refiltering
+            // a few pixels rather than taking a scalar tail
+            const i32 x0 = w >= 8 ? i1_min(x, w - 8) : 0;
+            ATrousBlock(task, x0, y);
+        }
+    }
+}
+
+ProfileMark(pm_ATrous, ATrous)
+static bool ATrous(
+    int2 size,
+    const float3* color,
+    const float3* albedo,
+    const float3* normal,
+    float3* output)
+{
+    if (!color || !output || size.x <= 0 || size.y <= 0)
+    {
+        return false;
+    }
+
+    ProfileBegin(pm_ATrous);
+
+    const i32 len = size.x * size.y;
+    spinlock_lock(&ms_atrousLock);
+    if (len != ms_atrousLen)
+    {
+        PermReserve(ms_atrousA, len);
+        PermReserve(ms_atrousB, len);
+        PermReserve(ms_atrousNormals, len);
+        ms_atrousLen = len;
+    }
+    ms_atrousTick = time_now();
+    float4* pim_noalias bufA = ms_atrousA;
+    float4* pim_noalias bufB = ms_atrousB;
+    float4* pim_noalias normals = ms_atrousNormals;
+
+    for (i32 i = 0; i < len; ++i)
+    {
+        float4 c = f3_f4(color[i], 0.0f);
+        if (albedo)
+        {
+            c = f4_div(c, f4_addvs(f3_f4(albedo[i], 1.0f), kATrousAlbedoBias));
+        }
+        bufA[i] = c;
+    }
+    if (normal)
+    {
+        for (i32 i = 0; i < len; ++i)
+        {
+            normals[i] = f3_f4(normal[i], 0.0f);
+        }
+    }
+    else
+    {
+        memset(normals, 0, sizeof(normals[0]) * len);
+    }
+
+    float sigmaC = kATrousSigmaC;
+    for (i32 pass = 0; pass < kATrousPasses; ++pass)
+    {
+        task_ATrous* task = &ms_atrousTasks[pass];
+        memset(task, 0, sizeof(*task));
+        task->size = size;
+        task->step = 1 << pass;
+        task->invVarC = 1.0f / (sigmaC * sigmaC);
+        task->invVarN = 1.0f / (kATrousSigmaN * kATrousSigmaN);
+        task->src = bufA;
+        task->normals = normals;
+        task->dst = bufB;
+        task_run(&task->task, ATrousFn, size.y);
+
+        float4* tmp = bufA;
+        bufA = bufB;
+        bufB = tmp;
+        sigmaC *= 0.5f;
+    }
+
+    for (i32 i = 0; i < len; ++i)
+    {
+        float4 c = bufA[i];
+        if (albedo)
+        {
+            c = f4_mul(c, f4_addvs(f3_f4(albedo[i], 1.0f), kATrousAlbedoBias));
+        }
+        output[i] = f4_f3(c);
+    }
+
+    spinlock_unlock(&ms_atrousLock);
+
+    ProfileEnd(pm_ATrous);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
 ProfileMark(pm_Denoise, Denoise)
 bool Denoise(
     DenoiseType type,
@@ -240,9 +481,9 @@ bool Denoise(
     ProfileBegin(pm_Denoise);
     bool success = true;
 
-    if (!EnsureInit())
+    if (type == DenoiseType_ATrous)
     {
-        success = false;
+        success = ATrous(size, color, albedo, normal, output);
         goto onreturn;
     }
 
@@ -252,6 +493,21 @@ bool Denoise(
         goto onreturn;
     }
 
+    spinlock_lock(&ms_lock);
+
+    if (!EnsureInit())
+    {
+        spinlock_unlock(&ms_lock);
+        static bool s_warned;
+        if (!s_warned)
+        {
+            s_warned = true;
+            con_logf(LogSev_Warning, "oidn", "OpenImageDenoise unavailable, using the a-trous filter");
+        }
+        success = ATrous(size, color, albedo, normal, output);
+        goto onreturn;
+    }
+
     const CacheKey key =
     {
         .type = type,
@@ -263,31 +519,55 @@ bool Denoise(
     };
 
     OIDNFilter filter = GetFilter(&key);
-    if (!filter)
-	{
-		success = false;
-        goto onreturn;
+    if (filter)
+    {
+        oidn.oidnExecuteFilter(filter);
+        success = !LogErrors();
     }
-
-    oidn.oidnExecuteFilter(filter);
-
-    if (LogErrors())
-	{
-		success = false;
-        goto onreturn;
+    else
+    {
+        success = false;
     }
 
+    spinlock_unlock(&ms_lock);
+
 onreturn:
     ProfileEnd(pm_Denoise);
     return success;
 }
 
+static void EvictATrous(void)
+{
+    // a denoise is executing, try again next frame
+    if (!spinlock_trylock(&ms_atrousLock))
+    {
+        return;
+    }
+    if (ms_atrousLen && (time_sec(time_now() - ms_atrousTick) > 5.0))
+    {
+        pim_free(ms_atrousA);
+        pim_free(ms_atrousB);
+        pim_free(ms_atrousNormals);
+        ms_atrousA = NULL;
+        ms_atrousB = NULL;
+        ms_atrousNormals = NULL;
+        ms_atrousLen = 0;
+    }
+    spinlock_unlock(&ms_atrousLock);
+}
+
 void Denoise_Evict(void)
 {
+    EvictATrous();
     if (!oidn.lib.handle)
     {
         return;
     }
+    // a denoise is executing, try again next frame
+    if (!spinlock_trylock(&ms_lock))
+    {
+        return;
+    }
 
     u64 now = time_now();
     for (i32 i = 0; i < kMaxCachedFilters; ++i)
@@ -304,4 +584,6 @@ void Denoise_Evict(void)
             }
         }
     }
+
+    spinlock_unlock(&ms_lock);
 }
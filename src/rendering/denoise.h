@@ -9,6 +9,8 @@ typedef enum
 {
     DenoiseType_Image,
     DenoiseType_Lightmap,
+    // built in edge-avoiding a-trous filter, also used when OIDN is missing
+    DenoiseType_ATrous,
 
     DenoiseType_COUNT
 } DenoiseType;
@@ -16,12 +16,15 @@
 #include "rendering/material.h"
 #include "io/fstr.h"
 #include "threading/task.h"
+#include "common/atomics.h"
 #include "assets/crate.h"
 #include "ui/cimgui_ext.h"
 #include <string.h>
 
 static drawables_t ms_drawables;
+static u32 ms_version;
 drawables_t *const drawables_get(void) { return &ms_drawables; }
+u32 drawables_version(void) { return ms_version; }
 
 void drawables_init(void)
 {
@@ -43,6 +46,7 @@ i32 drawables_add(drawables_t *const dr, guid_t name)
     const i32 back = dr->count;
     const i32 len = back + 1;
     dr->count = len;
+    ++ms_version;
 
     PermGrow(dr->names, len);
     PermGrow(dr->meshes, len);
@@ -82,6 +86,7 @@ static void RemoveAtIndex(drawables_t *const dr, i32 i)
     const i32 len = dr->count;
     dr->count = len - 1;
     ASSERT(len > 0);
+    ++ms_version;
 
     PopSwap(dr->names, i, len);
     PopSwap(dr->meshes, i, len);
@@ -120,6 +125,7 @@ void drawables_clear(drawables_t *const dr)
             DestroyAtIndex(dr, i);
         }
         dr->count = 0;
+        ++ms_version;
     }
 }
 
@@ -176,6 +182,8 @@ typedef struct task_UpdateTransforms
 {
     task_t task;
     drawables_t* dr;
+    // nonzero when any matrix changed
+    i32 changed;
 } task_UpdateTransforms;
 
 static void UpdateTransformsFn(void* pbase, i32 begin, i32 end)
@@ -188,10 +196,20 @@ static void UpdateTransformsFn(void* pbase, i32 begin, i32 end)
     float4x4 *const pim_noalias matrices = dr->matrices;
     float3x3 *const pim_noalias invMatrices = dr->invMatrices;
 
+    bool changed = false;
     for (i32 i = begin; i < end; ++i)
     {
-        matrices[i] = f4x4_trs(translations[i], rotations[i], scales[i]);
-        invMatrices[i] = f3x3_IM(matrices[i]);
+        float4x4 M = f4x4_trs(translations[i], rotations[i], scales[i]);
+        if (memcmp(&M, matrices + i, sizeof(M)))
+        {
+            changed = true;
+            matrices[i] = M;
+            invMatrices[i] = f3x3_IM(M);
+        }
+    }
+    if (changed)
+    {
+        store_i32(&task->changed, 1, MO_Relaxed);
     }
 }
 
@@ -203,6 +221,10 @@ void drawables_updatetransforms(drawables_t *const dr)
     task_UpdateTransforms *const task = tmp_calloc(sizeof(*task));
     task->dr = dr;
     task_run(task, UpdateTransformsFn, dr->count);
+    if (task->changed)
+    {
+        ++ms_version;
+    }
 
     ProfileEnd(pm_TRS);
 }
@@ -280,6 +302,7 @@ bool drawables_load(crate_t *const crate, drawables_t *const dst)
     ASSERT(dst);
     bool loaded = false;
     drawables_del(dst);
+    ++ms_version;
 
     i32 len = 0;
     if (crate_get(crate, guid_str("drawables.count"), &len, sizeof(len)) && (len > 0))
@@ -369,6 +392,7 @@ void drawables_gui(bool* enabled)
                 if (igTreeNodeStr("Material"))
                 {
                     material_t* mat = &dr->materials[iDrawable];
+                    const material_t prevMat = *mat;
 
                     char texname[PIM_PATH];
                     texture_getnamestr(mat->albedo, ARGS(texname));
@@ -404,6 +428,10 @@ void drawables_gui(bool* enabled)
 
                     igExSliderFloat("Index of Refraction", &mat->ior, 0.01f, 10.0f);
                     igExSliderFloat("Bumpiness", &mat->bumpiness, 0.0f, 10.0f);
+                    if (memcmp(&prevMat, mat, sizeof(prevMat)))
+                    {
+                        ++ms_version;
+                    }
                     igTreePop();
                 }
                 igTreePop();
@@ -45,6 +45,9 @@ void drawables_shutdown(void);
 void drawables_gui(bool* enabled);
 
 drawables_t *const drawables_get(void);
+// changes whenever a drawable is added, removed, loaded, moved or restyled,
+// so consumers can skip looking for edits while it holds still
+u32 drawables_version(void);
 
 i32 drawables_add(drawables_t *const dr, guid_t name);
 bool drawables_rm(drawables_t *const dr, guid_t name);
@@ -15,7 +15,7 @@ typedef struct task_ToLum
     float* averages;
 } task_ToLum;
 
-static void CalcAverageFn(task_t* pbase, i32 begin, i32 end)
+static void CalcAverageFn(void* pbase, i32 begin, i32 end)
 {
     task_ToLum* task = (task_ToLum*)pbase;
     float* pim_noalias averages = task->averages;
@@ -59,7 +59,7 @@ typedef struct task_Expose
     float exposure;
 } task_Expose;
 
-static void ExposeFn(task_t* pbase, i32 begin, i32 end)
+static void ExposeFn(void* pbase, i32 begin, i32 end)
 {
     task_Expose* task = (task_Expose*)pbase;
     float4* pim_noalias light = task->light;
@@ -6,9 +6,11 @@
 #include "math/float4_funcs.h"
 #include "math/float4x4_funcs.h"
 #include "math/sdf.h"
+#include "math/box.h"
 #include "math/area.h"
 #include "math/sampling.h"
 #include "math/sh.h"
+#include "math/color.h"
 #include "math/sphgauss.h"
 #include "common/console.h"
 #include "common/sort.h"
@@ -25,9 +27,11 @@
 #include "common/profiler.h"
 #include "common/cmd.h"
 #include "common/atomics.h"
+#include "common/time.h"
 #include "assets/crate.h"
 #include "io/fstr.h"
 #include <stb/stb_image_write.h>
+#include <miniz.h>
 #include <string.h>
 
 #define CHART_SPLITS    2
@@ -43,10 +47,16 @@ typedef enum
     LmChannel_COUNT
 } LmChannel;
 
+// one bit per texel, rows of u64 words
 typedef struct mask_s
 {
     int2 size;
-    u8* ptr;
+    // words per row, one more than the width needs so that 64 columns
+    // read from anywhere within the width stay inside the row
+    i32 stride;
+    u64* bits;
+    // set bits per row
+    i32* rowCounts;
 } mask_t;
 
 typedef struct chartnode_s
@@ -60,7 +70,9 @@ typedef struct chartnode_s
 
 typedef struct chart_s
 {
+    // trimmed to the chart's texels, which start at maskLo
     mask_t mask;
+    int2 maskLo;
     chartnode_t* nodes;
     i32 nodeCount;
     i32 atlasIndex;
@@ -79,43 +91,108 @@ static lmpack_t ms_pack;
 static bool ms_once;
 
 static cmdstat_t CmdPrintLm(i32 argc, const char** argv);
+static void lmdeps_snapshot(void);
+static void lmdeps_clear(void);
+static void lmstream_cancel(const lmpack_t* pack);
 
 lmpack_t* lmpack_get(void) { return &ms_pack; }
 
-void lightmap_new(lightmap_t* lm, i32 size)
+pim_inline i32 TileCount(i32 size)
 {
-    ASSERT(lm);
-    ASSERT(size > 0);
-    memset(lm, 0, sizeof(*lm));
+    return (size / kLmTile) * (size / kLmTile);
+}
 
-    lm->size = size;
+pim_inline ushort4 VEC_CALL HalfProbe(float4 probe)
+{
+    return f4_half4(f4_min(probe, f4_s(65504.0f)));
+}
 
-    const i32 texelcount = size * size;
-    i32 probesBytes = sizeof(float4) * texelcount * kGiDirections;
-    i32 positionBytes = sizeof(lm->position[0]) * texelcount;
-    i32 normalBytes = sizeof(lm->normal[0]) * texelcount;
-    i32 sampleBytes = sizeof(lm->sampleCounts[0]) * texelcount;
-    i32 texelBytes = probesBytes + sampleBytes + positionBytes + normalBytes;
-    u8* allocation = tex_calloc(texelBytes);
+i32 lightmap_texelbytes(void)
+{
+    return sizeof(lmtexel_t);
+}
 
-    for (i32 i = 0; i < kGiDirections; ++i)
+i32 lightmap_framebytes(i32 size)
+{
+    return sizeof(float4) * TileCount(size);
+}
+
+ushort4 VEC_CALL lm_probe_encode(float4 probe, float dither)
+{
+    typedef union { float f; u32 u; } f32_t;
+    const float m = f1_max(f1_max(probe.x, probe.y), probe.z);
+    // m < 2^e
+    i32 e = 0;
+    if (m > 0.0f)
     {
-        lm->probes[i] = (float4*)allocation;
-        allocation += sizeof(float4) * texelcount;
+        frexpf(m, &e);
     }
+    e = i1_clamp(e, -kLmProbeExpBias, 31 - kLmProbeExpBias);
+    const f32_t scale = { .u = (u32)(127 + 16 - e) << 23 };
+    const u32 weight = (u32)f1_clamp(probe.w * 2047.0f + dither, 0.0f, 2047.0f);
+    ushort4 q;
+    q.x = (u16)f1_clamp(probe.x * scale.f + dither, 0.0f, 65535.0f);
+    q.y = (u16)f1_clamp(probe.y * scale.f + dither, 0.0f, 65535.0f);
+    q.z = (u16)f1_clamp(probe.z * scale.f + dither, 0.0f, 65535.0f);
+    q.w = (u16)((weight << 5) | (u32)(e + kLmProbeExpBias));
+    return q;
+}
 
-    lm->position = (float3*)allocation;
-    allocation += sizeof(float3) * texelcount;
+// refits the tile's frame around the given positions of its texels and
+// requantizes them. coveredOnly: skip texels without samples, which may
+// hold no position at all.
+static void FrameTile(
+    lightmap_t* lm,
+    i32 iTile,
+    const float4* pim_noalias positions,
+    bool coveredOnly)
+{
+    const i32 tileLen = kLmTile * kLmTile;
+    lmtexel_t *const pim_noalias texels = lm->texels + iTile * tileLen;
+    float4 lo = f4_s(1 << 20);
+    float4 hi = f4_s(-(1 << 20));
+    for (i32 i = 0; i < tileLen; ++i)
+    {
+        if (!coveredOnly || (texels[i].sampleCount != 0.0f))
+        {
+            lo = f4_min(lo, positions[i]);
+            hi = f4_max(hi, positions[i]);
+        }
+    }
+    if (lo.x > hi.x)
+    {
+        lo = f4_0;
+        hi = f4_0;
+    }
+    const float step = f4_hmax3(f4_sub(hi, lo)) / 65535.0f;
+    const float rcpStep = (step > 0.0f) ? (1.0f / step) : 0.0f;
+    for (i32 i = 0; i < tileLen; ++i)
+    {
+        float4 q = f4_mulvs(f4_sub(positions[i], lo), rcpStep);
+        q = f4_clampvs(q, 0.0f, 65535.0f);
+        texels[i].position.x = (u16)(q.x + 0.5f);
+        texels[i].position.y = (u16)(q.y + 0.5f);
+        texels[i].position.z = (u16)(q.z + 0.5f);
+    }
+    lo.w = step;
+    lm->tileFrames[iTile] = lo;
+}
 
-    lm->normal = (float3*)allocation;
-    allocation += sizeof(float3) * texelcount;
+void lightmap_new(lightmap_t* lm, i32 size)
+{
+    ASSERT(lm);
+    ASSERT(size > 0);
+    ASSERT((size % kLmTile) == 0);
+    memset(lm, 0, sizeof(*lm));
 
-    lm->sampleCounts = (float*)allocation;
-    allocation += sizeof(float) * texelcount;
+    lm->size = size;
+    lm->texels = tex_calloc(sizeof(lm->texels[0]) * size * size);
+    lm->dirtyTiles = perm_calloc(sizeof(lm->dirtyTiles[0]) * TileCount(size));
+    lm->tileFrames = perm_calloc(lightmap_framebytes(size));
 
     lm->slot = vkrTexTable_Alloc(
         VK_IMAGE_VIEW_TYPE_2D_ARRAY,
-        VK_FORMAT_R32G32B32A32_SFLOAT,
+        VK_FORMAT_R16G16B16A16_SFLOAT,
         size,
         size,
         1,
@@ -130,7 +207,9 @@ void lightmap_del(lightmap_t* lm)
     if (lm)
     {
         vkrTexTable_Free(lm->slot);
-        pim_free(lm->probes[0]);
+        pim_free(lm->texels);
+        pim_free(lm->dirtyTiles);
+        pim_free(lm->tileFrames);
         memset(lm, 0, sizeof(*lm));
     }
 }
@@ -138,11 +217,110 @@ void lightmap_del(lightmap_t* lm)
 void lightmap_upload(lightmap_t* lm)
 {
     ASSERT(lm);
-    const i32 len = lm->size * lm->size;
+    const i32 size = lm->size;
+    const i32 len = size * size;
+    const lmtexel_t* pim_noalias texels = lm->texels;
+    memset(lm->dirtyTiles, 0, sizeof(lm->dirtyTiles[0]) * TileCount(size));
+    // the upload copies out of this before returning
+    ushort4* pim_noalias rows = tmp_malloc(sizeof(rows[0]) * len);
+    for (i32 i = 0; i < kGiDirections; ++i)
+    {
+        for (i32 iTexel = 0; iTexel < len; ++iTexel)
+        {
+            const int2 c = lm_coord(size, iTexel);
+            rows[c.x + c.y * size] = HalfProbe(lm_probe_decode(texels[iTexel].probes[i]));
+        }
+        vkrTexTable_Upload(lm->slot, i, rows, sizeof(rows[0]) * len);
+    }
+}
+
+ProfileMark(pm_UploadDirty, lightmap_upload_dirty)
+i32 lightmap_upload_dirty(lightmap_t* lm)
+{
+    ASSERT(lm);
+    const i32 size = lm->size;
+    const i32 tilesPerRow = size / kLmTile;
+    const i32 tileLen = kLmTile * kLmTile;
+    i32 *const pim_noalias dirtyTiles = lm->dirtyTiles;
+
+    // merge runs of dirty tiles along each row of tiles into one rect
+    i32 rectCount = 0;
+    i32 tileCount = 0;
+    int4* pim_noalias rects = tmp_malloc(sizeof(rects[0]) * tilesPerRow * ((tilesPerRow + 1) / 2));
+    for (i32 ty = 0; ty < tilesPerRow; ++ty)
+    {
+        i32* pim_noalias row = dirtyTiles + ty * tilesPerRow;
+        for (i32 tx = 0; tx < tilesPerRow; ++tx)
+        {
+            if (!load_i32(row + tx, MO_Relaxed))
+            {
+                continue;
+            }
+            i32 run = 0;
+            while (((tx + run) < tilesPerRow) && load_i32(row + tx + run, MO_Relaxed))
+            {
+                store_i32(row + tx + run, 0, MO_Relaxed);
+                ++run;
+            }
+            const int4 rect = { tx * kLmTile, ty * kLmTile, run * kLmTile, kLmTile };
+            rects[rectCount++] = rect;
+            tileCount += run;
+            tx += run;
+        }
+    }
+    if (rectCount == 0)
+    {
+        return 0;
+    }
+
+    ProfileBegin(pm_UploadDirty);
+
+    const lmtexel_t* pim_noalias texels = lm->texels;
+    const i32 bytes = sizeof(ushort4) * tileLen * tileCount * kGiDirections;
+    ushort4* pim_noalias halfs = tmp_malloc(bytes);
+    i32 j = 0;
+    for (i32 i = 0; i < kGiDirections; ++i)
+    {
+        for (i32 iRect = 0; iRect < rectCount; ++iRect)
+        {
+            const int4 rect = rects[iRect];
+            for (i32 y = rect.y; y < rect.y + rect.w; ++y)
+            {
+                for (i32 x = rect.x; x < rect.x + rect.z; ++x)
+                {
+                    halfs[j++] = HalfProbe(lm_probe_decode(texels[lm_index(size, x, y)].probes[i]));
+                }
+            }
+        }
+    }
+    ASSERT(j * (i32)sizeof(halfs[0]) == bytes);
+    vkrTexTable_UploadRegions(lm->slot, 0, kGiDirections, rects, rectCount, halfs, bytes);
+
+    ProfileEnd(pm_UploadDirty);
+    return bytes;
+}
+
+void lightmap_sample(const lightmap_t* lm, float2 uv, float4* probesOut)
+{
+    const i32 size = lm->size;
+    const int2 size2 = i2_s(size);
+    const bilinear_t b = BilinearClamp(size2, uv);
+    const int2 ca = IndexToCoord(size2, b.a);
+    const int2 cb = IndexToCoord(size2, b.b);
+    const int2 cc = IndexToCoord(size2, b.c);
+    const int2 cd = IndexToCoord(size2, b.d);
+    const lmtexel_t* pim_noalias ta = lm->texels + lm_index(size, ca.x, ca.y);
+    const lmtexel_t* pim_noalias tb = lm->texels + lm_index(size, cb.x, cb.y);
+    const lmtexel_t* pim_noalias tc = lm->texels + lm_index(size, cc.x, cc.y);
+    const lmtexel_t* pim_noalias td = lm->texels + lm_index(size, cd.x, cd.y);
     for (i32 i = 0; i < kGiDirections; ++i)
     {
-        const float4* pim_noalias probes = lm->probes[i];
-        vkrTexTable_Upload(lm->slot, i, probes, sizeof(probes[0]) * len);
+        probesOut[i] = BilinearBlend_f4(
+            lm_probe_decode(ta->probes[i]),
+            lm_probe_decode(tb->probes[i]),
+            lm_probe_decode(tc->probes[i]),
+            lm_probe_decode(td->probes[i]),
+            b.frac);
     }
 }
 
@@ -175,58 +353,67 @@ pim_inline void chartnode_sort(chartnode_t* nodes, i32 count)
 
 pim_inline mask_t VEC_CALL mask_new(int2 size)
 {
-    i32 len = size.x * size.y;
     mask_t mask;
     mask.size = size;
-    mask.ptr = perm_calloc(sizeof(u8) * len);
+    mask.stride = ((size.x + 63) >> 6) + 1;
+    mask.bits = perm_calloc(sizeof(mask.bits[0]) * mask.stride * size.y);
+    mask.rowCounts = perm_calloc(sizeof(mask.rowCounts[0]) * size.y);
     return mask;
 }
 
 pim_inline void VEC_CALL mask_del(mask_t* mask)
 {
-    pim_free(mask->ptr);
-    mask->ptr = NULL;
+    pim_free(mask->bits);
+    pim_free(mask->rowCounts);
+    mask->bits = NULL;
+    mask->rowCounts = NULL;
     mask->size.x = 0;
     mask->size.y = 0;
+    mask->stride = 0;
 }
 
-pim_inline float4 VEC_CALL norm_blend(float4 A, float4 B, float4 C, float4 wuv)
+pim_inline bool VEC_CALL mask_get(mask_t mask, i32 x, i32 y)
 {
-    float4 N = f4_blend(A, B, C, wuv);
-    return f4_normalize3(N);
+    return (mask.bits[y * mask.stride + (x >> 6)] >> (x & 63)) & 1;
 }
 
-pim_inline float2 VEC_CALL lm_blend(float3 a, float3 b, float3 c, float4 wuv)
+pim_inline void VEC_CALL mask_set(mask_t mask, i32 x, i32 y)
 {
-    float3 lm3 = f3_blend(a, b, c, wuv);
-    float2 lm = { lm3.x, lm3.y };
-    return lm;
+    u64* word = mask.bits + y * mask.stride + (x >> 6);
+    const u64 bit = 1ull << (x & 63);
+    if (!(*word & bit))
+    {
+        *word |= bit;
+        mask.rowCounts[y]++;
+    }
+}
+
+// the 64 columns of a row starting at column x
+pim_inline u64 mask_window(const u64* pim_noalias row, i32 x)
+{
+    const i32 w = x >> 6;
+    const i32 s = x & 63;
+    u64 window = row[w] >> s;
+    if (s)
+    {
+        window |= row[w + 1] << (64 - s);
+    }
+    return window;
 }
 
+// b is trimmed and placed at tr, entirely within a
 pim_inline bool VEC_CALL mask_fits(mask_t a, mask_t b, int2 tr)
 {
+    const i32 words = b.stride - 1;
     for (i32 by = 0; by < b.size.y; ++by)
     {
-        for (i32 bx = 0; bx < b.size.x; ++bx)
+        const u64* pim_noalias aRow = a.bits + (by + tr.y) * a.stride;
+        const u64* pim_noalias bRow = b.bits + by * b.stride;
+        for (i32 j = 0; j < words; ++j)
         {
-            i32 bi = bx + by * b.size.x;
-            if (b.ptr[bi])
+            if (bRow[j] & mask_window(aRow, tr.x + (j << 6)))
             {
-                i32 ax = bx + tr.x;
-                i32 ay = by + tr.y;
-                if (ax < 0 || ay < 0)
-                {
-                    return false;
-                }
-                if (ax >= a.size.x || ay >= a.size.y)
-                {
-                    return false;
-                }
-                i32 ai = ax + ay * a.size.x;
-                if (a.ptr[ai])
-                {
-                    return false;
-                }
+                return false;
             }
         }
     }
@@ -235,27 +422,45 @@ pim_inline bool VEC_CALL mask_fits(mask_t a, mask_t b, int2 tr)
 
 pim_inline void VEC_CALL mask_write(mask_t a, mask_t b, int2 tr)
 {
+    ASSERT(tr.x >= 0);
+    ASSERT(tr.y >= 0);
+    ASSERT((tr.x + b.size.x) <= a.size.x);
+    ASSERT((tr.y + b.size.y) <= a.size.y);
+    const i32 words = b.stride - 1;
     for (i32 by = 0; by < b.size.y; ++by)
     {
-        for (i32 bx = 0; bx < b.size.x; ++bx)
+        u64* pim_noalias aRow = a.bits + (by + tr.y) * a.stride;
+        const u64* pim_noalias bRow = b.bits + by * b.stride;
+        for (i32 j = 0; j < words; ++j)
         {
-            i32 bi = bx + by * b.size.x;
-            if (b.ptr[bi])
+            const u64 word = bRow[j];
+            const i32 x = tr.x + (j << 6);
+            const i32 w = x >> 6;
+            const i32 s = x & 63;
+            ASSERT(!(word & mask_window(aRow, x)));
+            aRow[w] |= word << s;
+            if (s)
             {
-                i32 ax = bx + tr.x;
-                i32 ay = by + tr.y;
-                i32 ai = ax + ay * a.size.x;
-                ASSERT(ax >= 0);
-                ASSERT(ay >= 0);
-                ASSERT(ax < a.size.x);
-                ASSERT(ay < a.size.y);
-                ASSERT(!a.ptr[ai]);
-                a.ptr[ai] = b.ptr[bi];
+                aRow[w + 1] |= word >> (64 - s);
             }
         }
+        a.rowCounts[by + tr.y] += b.rowCounts[by];
     }
 }
 
+pim_inline float4 VEC_CALL norm_blend(float4 A, float4 B, float4 C, float4 wuv)
+{
+    float4 N = f4_blend(A, B, C, wuv);
+    return f4_normalize3(N);
+}
+
+pim_inline float2 VEC_CALL lm_blend(float3 a, float3 b, float3 c, float4 wuv)
+{
+    float3 lm3 = f3_blend(a, b, c, wuv);
+    float2 lm = { lm3.x, lm3.y };
+    return lm;
+}
+
 pim_inline int2 VEC_CALL tri_size(tri2d_t tri)
 {
     float2 hi = f2_max(f2_max(tri.a, tri.b), tri.c);
@@ -286,43 +491,84 @@ pim_inline bool VEC_CALL TriTest(tri2d_t tri, float2 pt)
 
 pim_inline void VEC_CALL mask_tri(mask_t mask, tri2d_t tri)
 {
-    const int2 size = mask.size;
-    for (i32 y = 0; y < size.y; ++y)
+    // TriTest rejects texels more than twice its threshold away
+    const float2 triLo = f2_min(f2_min(tri.a, tri.b), tri.c);
+    const float2 triHi = f2_max(f2_max(tri.a, tri.b), tri.c);
+    const int2 lo = i2_max(f2_i2(f2_floor(f2_subvs(triLo, 5.0f))), i2_s(0));
+    const int2 hi = i2_min(f2_i2(f2_ceil(f2_addvs(triHi, 5.0f))), mask.size);
+    for (i32 y = lo.y; y < hi.y; ++y)
     {
-        for (i32 x = 0; x < size.x; ++x)
+        for (i32 x = lo.x; x < hi.x; ++x)
         {
-            const i32 i = x + y * size.x;
             float2 pt = { (float)x, (float)y };
-            if (TriTest(tri, pt))
+            if (!mask_get(mask, x, y) && TriTest(tri, pt))
             {
-                mask.ptr[i] = 0xff;
+                mask_set(mask, x, y);
             }
         }
     }
 }
 
-pim_inline mask_t VEC_CALL mask_fromtri(tri2d_t tri)
-{
-    int2 size = tri_size(tri);
-    size.x += 2;
-    size.y += 2;
-    mask_t mask = mask_new(size);
-    mask_tri(mask, tri);
-    return mask;
-}
-
-pim_inline bool VEC_CALL mask_find(mask_t atlas, mask_t item, int2* trOut, i32 prevRow)
+// shrinks a mask to the bounds of its set bits, which start at loOut
+pim_inline mask_t VEC_CALL mask_trim(mask_t mask, int2* loOut)
 {
-    int2 lo = i2_addvs(i2_neg(item.size), 1);
-    int2 hi = i2_subvs(atlas.size, 1);
-    i32 y = lo.y;
-    if (prevRow != ROW_RESET)
+    int2 lo = mask.size;
+    int2 hi = i2_s(0);
+    for (i32 y = 0; y < mask.size.y; ++y)
+    {
+        if (mask.rowCounts[y])
+        {
+            lo.y = i1_min(lo.y, y);
+            hi.y = y + 1;
+            for (i32 x = 0; x < mask.size.x; ++x)
+            {
+                if (mask_get(mask, x, y))
+                {
+                    lo.x = i1_min(lo.x, x);
+                    hi.x = i1_max(hi.x, x + 1);
+                }
+            }
+        }
+    }
+    if ((hi.x <= lo.x) || (hi.y <= lo.y))
     {
-        y = prevRow;
+        *loOut = i2_s(0);
+        return mask_new(i2_s(1));
     }
-    for (; y < hi.y; ++y)
+
+    mask_t trimmed = mask_new(i2_sub(hi, lo));
+    for (i32 y = lo.y; y < hi.y; ++y)
     {
         for (i32 x = lo.x; x < hi.x; ++x)
+        {
+            if (mask_get(mask, x, y))
+            {
+                mask_set(trimmed, x - lo.x, y - lo.y);
+            }
+        }
+    }
+    *loOut = lo;
+    return trimmed;
+}
+
+// first fit, by row then column, of a trimmed mask at or below row y
+pim_inline bool VEC_CALL mask_find(mask_t atlas, mask_t item, int2* trOut, i32 y)
+{
+    const int2 hi = i2_sub(atlas.size, item.size);
+    const i32 width = atlas.size.x;
+    for (y = i1_max(y, 0); y <= hi.y; ++y)
+    {
+        // skip rows without enough free texels for the item's rows
+        bool roomy = true;
+        for (i32 r = 0; roomy && (r < item.size.y); ++r)
+        {
+            roomy = (width - atlas.rowCounts[y + r]) >= item.rowCounts[r];
+        }
+        if (!roomy)
+        {
+            continue;
+        }
+        for (i32 x = 0; x <= hi.x; ++x)
         {
             int2 tr = { x, y };
             if (mask_fits(atlas, item, tr))
@@ -578,7 +824,7 @@ typedef struct chartmask_s
     i32 chartCount;
 } chartmask_t;
 
-static void ChartMaskFn(task_t* pbase, i32 begin, i32 end)
+static void ChartMaskFn(void* pbase, i32 begin, i32 end)
 {
     chartmask_t* task = (chartmask_t*)pbase;
     chart_t* charts = task->charts;
@@ -604,12 +850,14 @@ static void ChartMaskFn(task_t* pbase, i32 begin, i32 end)
         chart.area = size.x * size.y;
         hi = f2_addvs(hi, 2.0f);
 
-        chart.mask = mask_new(f2_i2(hi));
+        mask_t mask = mask_new(f2_i2(hi));
         for (i32 iNode = 0; iNode < chart.nodeCount; ++iNode)
         {
             tri2d_t tri = chart.nodes[iNode].triCoord;
-            mask_tri(chart.mask, tri);
+            mask_tri(mask, tri);
         }
+        chart.mask = mask_trim(mask, &chart.maskLo);
+        mask_del(&mask);
 
         charts[i] = chart;
     }
@@ -748,16 +996,21 @@ static bool atlas_search(
     {
         atlas_t* pim_noalias atlas = atlases + i;
     retry:
-        if (mask_find(atlas->mask, chart->mask, &tr, *prevRow))
+        // rows are tracked as the chart's untrimmed translation
+        if (mask_find(
+            atlas->mask,
+            chart->mask,
+            &tr,
+            (*prevRow != ROW_RESET) ? (*prevRow + chart->maskLo.y) : 0))
         {
             *prevAtlas = i;
-            *prevRow = tr.y;
+            *prevRow = tr.y - chart->maskLo.y;
             spinlock_lock(&atlas->mtx);
             bool fits = mask_fits(atlas->mask, chart->mask, tr);
             if (fits)
             {
                 mask_write(atlas->mask, chart->mask, tr);
-                chart->translation = tr;
+                chart->translation = i2_sub(tr, chart->maskLo);
                 chart->atlasIndex = i;
                 atlas->chartCount++;
             }
@@ -837,7 +1090,7 @@ typedef struct atlastask_s
     atlas_t* atlases;
 } atlastask_t;
 
-static void AtlasFn(task_t* pbase, i32 begin, i32 end)
+static void AtlasFn(void* pbase, i32 begin, i32 end)
 {
     atlastask_t* task = (atlastask_t*)pbase;
     chart_t* pim_noalias charts = task->charts;
@@ -993,15 +1246,46 @@ static void chartnodes_assign(
     }
 }
 
-typedef struct quadtree_s
+#define kUvCellDepth    5
+#define kUvBins         16
+#define kUvLeafSize     4
+#define kUvMaxDepth     48
+
+// cells of a fixed depth quadtree over atlas space.
+// each triangle belongs to the deepest cell holding it, and a texel only
+// considers the triangles of cells that hold it.
+typedef struct uvcells_s
+{
+    i32 nodeCount;
+    box2d_t* pim_noalias boxes;         // bounding box of cell
+    box2d_t* pim_noalias clipped;       // box clipped by every ancestor
+    i32* pim_noalias ranks;             // preorder index, breaks ties
+} uvcells_t;
+
+typedef struct uvprim_s
+{
+    // cell of the triangle clipped to the search limit around it
+    box2d_t bounds;
+    tri2d_t tri;                        // lightmap UV
+    int2 ind;                           // iDrawable, iVert
+    u64 order;                          // cell rank, then insertion order
+} uvprim_t;
+
+typedef struct uvnode_s
+{
+    box2d_t bounds;
+    i32 begin;                          // first child, or first prim of a leaf
+    i32 count;                          // prims in a leaf, 0 for inner nodes
+} uvnode_t;
+
+// 2D BVH over the triangles of one lightmap
+typedef struct uvbvh_s
 {
-    i32 maxDepth;
+    uvnode_t* pim_noalias nodes;
+    uvprim_t* pim_noalias prims;
     i32 nodeCount;
-    box2d_t* pim_noalias boxes;         // bounding box of node
-    i32* pim_noalias listLens;          // number of triangles in this node
-    tri2d_t** pim_noalias triLists;     // lightmap UV
-    int2** pim_noalias indexLists;      // iDrawable, iVert
-} quadtree_t;
+    i32 primCount;
+} uvbvh_t;
 
 pim_inline i32 CalcNodeCount(i32 maxDepth)
 {
@@ -1023,6 +1307,40 @@ pim_inline i32 GetParent(i32 c)
     return (c - 1) >> 2;
 }
 
+pim_inline float VEC_CALL f2_axis(float2 v, i32 axis)
+{
+    return axis ? v.y : v.x;
+}
+
+pim_inline box2d_t VEC_CALL box2d_empty(void)
+{
+    box2d_t box = { f2_s(1 << 20), f2_s(-(1 << 20)) };
+    return box;
+}
+
+pim_inline box2d_t VEC_CALL box2d_union(box2d_t lhs, box2d_t rhs)
+{
+    box2d_t box = { f2_min(lhs.lo, rhs.lo), f2_max(lhs.hi, rhs.hi) };
+    return box;
+}
+
+pim_inline box2d_t VEC_CALL box2d_intersect(box2d_t lhs, box2d_t rhs)
+{
+    box2d_t box = { f2_max(lhs.lo, rhs.lo), f2_min(lhs.hi, rhs.hi) };
+    return box;
+}
+
+pim_inline float2 VEC_CALL box2d_center(box2d_t box)
+{
+    return f2_lerp(box.lo, box.hi, 0.5f);
+}
+
+pim_inline float VEC_CALL box2d_area(box2d_t box)
+{
+    float2 size = f2_max(f2_sub(box.hi, box.lo), f2_0);
+    return size.x * size.y;
+}
+
 static void SetupBounds(box2d_t* pim_noalias boxes, i32 p, i32 nodeCount)
 {
     const i32 c0 = GetChild(p, 0);
@@ -1049,37 +1367,49 @@ static void SetupBounds(box2d_t* pim_noalias boxes, i32 p, i32 nodeCount)
     }
 }
 
-pim_inline void quadtree_new(quadtree_t* qt, i32 maxDepth, box2d_t bounds)
+static void SetupCells(uvcells_t* pim_noalias cells, i32 n, i32* pim_noalias rank)
+{
+    if (n < cells->nodeCount)
+    {
+        cells->ranks[n] = *rank;
+        *rank += 1;
+        box2d_t clipped = cells->boxes[n];
+        if (n > 0)
+        {
+            clipped = box2d_intersect(clipped, cells->clipped[GetParent(n)]);
+        }
+        cells->clipped[n] = clipped;
+        for (i32 i = 0; i < 4; ++i)
+        {
+            SetupCells(cells, GetChild(n, i), rank);
+        }
+    }
+}
+
+static void uvcells_new(uvcells_t* cells, i32 maxDepth, box2d_t bounds)
 {
     i32 len = CalcNodeCount(maxDepth);
-    qt->maxDepth = maxDepth;
-    qt->nodeCount = len;
-    qt->boxes = perm_calloc(sizeof(qt->boxes[0]) * len);
-    qt->listLens = perm_calloc(sizeof(qt->listLens[0]) * len);
-    qt->triLists = perm_calloc(sizeof(qt->triLists[0]) * len);
-    qt->indexLists = perm_calloc(sizeof(qt->indexLists[0]) * len);
+    cells->nodeCount = len;
+    cells->boxes = perm_calloc(sizeof(cells->boxes[0]) * len);
+    cells->clipped = perm_calloc(sizeof(cells->clipped[0]) * len);
+    cells->ranks = perm_calloc(sizeof(cells->ranks[0]) * len);
     if (len > 0)
     {
-        qt->boxes[0] = bounds;
-        SetupBounds(qt->boxes, 0, len);
+        cells->boxes[0] = bounds;
+        SetupBounds(cells->boxes, 0, len);
+        i32 rank = 0;
+        SetupCells(cells, 0, &rank);
     }
 }
 
-pim_inline void quadtree_del(quadtree_t* qt)
+static void uvcells_del(uvcells_t* cells)
 {
-    if (qt)
+    if (cells)
     {
-        pim_free(qt->boxes);
-        pim_free(qt->listLens);
-        i32 len = qt->nodeCount;
-        for (i32 i = 0; i < len; ++i)
-        {
-            pim_free(qt->triLists[i]);
-            pim_free(qt->indexLists[i]);
-        }
-        pim_free(qt->triLists);
-        pim_free(qt->indexLists);
-        memset(qt, 0, sizeof(*qt));
+        pim_free(cells->boxes);
+        pim_free(cells->clipped);
+        pim_free(cells->ranks);
+        memset(cells, 0, sizeof(*cells));
     }
 }
 
@@ -1097,203 +1427,436 @@ pim_inline bool VEC_CALL BoxHoldsPt(box2d_t box, float2 pt)
     return b2_all(b2_and(f2_gteq(pt, box.lo), f2_lteq(pt, box.hi)));
 }
 
-static bool quadtree_insert(quadtree_t* pim_noalias qt, i32 n, tri2d_t tri, i32 iDrawable, i32 iVert)
+// sdTriangle2D loses its sign on zero area triangles and reports 0 everywhere,
+// so those can be picked anywhere in their cell
+pim_inline bool VEC_CALL TriIsSliver(tri2d_t tri)
 {
-    if (n < qt->nodeCount)
+    float2 ba = f2_sub(tri.b, tri.a);
+    float2 ac = f2_sub(tri.a, tri.c);
+    float cross = ba.x * ac.y - ba.y * ac.x;
+    float scale = f2_dot(ba, ba) + f2_dot(ac, ac);
+    return !(f1_abs(cross) > scale * 1e-5f);
+}
+
+// deepest cell holding the triangle, or -1
+static i32 FindCell(const uvcells_t* cells, i32 n, tri2d_t tri)
+{
+    if ((n < cells->nodeCount) && BoxHoldsTri(cells->boxes[n], tri))
     {
-        if (BoxHoldsTri(qt->boxes[n], tri))
+        for (i32 i = 0; i < 4; ++i)
         {
-            for (i32 i = 0; i < 4; ++i)
+            i32 cell = FindCell(cells, GetChild(n, i), tri);
+            if (cell >= 0)
             {
-                if (quadtree_insert(qt, GetChild(n, i), tri, iDrawable, iVert))
-                {
-                    return true;
-                }
+                return cell;
             }
-            i32 len = qt->listLens[n] + 1;
-            qt->listLens[n] = len;
-            PermReserve(qt->triLists[n], len);
-            qt->triLists[n][len - 1] = tri;
-            PermReserve(qt->indexLists[n], len);
-            qt->indexLists[n][len - 1] = i2_v(iDrawable, iVert);
-            return true;
         }
+        return n;
     }
-    return false;
+    return -1;
 }
 
-static float quadtree_find(
-    const quadtree_t* qt,
-    i32 n,
-    float2 pt,
-    float limit,
-    int2* pim_noalias indOut)
+static void uvbvh_split(uvbvh_t* pim_noalias bvh, i32 n, i32 begin, i32 end, i32 depth)
 {
-    if (n < qt->nodeCount)
+    uvprim_t* pim_noalias prims = bvh->prims;
+    box2d_t bounds = box2d_empty();
+    box2d_t centers = box2d_empty();
+    for (i32 i = begin; i < end; ++i)
+    {
+        bounds = box2d_union(bounds, prims[i].bounds);
+        float2 center = box2d_center(prims[i].bounds);
+        centers.lo = f2_min(centers.lo, center);
+        centers.hi = f2_max(centers.hi, center);
+    }
+
+    const i32 count = end - begin;
+    bvh->nodes[n].bounds = bounds;
+    bvh->nodes[n].begin = begin;
+    bvh->nodes[n].count = count;
+    if ((count <= kUvLeafSize) || (depth >= kUvMaxDepth))
+    {
+        return;
+    }
+
+    // binned SAH, by area rather than perimeter since queries are points
+    i32 bestAxis = -1;
+    i32 bestBin = -1;
+    float bestCost = count * box2d_area(bounds);
+    for (i32 axis = 0; axis < 2; ++axis)
     {
-        if (BoxHoldsPt(qt->boxes[n], pt))
+        const float lo = f2_axis(centers.lo, axis);
+        const float extent = f2_axis(centers.hi, axis) - lo;
+        if (!(extent > 0.0f))
         {
-            i32 chosen = -1;
-            float chosenDist = limit;
-            i32 len = qt->listLens[n];
-            const tri2d_t* triList = qt->triLists[n];
-            for (i32 i = 0; i < len; ++i)
-            {
-                tri2d_t tri = triList[i];
-                float dist = sdTriangle2D(tri.a, tri.b, tri.c, pt);
-                if (dist < chosenDist)
-                {
-                    chosenDist = dist;
-                    chosen = i;
-                }
-            }
+            continue;
+        }
+        const float scale = kUvBins / extent;
+
+        i32 binCounts[kUvBins] = { 0 };
+        box2d_t binBoxes[kUvBins];
+        for (i32 i = 0; i < kUvBins; ++i)
+        {
+            binBoxes[i] = box2d_empty();
+        }
+        for (i32 i = begin; i < end; ++i)
+        {
+            float c = f2_axis(box2d_center(prims[i].bounds), axis);
+            i32 bin = i1_clamp((i32)((c - lo) * scale), 0, kUvBins - 1);
+            binCounts[bin] += 1;
+            binBoxes[bin] = box2d_union(binBoxes[bin], prims[i].bounds);
+        }
 
-            int2 ind = { -1, -1 };
-            if (chosenDist < limit)
+        float rightCosts[kUvBins] = { 0 };
+        {
+            box2d_t box = box2d_empty();
+            i32 right = 0;
+            for (i32 i = kUvBins - 1; i > 0; --i)
             {
-                limit = chosenDist;
-                ind = qt->indexLists[n][chosen];
+                box = box2d_union(box, binBoxes[i]);
+                right += binCounts[i];
+                rightCosts[i] = right * box2d_area(box);
             }
-
-            for (i32 i = 0; i < 4; ++i)
+        }
+        {
+            box2d_t box = box2d_empty();
+            i32 left = 0;
+            for (i32 i = 0; (i + 1) < kUvBins; ++i)
             {
-                int2 childInd = { -1, -1 };
-                float childDist = quadtree_find(qt, GetChild(n, i), pt, limit, &childInd);
-                if (childDist < limit)
+                box = box2d_union(box, binBoxes[i]);
+                left += binCounts[i];
+                if ((left == 0) || (left == count))
                 {
-                    limit = childDist;
-                    ind = childInd;
+                    continue;
+                }
+                float cost = box2d_area(bounds) + left * box2d_area(box) + rightCosts[i + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = i;
                 }
             }
-            *indOut = ind;
         }
     }
-    return limit;
-}
-
-typedef struct embed_s
-{
-    task_t task;
-    lightmap_t* lightmaps;
-    const quadtree_t* trees;
-    i32 lmCount;
-    float texelsPerMeter;
-} embed_t;
-
-static void EmbedAttributesFn(void *const pbase, i32 begin, i32 end)
-{
-    embed_t *const task = pbase;
-    lightmap_t *const pim_noalias lightmaps = task->lightmaps;
-    const quadtree_t* pim_noalias trees = task->trees;
-    const i32 lmCount = task->lmCount;
-    const float texelsPerMeter = task->texelsPerMeter;
-    const float metersPerTexel = 1.0f / texelsPerMeter;
-    const i32 lmSize = lightmaps[0].size;
-    const i32 lmLen = lmSize * lmSize;
-    const int2 size = { lmSize, lmSize };
-    const float limit = 4.0f / lmSize;
-
-    drawables_t const *const drawables = drawables_get();
-    const i32 drawablesCount = drawables->count;
-    meshid_t const *const pim_noalias meshids = drawables->meshes;
-    float4x4 const *const pim_noalias matrices = drawables->matrices;
-    float3x3 const *const pim_noalias invMatrices = drawables->invMatrices;
 
-    for (i32 iWork = begin; iWork < end; ++iWork)
+    if (bestAxis < 0)
     {
-        const i32 iLightmap = iWork / lmLen;
-        const i32 iTexel = iWork % lmLen;
-        const i32 x = iTexel % lmSize;
-        const i32 y = iTexel / lmSize;
-        const float2 uv = CoordToUv(size, i2_v(x, y));
-        lightmap_t lightmap = lightmaps[iLightmap];
-        const quadtree_t* qt = trees + iLightmap;
-
-        lightmap.sampleCounts[iTexel] = 0.0f;
+        return;
+    }
 
-        int2 ind;
-        float dist = quadtree_find(qt, 0, uv, limit, &ind);
-        if ((dist < limit) && (ind.x != -1) && (ind.y != -1))
+    i32 mid = begin;
+    {
+        const float lo = f2_axis(centers.lo, bestAxis);
+        const float scale = kUvBins / (f2_axis(centers.hi, bestAxis) - lo);
+        i32 back = end - 1;
+        while (mid <= back)
         {
-            i32 iDraw = ind.x;
-            i32 iVert = ind.y;
-
-            mesh_t const *const mesh = mesh_get(meshids[iDraw]);
-            if (!mesh)
+            float c = f2_axis(box2d_center(prims[mid].bounds), bestAxis);
+            i32 bin = i1_clamp((i32)((c - lo) * scale), 0, kUvBins - 1);
+            if (bin <= bestBin)
             {
-                continue;
+                ++mid;
             }
-
-            float4 const *const pim_noalias positions = mesh->positions;
-            float4 const *const pim_noalias normals = mesh->normals;
-            float4 const *const pim_noalias uvs = mesh->uvs;
-
-            const i32 a = iVert + 0;
-            const i32 b = iVert + 1;
-            const i32 c = iVert + 2;
-            ASSERT(c < mesh->length);
-            ASSERT((i32)mesh->normals[a].w == iLightmap);
-
-            float2 LMA = f2_v(uvs[a].z, uvs[a].w);
-            float2 LMB = f2_v(uvs[b].z, uvs[b].w);
-            float2 LMC = f2_v(uvs[c].z, uvs[c].w);
-            float area = sdEdge2D(LMA, LMB, LMC);
-            if (area <= 0.0f)
+            else
             {
-                continue;
+                uvprim_t tmp = prims[mid];
+                prims[mid] = prims[back];
+                prims[back] = tmp;
+                --back;
             }
-
-            const float rcpArea = 1.0f / area;
-            float4 wuv = bary2D(LMA, LMB, LMC, rcpArea, uv);
-            wuv = f4_clampvs(wuv, 0.0f, 1.0f);
-            wuv = f4_divvs(wuv, f4_sum3(wuv));
-
-            const float4x4 M = matrices[iDraw];
-            const float3x3 IM = invMatrices[iDraw];
-
-            float4 A = f4x4_mul_pt(M, positions[a]);
-            float4 B = f4x4_mul_pt(M, positions[b]);
-            float4 C = f4x4_mul_pt(M, positions[c]);
-            float4 P = f4_blend(A, B, C, wuv);
-
-            float4 NA = f3x3_mul_col(IM, normals[a]);
-            float4 NB = f3x3_mul_col(IM, normals[a]);
-            float4 NC = f3x3_mul_col(IM, normals[a]);
-
-            NA = f4_normalize3(NA);
-            NB = f4_normalize3(NB);
-            NC = f4_normalize3(NC);
-            float4 N = f4_blend(NA, NB, NC, wuv);
-            N = f4_normalize3(N);
-
-            lightmap.position[iTexel] = f4_f3(P);
-            lightmap.normal[iTexel] = f4_f3(N);
-            lightmap.sampleCounts[iTexel] = 1.0f;
         }
     }
+    ASSERT(mid > begin);
+    ASSERT(mid < end);
+
+    const i32 children = bvh->nodeCount;
+    bvh->nodeCount += 2;
+    bvh->nodes[n].begin = children;
+    bvh->nodes[n].count = 0;
+    uvbvh_split(bvh, children + 0, begin, mid, depth + 1);
+    uvbvh_split(bvh, children + 1, mid, end, depth + 1);
 }
 
-static void EmbedAttributes(
-    lightmap_t* lightmaps,
-    i32 lmCount,
-    float texelsPerMeter)
+// prims hold tri and ind, order holds the insertion order
+static void uvbvh_new(uvbvh_t* bvh, const uvcells_t* cells, float limit)
 {
-    if (lmCount > 0)
+    const float reach = limit * 1.0625f;
+    uvprim_t* pim_noalias prims = bvh->prims;
+    i32 primCount = 0;
+    for (i32 i = 0; i < bvh->primCount; ++i)
     {
-        quadtree_t* trees = tmp_calloc(sizeof(trees[0]) * lmCount);
+        uvprim_t prim = prims[i];
+        const i32 cell = FindCell(cells, 0, prim.tri);
+        if (cell < 0)
         {
-            const float eps = 0.01f;
-            box2d_t bounds = { f2_s(0.0f - eps), f2_s(1.0f + eps) };
-            for (i32 i = 0; i < lmCount; ++i)
+            continue;
+        }
+        prim.bounds = cells->clipped[cell];
+        if (!TriIsSliver(prim.tri))
+        {
+            box2d_t near;
+            near.lo = f2_min(prim.tri.a, f2_min(prim.tri.b, prim.tri.c));
+            near.hi = f2_max(prim.tri.a, f2_max(prim.tri.b, prim.tri.c));
+            near.lo = f2_subvs(near.lo, reach);
+            near.hi = f2_addvs(near.hi, reach);
+            prim.bounds = box2d_intersect(prim.bounds, near);
+        }
+        prim.order |= (u64)cells->ranks[cell] << 32;
+        prims[primCount++] = prim;
+    }
+    bvh->primCount = primCount;
+
+    bvh->nodeCount = 0;
+    bvh->nodes = perm_malloc(sizeof(bvh->nodes[0]) * i1_max(1, 2 * primCount - 1));
+    if (primCount > 0)
+    {
+        bvh->nodeCount = 1;
+        uvbvh_split(bvh, 0, 0, primCount, 0);
+    }
+}
+
+static void uvbvh_del(uvbvh_t* bvh)
+{
+    if (bvh)
+    {
+        pim_free(bvh->nodes);
+        pim_free(bvh->prims);
+        memset(bvh, 0, sizeof(*bvh));
+    }
+}
+
+// nearest triangle closer than limit, ties go to the lowest order
+static float uvbvh_find(
+    const uvbvh_t* bvh,
+    float2 pt,
+    float limit,
+    int2* pim_noalias indOut)
+{
+    const uvnode_t* pim_noalias nodes = bvh->nodes;
+    const uvprim_t* pim_noalias prims = bvh->prims;
+    int2 ind = { -1, -1 };
+    u64 order = 0;
+
+    i32 stack[kUvMaxDepth + 2];
+    i32 top = 0;
+    if (bvh->nodeCount > 0)
+    {
+        stack[top++] = 0;
+    }
+    while (top > 0)
+    {
+        const uvnode_t node = nodes[stack[--top]];
+        if (!BoxHoldsPt(node.bounds, pt))
+        {
+            continue;
+        }
+        if (node.count == 0)
+        {
+            ASSERT((top + 2) <= (i32)NELEM(stack));
+            stack[top++] = node.begin + 1;
+            stack[top++] = node.begin + 0;
+            continue;
+        }
+        for (i32 i = node.begin; i < node.begin + node.count; ++i)
+        {
+            if (!BoxHoldsPt(prims[i].bounds, pt))
+            {
+                continue;
+            }
+            tri2d_t tri = prims[i].tri;
+            float dist = sdTriangle2D(tri.a, tri.b, tri.c, pt);
+            if ((dist < limit) ||
+                ((dist == limit) && (ind.x != -1) && (prims[i].order < order)))
+            {
+                limit = dist;
+                ind = prims[i].ind;
+                order = prims[i].order;
+            }
+        }
+    }
+
+    *indOut = ind;
+    return limit;
+}
+
+typedef struct task_BuildUvBvh
+{
+    task_t task;
+    uvbvh_t* bvhs;
+    const uvcells_t* cells;
+    float limit;
+} task_BuildUvBvh;
+
+static void BuildUvBvhFn(void* pbase, i32 begin, i32 end)
+{
+    task_BuildUvBvh *const task = (task_BuildUvBvh*)pbase;
+    for (i32 i = begin; i < end; ++i)
+    {
+        uvbvh_new(task->bvhs + i, task->cells, task->limit);
+    }
+}
+
+typedef struct embed_s
+{
+    task_t task;
+    lightmap_t* lightmaps;
+    const uvbvh_t* bvhs;
+    // drawables whose texels are rewritten, or NULL for all texels
+    const u8* drawMask;
+    i32 lmCount;
+    float texelsPerMeter;
+} embed_t;
+
+static void EmbedAttributesFn(void *const pbase, i32 begin, i32 end)
+{
+    embed_t *const task = pbase;
+    lightmap_t *const pim_noalias lightmaps = task->lightmaps;
+    const uvbvh_t* pim_noalias bvhs = task->bvhs;
+    const u8* pim_noalias drawMask = task->drawMask;
+    const i32 lmCount = task->lmCount;
+    const float texelsPerMeter = task->texelsPerMeter;
+    const float metersPerTexel = 1.0f / texelsPerMeter;
+    const i32 lmSize = lightmaps[0].size;
+    const i32 tileLen = kLmTile * kLmTile;
+    const i32 tilesPerMap = TileCount(lmSize);
+    const int2 size = { lmSize, lmSize };
+    const float limit = 4.0f / lmSize;
+
+    drawables_t const *const drawables = drawables_get();
+    const i32 drawablesCount = drawables->count;
+    meshid_t const *const pim_noalias meshids = drawables->meshes;
+    float4x4 const *const pim_noalias matrices = drawables->matrices;
+    float3x3 const *const pim_noalias invMatrices = drawables->invMatrices;
+
+    for (i32 iWork = begin; iWork < end; ++iWork)
+    {
+        const i32 iLightmap = iWork / tilesPerMap;
+        const i32 iTile = iWork % tilesPerMap;
+        lightmap_t *const lm = lightmaps + iLightmap;
+        const uvbvh_t* bvh = bvhs + iLightmap;
+
+        // positions are quantized per tile, so the tile is refit at once
+        float4 tilePositions[kLmTile * kLmTile];
+        for (i32 j = 0; j < tileLen; ++j)
+        {
+            tilePositions[j] = lm_position(lm, iTile * tileLen + j);
+        }
+
+        for (i32 j = 0; j < tileLen; ++j)
+        {
+            const i32 iTexel = iTile * tileLen + j;
+            const float2 uv = CoordToUv(size, lm_coord(lmSize, iTexel));
+            lmtexel_t *const pim_noalias texel = lm->texels + iTexel;
+
+            if (!drawMask)
+            {
+                texel->sampleCount = 0.0f;
+            }
+
+            int2 ind;
+            float dist = uvbvh_find(bvh, uv, limit, &ind);
+            if ((dist < limit) && (ind.x != -1) && (ind.y != -1))
             {
-                quadtree_new(trees + i, 5, bounds);
+                i32 iDraw = ind.x;
+                i32 iVert = ind.y;
+                if (drawMask && !drawMask[iDraw])
+                {
+                    continue;
+                }
+
+                mesh_t const *const mesh = mesh_get(meshids[iDraw]);
+                if (!mesh)
+                {
+                    continue;
+                }
+
+                float4 const *const pim_noalias positions = mesh->positions;
+                float4 const *const pim_noalias normals = mesh->normals;
+                float4 const *const pim_noalias uvs = mesh->uvs;
+
+                const i32 a = iVert + 0;
+                const i32 b = iVert + 1;
+                const i32 c = iVert + 2;
+                ASSERT(c < mesh->length);
+                ASSERT((i32)mesh->normals[a].w == iLightmap);
+
+                float2 LMA = f2_v(uvs[a].z, uvs[a].w);
+                float2 LMB = f2_v(uvs[b].z, uvs[b].w);
+                float2 LMC = f2_v(uvs[c].z, uvs[c].w);
+                float area = sdEdge2D(LMA, LMB, LMC);
+                if (area <= 0.0f)
+                {
+                    continue;
+                }
+
+                const float rcpArea = 1.0f / area;
+                float4 wuv = bary2D(LMA, LMB, LMC, rcpArea, uv);
+                wuv = f4_clampvs(wuv, 0.0f, 1.0f);
+                wuv = f4_divvs(wuv, f4_sum3(wuv));
+
+                const float4x4 M = matrices[iDraw];
+                const float3x3 IM = invMatrices[iDraw];
+
+                float4 A = f4x4_mul_pt(M, positions[a]);
+                float4 B = f4x4_mul_pt(M, positions[b]);
+                float4 C = f4x4_mul_pt(M, positions[c]);
+                float4 P = f4_blend(A, B, C, wuv);
+
+                float4 NA = f3x3_mul_col(IM, normals[a]);
+                float4 NB = f3x3_mul_col(IM, normals[a]);
+                float4 NC = f3x3_mul_col(IM, normals[a]);
+
+                NA = f4_normalize3(NA);
+                NB = f4_normalize3(NB);
+                NC = f4_normalize3(NC);
+                float4 N = f4_blend(NA, NB, NC, wuv);
+                N = f4_normalize3(N);
+
+                tilePositions[j] = P;
+                texel->normal = NormalToOct16(N);
+                texel->sampleCount = 1.0f;
+                texel->lumMoments = f2_0;
             }
         }
 
+        FrameTile(lm, iTile, tilePositions, true);
+    }
+}
+
+static void EmbedAttributes(
+    lightmap_t* lightmaps,
+    i32 lmCount,
+    float texelsPerMeter,
+    const u8* drawMask)
+{
+    if (lmCount > 0)
+    {
+        const drawables_t* drawables = drawables_get();
+        const i32 dwCount = drawables->count;
+        const meshid_t* pim_noalias meshids = drawables->meshes;
+        const i32 lmSize = lightmaps[0].size;
+        const float limit = 4.0f / lmSize;
+
+        uvcells_t cells = { 0 };
+        {
+            const float eps = 0.01f;
+            box2d_t bounds = { f2_s(0.0f - eps), f2_s(1.0f + eps) };
+            uvcells_new(&cells, kUvCellDepth, bounds);
+        }
+
+        uvbvh_t* bvhs = tmp_calloc(sizeof(bvhs[0]) * lmCount);
+        for (i32 pass = 0; pass < 2; ++pass)
         {
-            const drawables_t* drawables = drawables_get();
-            const i32 dwCount = drawables->count;
-            const meshid_t* pim_noalias meshids = drawables->meshes;
+            if (pass == 1)
+            {
+                for (i32 i = 0; i < lmCount; ++i)
+                {
+                    bvhs[i].prims = perm_malloc(sizeof(bvhs[i].prims[0]) * i1_max(1, bvhs[i].primCount));
+                    bvhs[i].primCount = 0;
+                }
+            }
+
+            u32 order = 0;
             for (i32 iDraw = 0; iDraw < dwCount; ++iDraw)
             {
                 mesh_t const *const mesh = mesh_get(meshids[iDraw]);
@@ -1312,29 +1875,43 @@ static void EmbedAttributes(
                     const i32 iMap = (i32)normals[a].w;
                     if ((iMap >= 0) && (iMap < lmCount))
                     {
-                        float2 A = f2_v(uvs[a].z, uvs[a].w);
-                        float2 B = f2_v(uvs[b].z, uvs[b].w);
-                        float2 C = f2_v(uvs[c].z, uvs[c].w);
-                        tri2d_t tri = { A, B, C };
-                        quadtree_t* tree = trees + iMap;
-                        bool inserted = quadtree_insert(tree, 0, tri, iDraw, iVert);
-                        ASSERT(inserted);
+                        uvbvh_t* bvh = bvhs + iMap;
+                        if (pass == 1)
+                        {
+                            uvprim_t* prim = bvh->prims + bvh->primCount;
+                            prim->tri.a = f2_v(uvs[a].z, uvs[a].w);
+                            prim->tri.b = f2_v(uvs[b].z, uvs[b].w);
+                            prim->tri.c = f2_v(uvs[c].z, uvs[c].w);
+                            prim->ind = i2_v(iDraw, iVert);
+                            prim->order = order++;
+                        }
+                        bvh->primCount += 1;
                     }
                 }
             }
         }
 
+        {
+            task_BuildUvBvh* task = tmp_calloc(sizeof(*task));
+            task->bvhs = bvhs;
+            task->cells = &cells;
+            task->limit = limit;
+            task_run(&task->task, BuildUvBvhFn, lmCount);
+        }
+
         embed_t* task = tmp_calloc(sizeof(*task));
         task->lightmaps = lightmaps;
-        task->trees = trees;
+        task->bvhs = bvhs;
+        task->drawMask = drawMask;
         task->lmCount = lmCount;
         task->texelsPerMeter = texelsPerMeter;
-        task_run(task, EmbedAttributesFn, TexelCount(lightmaps, lmCount));
+        task_run(task, EmbedAttributesFn, lmCount * TileCount(lightmaps[0].size));
 
         for (i32 i = 0; i < lmCount; ++i)
         {
-            quadtree_del(trees + i);
+            uvbvh_del(bvhs + i);
         }
+        uvcells_del(&cells);
     }
 }
 
@@ -1345,6 +1922,7 @@ lmpack_t lmpack_pack(
     float degThresh)
 {
     ASSERT(atlasSize > 0);
+    ASSERT((atlasSize % kLmTile) == 0);
 
     if (!ms_once)
     {
@@ -1379,7 +1957,8 @@ lmpack_t lmpack_pack(
 
     chartnodes_assign(charts, chartCount, pack.lightmaps, atlasCount);
 
-    EmbedAttributes(pack.lightmaps, atlasCount, texelsPerUnit);
+    EmbedAttributes(pack.lightmaps, atlasCount, texelsPerUnit, NULL);
+    lmdeps_snapshot();
 
     pim_free(nodes);
     for (i32 i = 0; i < chartCount; ++i)
@@ -1395,69 +1974,220 @@ void lmpack_del(lmpack_t* pack)
 {
     if (pack)
     {
+        lmstream_cancel(pack);
         for (i32 i = 0; i < pack->lmCount; ++i)
         {
             lightmap_del(pack->lightmaps + i);
         }
         pim_free(pack->lightmaps);
         memset(pack, 0, sizeof(*pack));
+        if (pack == &ms_pack)
+        {
+            lmpack_bake_reset();
+            lmdeps_clear();
+        }
     }
 }
 
+// ----------------------------------------------------------------------------
+// Bake scheduling: each pass ranks texels by the relative standard error of
+// their mean luminance, drops the converged ones, and bakes the rest from a
+// compact list, worst first. Error falls with the square root of the sample
+// count, which also estimates how many samples are left.
+
+// 0 holds texels under minSpp, then half octaves of error down to the target
+#define kBakeBuckets        32
+#define kBakeConverged      0xfe
+#define kBakeEmpty          0xff
+// luminance below this is noise around black, not signal
+#define kBakeLumBias        1e-3f
+
+typedef struct lmsched_s
+{
+    // global texel indices, worst first
+    i32* queue;
+    i32 count;
+    i32 cursor;
+    bool ranked;
+    float maxError;
+    i32 minSpp;
+    i32 maxSpp;
+    u64 lastTick;
+    lmbakestats_t stats;
+} lmsched_t;
+
+static lmsched_t ms_sched;
+
+pim_inline i32 VEC_CALL RankTexel(
+    const lmsched_t* sched,
+    float sampleCount,
+    float2 moments,
+    float* samplesLeft)
+{
+    *samplesLeft = 0.0f;
+    if (sampleCount == 0.0f)
+    {
+        return kBakeEmpty;
+    }
+    // sampleCount starts at 1 for valid texels
+    const float n = sampleCount - 1.0f;
+    if (n >= sched->maxSpp)
+    {
+        return kBakeConverged;
+    }
+    if (n < sched->minSpp)
+    {
+        *samplesLeft = sched->minSpp - n;
+        return 0;
+    }
+    const float variance = moments.y / (n - 1.0f);
+    const float stdErr = sqrtf(variance / n);
+    const float ratio = stdErr / ((moments.x + kBakeLumBias) * sched->maxError);
+    if (ratio <= 1.0f)
+    {
+        return kBakeConverged;
+    }
+    *samplesLeft = f1_min(n * ratio * ratio, (float)sched->maxSpp) - n;
+    i32 bucket = (i32)((8.0f - log2f(ratio)) * 2.0f);
+    return i1_clamp(bucket, 1, kBakeBuckets - 1);
+}
+
+typedef struct task_RankTexels
+{
+    task_t task;
+    const lmsched_t* sched;
+    u8* buckets;
+    float* samplesLeft;
+} task_RankTexels;
+
+static void RankTexelsFn(void* pbase, i32 begin, i32 end)
+{
+    task_RankTexels *const task = (task_RankTexels*)pbase;
+    const lmsched_t *const sched = task->sched;
+    u8 *const pim_noalias buckets = task->buckets;
+    float *const pim_noalias samplesLeft = task->samplesLeft;
+
+    const lmpack_t *const pack = lmpack_get();
+    const i32 lmSize = pack->lmSize;
+    const i32 lmLen = lmSize * lmSize;
+    for (i32 iWork = begin; iWork < end; ++iWork)
+    {
+        const lmtexel_t* pim_noalias texel =
+            pack->lightmaps[iWork / lmLen].texels + (iWork % lmLen);
+        buckets[iWork] = (u8)RankTexel(
+            sched,
+            texel->sampleCount,
+            texel->lumMoments,
+            samplesLeft + iWork);
+    }
+}
+
+ProfileMark(pm_Rank, RankTexels)
+static void RankTexels(lmsched_t* sched, i32 texelCount)
+{
+    ProfileBegin(pm_Rank);
+
+    task_RankTexels* task = tmp_calloc(sizeof(*task));
+    task->sched = sched;
+    task->buckets = tmp_malloc(sizeof(task->buckets[0]) * texelCount);
+    task->samplesLeft = tmp_malloc(sizeof(task->samplesLeft[0]) * texelCount);
+    task_run(&task->task, RankTexelsFn, texelCount);
+
+    const u8* pim_noalias buckets = task->buckets;
+    const float* pim_noalias samplesLeft = task->samplesLeft;
+    i32 offsets[kBakeBuckets] = { 0 };
+    i32 texels = 0;
+    i32 converged = 0;
+    double left = 0.0;
+    for (i32 i = 0; i < texelCount; ++i)
+    {
+        const i32 bucket = buckets[i];
+        if (bucket < kBakeBuckets)
+        {
+            ++offsets[bucket];
+            left += samplesLeft[i];
+        }
+        texels += bucket != kBakeEmpty;
+        converged += bucket == kBakeConverged;
+    }
+
+    // counting sort by bucket
+    i32 count = 0;
+    for (i32 i = 0; i < kBakeBuckets; ++i)
+    {
+        const i32 size = offsets[i];
+        offsets[i] = count;
+        count += size;
+    }
+    sched->queue = perm_realloc(sched->queue, sizeof(sched->queue[0]) * i1_max(1, count));
+    i32* pim_noalias queue = sched->queue;
+    for (i32 i = 0; i < texelCount; ++i)
+    {
+        const i32 bucket = buckets[i];
+        if (bucket < kBakeBuckets)
+        {
+            queue[offsets[bucket]++] = i;
+        }
+    }
+
+    if (sched->ranked && (count == 0) && (sched->count > 0))
+    {
+        con_logf(LogSev_Info, "LM", "Lightmap bake converged after %.0f samples", sched->stats.samples);
+    }
+
+    sched->count = count;
+    sched->cursor = 0;
+    sched->ranked = true;
+    sched->stats.texels = texels;
+    sched->stats.converged = converged;
+    sched->stats.samplesLeft = left;
+
+    ProfileEnd(pm_Rank);
+}
+
 typedef struct bake_s
 {
     task_t task;
     pt_scene_t* scene;
-    float timeSlice;
+    const i32* queue;
     i32 spp;
 } bake_t;
 
 static void BakeFn(void* pbase, i32 begin, i32 end)
 {
-    const i32 tid = task_thread_id();
-
     bake_t *const task = pbase;
     pt_scene_t *const scene = task->scene;
-    const float timeSlice = task->timeSlice;
+    const i32* pim_noalias queue = task->queue;
     const i32 spp = task->spp;
 
     lmpack_t *const pack = lmpack_get();
     const i32 lmSize = pack->lmSize;
     const i32 lmLen = lmSize * lmSize;
-    const float rcpSize = 1.0f / lmSize;
-    const int2 size = { lmSize, lmSize };
     const float metersPerTexel = 1.0f / pack->texelsPerMeter;
 
     pt_sampler_t sampler = pt_sampler_get();
-    for (i32 iWork = begin; iWork < end; ++iWork)
+    for (i32 iQueue = begin; iQueue < end; ++iQueue)
     {
-        i32 iLightmap = iWork / lmLen;
-        i32 iTexel = iWork % lmLen;
-        lightmap_t lightmap = pack->lightmaps[iLightmap];
-
-        float sampleCount = lightmap.sampleCounts[iTexel];
-        if (sampleCount == 0.0f)
-        {
-            continue;
-        }
+        const i32 iWork = queue[iQueue];
+        const lightmap_t lightmap = pack->lightmaps[iWork / lmLen];
+        const i32 iTexel = iWork % lmLen;
+        lmtexel_t *const pim_noalias texel = lightmap.texels + iTexel;
 
-        if (pt_sample_1d(&sampler) > timeSlice)
-        {
-            continue;
-        }
+        float sampleCount = texel->sampleCount;
+        ASSERT(sampleCount > 0.0f);
+        float2 moments = texel->lumMoments;
 
-        const float4 N = f4_normalize3(
-            f3_f4(lightmap.normal[iTexel], 0.0f));
-        const float4 P = f4_add(
-            f3_f4(lightmap.position[iTexel], 1.0f),
-            f4_mulvs(N, kMilli));
+        // clear of the surface by more than the position's rounding error
+        const float4 N = Oct16ToNormal(texel->normal);
+        const float lift = kMilli + lightmap.tileFrames[iTexel / (kLmTile * kLmTile)].w;
+        const float4 P = f4_add(lm_position(&lightmap, iTexel), f4_mulvs(N, lift));
         const float3x3 TBN = NormalToTBN(N);
 
         float4 probes[kGiDirections];
         float4 axii[kGiDirections];
         for (i32 i = 0; i < kGiDirections; ++i)
         {
-            probes[i] = lightmap.probes[i][iTexel];
+            probes[i] = lm_probe_decode(texel->probes[i]);
             float4 ax = kGiAxii[i];
             float sharpness = ax.w;
             ax = TbnToWorld(TBN, ax);
@@ -1467,6 +2197,8 @@ static void BakeFn(void* pbase, i32 begin, i32 end)
 
         for (i32 i = 0; i < spp; ++i)
         {
+            // sampleCount starts at 1 for valid texels
+            pt_sampler_begin(&sampler, (u32)iWork, (u32)sampleCount - 1u);
             float4 Lts = SampleUnitHemisphere(pt_sample_2d(&sampler));
             float4 rd = TbnToWorld(TBN, Lts);
             float dt = (pt_sample_1d(&sampler) - 0.5f) * metersPerTexel;
@@ -1476,7 +2208,6 @@ static void BakeFn(void* pbase, i32 begin, i32 end)
             ro = f4_add(ro, f4_mulvs(TBN.c1, db));
             pt_result_t result = pt_trace_ray(&sampler, scene, ro, rd);
             float weight = 1.0f / sampleCount;
-            sampleCount += 1.0f;
             SG_Accumulate(
                 weight,
                 rd,
@@ -1484,126 +2215,1022 @@ static void BakeFn(void* pbase, i32 begin, i32 end)
                 axii,
                 probes,
                 kGiDirections);
+
+            // Welford, over the sampleCount - 1 samples taken so far
+            float lum = f4_perlum(f3_f4(result.color, 0.0f));
+            float delta = lum - moments.x;
+            moments.x += delta / sampleCount;
+            moments.y += delta * (lum - moments.x);
+            sampleCount += 1.0f;
         }
+        pt_sampler_end(&sampler);
 
         for (i32 i = 0; i < kGiDirections; ++i)
         {
-            lightmap.probes[i][iTexel] = probes[i];
+            texel->probes[i] = lm_probe_encode(probes[i], prng_f32(&sampler.rng));
         }
-        lightmap.sampleCounts[iTexel] = sampleCount;
+        texel->sampleCount = sampleCount;
+        texel->lumMoments = moments;
+        // storage is tiled, so a tile is a contiguous run of texels
+        store_i32(lightmap.dirtyTiles + iTexel / (kLmTile * kLmTile), 1, MO_Relaxed);
     }
     pt_sampler_set(sampler);
 }
 
 ProfileMark(pm_Bake, lmpack_bake)
-void lmpack_bake(pt_scene_t* scene, float timeSlice, i32 spp)
+void lmpack_bake(
+    pt_scene_t* scene,
+    float timeSlice,
+    i32 spp,
+    float maxError,
+    i32 minSpp,
+    i32 maxSpp)
 {
     ProfileBegin(pm_Bake);
     ASSERT(scene);
 
+    lmpack_stream(true);
     pt_scene_update(scene);
 
+    lmsched_t *const sched = &ms_sched;
+    spp = i1_max(1, spp);
+    // the variance needs two samples
+    minSpp = i1_max(2, minSpp);
+    maxSpp = i1_max(minSpp, maxSpp);
+    if ((sched->maxError != maxError) ||
+        (sched->minSpp != minSpp) ||
+        (sched->maxSpp != maxSpp))
+    {
+        sched->maxError = maxError;
+        sched->minSpp = minSpp;
+        sched->maxSpp = maxSpp;
+        sched->ranked = false;
+    }
+
     lmpack_t const *const pack = lmpack_get();
     i32 texelCount = TexelCount(pack->lightmaps, pack->lmCount);
     if (texelCount > 0)
     {
-        bake_t *const task = perm_calloc(sizeof(*task));
-        task->scene = scene;
-        task->timeSlice = timeSlice;
-        task->spp = i1_max(1, spp);
-        task_run(task, BakeFn, texelCount);
+        // once every texel converged, there is nothing to rerank until
+        // the settings or the lightmaps change
+        if (!sched->ranked || ((sched->count > 0) && (sched->cursor >= sched->count)))
+        {
+            RankTexels(sched, texelCount);
+        }
+
+        const i32 budget = i1_max(1, (i32)ceilf(timeSlice * sched->stats.texels));
+        const i32 count = i1_min(budget, sched->count - sched->cursor);
+        const u64 now = time_now();
+        if (count > 0)
+        {
+            bake_t *const task = tmp_calloc(sizeof(*task));
+            task->scene = scene;
+            task->queue = sched->queue + sched->cursor;
+            task->spp = spp;
+            task_run(task, BakeFn, count);
+            sched->cursor += count;
+
+            lmbakestats_t *const stats = &sched->stats;
+            const double samples = (double)count * spp;
+            stats->samples += samples;
+            stats->samplesLeft = stats->samplesLeft > samples ?
+                stats->samplesLeft - samples : 0.0;
+            const double dt = time_sec(now - sched->lastTick);
+            if (sched->lastTick && (dt > 0.0))
+            {
+                // smoothed over the last few dozen bakes
+                const double rate = samples / dt;
+                stats->samplesPerSecond = stats->samplesPerSecond > 0.0 ?
+                    stats->samplesPerSecond + (rate - stats->samplesPerSecond) * 0.05 : rate;
+            }
+            stats->eta = stats->samplesPerSecond > 0.0 ?
+                stats->samplesLeft / stats->samplesPerSecond : -1.0;
+        }
+        else
+        {
+            sched->stats.eta = 0.0;
+        }
+        sched->lastTick = now;
     }
 
     ProfileEnd(pm_Bake);
 }
 
-bool lmpack_save(crate_t* crate, const lmpack_t* pack)
+const lmbakestats_t* lmpack_bake_stats(void)
 {
-    bool wrote = false;
-    ASSERT(pack);
+    return &ms_sched.stats;
+}
 
-    const i32 lmcount = pack->lmCount;
-    const i32 lmsize = pack->lmSize;
-    const i32 texelcount = lmsize * lmsize;
-    const lightmap_t lmNull = { 0 };
-    const i32 probesBytes = sizeof(lmNull.probes[0][0]) * texelcount * kGiDirections;
-    const i32 positionBytes = sizeof(lmNull.position[0]) * texelcount;
-    const i32 normalBytes = sizeof(lmNull.normal[0]) * texelcount;
-    const i32 sampleBytes = sizeof(lmNull.sampleCounts[0]) * texelcount;
-    const i32 texelBytes = probesBytes + sampleBytes + positionBytes + normalBytes;
+void lmpack_bake_reset(void)
+{
+    lmsched_t *const sched = &ms_sched;
+    pim_free(sched->queue);
+    sched->queue = NULL;
+    sched->count = 0;
+    sched->cursor = 0;
+    sched->ranked = false;
+    sched->lastTick = 0;
+    memset(&sched->stats, 0, sizeof(sched->stats));
+}
 
-    // write pack header
-    dlmpack_t dpack = { 0 };
-    dpack.version = kLmPackVersion;
-    dpack.directions = kGiDirections;
-    dpack.lmCount = lmcount;
-    dpack.lmSize = pack->lmSize;
-    dpack.bytesPerLightmap = texelBytes;
-    dpack.texelsPerMeter = pack->texelsPerMeter;
+// ----------------------------------------------------------------------------
+// Incremental rebake: the drawables a pack was baked against are kept as a
+// snapshot. An edit is diffed against it, and only texels the edit could
+// have changed start over: texels of moved drawables, and texels in sight
+// of an edited region, within reach of it unless the edit was emissive.
+// Charts and their atlas placement are stored in the meshes and survive.
 
-    if (crate_set(crate, guid_str("lmpack"), &dpack, sizeof(dpack)))
+typedef struct lmdeps_s
+{
+    i32 count;
+    guid_t* names;
+    float4x4* matrices;
+    material_t* materials;
+    // world space
+    box_t* bounds;
+} lmdeps_t;
+
+typedef struct lmedit_s
+{
+    // old and new world bounds
+    box_t bounds;
+    bool emissive;
+} lmedit_t;
+
+static lmdeps_t ms_deps;
+
+static void lmdeps_clear(void)
+{
+    lmdeps_t *const deps = &ms_deps;
+    pim_free(deps->names);
+    pim_free(deps->matrices);
+    pim_free(deps->materials);
+    pim_free(deps->bounds);
+    memset(deps, 0, sizeof(*deps));
+}
+
+static void lmdeps_snapshot(void)
+{
+    lmdeps_t *const deps = &ms_deps;
+    const drawables_t *const drawables = drawables_get();
+    const i32 count = drawables->count;
+    deps->count = count;
+    deps->names = perm_realloc(deps->names, sizeof(deps->names[0]) * count);
+    deps->matrices = perm_realloc(deps->matrices, sizeof(deps->matrices[0]) * count);
+    deps->materials = perm_realloc(deps->materials, sizeof(deps->materials[0]) * count);
+    deps->bounds = perm_realloc(deps->bounds, sizeof(deps->bounds[0]) * count);
+    for (i32 i = 0; i < count; ++i)
     {
-        wrote = true;
-        for (i32 i = 0; i < lmcount; ++i)
-        {
-            char name[PIM_PATH] = { 0 };
-            SPrintf(ARGS(name), "lightmap_%d", i);
-            const lightmap_t lm = pack->lightmaps[i];
-            wrote &= crate_set(crate, guid_str(name), lm.probes[0], texelBytes);
-        }
+        deps->names[i] = drawables->names[i];
+        deps->matrices[i] = drawables->matrices[i];
+        deps->materials[i] = drawables->materials[i];
+        deps->bounds[i] = box_transform(drawables->matrices[i], drawables->bounds[i]);
     }
-
-    return wrote;
 }
 
-bool lmpack_load(crate_t* crate, lmpack_t* pack)
+// diffs the drawables against the snapshot.
+// edits: [drawables + snapshot count] or NULL
+// moved: [drawables count] or NULL, set where texels need new positions
+static i32 lmdeps_diff(lmedit_t* edits, u8* moved, bool* added)
 {
-    bool loaded = false;
-    lmpack_del(pack);
+    const lmdeps_t *const deps = &ms_deps;
+    const drawables_t *const drawables = drawables_get();
+    const i32 count = drawables->count;
+    const i32 depCount = deps->count;
 
-    dlmpack_t dpack = { 0 };
-    if (crate_get(crate, guid_str("lmpack"), &dpack, sizeof(dpack)))
+    u8* pim_noalias matched = tmp_calloc(sizeof(matched[0]) * i1_max(1, depCount));
+    i32 editCount = 0;
+    i32 shift = 0;
+    *added = false;
+    for (i32 i = 0; i < count; ++i)
     {
-        if ((dpack.version == kLmPackVersion) &&
-            (dpack.directions == kGiDirections) &&
-            (dpack.lmCount > 0) &&
-            (dpack.lmSize > 0))
+        const guid_t name = drawables->names[i];
+        // drawables keep their order, so only a removal or insertion shifts them
+        i32 j = i + shift;
+        if ((j < 0) || (j >= depCount) || !guid_eq(deps->names[j], name))
         {
-            loaded = true;
-
-            const i32 lmcount = dpack.lmCount;
-            const i32 lmsize = dpack.lmSize;
-            const i32 texelcount = lmsize * lmsize;
-            const lightmap_t lmNull = { 0 };
-            const i32 probesBytes = sizeof(lmNull.probes[0][0]) * texelcount * kGiDirections;
-            const i32 positionBytes = sizeof(lmNull.position[0]) * texelcount;
-            const i32 normalBytes = sizeof(lmNull.normal[0]) * texelcount;
-            const i32 sampleBytes = sizeof(lmNull.sampleCounts[0]) * texelcount;
-            const i32 texelBytes = probesBytes + sampleBytes + positionBytes + normalBytes;
-
-            pack->lightmaps = perm_calloc(sizeof(pack->lightmaps[0]) * lmcount);
-            pack->lmCount = lmcount;
-            pack->lmSize = dpack.lmSize;
-            pack->texelsPerMeter = dpack.texelsPerMeter;
-
-            for (i32 i = 0; i < lmcount; ++i)
+            j = -1;
+            for (i32 k = 0; k < depCount; ++k)
             {
-                char name[PIM_PATH] = { 0 };
-                SPrintf(ARGS(name), "lightmap_%d", i);
-                lightmap_t lm = { 0 };
-                lightmap_new(&lm, lmsize);
-                loaded &= crate_get(crate, guid_str(name), lm.probes[0], texelBytes);
-                lightmap_upload(&lm);
-                pack->lightmaps[i] = lm;
+                if (!matched[k] && guid_eq(deps->names[k], name))
+                {
+                    j = k;
+                    shift = k - i;
+                    break;
+                }
             }
         }
-    }
+
+        const float4x4 M = drawables->matrices[i];
+        const material_t mat = drawables->materials[i];
+        const box_t bounds = box_transform(M, drawables->bounds[i]);
+        if (j == -1)
+        {
+            // no charts in the atlas yet
+            *added = true;
+            if (edits)
+            {
+                edits[editCount].bounds = bounds;
+                edits[editCount].emissive = (mat.flags & matflag_emissive) != 0;
+            }
+            ++editCount;
+            continue;
+        }
+
+        matched[j] = 1;
+        const bool transformed = memcmp(&deps->matrices[j], &M, sizeof(M)) != 0;
+        const bool restyled = memcmp(&deps->materials[j], &mat, sizeof(mat)) != 0;
+        if (transformed || restyled)
+        {
+            if (edits)
+            {
+                edits[editCount].bounds = box_union(deps->bounds[j], bounds);
+                edits[editCount].emissive =
+                    ((mat.flags | deps->materials[j].flags) & matflag_emissive) != 0;
+            }
+            if (moved)
+            {
+                moved[i] = transformed;
+            }
+            ++editCount;
+        }
+    }
+
+    for (i32 j = 0; j < depCount; ++j)
+    {
+        if (!matched[j])
+        {
+            if (edits)
+            {
+                edits[editCount].bounds = deps->bounds[j];
+                edits[editCount].emissive = (deps->materials[j].flags & matflag_emissive) != 0;
+            }
+            ++editCount;
+        }
+    }
+
+    return editCount;
+}
+
+i32 lmpack_edits(bool* needsRepack)
+{
+    bool added = false;
+    i32 count = 0;
+    if (ms_pack.lmCount > 0)
+    {
+        count = lmdeps_diff(NULL, NULL, &added);
+    }
+    if (needsRepack)
+    {
+        *needsRepack = added;
+    }
+    return count;
+}
+
+typedef struct task_Invalidate
+{
+    task_t task;
+    pt_scene_t* scene;
+    const lmedit_t* edits;
+    i32 editCount;
+    float reach;
+    i32 invalidated;
+} task_Invalidate;
+
+pim_inline bool VEC_CALL EditVisible(
+    pt_scene_t *const scene,
+    lmedit_t edit,
+    float reach,
+    float4 P,
+    float4 N)
+{
+    const box_t box = edit.bounds;
+    if (box_contains(box, P))
+    {
+        return true;
+    }
+    if (!edit.emissive && (sdBox3D(box, P) > reach))
+    {
+        return false;
+    }
+
+    const float4 center = box_center(box);
+    const float4 extents = box_extents(box);
+    // entirely behind the texel
+    if ((f4_dot3(N, f4_sub(center, P)) + f4_dot3(f4_abs(N), extents)) <= 0.0f)
+    {
+        return false;
+    }
+
+    // the center, and the corners halfway out to the box's corners
+    const float4 ro = f4_add(P, f4_mulvs(N, kMilli));
+    const float4 halfExtents = f4_mulvs(extents, 0.5f);
+    for (i32 i = 0; i < 9; ++i)
+    {
+        float4 target = center;
+        if (i > 0)
+        {
+            const i32 c = i - 1;
+            const float4 sign = f4_v(
+                (c & 1) ? 1.0f : -1.0f,
+                (c & 2) ? 1.0f : -1.0f,
+                (c & 4) ? 1.0f : -1.0f,
+                0.0f);
+            target = f4_add(center, f4_mul(sign, halfExtents));
+        }
+        const float4 rd = f4_normalize3(f4_sub(target, ro));
+        if (f4_dot3(rd, N) <= 0.0f)
+        {
+            continue;
+        }
+        // anything hit before the ray enters the box occludes it
+        const float2 nf = isectBox3D(ro, f4_rcp(rd), box);
+        const float tEntry = f1_max(nf.x, 0.0f);
+        if (tEntry <= kMilli)
+        {
+            return true;
+        }
+        const rayhit_t hit = pt_intersect(scene, ro, rd, 0.0f, tEntry);
+        if (hit.type == hit_nothing)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void InvalidateFn(void* pbase, i32 begin, i32 end)
+{
+    task_Invalidate *const task = (task_Invalidate*)pbase;
+    pt_scene_t *const scene = task->scene;
+    const lmedit_t* pim_noalias edits = task->edits;
+    const i32 editCount = task->editCount;
+    const float reach = task->reach;
+
+    lmpack_t *const pack = lmpack_get();
+    const i32 lmSize = pack->lmSize;
+    const i32 lmLen = lmSize * lmSize;
+
+    i32 invalidated = 0;
+    for (i32 iWork = begin; iWork < end; ++iWork)
+    {
+        const lightmap_t* lm = pack->lightmaps + iWork / lmLen;
+        lmtexel_t *const pim_noalias texel = lm->texels + (iWork % lmLen);
+        if (texel->sampleCount == 0.0f)
+        {
+            continue;
+        }
+
+        const float4 P = lm_position(lm, iWork % lmLen);
+        const float4 N = Oct16ToNormal(texel->normal);
+        for (i32 i = 0; i < editCount; ++i)
+        {
+            if (EditVisible(scene, edits[i], reach, P, N))
+            {
+                // the next sample replaces the probes outright,
+                // so they keep showing the old result until then
+                texel->sampleCount = 1.0f;
+                texel->lumMoments = f2_0;
+                ++invalidated;
+                break;
+            }
+        }
+    }
+    fetch_add_i32(&task->invalidated, invalidated, MO_Relaxed);
+}
+
+ProfileMark(pm_Rebake, lmpack_rebake)
+i32 lmpack_rebake(pt_scene_t* scene, float reach)
+{
+    lmpack_t *const pack = &ms_pack;
+    const i32 texelCount = TexelCount(pack->lightmaps, pack->lmCount);
+    if (texelCount <= 0)
+    {
+        return 0;
+    }
+
+    ProfileBegin(pm_Rebake);
+    ASSERT(scene);
+
+    lmpack_stream(true);
+    const drawables_t *const drawables = drawables_get();
+    lmedit_t* edits = tmp_malloc(sizeof(edits[0]) * i1_max(1, drawables->count + ms_deps.count));
+    u8* moved = tmp_calloc(sizeof(moved[0]) * i1_max(1, drawables->count));
+    bool added = false;
+    const i32 editCount = lmdeps_diff(edits, moved, &added);
+
+    i32 invalidated = 0;
+    if (editCount > 0)
+    {
+        bool anyMoved = false;
+        for (i32 i = 0; i < drawables->count; ++i)
+        {
+            anyMoved |= moved[i] != 0;
+        }
+        if (anyMoved)
+        {
+            EmbedAttributes(pack->lightmaps, pack->lmCount, pack->texelsPerMeter, moved);
+        }
+
+        task_Invalidate* task = tmp_calloc(sizeof(*task));
+        task->scene = scene;
+        task->edits = edits;
+        task->editCount = editCount;
+        task->reach = reach;
+        task_run(&task->task, InvalidateFn, texelCount);
+        invalidated = task->invalidated;
+
+        lmdeps_snapshot();
+        ms_sched.ranked = false;
+
+        con_logf(LogSev_Info, "LM", "Rebaking %d texels after %d drawable edits",
+            invalidated,
+            editCount);
+    }
+
+    ProfileEnd(pm_Rebake);
+    return invalidated;
+}
+
+// ----------------------------------------------------------------------------
+// Storage: each lightmap is saved as planes, the probes of each direction as
+// half floats and optionally the bake state (position, octahedral normal,
+// sample count and luminance moments). Each plane is byte shuffled so that
+// deflate sees runs of similar bytes, then compressed on its own so planes
+// save and load in parallel. Loading reads the compressed planes, then
+// decodes them on the task system while lmpack_stream uploads each
+// lightmap once all of its planes have landed.
+
+typedef enum
+{
+    LmPlane_Probes,
+    LmPlane_Position = LmPlane_Probes + kGiDirections,
+    LmPlane_Normal,
+    LmPlane_SampleCounts,
+    LmPlane_LumMoments,
+
+    LmPlane_COUNT
+} LmPlane;
+
+// sizes of the compressed planes that follow, 0 where omitted
+typedef struct dlightmap_s
+{
+    i32 planeBytes[LmPlane_COUNT];
+} dlightmap_t;
+
+typedef struct lmstream_s
+{
+    task_t task;
+    lmpack_t* pack;
+    // [lmCount * LmPlane_COUNT]
+    u8** blobs;
+    i32* blobBytes;
+    // [lmCount]
+    i32* pending;
+    bool* uploaded;
+    i32 lmCount;
+    i32 failed;
+} lmstream_t;
+
+// workers can pop a stream's task after it completes, so streams are
+// recycled rather than freed: [0] streams ms_pack, [1] decodes other packs
+static lmstream_t ms_streams[2];
+static lmstream_t* ms_stream;
+
+// bytes per texel of a plane and the size of the elements that are shuffled
+pim_inline i32 PlaneStride(i32 plane, i32* wordOut)
+{
+    if (plane < LmPlane_Position)
+    {
+        *wordOut = sizeof(u16);
+        return sizeof(ushort4);
+    }
+    switch (plane)
+    {
+    default:
+        ASSERT(false);
+        *wordOut = 1;
+        return 0;
+    case LmPlane_Position:
+        *wordOut = sizeof(float);
+        return sizeof(float3);
+    case LmPlane_Normal:
+        *wordOut = sizeof(i16);
+        return sizeof(short2);
+    case LmPlane_SampleCounts:
+        *wordOut = sizeof(float);
+        return sizeof(float);
+    case LmPlane_LumMoments:
+        *wordOut = sizeof(float);
+        return sizeof(float2);
+    }
+}
+
+pim_inline i32 PlaneCount(bool bakeState)
+{
+    return bakeState ? LmPlane_COUNT : LmPlane_Position;
+}
+
+static i32 PlanesBytes(i32 texelCount, bool bakeState)
+{
+    i32 bytes = 0;
+    for (i32 i = 0; i < PlaneCount(bakeState); ++i)
+    {
+        i32 word;
+        bytes += PlaneStride(i, &word) * texelCount;
+    }
+    return bytes;
+}
+
+// gathers byte i of every word, so that exponents end up next to each other
+static void ByteShuffle(u8* pim_noalias dst, const u8* pim_noalias src, i32 bytes, i32 word)
+{
+    const i32 words = bytes / word;
+    for (i32 b = 0; b < word; ++b)
+    {
+        for (i32 i = 0; i < words; ++i)
+        {
+            dst[b * words + i] = src[i * word + b];
+        }
+    }
+}
+
+static void ByteUnshuffle(u8* pim_noalias dst, const u8* pim_noalias src, i32 bytes, i32 word)
+{
+    const i32 words = bytes / word;
+    for (i32 b = 0; b < word; ++b)
+    {
+        for (i32 i = 0; i < words; ++i)
+        {
+            dst[i * word + b] = src[b * words + i];
+        }
+    }
+}
+
+// planes keep the texels' tiled storage order
+static void EncodePlane(const lightmap_t* lm, i32 plane, u8* pim_noalias dst)
+{
+    const i32 len = lm->size * lm->size;
+    const lmtexel_t* pim_noalias texels = lm->texels;
+    if (plane < LmPlane_Position)
+    {
+        const i32 iProbe = plane - LmPlane_Probes;
+        ushort4* pim_noalias halfs = (ushort4*)dst;
+        for (i32 i = 0; i < len; ++i)
+        {
+            halfs[i] = HalfProbe(lm_probe_decode(texels[i].probes[iProbe]));
+        }
+        return;
+    }
+    switch (plane)
+    {
+    default:
+        ASSERT(false);
+        break;
+    case LmPlane_Position:
+    {
+        float3* pim_noalias positions = (float3*)dst;
+        for (i32 i = 0; i < len; ++i)
+        {
+            positions[i] = f4_f3(lm_position(lm, i));
+        }
+    }
+    break;
+    case LmPlane_Normal:
+    {
+        short2* pim_noalias octs = (short2*)dst;
+        for (i32 i = 0; i < len; ++i)
+        {
+            octs[i] = texels[i].normal;
+        }
+    }
+    break;
+    case LmPlane_SampleCounts:
+    {
+        float* pim_noalias counts = (float*)dst;
+        for (i32 i = 0; i < len; ++i)
+        {
+            counts[i] = texels[i].sampleCount;
+        }
+    }
+    break;
+    case LmPlane_LumMoments:
+    {
+        float2* pim_noalias moments = (float2*)dst;
+        for (i32 i = 0; i < len; ++i)
+        {
+            moments[i] = texels[i].lumMoments;
+        }
+    }
+    break;
+    }
+}
+
+static void DecodePlane(lightmap_t* lm, i32 plane, const u8* pim_noalias src)
+{
+    const i32 len = lm->size * lm->size;
+    lmtexel_t* pim_noalias texels = lm->texels;
+    if (plane < LmPlane_Position)
+    {
+        const i32 iProbe = plane - LmPlane_Probes;
+        const ushort4* pim_noalias halfs = (const ushort4*)src;
+        for (i32 i = 0; i < len; ++i)
+        {
+            texels[i].probes[iProbe] = lm_probe_encode(half4_f4(halfs[i]), 0.5f);
+        }
+        return;
+    }
+    switch (plane)
+    {
+    default:
+        ASSERT(false);
+        break;
+    case LmPlane_Position:
+    {
+        // texels without samples were saved inside their tile's frame,
+        // so every texel can be fit
+        const float3* pim_noalias positions = (const float3*)src;
+        const i32 tileLen = kLmTile * kLmTile;
+        float4 tile[kLmTile * kLmTile];
+        for (i32 iTile = 0; (iTile * tileLen) < len; ++iTile)
+        {
+            for (i32 i = 0; i < tileLen; ++i)
+            {
+                tile[i] = f3_f4(positions[iTile * tileLen + i], 1.0f);
+            }
+            FrameTile(lm, iTile, tile, false);
+        }
+    }
+    break;
+    case LmPlane_Normal:
+    {
+        const short2* pim_noalias octs = (const short2*)src;
+        for (i32 i = 0; i < len; ++i)
+        {
+            texels[i].normal = octs[i];
+        }
+    }
+    break;
+    case LmPlane_SampleCounts:
+    {
+        const float* pim_noalias counts = (const float*)src;
+        for (i32 i = 0; i < len; ++i)
+        {
+            texels[i].sampleCount = counts[i];
+        }
+    }
+    break;
+    case LmPlane_LumMoments:
+    {
+        const float2* pim_noalias moments = (const float2*)src;
+        for (i32 i = 0; i < len; ++i)
+        {
+            texels[i].lumMoments = moments[i];
+        }
+    }
+    break;
+    }
+}
+
+typedef struct task_SavePlanes
+{
+    task_t task;
+    const lmpack_t* pack;
+    i32 planeCount;
+    // [lmCount * planeCount]
+    u8** blobs;
+    i32* blobBytes;
+} task_SavePlanes;
+
+static void SavePlanesFn(void* pbase, i32 begin, i32 end)
+{
+    task_SavePlanes *const task = (task_SavePlanes*)pbase;
+    const lmpack_t *const pack = task->pack;
+    const i32 planeCount = task->planeCount;
+    const i32 len = pack->lmSize * pack->lmSize;
+
+    for (i32 iWork = begin; iWork < end; ++iWork)
+    {
+        const lightmap_t* lm = pack->lightmaps + iWork / planeCount;
+        const i32 plane = iWork % planeCount;
+        i32 word;
+        const i32 bytes = PlaneStride(plane, &word) * len;
+
+        u8* raw = perm_malloc(bytes);
+        u8* shuffled = perm_malloc(bytes);
+        EncodePlane(lm, plane, raw);
+        ByteShuffle(shuffled, raw, bytes, word);
+        pim_free(raw);
+
+        mz_ulong packedBytes = mz_compressBound(bytes);
+        u8* packed = perm_malloc((i32)packedBytes);
+        if (mz_compress2(packed, &packedBytes, shuffled, bytes, MZ_BEST_SPEED) == MZ_OK)
+        {
+            task->blobs[iWork] = packed;
+            task->blobBytes[iWork] = (i32)packedBytes;
+        }
+        else
+        {
+            pim_free(packed);
+        }
+        pim_free(shuffled);
+    }
+}
+
+static void LoadPlanesFn(void* pbase, i32 begin, i32 end)
+{
+    lmstream_t *const stream = (lmstream_t*)pbase;
+    lmpack_t *const pack = stream->pack;
+    const i32 len = pack->lmSize * pack->lmSize;
+
+    for (i32 iWork = begin; iWork < end; ++iWork)
+    {
+        const i32 iLightmap = iWork / LmPlane_COUNT;
+        const i32 plane = iWork % LmPlane_COUNT;
+        u8* blob = stream->blobs[iWork];
+        if (blob)
+        {
+            i32 word;
+            const i32 bytes = PlaneStride(plane, &word) * len;
+            u8* shuffled = perm_malloc(bytes);
+            mz_ulong rawBytes = bytes;
+            if ((mz_uncompress(shuffled, &rawBytes, blob, stream->blobBytes[iWork]) == MZ_OK) &&
+                (rawBytes == (mz_ulong)bytes))
+            {
+                u8* raw = perm_malloc(bytes);
+                ByteUnshuffle(raw, shuffled, bytes, word);
+                DecodePlane(pack->lightmaps + iLightmap, plane, raw);
+                pim_free(raw);
+            }
+            else
+            {
+                store_i32(&stream->failed, 1, MO_Relaxed);
+            }
+            pim_free(shuffled);
+            pim_free(blob);
+            stream->blobs[iWork] = NULL;
+        }
+        dec_i32(stream->pending + iLightmap, MO_AcqRel);
+    }
+}
+
+static void lmstream_del(lmstream_t* stream)
+{
+    if (stream)
+    {
+        task_await(stream);
+        for (i32 i = 0; i < stream->lmCount * LmPlane_COUNT; ++i)
+        {
+            pim_free(stream->blobs[i]);
+        }
+        pim_free(stream->blobs);
+        pim_free(stream->blobBytes);
+        pim_free(stream->pending);
+        pim_free(stream->uploaded);
+        memset(stream, 0, sizeof(*stream));
+    }
+}
+
+// waits out the decode of a pack about to be freed
+static void lmstream_cancel(const lmpack_t* pack)
+{
+    if (ms_stream && (ms_stream->pack == pack))
+    {
+        lmstream_del(ms_stream);
+        ms_stream = NULL;
+    }
+}
+
+bool lmpack_stream(bool wait)
+{
+    lmstream_t *const stream = ms_stream;
+    if (!stream)
+    {
+        return false;
+    }
+    if (wait)
+    {
+        task_await(stream);
+    }
+
+    lmpack_t *const pack = stream->pack;
+    bool loading = false;
+    for (i32 i = 0; i < stream->lmCount; ++i)
+    {
+        if (!stream->uploaded[i])
+        {
+            if (load_i32(stream->pending + i, MO_Acquire) == 0)
+            {
+                lightmap_upload(pack->lightmaps + i);
+                stream->uploaded[i] = true;
+            }
+            else
+            {
+                loading = true;
+            }
+        }
+    }
+
+    if (!loading)
+    {
+        if (load_i32(&stream->failed, MO_Relaxed))
+        {
+            con_logf(LogSev_Error, "LM", "Some lightmap planes failed to decompress");
+        }
+        ms_stream = NULL;
+        lmstream_del(stream);
+    }
+    return loading;
+}
+
+bool lmpack_save(crate_t* crate, const lmpack_t* pack, bool bakeState)
+{
+    bool wrote = false;
+    ASSERT(pack);
+    if (pack == &ms_pack)
+    {
+        lmpack_stream(true);
+    }
+
+    const i32 lmcount = pack->lmCount;
+    const i32 lmsize = pack->lmSize;
+    const i32 texelcount = lmsize * lmsize;
+    bakeState = bakeState && !pack->stripped;
+    const i32 planeCount = PlaneCount(bakeState);
+
+    // write pack header
+    dlmpack_t dpack = { 0 };
+    dpack.version = kLmPackVersion;
+    dpack.directions = kGiDirections;
+    dpack.lmCount = lmcount;
+    dpack.lmSize = pack->lmSize;
+    dpack.bytesPerLightmap = PlanesBytes(texelcount, bakeState);
+    dpack.texelsPerMeter = pack->texelsPerMeter;
+    dpack.bakeState = bakeState;
+
+    if (crate_set(crate, guid_str("lmpack"), &dpack, sizeof(dpack)))
+    {
+        wrote = true;
+
+        task_SavePlanes* task = tmp_calloc(sizeof(*task));
+        task->pack = pack;
+        task->planeCount = planeCount;
+        task->blobs = tmp_calloc(sizeof(task->blobs[0]) * lmcount * planeCount);
+        task->blobBytes = tmp_calloc(sizeof(task->blobBytes[0]) * lmcount * planeCount);
+        task_run(&task->task, SavePlanesFn, lmcount * planeCount);
+
+        for (i32 i = 0; i < lmcount; ++i)
+        {
+            u8** blobs = task->blobs + i * planeCount;
+            const i32* blobBytes = task->blobBytes + i * planeCount;
+
+            dlightmap_t dlm = { 0 };
+            i32 bytes = sizeof(dlm);
+            for (i32 j = 0; j < planeCount; ++j)
+            {
+                wrote &= blobs[j] != NULL;
+                dlm.planeBytes[j] = blobBytes[j];
+                bytes += blobBytes[j];
+            }
+
+            if (wrote)
+            {
+                u8* entry = perm_malloc(bytes);
+                memcpy(entry, &dlm, sizeof(dlm));
+                u8* dst = entry + sizeof(dlm);
+                for (i32 j = 0; j < planeCount; ++j)
+                {
+                    memcpy(dst, blobs[j], blobBytes[j]);
+                    dst += blobBytes[j];
+                }
+                char name[PIM_PATH] = { 0 };
+                SPrintf(ARGS(name), "lightmap_%d", i);
+                wrote &= crate_set(crate, guid_str(name), entry, bytes);
+                pim_free(entry);
+            }
+
+            for (i32 j = 0; j < planeCount; ++j)
+            {
+                pim_free(blobs[j]);
+            }
+        }
+    }
+
+    return wrote;
+}
+
+bool lmpack_load(crate_t* crate, lmpack_t* pack)
+{
+    bool loaded = false;
+    lmpack_del(pack);
+
+    dlmpack_t dpack = { 0 };
+    if (crate_get(crate, guid_str("lmpack"), &dpack, sizeof(dpack)))
+    {
+        if ((dpack.version == kLmPackVersion) &&
+            (dpack.directions == kGiDirections) &&
+            (dpack.lmCount > 0) &&
+            (dpack.lmSize > 0) &&
+            ((dpack.lmSize % kLmTile) == 0))
+        {
+            loaded = true;
+
+            const i32 lmcount = dpack.lmCount;
+            const i32 lmsize = dpack.lmSize;
+
+            pack->lightmaps = perm_calloc(sizeof(pack->lightmaps[0]) * lmcount);
+            pack->lmCount = lmcount;
+            pack->lmSize = dpack.lmSize;
+            pack->texelsPerMeter = dpack.texelsPerMeter;
+            pack->stripped = !dpack.bakeState;
+
+            lmstream_t* stream = &ms_streams[(pack == &ms_pack) ? 0 : 1];
+            ASSERT(!stream->pack);
+            stream->pack = pack;
+            stream->lmCount = lmcount;
+            stream->blobs = perm_calloc(sizeof(stream->blobs[0]) * lmcount * LmPlane_COUNT);
+            stream->blobBytes = perm_calloc(sizeof(stream->blobBytes[0]) * lmcount * LmPlane_COUNT);
+            stream->pending = perm_calloc(sizeof(stream->pending[0]) * lmcount);
+            stream->uploaded = perm_calloc(sizeof(stream->uploaded[0]) * lmcount);
+
+            // the crate is read here, only decoding is left to the tasks
+            for (i32 i = 0; i < lmcount; ++i)
+            {
+                lightmap_new(pack->lightmaps + i, lmsize);
+                stream->pending[i] = LmPlane_COUNT;
+
+                char name[PIM_PATH] = { 0 };
+                SPrintf(ARGS(name), "lightmap_%d", i);
+                const guid_t id = guid_str(name);
+                i32 offset = 0;
+                i32 size = 0;
+                u8* entry = NULL;
+                if (crate_stat(crate, id, &offset, &size) && (size >= (i32)sizeof(dlightmap_t)))
+                {
+                    entry = perm_malloc(size);
+                    if (!crate_get(crate, id, entry, size))
+                    {
+                        pim_free(entry);
+                        entry = NULL;
+                    }
+                }
+                if (!entry)
+                {
+                    loaded = false;
+                    continue;
+                }
+
+                dlightmap_t dlm;
+                memcpy(&dlm, entry, sizeof(dlm));
+                const u8* src = entry + sizeof(dlm);
+                i32 left = size - (i32)sizeof(dlm);
+                for (i32 j = 0; j < LmPlane_COUNT; ++j)
+                {
+                    const i32 bytes = dlm.planeBytes[j];
+                    if ((bytes > 0) && (bytes <= left))
+                    {
+                        u8* blob = perm_malloc(bytes);
+                        memcpy(blob, src, bytes);
+                        stream->blobs[i * LmPlane_COUNT + j] = blob;
+                        stream->blobBytes[i * LmPlane_COUNT + j] = bytes;
+                        src += bytes;
+                        left -= bytes;
+                    }
+                    else if (bytes != 0)
+                    {
+                        loaded = false;
+                    }
+                }
+                pim_free(entry);
+            }
+
+            if (pack == &ms_pack)
+            {
+                lmdeps_snapshot();
+                ms_stream = stream;
+                task_submit(&stream->task, LoadPlanesFn, lmcount * LmPlane_COUNT);
+                task_sys_schedule();
+            }
+            else
+            {
+                // only the active pack streams
+                task_run(&stream->task, LoadPlanesFn, lmcount * LmPlane_COUNT);
+                for (i32 i = 0; i < lmcount; ++i)
+                {
+                    lightmap_upload(pack->lightmaps + i);
+                }
+                lmstream_del(stream);
+            }
+        }
+    }
 
     return loaded;
 }
 
 static cmdstat_t CmdPrintLm(i32 argc, const char** argv)
 {
+    lmpack_stream(true);
+
     char filename[PIM_PATH] = { 0 };
     const char* prefix = "lightmap";
     LmChannel channel = LmChannel_Color;
@@ -1643,50 +3270,29 @@ static cmdstat_t CmdPrintLm(i32 argc, const char** argv)
         const i32 len = lm.size * lm.size;
         buffer = tmp_realloc(buffer, sizeof(buffer[0]) * len);
 
-        const float3* pim_noalias srcBuffer = NULL;
-        switch (channel)
-        {
-        default:
-        case LmChannel_Position:
-            srcBuffer = lm.position;
-            break;
-        case LmChannel_Normal:
-            srcBuffer = lm.normal;
-            break;
-        }
-
-        if ((channel == LmChannel_Color) || (channel == LmChannel_Denoised))
-        {
-            for (i32 j = 0; j < len; ++j)
-            {
-                float4 ldr = tmap4_reinhard(f3_f4(srcBuffer[j], 1.0f));
-                u32 color = LinearToColor(ldr);
-                color |= 0xff << 24;
-                buffer[j] = color;
-            }
-        }
-        if (channel == LmChannel_Position)
-        {
-            for (i32 j = 0; j < len; ++j)
-            {
-                float3 pos = srcBuffer[j];
-                pos = f3_divvs(pos, 100.0f);
-                u32 color = f4_rgba8(f3_f4(pos, 1.0f));
-                color |= 0xff << 24;
-                buffer[j] = color;
-            }
-        }
-        if (channel == LmChannel_Normal)
+        for (i32 j = 0; j < len; ++j)
         {
-            for (i32 j = 0; j < len; ++j)
+            const lmtexel_t* pim_noalias texel = lm.texels + j;
+            const int2 c = lm_coord(lm.size, j);
+            float4 value = f4_0;
+            switch (channel)
             {
-                float3 norm = srcBuffer[j];
-                norm = f3_mulvs(norm, 0.5f);
-                norm = f3_addvs(norm, 0.5f);
-                u32 color = f4_rgba8(f3_f4(norm, 1.0f));
-                color |= 0xff << 24;
-                buffer[j] = color;
+            default:
+            case LmChannel_Color:
+            case LmChannel_Denoised:
+                value = tmap4_reinhard(lm_probe_decode(texel->probes[0]));
+                break;
+            case LmChannel_Position:
+                value = f3_f4(f3_divvs(f4_f3(lm_position(&lm, j)), 100.0f), 1.0f);
+                break;
+            case LmChannel_Normal:
+                value = f4_addvs(f4_mulvs(Oct16ToNormal(texel->normal), 0.5f), 0.5f);
+                break;
             }
+            u32 color = (channel == LmChannel_Color) || (channel == LmChannel_Denoised) ?
+                LinearToColor(value) : f4_rgba8(value);
+            color |= 0xff << 24;
+            buffer[c.x + c.y * lm.size] = color;
         }
 
         SPrintf(ARGS(filename), "%s_%d.png", prefix, i);
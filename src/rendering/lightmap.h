@@ -8,8 +8,10 @@
 
 PIM_C_BEGIN
 
-#define kLmPackVersion      2
+#define kLmPackVersion      3
 #define kGiDirections       5
+// texels are stored in square tiles of this width
+#define kLmTile             8
 
 static const float4 kGiAxii[kGiDirections] =
 {
@@ -24,12 +26,30 @@ typedef struct task_s task_t;
 typedef struct pt_scene_s pt_scene_t;
 typedef struct crate_s crate_t;
 
+// everything the bake reads and writes for one texel, kept together
+// in one cache line
+typedef struct lmtexel_s
+{
+    // SG lobes, see lm_probe_decode
+    ushort4 probes[kGiDirections];
+    // running mean and squared deviation sum of sample luminance (Welford)
+    float2 lumMoments;
+    float sampleCount;
+    // octahedral
+    short2 normal;
+    // steps from the origin of the texel's tile, see lightmap_t.tileFrames
+    ushort3 position;
+} lmtexel_t;
+SASSERT(sizeof(lmtexel_t) == 64);
+
 typedef struct lightmap_s
 {
-    float4* pim_noalias probes[kGiDirections];
-    float3* pim_noalias position;
-    float3* pim_noalias normal;
-    float* pim_noalias sampleCounts;
+    // size * size texels in tiles of kLmTile * kLmTile, see lm_index
+    lmtexel_t* pim_noalias texels;
+    // nonzero for each tile baked since it was last uploaded
+    i32* pim_noalias dirtyTiles;
+    // per tile, xyz: low corner of the texel positions, w: meters per step
+    float4* pim_noalias tileFrames;
     i32 size;
     vkrTextureId slot;
 } lightmap_t;
@@ -41,6 +61,8 @@ typedef struct lmpack_s
     i32 lmCount;
     i32 lmSize;
     float texelsPerMeter;
+    // loaded without bake state, baking needs a repack
+    bool stripped;
 } lmpack_t;
 
 typedef struct dlmpack_s
@@ -49,14 +71,82 @@ typedef struct dlmpack_s
     i32 directions;
     i32 lmCount;
     i32 lmSize;
+    // uncompressed
     i32 bytesPerLightmap;
     float texelsPerMeter;
+    // positions, normals and sample statistics are saved
+    i32 bakeState;
 } dlmpack_t;
 
+// storage index of the texel at (x, y)
+pim_inline i32 VEC_CALL lm_index(i32 size, i32 x, i32 y)
+{
+    const i32 tilesPerRow = size / kLmTile;
+    const i32 tile = (y / kLmTile) * tilesPerRow + (x / kLmTile);
+    return tile * (kLmTile * kLmTile) + (y % kLmTile) * kLmTile + (x % kLmTile);
+}
+
+// coordinate of the texel at storage index i
+pim_inline int2 VEC_CALL lm_coord(i32 size, i32 i)
+{
+    const i32 tilesPerRow = size / kLmTile;
+    const i32 tile = i / (kLmTile * kLmTile);
+    const i32 j = i % (kLmTile * kLmTile);
+    int2 coord;
+    coord.x = (tile % tilesPerRow) * kLmTile + (j % kLmTile);
+    coord.y = (tile / tilesPerRow) * kLmTile + (j / kLmTile);
+    return coord;
+}
+
+// an SG lobe in 8 bytes: xyz hold the rgb amplitude as 16 bit mantissas
+// under a shared exponent, w the lobe's fit weight as 11 bit unorm over
+// the 5 bit biased exponent
+#define kLmProbeExpBias     15
+
+pim_inline float4 VEC_CALL lm_probe_decode(ushort4 q)
+{
+    // mantissa * 2^(e - 16), built from the float's exponent bits
+    typedef union { float f; u32 u; } f32_t;
+    const i32 e = (q.w & 31) - kLmProbeExpBias;
+    const f32_t scale = { .u = (u32)(127 + e - 16) << 23 };
+    float4 probe;
+    probe.x = q.x * scale.f;
+    probe.y = q.y * scale.f;
+    probe.z = q.z * scale.f;
+    probe.w = (q.w >> 5) * (1.0f / 2047.0f);
+    return probe;
+}
+
+// dither in [0, 1): 0.5 rounds to nearest, uniform noise rounds
+// stochastically so that running means keep moving by less than a step
+ushort4 VEC_CALL lm_probe_encode(float4 probe, float dither);
+
+// position of the texel at storage index i
+pim_inline float4 VEC_CALL lm_position(const lightmap_t* lm, i32 i)
+{
+    const float4 frame = lm->tileFrames[i / (kLmTile * kLmTile)];
+    const ushort3 q = lm->texels[i].position;
+    float4 position;
+    position.x = frame.x + q.x * frame.w;
+    position.y = frame.y + q.y * frame.w;
+    position.z = frame.z + q.z * frame.w;
+    position.w = 1.0f;
+    return position;
+}
+
+// bytes per texel, sizeof(lmtexel_t)
+i32 lightmap_texelbytes(void);
+// bytes of tile frames per lightmap of this size
+i32 lightmap_framebytes(i32 size);
+// size must be a multiple of kLmTile
 void lightmap_new(lightmap_t* lm, i32 size);
 void lightmap_del(lightmap_t* lm);
-// upload changes to the GPU copy
+// upload changes to the GPU copy, converted to rows of half floats
 void lightmap_upload(lightmap_t* lm);
+// upload only the dirty tiles, returns the number of bytes sent
+i32 lightmap_upload_dirty(lightmap_t* lm);
+// bilinear sample of every probe direction, clamped to the edges
+void lightmap_sample(const lightmap_t* lm, float2 uv, float4* probesOut);
 
 lmpack_t* lmpack_get(void);
 lmpack_t lmpack_pack(
@@ -66,9 +156,51 @@ lmpack_t lmpack_pack(
     float degThresh);
 void lmpack_del(lmpack_t* pack);
 
-void lmpack_bake(pt_scene_t* scene, float timeSlice, i32 spp);
+typedef struct lmbakestats_s
+{
+    // texels covered by geometry
+    i32 texels;
+    // texels within the error target or at the sample cap
+    i32 converged;
+    // samples taken, and estimated samples left until every texel converges
+    double samples;
+    double samplesLeft;
+    double samplesPerSecond;
+    // seconds until converged, negative while unknown
+    double eta;
+} lmbakestats_t;
+
+// bakes up to timeSlice of the texels per call, spp samples each,
+// worst first among those whose mean luminance has a relative standard
+// error above maxError. texels stop at maxSpp samples.
+void lmpack_bake(
+    pt_scene_t* scene,
+    float timeSlice,
+    i32 spp,
+    float maxError,
+    i32 minSpp,
+    i32 maxSpp);
+const lmbakestats_t* lmpack_bake_stats(void);
+// reranks every texel on the next bake, after texels changed outside it
+void lmpack_bake_reset(void);
+
+// number of drawables moved, restyled, added or removed since the pack
+// was made, loaded or last rebaked. added drawables have no charts in the
+// atlas, so they need a repack.
+i32 lmpack_edits(bool* needsRepack);
+// restarts only the texels those edits could have changed: texels of moved
+// drawables, and texels in sight of an edited region and within reach
+// meters of it, or at any distance for emissive edits.
+// scene must already contain the edits. returns texels restarted.
+i32 lmpack_rebake(pt_scene_t* scene, float reach);
 
-bool lmpack_save(crate_t* crate, const lmpack_t* src);
+// bakeState: also save what resuming the bake needs, without it
+// the pack is only good for rendering
+bool lmpack_save(crate_t* crate, const lmpack_t* src, bool bakeState);
+// lightmaps of the active pack finish decoding on the task system
 bool lmpack_load(crate_t* crate, lmpack_t* dst);
+// uploads lightmaps of the active pack that finished decoding.
+// wait: finish decoding first. returns true while some are still loading.
+bool lmpack_stream(bool wait);
 
 PIM_C_END
@@ -91,7 +91,7 @@ typedef struct task_mipc32_s
     int2 dstSize;
 } task_mipc32_t;
 
-static void mipmap_c32fn(task_t* pbase, i32 begin, i32 end)
+static void mipmap_c32fn(void* pbase, i32 begin, i32 end)
 {
     task_mipc32_t* task = (task_mipc32_t*)pbase;
     u32 const *const pim_noalias srcMip = task->srcMip;
@@ -143,7 +143,7 @@ typedef struct task_mipf32_s
     int2 dstSize;
 } task_mipf32_t;
 
-static void mipmap_f32fn(task_t* pbase, i32 begin, i32 end)
+static void mipmap_f32fn(void* pbase, i32 begin, i32 end)
 {
     task_mipf32_t* task = (task_mipf32_t*)pbase;
     float const *const pim_noalias srcMip = task->srcMip;
@@ -181,3 +181,105 @@ void mipmap_f32(float* mipChain, int2 size)
     }
     ProfileEnd(pm_mipmap_f32);
 }
+
+typedef struct task_mipdir8_s
+{
+    task_t task;
+    const u32* srcMip;
+    u32* dstMip;
+    int2 srcSize;
+    int2 dstSize;
+} task_mipdir8_t;
+
+static void mipmap_dir8fn(void* pbase, i32 begin, i32 end)
+{
+    task_mipdir8_t* task = (task_mipdir8_t*)pbase;
+    u32 const *const pim_noalias srcMip = task->srcMip;
+    u32 *const pim_noalias dstMip = task->dstMip;
+    const int2 srcSize = task->srcSize;
+    const int2 dstSize = task->dstSize;
+    for (i32 i = begin; i < end; ++i)
+    {
+        int2 c = i2_mulvs(IndexToCoord(dstSize, i), 2);
+        i32 ia = Clamp(srcSize, i2_v(c.x + 0, c.y + 0));
+        i32 ib = Clamp(srcSize, i2_v(c.x + 1, c.y + 0));
+        i32 ic = Clamp(srcSize, i2_v(c.x + 0, c.y + 1));
+        i32 id = Clamp(srcSize, i2_v(c.x + 1, c.y + 1));
+        float4 va = ColorToDirection_fast(srcMip[ia]);
+        float4 vb = ColorToDirection_fast(srcMip[ib]);
+        float4 vc = ColorToDirection_fast(srcMip[ic]);
+        float4 vd = ColorToDirection_fast(srcMip[id]);
+        float4 v = f4_add(f4_add(va, vb), f4_add(vc, vd));
+        // DirectionToColor renormalizes
+        dstMip[i] = DirectionToColor(v);
+    }
+}
+
+ProfileMark(pm_mipmap_dir8, mipmap_dir8)
+void mipmap_dir8(u32* mipChain, int2 size)
+{
+    ProfileBegin(pm_mipmap_dir8);
+    i32 mipCount = CalcMipCount(size);
+    for (i32 dstMip = 1; dstMip < mipCount; ++dstMip)
+    {
+        i32 srcMip = dstMip - 1;
+        task_mipdir8_t* task = tmp_calloc(sizeof(*task));
+        task->srcMip = mipChain + CalcMipOffset(size, srcMip);
+        task->dstMip = mipChain + CalcMipOffset(size, dstMip);
+        task->srcSize = CalcMipSize(size, srcMip);
+        task->dstSize = CalcMipSize(size, dstMip);
+        task_run(&task->task, mipmap_dir8fn, CalcMipLen(size, dstMip));
+    }
+    ProfileEnd(pm_mipmap_dir8);
+}
+
+typedef struct task_mipxy16_s
+{
+    task_t task;
+    const short2* srcMip;
+    short2* dstMip;
+    int2 srcSize;
+    int2 dstSize;
+} task_mipxy16_t;
+
+static void mipmap_xy16fn(void* pbase, i32 begin, i32 end)
+{
+    task_mipxy16_t* task = (task_mipxy16_t*)pbase;
+    short2 const *const pim_noalias srcMip = task->srcMip;
+    short2 *const pim_noalias dstMip = task->dstMip;
+    const int2 srcSize = task->srcSize;
+    const int2 dstSize = task->dstSize;
+    for (i32 i = begin; i < end; ++i)
+    {
+        int2 c = i2_mulvs(IndexToCoord(dstSize, i), 2);
+        i32 ia = Clamp(srcSize, i2_v(c.x + 0, c.y + 0));
+        i32 ib = Clamp(srcSize, i2_v(c.x + 1, c.y + 0));
+        i32 ic = Clamp(srcSize, i2_v(c.x + 0, c.y + 1));
+        i32 id = Clamp(srcSize, i2_v(c.x + 1, c.y + 1));
+        float4 va = Xy16ToNormalTs(srcMip[ia]);
+        float4 vb = Xy16ToNormalTs(srcMip[ib]);
+        float4 vc = Xy16ToNormalTs(srcMip[ic]);
+        float4 vd = Xy16ToNormalTs(srcMip[id]);
+        float4 v = f4_add(f4_add(va, vb), f4_add(vc, vd));
+        // NormalTsToXy16 renormalizes
+        dstMip[i] = NormalTsToXy16(v);
+    }
+}
+
+ProfileMark(pm_mipmap_xy16, mipmap_xy16)
+void mipmap_xy16(short2* mipChain, int2 size)
+{
+    ProfileBegin(pm_mipmap_xy16);
+    i32 mipCount = CalcMipCount(size);
+    for (i32 dstMip = 1; dstMip < mipCount; ++dstMip)
+    {
+        i32 srcMip = dstMip - 1;
+        task_mipxy16_t* task = tmp_calloc(sizeof(*task));
+        task->srcMip = mipChain + CalcMipOffset(size, srcMip);
+        task->dstMip = mipChain + CalcMipOffset(size, dstMip);
+        task->srcSize = CalcMipSize(size, srcMip);
+        task->dstSize = CalcMipSize(size, dstMip);
+        task_run(&task->task, mipmap_xy16fn, CalcMipLen(size, dstMip));
+    }
+    ProfileEnd(pm_mipmap_xy16);
+}
@@ -14,5 +14,7 @@ float* mipmap_new_f32(int2 size, EAlloc allocator);
 void mipmap_f4(float4* mipChain, int2 size);
 void mipmap_c32(u32* mipChain, int2 size);
 void mipmap_f32(float* mipChain, int2 size);
+void mipmap_dir8(u32* mipChain, int2 size);
+void mipmap_xy16(short2* mipChain, int2 size);
 
 PIM_C_END
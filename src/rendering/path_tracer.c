@@ -21,8 +21,10 @@
 #include "math/lighting.h"
 #include "math/atmosphere.h"
 #include "math/dist1d.h"
+#include "math/lighttree.h"
 #include "math/grid.h"
 #include "math/box.h"
+#include "containers/dict.h"
 
 #include "allocator/allocator.h"
 #include "threading/task.h"
@@ -30,24 +32,38 @@
 #include "common/profiler.h"
 #include "common/console.h"
 #include "common/cvar.h"
+#include "common/cmd.h"
 #include "common/stringutil.h"
 #include "common/serialize.h"
 #include "common/atomics.h"
 #include "common/time.h"
+#include "common/fnv1a.h"
+#include "common/nextpow2.h"
 #include "ui/cimgui_ext.h"
 
 #include "stb/stb_perlin_fork.h"
 #include <string.h>
+#include <stdlib.h>
+#include <float.h>
 
 // ----------------------------------------------------------------------------
 
+// additive recurrence slots in pt_sampler_t::Xi,
+// used when no sobol sequence is active
 typedef enum LdsSlot
 {
+    LdsSlot_Roulette,
+    LdsSlot_LightSelect,
     LdsSlot_Brdf,
-    LdsSlot_MeanFreePath,
+    LdsSlot_Scatter,
+    LdsSlot_PhaseDir,
+    LdsSlot_UvX,
+    LdsSlot_UvY,
+    LdsSlot_Dof,
 
     LdsSlot_COUNT
 } LdsSlot;
+SASSERT(LdsSlot_COUNT == NELEM(((pt_sampler_t*)0)->Xi));
 
 typedef struct surfhit_s
 {
@@ -87,7 +103,6 @@ typedef struct media_desc_s
     float4 noiseAlbedo;
     float4 logConstantAlbedo;
     float4 logNoiseAlbedo;
-    float rcpMajorant;
     float absorption;
     float constantAmt;
     float noiseAmt;
@@ -114,23 +129,27 @@ typedef struct pt_scene_s
 {
     RTCScene rtcScene;
 
-    // all geometry within the scene
-    // xyz: vertex position
+    // all geometry within the scene, as deduplicated vertices
+    // xyz: vertex position, shared with embree
     //   w: 1
     // [vertCount]
     float4* pim_noalias positions;
-    // xyz: vertex normal
+    // octahedral vertex normal
     // [vertCount]
-    float4* pim_noalias normals;
+    short2* pim_noalias normals;
     //  xy: texture coordinate
     // [vertCount]
     float2* pim_noalias uvs;
-    // material indices
-    // [vertCount]
+    // three vertex indices per triangle, shared with embree.
+    // triangles are referred to by their first index, iVert.
+    // [indexCount]
+    i32* pim_noalias indices;
+    // material index per triangle
+    // [indexCount / 3]
     i32* pim_noalias matIds;
-    // emissive index
-    // [vertCount]
-    i32* pim_noalias vertToEmit;
+    // emissive index per triangle
+    // [indexCount / 3]
+    i32* pim_noalias triToEmit;
 
     // emissive triangle indices
     // [emissiveCount]
@@ -140,10 +159,40 @@ typedef struct pt_scene_s
     // [portalCount]
     i32* pim_noalias portals;
 
-    // grid of discrete light distributions
+    // hierarchy over emissives for light selection
+    lighttree_t lightTree;
+
+    // grid of discrete light distributions, when pt_light_grid is enabled
+    // cells are hashed by grid index. a lookup during a trace only claims
+    // the cell; pt_scene_update builds it, so every lookup within a trace
+    // sees the same set of cells.
     grid_t lightGrid;
-    // [lightGrid.size]
-    dist1d_t* pim_noalias lightDists;
+    // grid index of each slot, -1 when empty
+    // [lightCellCapacity]
+    i32* pim_noalias lightCellKeys;
+    // distribution of each slot, NULL until built
+    // [lightCellCapacity]
+    dist1d_t** pim_noalias lightCells;
+    // nonzero when a slot is queued in lightDirtySlots
+    // [lightCellCapacity]
+    i32* pim_noalias lightCellDirty;
+    // slots whose live counts changed since the last UpdateDists
+    // [lightDirtyCount]
+    i32* pim_noalias lightDirtySlots;
+    // slots claimed since the last BuildLightCells
+    // [lightPendingCount]
+    i32* pim_noalias lightPendingSlots;
+
+    // coarse bounds of the media extinction per horizontal slab of the
+    // scene, for delta and ratio tracking. only the height fog varies, and
+    // its bounds only depend on height.
+    // height of the bottom of slab 0
+    float mediaLo;
+    float mediaSlabsPerMeter;
+    // x: extinction majorant
+    // y: majorant of the extinction above the constant media, 0 when homogeneous
+    // [mediaSlabCount]
+    float2* pim_noalias mediaSlabs;
 
     // surface description, indexed by matIds
     // [matCount]
@@ -153,11 +202,22 @@ typedef struct pt_scene_s
 
     // array lengths
     i32 vertCount;
+    i32 indexCount;
     i32 matCount;
     i32 emissiveCount;
     i32 portalCount;
+    i32 lightCellCapacity;
+    i32 lightDirtyCount;
+    i32 lightPendingCount;
+    i32 mediaSlabCount;
     // parameters
     media_desc_t mediaDesc;
+    // gui edits, applied by the next pt_scene_update while no trace runs
+    media_desc_t mediaDescNext;
+    bool mediaDescDirty;
+    // every light cell is built and hits no longer adjust them,
+    // see pt_scene_freeze_lights
+    bool lightsFrozen;
 } pt_scene_t;
 
 // ----------------------------------------------------------------------------
@@ -173,12 +233,24 @@ static float EmissionPdf(
     pt_sampler_t*const pim_noalias sampler,
     const pt_scene_t*const pim_noalias scene,
     i32 iVert,
-    i32 attempts);
-static void CalcEmissionPdfFn(task_t* pbase, i32 begin, i32 end);
+    i32 attempts,
+    float skyLum,
+    float*const pim_noalias lumOut);
+static float SkyLuminance(const pt_scene_t*const pim_noalias scene);
+static void CalcEmissionPdfFn(void* pbase, i32 begin, i32 end);
 static void SetupEmissives(pt_scene_t*const pim_noalias scene);
 static void SetupPortals(pt_scene_t* scene);
-static void SetupLightGridFn(task_t* pbase, i32 begin, i32 end);
+static bool VEC_CALL InsideLevel(
+    const pt_scene_t*const pim_noalias scene,
+    float4 position,
+    float radius);
+static dist1d_t* BuildLightCell(
+    const pt_scene_t*const pim_noalias scene,
+    i32 iCell);
+static void BuildLightCells(pt_scene_t*const pim_noalias scene);
 static void SetupLightGrid(pt_scene_t*const pim_noalias scene);
+static void SetupMediaGrid(pt_scene_t*const pim_noalias scene);
+static void UpdateMediaGrid(pt_scene_t*const pim_noalias scene);
 
 static void media_desc_new(media_desc_t *const desc);
 static void media_desc_update(media_desc_t *const desc);
@@ -224,7 +296,8 @@ pim_inline surfhit_t VEC_CALL GetSurface(
     float4 ro,
     float4 rd,
     rayhit_t hit,
-    i32 bounce);
+    i32 bounce,
+    float coneWidth);
 pim_inline rayhit_t VEC_CALL pt_intersect_local(
     const pt_scene_t*const pim_noalias scene,
     float4 ro,
@@ -301,6 +374,11 @@ pim_inline bool VEC_CALL EvaluateLight(
 pim_inline float4 VEC_CALL AlbedoToLogAlbedo(float4 albedo);
 pim_inline float2 VEC_CALL Media_Density(media_desc_t const *const desc, float4 P);
 pim_inline media_t VEC_CALL Media_Sample(media_desc_t const *const desc, float4 P);
+pim_inline media_t VEC_CALL Media_Constant(media_desc_t const *const desc);
+pim_inline float2 VEC_CALL Media_Bounds(
+    media_desc_t const *const desc,
+    float yLo,
+    float yHi);
 pim_inline float4 VEC_CALL Media_Albedo(media_desc_t const *const desc, float4 P);
 pim_inline float4 VEC_CALL Media_Normal(media_desc_t const *const desc, float4 P);
 pim_inline media_t VEC_CALL Media_Lerp(media_t lhs, media_t rhs, float t);
@@ -350,65 +428,62 @@ pim_inline void VEC_CALL SetSampler(pt_sampler_t sampler);
 
 pim_inline float VEC_CALL Sample1D(pt_sampler_t*const pim_noalias sampler);
 pim_inline float2 VEC_CALL Sample2D(pt_sampler_t*const pim_noalias sampler);
+pim_inline void VEC_CALL LdsBegin(pt_sampler_t*const pim_noalias sampler, u32 key, u32 index);
+pim_inline void VEC_CALL LdsEnd(pt_sampler_t*const pim_noalias sampler);
 
-pim_inline float VEC_CALL RoulettePrng(pt_sampler_t *const pim_noalias sampler)
+pim_inline float VEC_CALL LdsRecurrence(
+    pt_sampler_t *const pim_noalias sampler,
+    LdsSlot slot,
+    float alpha)
 {
-    float Xi = sampler->Xi[0];
-    Xi += (kGoldenRatio - 1.0f);
+    if (sampler->ldsDim >= 0)
+    {
+        return Sample1D(sampler);
+    }
+    float Xi = sampler->Xi[slot];
+    Xi += alpha;
     Xi = (Xi >= 1.0f) ? (Xi - 1.0f) : Xi;
-    sampler->Xi[0] = Xi;
+    sampler->Xi[slot] = Xi;
     return Xi;
 }
+
+pim_inline float VEC_CALL RoulettePrng(pt_sampler_t *const pim_noalias sampler)
+{
+    return LdsRecurrence(sampler, LdsSlot_Roulette, kGoldenRatio - 1.0f);
+}
 pim_inline float VEC_CALL LightSelectPrng(pt_sampler_t *const pim_noalias sampler)
 {
-    float Xi = sampler->Xi[1];
-    Xi += (kSqrt2 - 1.0f);
-    Xi = (Xi >= 1.0f) ? (Xi - 1.0f) : Xi;
-    sampler->Xi[1] = Xi;
-    return Xi;
+    return LdsRecurrence(sampler, LdsSlot_LightSelect, kSqrt2 - 1.0f);
 }
 pim_inline float VEC_CALL BrdfPrng(pt_sampler_t*const pim_noalias sampler)
 {
-    float Xi = sampler->Xi[2];
-    Xi += (kSqrt3 - 1.0f);
-    Xi = (Xi >= 1.0f) ? (Xi - 1.0f) : Xi;
-    sampler->Xi[2] = Xi;
-    return Xi;
+    return LdsRecurrence(sampler, LdsSlot_Brdf, kSqrt3 - 1.0f);
 }
 pim_inline float VEC_CALL ScatterPrng(pt_sampler_t *const pim_noalias sampler)
 {
-    float Xi = sampler->Xi[3];
-    Xi += (kSqrt5 - 2.0f);
-    Xi = (Xi >= 1.0f) ? (Xi - 1.0f) : Xi;
-    sampler->Xi[3] = Xi;
-    return Xi;
+    return LdsRecurrence(sampler, LdsSlot_Scatter, kSqrt5 - 2.0f);
 }
 pim_inline float VEC_CALL PhaseDirPrng(pt_sampler_t *const pim_noalias sampler)
 {
-    float Xi = sampler->Xi[4];
-    Xi += (kSqrt7 - 2.0f);
-    Xi = (Xi >= 1.0f) ? (Xi - 1.0f) : Xi;
-    sampler->Xi[4] = Xi;
-    return Xi;
+    return LdsRecurrence(sampler, LdsSlot_PhaseDir, kSqrt7 - 2.0f);
 }
 pim_inline float2 VEC_CALL UvPrng(pt_sampler_t *const pim_noalias sampler)
 {
-    float Xi = sampler->Xi[5];
-    Xi += (kSqrt11 - 3.0f);
-    Xi = (Xi >= 1.0f) ? (Xi - 1.0f) : Xi;
-    sampler->Xi[5] = Xi;
-    float Yi = sampler->Xi[6];
-    Yi += (kSqrt17 - 4.0f);
-    Yi = (Yi >= 1.0f) ? (Yi - 1.0f) : Yi;
-    sampler->Xi[6] = Yi;
+    if (sampler->ldsDim >= 0)
+    {
+        return Sample2D(sampler);
+    }
+    float Xi = LdsRecurrence(sampler, LdsSlot_UvX, kSqrt11 - 3.0f);
+    float Yi = LdsRecurrence(sampler, LdsSlot_UvY, kSqrt17 - 4.0f);
     return f2_v(Xi, Yi);
 }
 pim_inline float2 VEC_CALL DofPrng(pt_sampler_t *const pim_noalias sampler)
 {
-    float Xi = sampler->Xi[7];
-    Xi += (kSqrt13 - 3.0f);
-    Xi = (Xi >= 1.0f) ? (Xi - 1.0f) : Xi;
-    sampler->Xi[7] = Xi;
+    if (sampler->ldsDim >= 0)
+    {
+        return Sample2D(sampler);
+    }
+    float Xi = LdsRecurrence(sampler, LdsSlot_Dof, kSqrt13 - 3.0f);
     return f2_v(Xi, Sample1D(sampler));
 }
 // ----------------------------------------------------------------------------
@@ -443,6 +518,64 @@ static cvar_t cv_pt_dist_samples =
     .desc = "path tracer light distribution minimum samples per update",
 };
 
+static cvar_t cv_pt_light_grid =
+{
+    .type = cvart_bool,
+    .name = "pt_light_grid",
+    .value = "0",
+    .desc = "path tracer selects lights from a learned per-cell grid instead of the light tree, on scene rebuild",
+};
+
+// off by default so existing renders keep a uniform sample count per pixel.
+// safe to enable: each pixel stays unbiased, only its noise level differs.
+static cvar_t cv_pt_adaptive =
+{
+    .type = cvart_bool,
+    .name = "pt_adaptive",
+    .value = "0",
+    .desc = "path tracer spends samples on noisy tiles and stops on converged pixels",
+};
+
+static cvar_t cv_pt_adaptive_min =
+{
+    .type = cvart_int,
+    .name = "pt_adaptive_min",
+    .value = "32",
+    .minInt = 4,
+    .maxInt = 1 << 16,
+    .desc = "path tracer samples per pixel before adaptive sampling may skip it",
+};
+
+static cvar_t cv_pt_adaptive_error =
+{
+    .type = cvart_float,
+    .name = "pt_adaptive_error",
+    .value = "0.01",
+    .minFloat = 0.0001f,
+    .maxFloat = 1.0f,
+    .desc = "path tracer relative standard error at which a pixel is converged",
+};
+
+static cvar_t cv_pt_history_max =
+{
+    .type = cvart_int,
+    .name = "pt_history_max",
+    .value = "64",
+    .minInt = 1,
+    .maxInt = 1 << 16,
+    .desc = "path tracer samples per pixel kept when reprojecting to a moved camera",
+};
+
+static cvar_t cv_pt_media_meters =
+{
+    .type = cvart_float,
+    .name = "pt_media_meters",
+    .value = "2",
+    .minFloat = 0.25f,
+    .maxFloat = 64.0f,
+    .desc = "path tracer media majorant slab height, on scene rebuild",
+};
+
 static cvar_t cv_pt_retro =
 {
     .type = cvart_bool,
@@ -454,6 +587,213 @@ static cvar_t cv_pt_retro =
 static RTCDevice ms_device;
 static pt_sampler_t ms_samplers[kMaxThreads];
 
+// per thread counters, on their own cache lines so threads don't share them
+typedef struct threadstats_s
+{
+    pim_alignas(64) pt_stats_t value;
+} threadstats_t;
+
+// running totals, only ever written by their own thread.
+// GatherStats reads them without resetting, so no count is lost to a
+// thread that is still tracing, and reports the change since last frame.
+static threadstats_t ms_threadStats[kMaxThreads];
+static pt_stats_t ms_statsTotal;
+static pt_stats_t ms_frameStats;
+static u64 ms_statsTick;
+
+pim_inline pt_stats_t* VEC_CALL ThreadStats(void)
+{
+    return &ms_threadStats[task_thread_id()].value;
+}
+
+pim_inline void VEC_CALL StatAdd(u64* counter, u64 count)
+{
+    store_u64(counter, *counter + count, MO_Relaxed);
+}
+
+// depth: bounces made before this ray
+// camera: the path starts at the camera, rather than at a bake texel or probe
+pim_inline void VEC_CALL StatPathRay(i32 depth, bool camera)
+{
+    pt_stats_t* stats = ThreadStats();
+    if (depth > 0)
+    {
+        StatAdd(&stats->secondaryRays, 1);
+    }
+    else if (camera)
+    {
+        StatAdd(&stats->primaryRays, 1);
+    }
+    else
+    {
+        StatAdd(&stats->bakeRays, 1);
+    }
+}
+
+// depth: bounces made before the path ended
+pim_inline void VEC_CALL StatPathEnd(i32 depth)
+{
+    StatAdd(&ThreadStats()->bounces[i1_clamp(depth, 0, kPtStatBounces - 1)], 1);
+}
+
+#define STAT_SUM(field) dst->field += load_u64(&src->field, MO_Relaxed)
+static void SumStats(pt_stats_t* dst, const pt_stats_t* src)
+{
+    STAT_SUM(primaryRays);
+    STAT_SUM(secondaryRays);
+    STAT_SUM(bakeRays);
+    STAT_SUM(lookupRays);
+    STAT_SUM(shadowRays);
+    STAT_SUM(pointQueries);
+    STAT_SUM(mediaSteps);
+    STAT_SUM(rouletteKills);
+    for (i32 i = 0; i < kPtStatBounces; ++i)
+    {
+        STAT_SUM(bounces[i]);
+    }
+}
+#undef STAT_SUM
+
+#define STAT_DIFF(field) dst->field = lhs->field - rhs->field
+static void DiffStats(pt_stats_t* dst, const pt_stats_t* lhs, const pt_stats_t* rhs)
+{
+    STAT_DIFF(primaryRays);
+    STAT_DIFF(secondaryRays);
+    STAT_DIFF(bakeRays);
+    STAT_DIFF(lookupRays);
+    STAT_DIFF(shadowRays);
+    STAT_DIFF(pointQueries);
+    STAT_DIFF(mediaSteps);
+    STAT_DIFF(rouletteKills);
+    for (i32 i = 0; i < kPtStatBounces; ++i)
+    {
+        STAT_DIFF(bounces[i]);
+    }
+}
+#undef STAT_DIFF
+
+// counts made by tasks still in flight land in this frame or the next
+static void GatherStats(void)
+{
+    const u64 now = time_now();
+    pt_stats_t total = { 0 };
+    const i32 numthreads = task_thread_ct();
+    for (i32 i = 0; i < numthreads; ++i)
+    {
+        SumStats(&total, &ms_threadStats[i].value);
+    }
+    pt_stats_t frame = { 0 };
+    DiffStats(&frame, &total, &ms_statsTotal);
+    frame.seconds = ms_statsTick ? time_sec(now - ms_statsTick) : 0.0;
+    ms_statsTick = now;
+    ms_statsTotal = total;
+    ms_frameStats = frame;
+}
+
+const pt_stats_t* pt_stats_get(void)
+{
+    return &ms_frameStats;
+}
+
+double pt_stats_mrays(const pt_stats_t* stats)
+{
+    if (stats->seconds <= 0.0)
+    {
+        return 0.0;
+    }
+    double rays =
+        (double)stats->primaryRays +
+        (double)stats->secondaryRays +
+        (double)stats->bakeRays +
+        (double)stats->lookupRays +
+        (double)stats->shadowRays;
+    return (rays * 1e-6) / stats->seconds;
+}
+
+static void StatsGui(const pt_stats_t* stats)
+{
+    if (igExCollapsingHeader1("pt stats"))
+    {
+        igIndent(0.0f);
+        igText("Mrays/s: %.2f", pt_stats_mrays(stats));
+        igText("Primary Rays: %.0f", (double)stats->primaryRays);
+        igText("Secondary Rays: %.0f", (double)stats->secondaryRays);
+        igText("Bake Rays: %.0f", (double)stats->bakeRays);
+        igText("Lookup Rays: %.0f", (double)stats->lookupRays);
+        igText("Shadow Rays: %.0f", (double)stats->shadowRays);
+        igText("Point Queries: %.0f", (double)stats->pointQueries);
+        igText("Media Steps: %.0f", (double)stats->mediaSteps);
+        igText("Roulette Kills: %.0f", (double)stats->rouletteKills);
+        if (igExCollapsingHeader1("bounce depth"))
+        {
+            for (i32 i = 0; i < kPtStatBounces; ++i)
+            {
+                igText("%2d%s: %.0f", i, (i == kPtStatBounces - 1) ? "+" : " ", (double)stats->bounces[i]);
+            }
+        }
+        igUnindent(0.0f);
+    }
+}
+
+static ser_obj_t* StatsToJson(const pt_stats_t* stats)
+{
+    ser_obj_t* root = ser_obj_dict();
+    ser_dict_set(root, "mraysPerSec", ser_obj_num(pt_stats_mrays(stats)));
+    ser_dict_set(root, "seconds", ser_obj_num(stats->seconds));
+    ser_dict_set(root, "primaryRays", ser_obj_num((double)stats->primaryRays));
+    ser_dict_set(root, "secondaryRays", ser_obj_num((double)stats->secondaryRays));
+    ser_dict_set(root, "bakeRays", ser_obj_num((double)stats->bakeRays));
+    ser_dict_set(root, "lookupRays", ser_obj_num((double)stats->lookupRays));
+    ser_dict_set(root, "shadowRays", ser_obj_num((double)stats->shadowRays));
+    ser_dict_set(root, "pointQueries", ser_obj_num((double)stats->pointQueries));
+    ser_dict_set(root, "mediaSteps", ser_obj_num((double)stats->mediaSteps));
+    ser_dict_set(root, "rouletteKills", ser_obj_num((double)stats->rouletteKills));
+    ser_obj_t* bounces = ser_obj_array();
+    for (i32 i = 0; i < kPtStatBounces; ++i)
+    {
+        ser_array_add(bounces, ser_obj_num((double)stats->bounces[i]));
+    }
+    ser_dict_set(root, "bounces", bounces);
+    return root;
+}
+
+// pt_stats [file.json]
+static cmdstat_t CmdPtStats(i32 argc, const char** argv)
+{
+    const pt_stats_t* stats = &ms_frameStats;
+    con_logf(LogSev_Info, "pt", "%.2f Mrays/s over %.2f ms",
+        pt_stats_mrays(stats), stats->seconds * 1e3);
+    con_logf(LogSev_Info, "pt", "primary %.0f, secondary %.0f, shadow %.0f",
+        (double)stats->primaryRays, (double)stats->secondaryRays, (double)stats->shadowRays);
+    con_logf(LogSev_Info, "pt", "bake %.0f, lookup %.0f",
+        (double)stats->bakeRays, (double)stats->lookupRays);
+    con_logf(LogSev_Info, "pt", "point queries %.0f, media steps %.0f, roulette kills %.0f",
+        (double)stats->pointQueries, (double)stats->mediaSteps, (double)stats->rouletteKills);
+
+    ser_obj_t* json = StatsToJson(stats);
+    bool saved = true;
+    if (argc > 1 && argv[1])
+    {
+        saved = ser_tofile(argv[1], json);
+        if (!saved)
+        {
+            con_logf(LogSev_Error, "pt", "Failed to save stats to '%s'", argv[1]);
+        }
+    }
+    else
+    {
+        i32 len = 0;
+        char* text = ser_write(json, &len);
+        if (text)
+        {
+            con_logf(LogSev_Info, "pt", "%s", text);
+            pim_free(text);
+        }
+    }
+    ser_obj_del(json);
+    return saved ? cmdstat_ok : cmdstat_err;
+}
+
 // ----------------------------------------------------------------------------
 
 static void OnRtcError(void* user, RTCError error, const char* msg)
@@ -497,6 +837,7 @@ static void InitSamplers(void)
     for (i32 i = 0; i < numthreads; ++i)
     {
         ms_samplers[i].rng.state = prng_u64(&rng);
+        ms_samplers[i].ldsDim = -1;
         for (i32 j = 0; j < NELEM(ms_samplers[i].Xi); ++j)
         {
             ms_samplers[i].Xi[j] = prng_f32(&rng);
@@ -510,8 +851,18 @@ void pt_sys_init(void)
     cvar_reg(&cv_pt_dist_meters);
     cvar_reg(&cv_pt_dist_alpha);
     cvar_reg(&cv_pt_dist_samples);
+    cvar_reg(&cv_pt_light_grid);
+    cvar_reg(&cv_pt_adaptive);
+    cvar_reg(&cv_pt_adaptive_min);
+    cvar_reg(&cv_pt_adaptive_error);
+    cvar_reg(&cv_pt_history_max);
+    cvar_reg(&cv_pt_media_meters);
     cvar_reg(&cv_pt_retro);
 
+    cmd_reg("pt_stats", CmdPtStats);
+
+    dist1d_sys_init();
+
     InitRTC();
     InitSamplers();
     InitPixelDist();
@@ -519,7 +870,7 @@ void pt_sys_init(void)
 
 void pt_sys_update(void)
 {
-
+    GatherStats();
 }
 
 void pt_sys_shutdown(void)
@@ -536,6 +887,27 @@ pt_sampler_t VEC_CALL pt_sampler_get(void) { return GetSampler(); }
 void VEC_CALL pt_sampler_set(pt_sampler_t sampler) { SetSampler(sampler); }
 float2 VEC_CALL pt_sample_2d(pt_sampler_t*const pim_noalias sampler) { return Sample2D(sampler); }
 float VEC_CALL pt_sample_1d(pt_sampler_t*const pim_noalias sampler) { return Sample1D(sampler); }
+void VEC_CALL pt_sampler_begin(pt_sampler_t*const pim_noalias sampler, u32 key, u32 index) { LdsBegin(sampler, key, index); }
+void VEC_CALL pt_sampler_end(pt_sampler_t*const pim_noalias sampler) { LdsEnd(sampler); }
+
+i32 pt_sampler_count(void)
+{
+    return task_thread_ct();
+}
+
+void pt_sampler_save(pt_sampler_t* dst)
+{
+    ASSERT(dst);
+    memcpy(dst, ms_samplers, sizeof(ms_samplers[0]) * pt_sampler_count());
+}
+
+// a checkpoint from a machine with fewer threads leaves the rest as they are
+void pt_sampler_load(const pt_sampler_t* src, i32 count)
+{
+    ASSERT(src || !count);
+    count = i1_clamp(count, 0, pt_sampler_count());
+    memcpy(ms_samplers, src, sizeof(ms_samplers[0]) * count);
+}
 
 pim_inline RTCRay VEC_CALL RtcNewRay(
     float4 ro,
@@ -647,6 +1019,7 @@ pim_inline void VEC_CALL RtcOccluded16(
 typedef pim_alignas(16) struct PointQueryUserData
 {
     const float4* pim_noalias positions;
+    const i32* pim_noalias indices;
     float distance;
     u32 primID;
     u32 geomID;
@@ -661,10 +1034,11 @@ pim_inline bool RtcPointQueryFn(RTCPointQueryFunctionArguments* args)
     {
         RTCPointQuery* pim_noalias query = args->query;
         const float4* pim_noalias positions = usr->positions;
+        const i32* pim_noalias indices = usr->indices;
         const u32 iVert = primID * 3;
-        float4 A = positions[iVert + 0];
-        float4 B = positions[iVert + 1];
-        float4 C = positions[iVert + 2];
+        float4 A = positions[indices[iVert + 0]];
+        float4 B = positions[indices[iVert + 1]];
+        float4 C = positions[indices[iVert + 2]];
         float4 P = { query->x, query->y, query->z, query->radius };
         float distance = sdTriangle3D(A, B, C, P);
         bool frontFace = distance > 0.0f;
@@ -689,6 +1063,7 @@ pim_inline PointQueryUserData VEC_CALL RtcPointQuery(const pt_scene_t*const pim_
 {
     PointQueryUserData usr = { 0 };
     usr.positions = scene->positions;
+    usr.indices = scene->indices;
     usr.distance = 1 << 20;
     usr.primID = RTC_INVALID_GEOMETRY_ID;
     usr.geomID = RTC_INVALID_GEOMETRY_ID;
@@ -701,6 +1076,7 @@ pim_inline PointQueryUserData VEC_CALL RtcPointQuery(const pt_scene_t*const pim_
     query.radius = pt.w;
     query.time = 0.0f;
     rtc.PointQuery(scene->rtcScene, &query, &ctx, RtcPointQueryFn, &usr);
+    StatAdd(&ThreadStats()->pointQueries, 1);
     return usr;
 }
 
@@ -719,52 +1095,30 @@ static RTCScene RtcNewScene(const pt_scene_t*const pim_noalias scene)
     ASSERT(geom);
 
     const i32 vertCount = scene->vertCount;
-    const i32 triCount = vertCount / 3;
+    const i32 triCount = scene->indexCount / 3;
 
-    if (vertCount > 0)
+    // embree reads the scene's own arrays; float4 positions pad out the
+    // 16 byte load embree may do past the last float3.
+    if ((vertCount > 0) && (triCount > 0))
     {
-        float3* pim_noalias dstPositions = rtc.SetNewGeometryBuffer(
+        rtc.SetSharedGeometryBuffer(
             geom,
             RTC_BUFFER_TYPE_VERTEX,
             0,
             RTC_FORMAT_FLOAT3,
-            sizeof(float3),
+            scene->positions,
+            0,
+            sizeof(scene->positions[0]),
             vertCount);
-        if (!dstPositions)
-        {
-            ASSERT(false);
-            rtc.ReleaseGeometry(geom);
-            rtc.ReleaseScene(rtcScene);
-            return NULL;
-        }
-        const float4* pim_noalias srcPositions = scene->positions;
-        for (i32 i = 0; i < vertCount; ++i)
-        {
-            dstPositions[i] = f4_f3(srcPositions[i]);
-        }
-    }
-
-    if (triCount > 0)
-    {
-        // kind of wasteful
-        i32* pim_noalias dstIndices = rtc.SetNewGeometryBuffer(
+        rtc.SetSharedGeometryBuffer(
             geom,
             RTC_BUFFER_TYPE_INDEX,
             0,
             RTC_FORMAT_UINT3,
-            sizeof(int3),
+            scene->indices,
+            0,
+            sizeof(scene->indices[0]) * 3,
             triCount);
-        if (!dstIndices)
-        {
-            ASSERT(false);
-            rtc.ReleaseGeometry(geom);
-            rtc.ReleaseScene(rtcScene);
-            return NULL;
-        }
-        for (i32 i = 0; i < vertCount; ++i)
-        {
-            dstIndices[i] = i;
-        }
     }
 
     rtc.CommitGeometry(geom);
@@ -777,6 +1131,13 @@ static RTCScene RtcNewScene(const pt_scene_t*const pim_noalias scene)
     return rtcScene;
 }
 
+typedef struct vertkey_s
+{
+    float3 position;
+    short2 normal;
+    float2 uv;
+} vertkey_t;
+
 static void FlattenDrawables(pt_scene_t*const pim_noalias scene)
 {
     const drawables_t* drawTable = drawables_get();
@@ -787,13 +1148,20 @@ static void FlattenDrawables(pt_scene_t*const pim_noalias scene)
 
     i32 vertCount = 0;
     float4* positions = NULL;
-    float4* normals = NULL;
+    short2* normals = NULL;
     float2* uvs = NULL;
+
+    i32 indexCount = 0;
+    i32* indices = NULL;
     i32* matIds = NULL;
 
     i32 matCount = 0;
     material_t* sceneMats = NULL;
 
+    // welds corners that agree on all attributes after quantization
+    dict_t lut;
+    dict_new(&lut, sizeof(vertkey_t), sizeof(i32), EAlloc_Perm);
+
     for (i32 i = 0; i < drawCount; ++i)
     {
         mesh_t const *const mesh = mesh_get(meshes[i]);
@@ -802,78 +1170,93 @@ static void FlattenDrawables(pt_scene_t*const pim_noalias scene)
             continue;
         }
 
-        const i32 meshLen = mesh->length;
+        const i32 meshLen = mesh->length - (mesh->length % 3);
         float4 const *const pim_noalias meshPositions = mesh->positions;
         float4 const *const pim_noalias meshNormals = mesh->normals;
         float4 const *const pim_noalias meshUvs = mesh->uvs;
 
-        const i32 vertBack = vertCount;
+        const i32 indexBack = indexCount;
         const i32 matBack = matCount;
-        vertCount += meshLen;
+        indexCount += meshLen;
         matCount += 1;
 
         const float4x4 M = matrices[i];
         const float3x3 IM = f3x3_IM(M);
         const material_t material = materials[i];
 
-        PermReserve(positions, vertCount);
-        PermReserve(normals, vertCount);
-        PermReserve(uvs, vertCount);
-        PermReserve(matIds, vertCount);
+        PermReserve(indices, indexCount);
+        PermReserve(matIds, indexCount / 3);
+        PermReserve(positions, vertCount + meshLen);
+        PermReserve(normals, vertCount + meshLen);
+        PermReserve(uvs, vertCount + meshLen);
 
         PermReserve(sceneMats, matCount);
         sceneMats[matBack] = material;
 
         for (i32 j = 0; j < meshLen; ++j)
         {
-            positions[vertBack + j] = f4x4_mul_pt(M, meshPositions[j]);
-        }
-
-        for (i32 j = 0; j < meshLen; ++j)
-        {
-            normals[vertBack + j] = f4_normalize3(f3x3_mul_col(IM, meshNormals[j]));
+            const float4 P = f4x4_mul_pt(M, meshPositions[j]);
+            const float4 N = f4_normalize3(f3x3_mul_col(IM, meshNormals[j]));
+            vertkey_t key;
+            memset(&key, 0, sizeof(key));
+            key.position = f4_f3(P);
+            key.normal = NormalToOct16(N);
+            key.uv = f2_v(meshUvs[j].x, meshUvs[j].y);
+
+            i32 iVert = -1;
+            if (!dict_get(&lut, &key, &iVert))
+            {
+                iVert = vertCount++;
+                dict_add(&lut, &key, &iVert);
+                positions[iVert] = f4_v(P.x, P.y, P.z, 1.0f);
+                normals[iVert] = key.normal;
+                uvs[iVert] = key.uv;
+            }
+            indices[indexBack + j] = iVert;
         }
 
-        for (i32 j = 0; (j + 3) <= meshLen; j += 3)
+        for (i32 j = indexBack / 3; j < indexCount / 3; ++j)
         {
-            float4 uva = meshUvs[j + 0];
-            float4 uvb = meshUvs[j + 1];
-            float4 uvc = meshUvs[j + 2];
-            float2 UA = f2_v(uva.x, uva.y);
-            float2 UB = f2_v(uvb.x, uvb.y);
-            float2 UC = f2_v(uvc.x, uvc.y);
-            uvs[vertBack + j + 0] = UA;
-            uvs[vertBack + j + 1] = UB;
-            uvs[vertBack + j + 2] = UC;
+            matIds[j] = matBack;
         }
+    }
 
-        for (i32 j = 0; j < meshLen; ++j)
-        {
-            matIds[vertBack + j] = matBack;
-        }
+    dict_del(&lut);
+    if (vertCount > 0)
+    {
+        PermReserve(positions, vertCount);
+        PermReserve(normals, vertCount);
+        PermReserve(uvs, vertCount);
     }
 
     scene->vertCount = vertCount;
+    scene->indexCount = indexCount;
     scene->positions = positions;
     scene->normals = normals;
     scene->uvs = uvs;
+    scene->indices = indices;
     scene->matIds = matIds;
 
     scene->matCount = matCount;
     scene->materials = sceneMats;
 }
 
+// lumOut: average emitted luminance over the triangle
 static float EmissionPdf(
     pt_sampler_t*const pim_noalias sampler,
     const pt_scene_t*const pim_noalias scene,
     i32 iVert,
-    i32 attempts)
+    i32 attempts,
+    float skyLum,
+    float*const pim_noalias lumOut)
 {
-    const i32 iMat = scene->matIds[iVert];
+    const i32 iMat = scene->matIds[iVert / 3];
     const material_t* mat = scene->materials + iMat;
 
+    *lumOut = 0.0f;
     if (mat->flags & matflag_sky)
     {
+        *lumOut = skyLum;
         return 1.0f;
     }
 
@@ -884,13 +1267,16 @@ static float EmissionPdf(
         {
             u32 const *const pim_noalias texels = romeMap->texels;
             const int2 texSize = romeMap->size;
+            texture_t const *const albedoMap = texture_get(mat->albedo);
 
             const float2* pim_noalias uvs = scene->uvs;
-            const float2 UA = uvs[iVert + 0];
-            const float2 UB = uvs[iVert + 1];
-            const float2 UC = uvs[iVert + 2];
+            i32 const *const pim_noalias indices = scene->indices;
+            const float2 UA = uvs[indices[iVert + 0]];
+            const float2 UB = uvs[indices[iVert + 1]];
+            const float2 UC = uvs[indices[iVert + 2]];
 
             i32 hits = 0;
+            float lum = 0.0f;
             for (i32 i = 0; i < attempts; ++i)
             {
                 float4 wuv = SampleBaryCoord(Sample2D(sampler));
@@ -899,8 +1285,15 @@ static float EmissionPdf(
                 if (sample > kThreshold)
                 {
                     ++hits;
+                    float4 albedo = f4_1;
+                    if (albedoMap)
+                    {
+                        albedo = UvWrapPow2_c32(albedoMap->texels, albedoMap->size, uv);
+                    }
+                    lum += f4_avglum(UnpackEmission(albedo, sample));
                 }
             }
+            *lumOut = lum / attempts;
             return (float)hits / (float)attempts;
         }
         else
@@ -910,67 +1303,111 @@ static float EmissionPdf(
     }
 }
 
+static float SkyLuminance(const pt_scene_t*const pim_noalias scene)
+{
+    if (!scene->sky)
+    {
+        return 1.0f;
+    }
+    const i32 kSamples = 64;
+    float sum = 0.0f;
+    for (i32 i = 0; i < kSamples; ++i)
+    {
+        float4 dir = SampleUnitSphere(Hammersley2D(i, kSamples));
+        sum += f4_avglum(f3_f4(Cubemap_ReadColor(scene->sky, dir), 0.0f));
+    }
+    return sum / kSamples;
+}
+
 typedef struct task_CalcEmissionPdf
 {
     task_t task;
     const pt_scene_t* scene;
     float* pdfs;
+    float* lums;
+    float skyLum;
     i32 attempts;
 } task_CalcEmissionPdf;
 
-static void CalcEmissionPdfFn(task_t* pbase, i32 begin, i32 end)
+static void CalcEmissionPdfFn(void* pbase, i32 begin, i32 end)
 {
     task_CalcEmissionPdf* task = (task_CalcEmissionPdf*)pbase;
     const pt_scene_t*const pim_noalias scene = task->scene;
     const i32 attempts = task->attempts;
+    const float skyLum = task->skyLum;
     float* pim_noalias pdfs = task->pdfs;
+    float* pim_noalias lums = task->lums;
 
     pt_sampler_t sampler = pt_sampler_get();
     for (i32 i = begin; i < end; ++i)
     {
-        pdfs[i] = EmissionPdf(&sampler, scene, i * 3, attempts);
+        pdfs[i] = EmissionPdf(&sampler, scene, i * 3, attempts, skyLum, lums + i);
     }
     pt_sampler_set(sampler);
 }
 
 static void SetupEmissives(pt_scene_t*const pim_noalias scene)
 {
-    const i32 vertCount = scene->vertCount;
-    const i32 triCount = vertCount / 3;
+    const i32 triCount = scene->indexCount / 3;
 
     task_CalcEmissionPdf* task = tmp_calloc(sizeof(*task));
     task->scene = scene;
     task->pdfs = tmp_malloc(sizeof(task->pdfs[0]) * triCount);
+    task->lums = tmp_malloc(sizeof(task->lums[0]) * triCount);
+    task->skyLum = SkyLuminance(scene);
     task->attempts = 1000;
 
     task_run(&task->task, CalcEmissionPdfFn, triCount);
 
     i32 emissiveCount = 0;
     i32* emissives = NULL;
-    i32* pim_noalias vertToEmit = perm_malloc(sizeof(vertToEmit[0]) * vertCount);
+    float* powers = NULL;
+    i32* pim_noalias triToEmit = perm_malloc(sizeof(triToEmit[0]) * triCount);
 
     const float* pim_noalias taskPdfs = task->pdfs;
+    const float* pim_noalias taskLums = task->lums;
     for (i32 iTri = 0; iTri < triCount; ++iTri)
     {
         i32 iVert = iTri * 3;
-        vertToEmit[iVert + 0] = -1;
-        vertToEmit[iVert + 1] = -1;
-        vertToEmit[iVert + 2] = -1;
+        triToEmit[iTri] = -1;
         float pdf = taskPdfs[iTri];
         if (pdf > 0.01f)
         {
-            vertToEmit[iVert + 0] = emissiveCount;
-            vertToEmit[iVert + 1] = emissiveCount;
-            vertToEmit[iVert + 2] = emissiveCount;
+            triToEmit[iTri] = emissiveCount;
             ++emissiveCount;
             PermReserve(emissives, emissiveCount);
+            TempReserve(powers, emissiveCount);
             emissives[emissiveCount - 1] = iVert;
+            powers[emissiveCount - 1] = GetArea(scene, iVert) * taskLums[iTri];
         }
     }
 
-    scene->vertToEmit = vertToEmit;
+    scene->triToEmit = triToEmit;
     scene->emissiveCount = emissiveCount;
     scene->emissives = emissives;
+
+    // the light tree wants unindexed triangles; expand just the emissive ones
+    float4* pim_noalias lightPositions = tmp_malloc(sizeof(lightPositions[0]) * emissiveCount * 3);
+    float4* pim_noalias lightNormals = tmp_malloc(sizeof(lightNormals[0]) * emissiveCount * 3);
+    i32* pim_noalias lights = tmp_malloc(sizeof(lights[0]) * emissiveCount);
+    for (i32 i = 0; i < emissiveCount; ++i)
+    {
+        for (i32 j = 0; j < 3; ++j)
+        {
+            const i32 iIndex = scene->indices[emissives[i] + j];
+            lightPositions[i * 3 + j] = scene->positions[iIndex];
+            lightNormals[i * 3 + j] = Oct16ToNormal(scene->normals[iIndex]);
+        }
+        lights[i] = i * 3;
+    }
+
+    lighttree_new(
+        &scene->lightTree,
+        lightPositions,
+        lightNormals,
+        lights,
+        powers,
+        emissiveCount);
 }
 
 static void SetupPortals(pt_scene_t* scene)
@@ -979,11 +1416,11 @@ static void SetupPortals(pt_scene_t* scene)
     i32* pim_noalias portals = NULL;
     const i32 matCount = scene->matCount;
     const material_t* materials = scene->materials;
-    const i32 vertCount = scene->vertCount;
+    const i32 indexCount = scene->indexCount;
     const i32* pim_noalias matIds = scene->matIds;
-    for (i32 iVert = 0; iVert < vertCount; iVert += 3)
+    for (i32 iVert = 0; iVert < indexCount; iVert += 3)
     {
-        i32 iMat = matIds[iVert];
+        i32 iMat = matIds[iVert / 3];
         ASSERT(iMat >= 0);
         ASSERT(iMat < matCount);
         const material_t* material = &materials[iMat];
@@ -998,133 +1435,270 @@ static void SetupPortals(pt_scene_t* scene)
     scene->portals = portals;
 }
 
-typedef struct task_SetupLightGrid
-{
-    task_t task;
-    pt_scene_t* scene;
-} task_SetupLightGrid;
+// upper bound of light grid cells kept in the hash table
+#define kMaxLightCells      (1 << 18)
+// longest run of slots searched before giving up on a cell
+#define kLightCellProbes    32
+
+// stands in for cells outside the level; never freed
+static dist1d_t ms_solidCell;
 
-static void SetupLightGridFn(task_t* pbase, i32 begin, i32 end)
+// returns true when a sphere at 'position' is near a surface, or when most
+// rays tossed from it hit front faces, and so is likely inside the level.
+static bool VEC_CALL InsideLevel(
+    const pt_scene_t*const pim_noalias scene,
+    float4 position,
+    float radius)
 {
-    task_SetupLightGrid* task = (task_SetupLightGrid*)pbase;
+    position.w = radius + 0.01f * kMilli;
+    PointQueryUserData query = RtcPointQuery(scene, position);
+    if (query.distance <= radius)
+    {
+        return true;
+    }
 
-    pt_scene_t*const pim_noalias scene = task->scene;
+    // far from a surface. might be inside or outside the map
+    // toss some rays and see if they are backfaces
+    const i32 kRays = 16;
+    float hitcount = 0.0f;
+    for (i32 j = 0; j < kRays; ++j)
+    {
+        float4 rd = SampleUnitSphere(Hammersley2D(j, kRays));
+        rayhit_t hit = pt_intersect_local(scene, position, rd, 0.0f, 1 << 20);
+        StatAdd(&ThreadStats()->lookupRays, 1);
+        if (hit.type == hit_triangle)
+        {
+            ++hitcount;
+        }
+    }
+    float hitratio = hitcount / kRays;
+    return hitratio >= 0.5f;
+}
 
-    const grid_t grid = scene->lightGrid;
-    dist1d_t *const pim_noalias dists = scene->lightDists;
+bool VEC_CALL pt_inside_level(
+    pt_scene_t *const pim_noalias scene,
+    float4 position,
+    float radius)
+{
+    return InsideLevel(scene, position, radius);
+}
 
+// seeded by the cell index, so a cell does not depend on which thread
+// or process built it
+static dist1d_t* BuildLightCell(
+    const pt_scene_t*const pim_noalias scene,
+    i32 iCell)
+{
     float4 const *const pim_noalias positions = scene->positions;
-    i32 const *const pim_noalias matIds = scene->matIds;
-    material_t const *const pim_noalias materials = scene->materials;
+    i32 const *const pim_noalias indices = scene->indices;
 
     const i32 emissiveCount = scene->emissiveCount;
     i32 const *const pim_noalias emissives = scene->emissives;
 
-    const float metersPerCell = cvar_get_float(&cv_pt_dist_meters);
+    const float metersPerCell = 1.0f / scene->lightGrid.cellsPerMeter;
     const float radius = metersPerCell * 0.666f;
-    pt_sampler_t sampler = GetSampler();
 
-    float4 hamm[16];
-    for (i32 i = 0; i < NELEM(hamm); ++i)
+    float4 position = grid_position(&scene->lightGrid, iCell);
+    if (!InsideLevel(scene, position, radius))
     {
-        float2 Xi = Hammersley2D(i, NELEM(hamm));
-        hamm[i] = SampleUnitSphere(Xi);
+        return &ms_solidCell;
     }
 
     RTCScene rtScene = scene->rtcScene;
+    prng_t rng = { ((u64)iCell + 1u) * 0x9e3779b97f4a7c15ull };
 
-    for (i32 i = begin; i < end; ++i)
+    dist1d_t* dist = perm_calloc(sizeof(*dist));
+    dist1d_new(dist, emissiveCount);
+
+    for (i32 iList = 0; iList < emissiveCount; ++iList)
     {
-        float4 position = grid_position(&grid, i);
-        position.w = radius + 0.01f * kMilli;
+        i32 iVert = emissives[iList];
+        float4 A = positions[indices[iVert + 0]];
+        float4 B = positions[indices[iVert + 1]];
+        float4 C = positions[indices[iVert + 2]];
+
+        i32 hits = 0;
+        float4 ros[16];
+        float4 rds[16];
+        bool visibles[16];
+        const i32 hitAttempts = 16;
+        const i32 loopIterations = hitAttempts / NELEM(ros);
+        for (i32 j = 0; j < loopIterations; ++j)
         {
-            PointQueryUserData query = RtcPointQuery(scene, position);
-            if (query.distance > radius)
+            for (i32 k = 0; k < NELEM(ros); ++k)
             {
-                // far from a surface. might be inside or outside the map
-                // toss some rays and see if they are backfaces
-                float hitcount = 0.0f;
-                for (i32 j = 0; j < NELEM(hamm); ++j)
-                {
-                    rayhit_t hit = pt_intersect_local(scene, position, hamm[j], 0.0f, 1 << 20);
-                    if (hit.type == hit_triangle)
-                    {
-                        ++hitcount;
-                    }
-                }
-                float hitratio = hitcount / NELEM(hamm);
-                if (hitratio < 0.5f)
-                {
-                    continue;
-                }
+                float4 t = f4_mulvs(f4_lerpsv(-1.5f, 1.5f, f4_rand(&rng)), radius);
+                float4 ro = f4_add(position, t);
+                ro.w = 0.0f;
+                float4 at = f4_blend(A, B, C, SampleBaryCoord(f2_rand(&rng)));
+                float4 rd = f4_sub(at, ro);
+                float dist = f4_length3(rd);
+                rd = f4_divvs(rd, dist);
+                rd.w = dist - 0.01f * kMilli;
+                ros[k] = ro;
+                rds[k] = rd;
+            }
+            RtcOccluded16(rtScene, ros, rds, visibles);
+            StatAdd(&ThreadStats()->shadowRays, NELEM(ros));
+            for (i32 k = 0; k < NELEM(ros); ++k)
+            {
+                hits += visibles[k] ? 1 : 0;
             }
         }
+        float hitPdf = (float)hits / (float)hitAttempts;
+
+        dist->pdf[iList] = hitPdf;
+    }
 
-        dist1d_t dist = { 0 };
-        dist1d_new(&dist, emissiveCount);
+    dist1d_bake(dist);
+    return dist;
+}
 
-        for (i32 iList = 0; iList < emissiveCount; ++iList)
+// returns the slot holding grid cell iCell, or -1 if it is absent.
+// claimedOut: when non-null, an empty slot is claimed for the cell,
+// and set to true if the caller now owns building the cell.
+static i32 LightCellSlot(
+    const pt_scene_t*const pim_noalias scene,
+    i32 iCell,
+    bool*const pim_noalias claimedOut)
+{
+    i32 *const pim_noalias keys = scene->lightCellKeys;
+    const u32 mask = (u32)scene->lightCellCapacity - 1u;
+    u32 slot = Fnv32Dword((u32)iCell, Fnv32Bias) & mask;
+    for (i32 i = 0; i < kLightCellProbes; ++i)
+    {
+        i32 key = load_i32(keys + slot, MO_Acquire);
+        if ((key == -1) && claimedOut)
         {
-            i32 iVert = emissives[iList];
-            i32 iMat = matIds[iVert];
-            float4 A = positions[iVert + 0];
-            float4 B = positions[iVert + 1];
-            float4 C = positions[iVert + 2];
-
-            i32 hits = 0;
-            float4 ros[16];
-            float4 rds[16];
-            bool visibles[16];
-            const i32 hitAttempts = 16;
-            const i32 loopIterations = hitAttempts / NELEM(ros);
-            for (i32 j = 0; j < loopIterations; ++j)
+            if (cmpex_i32(keys + slot, &key, iCell, MO_AcqRel))
             {
-                for (i32 k = 0; k < NELEM(ros); ++k)
-                {
-                    float4 t = f4_mulvs(f4_lerpsv(-1.5f, 1.5f, f4_rand(&sampler.rng)), radius);
-                    float4 ro = f4_add(position, t);
-                    ro.w = 0.0f;
-                    float4 at = f4_blend(A, B, C, SampleBaryCoord(Sample2D(&sampler)));
-                    float4 rd = f4_sub(at, ro);
-                    float dist = f4_length3(rd);
-                    rd = f4_divvs(rd, dist);
-                    rd.w = dist - 0.01f * kMilli;
-                    ros[k] = ro;
-                    rds[k] = rd;
-                }
-                RtcOccluded16(rtScene, ros, rds, visibles);
-                for (i32 k = 0; k < NELEM(ros); ++k)
-                {
-                    hits += visibles[k] ? 1 : 0;
-                }
+                *claimedOut = true;
+                return (i32)slot;
             }
-            float hitPdf = (float)hits / (float)hitAttempts;
-
-            dist.pdf[iList] = hitPdf;
+            // lost the race, key now holds the winner's cell
         }
-
-        dist1d_bake(&dist);
-        dists[i] = dist;
+        if (key == iCell)
+        {
+            return (i32)slot;
+        }
+        if (key == -1)
+        {
+            return -1;
+        }
+        slot = (slot + 1u) & mask;
     }
-    SetSampler(sampler);
+    return -1;
 }
 
-static void SetupLightGrid(pt_scene_t*const pim_noalias scene)
+// returns the light distribution of the cell containing position.
+// NULL until pt_scene_update builds the cell, or when the table is full.
+// the first lookup of a cell queues it to be built.
+static dist1d_t* LightCellGet(
+    pt_scene_t*const pim_noalias scene,
+    float4 position)
 {
-    if (scene->vertCount > 0)
+    const i32 iCell = grid_index(&scene->lightGrid, position);
+    bool claimed = false;
+    i32 slot = LightCellSlot(scene, iCell, &claimed);
+    if (slot < 0)
     {
-        box_t bounds = box_from_pts(scene->positions, scene->vertCount);
-        float metersPerCell = cvar_get_float(&cv_pt_dist_meters);
-        grid_t grid;
+        return NULL;
+    }
+    if (claimed)
+    {
+        i32 back = fetch_add_i32(&scene->lightPendingCount, 1, MO_Relaxed);
+        scene->lightPendingSlots[back] = slot;
+        return NULL;
+    }
+    return LoadPtr(dist1d_t, scene->lightCells[slot], MO_Acquire);
+}
+
+// like LightCellGet, but never claims a cell
+// slotOut: optional, receives the slot of the cell
+static dist1d_t* LightCellFind(
+    const pt_scene_t*const pim_noalias scene,
+    float4 position,
+    i32*const pim_noalias slotOut)
+{
+    const i32 iCell = grid_index(&scene->lightGrid, position);
+    i32 slot = LightCellSlot(scene, iCell, NULL);
+    if (slotOut)
+    {
+        *slotOut = slot;
+    }
+    if (slot < 0)
+    {
+        return NULL;
+    }
+    return LoadPtr(dist1d_t, scene->lightCells[slot], MO_Acquire);
+}
+
+// queues a slot for UpdateDists, once per update
+static void LightCellMarkDirty(pt_scene_t*const pim_noalias scene, i32 slot)
+{
+    i32 expected = 0;
+    if (cmpex_i32(scene->lightCellDirty + slot, &expected, 1, MO_Relaxed))
+    {
+        i32 back = fetch_add_i32(&scene->lightDirtyCount, 1, MO_Relaxed);
+        scene->lightDirtySlots[back] = slot;
+    }
+}
+
+static void SetupLightGrid(pt_scene_t*const pim_noalias scene)
+{
+    if ((scene->vertCount > 0) && cvar_get_bool(&cv_pt_light_grid))
+    {
+        box_t bounds = box_from_pts(scene->positions, scene->vertCount);
+        float metersPerCell = cvar_get_float(&cv_pt_dist_meters);
+        grid_t grid;
         grid_new(&grid, bounds, 1.0f / metersPerCell);
         const i32 len = grid_len(&grid);
+        // keep the table at most half full
+        const i32 capacity = (i32)NextPow2((u32)i1_clamp(len, 1, kMaxLightCells)) * 2;
         scene->lightGrid = grid;
-        scene->lightDists = tex_calloc(sizeof(scene->lightDists[0]) * len);
+        scene->lightCellCapacity = capacity;
+        scene->lightCellKeys = perm_malloc(sizeof(scene->lightCellKeys[0]) * capacity);
+        memset(scene->lightCellKeys, 0xff, sizeof(scene->lightCellKeys[0]) * capacity);
+        scene->lightCells = perm_calloc(sizeof(scene->lightCells[0]) * capacity);
+        scene->lightCellDirty = perm_calloc(sizeof(scene->lightCellDirty[0]) * capacity);
+        scene->lightDirtySlots = perm_malloc(sizeof(scene->lightDirtySlots[0]) * capacity);
+        scene->lightPendingSlots = perm_malloc(sizeof(scene->lightPendingSlots[0]) * capacity);
+    }
+}
 
-        task_SetupLightGrid* task = tmp_calloc(sizeof(*task));
-        task->scene = scene;
+#define kMaxMediaSlabs (1<<12)
+
+static void SetupMediaGrid(pt_scene_t*const pim_noalias scene)
+{
+    if (scene->vertCount > 0)
+    {
+        box_t bounds = box_from_pts(scene->positions, scene->vertCount);
+        float metersPerSlab = cvar_get_float(&cv_pt_media_meters);
+        const float height = f1_max(bounds.hi.y - bounds.lo.y, kMilli);
+        metersPerSlab = f1_max(metersPerSlab, height / kMaxMediaSlabs);
+        const i32 count = i1_clamp((i32)ceilf(height / metersPerSlab), 1, kMaxMediaSlabs);
+        scene->mediaLo = bounds.lo.y;
+        scene->mediaSlabsPerMeter = 1.0f / metersPerSlab;
+        scene->mediaSlabCount = count;
+        scene->mediaSlabs = perm_calloc(sizeof(scene->mediaSlabs[0]) * count);
+        UpdateMediaGrid(scene);
+    }
+}
 
-        task_run(task, SetupLightGridFn, len);
+// must not run while a trace reads the slabs, see pt_scene_update
+static void UpdateMediaGrid(pt_scene_t*const pim_noalias scene)
+{
+    float2* pim_noalias slabs = scene->mediaSlabs;
+    if (!slabs)
+    {
+        return;
+    }
+    const float metersPerSlab = 1.0f / scene->mediaSlabsPerMeter;
+    const i32 count = scene->mediaSlabCount;
+    for (i32 i = 0; i < count; ++i)
+    {
+        float yLo = scene->mediaLo + i * metersPerSlab;
+        slabs[i] = Media_Bounds(&scene->mediaDesc, yLo, yLo + metersPerSlab);
     }
 }
 
@@ -1140,10 +1714,64 @@ void pt_scene_update(pt_scene_t *const pim_noalias scene)
     {
         scene->sky = maps->cubemaps + iSky;
     }
+    if (scene->mediaDescDirty)
+    {
+        scene->mediaDesc = scene->mediaDescNext;
+        scene->mediaDescDirty = false;
+        UpdateMediaGrid(scene);
+    }
+    BuildLightCells(scene);
     UpdateDists(scene);
     ProfileEnd(pm_scene_update);
 }
 
+ProfileMark(pm_freeze_lights, pt_scene_freeze_lights)
+void pt_scene_freeze_lights(pt_scene_t*const pim_noalias scene)
+{
+    if (scene->lightsFrozen || !scene->lightCells)
+    {
+        scene->lightsFrozen = true;
+        return;
+    }
+    ProfileBegin(pm_freeze_lights);
+
+    // drop the cells built so far. which ones exist, their slots and their
+    // live counts all depend on what this process happened to trace.
+    const i32 capacity = scene->lightCellCapacity;
+    dist1d_t** lightCells = scene->lightCells;
+    for (i32 i = 0; i < capacity; ++i)
+    {
+        dist1d_t* dist = lightCells[i];
+        if (dist && (dist != &ms_solidCell))
+        {
+            dist1d_del(dist);
+            pim_free(dist);
+        }
+        lightCells[i] = NULL;
+    }
+    memset(scene->lightCellKeys, 0xff, sizeof(scene->lightCellKeys[0]) * capacity);
+    memset(scene->lightCellDirty, 0, sizeof(scene->lightCellDirty[0]) * capacity);
+    scene->lightDirtyCount = 0;
+    scene->lightPendingCount = 0;
+
+    // claiming in index order lays out the same table in every process.
+    // cells are seeded by index, so they build the same too.
+    const i32 len = grid_len(&scene->lightGrid);
+    for (i32 iCell = 0; iCell < len; ++iCell)
+    {
+        bool claimed = false;
+        i32 slot = LightCellSlot(scene, iCell, &claimed);
+        if (claimed)
+        {
+            scene->lightPendingSlots[scene->lightPendingCount++] = slot;
+        }
+    }
+    BuildLightCells(scene);
+    scene->lightsFrozen = true;
+
+    ProfileEnd(pm_freeze_lights);
+}
+
 pt_scene_t* pt_scene_new(void)
 {
     ASSERT(ms_device);
@@ -1161,6 +1789,7 @@ pt_scene_t* pt_scene_new(void)
     media_desc_new(&scene->mediaDesc);
     scene->rtcScene = RtcNewScene(scene);
     SetupLightGrid(scene);
+    SetupMediaGrid(scene);
 
     return scene;
 }
@@ -1179,22 +1808,36 @@ void pt_scene_del(pt_scene_t*const pim_noalias scene)
         pim_free(scene->positions);
         pim_free(scene->normals);
         pim_free(scene->uvs);
+        pim_free(scene->indices);
         pim_free(scene->matIds);
-        pim_free(scene->vertToEmit);
+        pim_free(scene->triToEmit);
 
         pim_free(scene->materials);
 
         pim_free(scene->emissives);
         pim_free(scene->portals);
 
+        lighttree_del(&scene->lightTree);
+        pim_free(scene->mediaSlabs);
+
+        if (scene->lightCells)
         {
-            const i32 gridLen = grid_len(&scene->lightGrid);
-            dist1d_t* lightDists = scene->lightDists;
-            for (i32 i = 0; i < gridLen; ++i)
+            const i32 capacity = scene->lightCellCapacity;
+            dist1d_t** lightCells = scene->lightCells;
+            for (i32 i = 0; i < capacity; ++i)
             {
-                dist1d_del(lightDists + i);
+                dist1d_t* dist = lightCells[i];
+                if (dist && (dist != &ms_solidCell))
+                {
+                    dist1d_del(dist);
+                    pim_free(dist);
+                }
             }
-            pim_free(scene->lightDists);
+            pim_free(scene->lightCells);
+            pim_free(scene->lightCellKeys);
+            pim_free(scene->lightCellDirty);
+            pim_free(scene->lightDirtySlots);
+            pim_free(scene->lightPendingSlots);
         }
 
         memset(scene, 0, sizeof(*scene));
@@ -1208,9 +1851,20 @@ void pt_scene_gui(pt_scene_t*const pim_noalias scene)
     {
         igIndent(0.0f);
         igText("Vertex Count: %d", scene->vertCount);
+        igText("Triangle Count: %d", scene->indexCount / 3);
         igText("Material Count: %d", scene->matCount);
         igText("Emissive Count: %d", scene->emissiveCount);
-        media_desc_gui(&scene->mediaDesc);
+        igText("Light Tree Nodes: %d", scene->lightTree.nodeCount);
+        // traces read mediaDesc, so edits wait for pt_scene_update
+        const media_desc_t prevDesc = scene->mediaDescDirty ?
+            scene->mediaDescNext : scene->mediaDesc;
+        media_desc_t desc = prevDesc;
+        media_desc_gui(&desc);
+        if (memcmp(&prevDesc, &desc, sizeof(prevDesc)))
+        {
+            scene->mediaDescNext = desc;
+            scene->mediaDescDirty = true;
+        }
         igUnindent(0.0f);
     }
 }
@@ -1230,10 +1884,14 @@ void pt_trace_new(
         trace->imageSize = imageSize;
         trace->scene = scene;
         trace->sampleWeight = 1.0f;
+        trace->stride = 1;
         trace->color = tex_calloc(sizeof(trace->color[0]) * texelCount);
         trace->albedo = tex_calloc(sizeof(trace->albedo[0]) * texelCount);
         trace->normal = tex_calloc(sizeof(trace->normal[0]) * texelCount);
-        trace->denoised = tex_calloc(sizeof(trace->denoised[0]) * texelCount);
+        trace->sampleCounts = tex_calloc(sizeof(trace->sampleCounts[0]) * texelCount);
+        trace->lumM2 = tex_calloc(sizeof(trace->lumM2[0]) * texelCount);
+        trace->depth = tex_calloc(sizeof(trace->depth[0]) * texelCount);
+        trace->primIds = tex_calloc(sizeof(trace->primIds[0]) * texelCount);
         dofinfo_new(&trace->dofinfo);
     }
 }
@@ -1245,7 +1903,17 @@ void pt_trace_del(pt_trace_t* trace)
         pim_free(trace->color);
         pim_free(trace->albedo);
         pim_free(trace->normal);
-        pim_free(trace->denoised);
+        pim_free(trace->sampleCounts);
+        pim_free(trace->lumM2);
+        pim_free(trace->depth);
+        pim_free(trace->primIds);
+        pim_free(trace->history.color);
+        pim_free(trace->history.albedo);
+        pim_free(trace->history.normal);
+        pim_free(trace->history.sampleCounts);
+        pim_free(trace->history.lumM2);
+        pim_free(trace->history.depth);
+        pim_free(trace->history.primIds);
         memset(trace, 0, sizeof(*trace));
     }
 }
@@ -1257,6 +1925,7 @@ void pt_trace_gui(pt_trace_t* trace)
         igIndent(0.0f);
         dofinfo_gui(&trace->dofinfo);
         pt_scene_gui(trace->scene);
+        StatsGui(&ms_frameStats);
         igUnindent(0.0f);
     }
 }
@@ -1305,10 +1974,11 @@ pim_inline float4 VEC_CALL GetPosition(
     rayhit_t hit)
 {
     float4 const *const pim_noalias positions = scene->positions;
+    i32 const *const pim_noalias indices = scene->indices;
     return f4_blend(
-        positions[hit.index + 0],
-        positions[hit.index + 1],
-        positions[hit.index + 2],
+        positions[indices[hit.index + 0]],
+        positions[indices[hit.index + 1]],
+        positions[indices[hit.index + 2]],
         hit.wuvt);
 }
 
@@ -1316,11 +1986,12 @@ pim_inline float4 VEC_CALL GetNormal(
     const pt_scene_t *const pim_noalias scene,
     rayhit_t hit)
 {
-    float4 const *const pim_noalias normals = scene->normals;
+    short2 const *const pim_noalias normals = scene->normals;
+    i32 const *const pim_noalias indices = scene->indices;
     float4 N = f4_blend(
-        normals[hit.index + 0],
-        normals[hit.index + 1],
-        normals[hit.index + 2],
+        Oct16ToNormal(normals[indices[hit.index + 0]]),
+        Oct16ToNormal(normals[indices[hit.index + 1]]),
+        Oct16ToNormal(normals[indices[hit.index + 2]]),
         hit.wuvt);
     N = (f4_dot3(hit.normal, N) > 0.0f) ? N : f4_neg(N);
     return f4_normalize3(N);
@@ -1331,19 +2002,21 @@ pim_inline float2 VEC_CALL GetUV(
     rayhit_t hit)
 {
     float2 const *const pim_noalias uvs = scene->uvs;
+    i32 const *const pim_noalias indices = scene->indices;
     return f2_blend(
-        uvs[hit.index + 0],
-        uvs[hit.index + 1],
-        uvs[hit.index + 2],
+        uvs[indices[hit.index + 0]],
+        uvs[indices[hit.index + 1]],
+        uvs[indices[hit.index + 2]],
         hit.wuvt);
 }
 
 pim_inline float VEC_CALL GetArea(const pt_scene_t *const pim_noalias scene, i32 iVert)
 {
     float4 const *const pim_noalias positions = scene->positions;
+    i32 const *const pim_noalias indices = scene->indices;
     ASSERT(iVert >= 0);
-    ASSERT((iVert + 2) < scene->vertCount);
-    return TriArea3D(positions[iVert + 0], positions[iVert + 1], positions[iVert + 2]);
+    ASSERT((iVert + 2) < scene->indexCount);
+    return TriArea3D(positions[indices[iVert + 0]], positions[indices[iVert + 1]], positions[indices[iVert + 2]]);
 }
 
 pim_inline material_t const *const pim_noalias VEC_CALL GetMaterial(
@@ -1352,8 +2025,8 @@ pim_inline material_t const *const pim_noalias VEC_CALL GetMaterial(
 {
     i32 iVert = hit.index;
     ASSERT(iVert >= 0);
-    ASSERT(iVert < scene->vertCount);
-    i32 matIndex = scene->matIds[iVert];
+    ASSERT(iVert < scene->indexCount);
+    i32 matIndex = scene->matIds[iVert / 3];
     ASSERT(matIndex >= 0);
     ASSERT(matIndex < scene->matCount);
     return &scene->materials[matIndex];
@@ -1450,12 +2123,50 @@ pim_inline float4 VEC_CALL GetEmission(
     }
 }
 
+// below any texture's mip 0
+#define kConeLodNone    -64.0f
+
+// log2 of a ray cone's footprint at a hit, in uv units.
+// Akenine-Moller et al, Texture Level of Detail Strategies for Real-Time Ray Tracing
+// http://www.realtimerendering.com/raytracinggems/unofficial_RayTracingGems_v1.7.pdf
+pim_inline float VEC_CALL GetConeLod(
+    const pt_scene_t *const pim_noalias scene,
+    float4 rd,
+    rayhit_t hit,
+    float coneWidth)
+{
+    if (coneWidth <= 0.0f)
+    {
+        return kConeLodNone;
+    }
+    float4 const *const pim_noalias positions = scene->positions;
+    float2 const *const pim_noalias uvs = scene->uvs;
+    i32 const *const pim_noalias indices = scene->indices;
+    const i32 i = hit.index;
+    tri2d_t uvTri = { uvs[indices[i + 0]], uvs[indices[i + 1]], uvs[indices[i + 2]] };
+    float uvArea = f1_abs(TriArea2D(uvTri));
+    float worldArea = TriArea3D(positions[indices[i + 0]], positions[indices[i + 1]], positions[indices[i + 2]]);
+    float cosTheta = f1_abs(f4_dot3(rd, hit.normal));
+    if ((uvArea <= 0.0f) || (worldArea <= kEpsilon) || (cosTheta <= kEpsilon))
+    {
+        return kConeLodNone;
+    }
+    return 0.5f * log2f(uvArea / worldArea) + log2f(coneWidth / cosTheta);
+}
+
+// mip level of a texture for a footprint from GetConeLod
+pim_inline float VEC_CALL GetTexMip(texture_t const *const pim_noalias tex, float lod)
+{
+    return lod + 0.5f * log2f((float)(tex->size.x * tex->size.y));
+}
+
 pim_inline surfhit_t VEC_CALL GetSurface(
     const pt_scene_t *const pim_noalias scene,
     float4 ro,
     float4 rd,
     rayhit_t hit,
-    i32 bounce)
+    i32 bounce,
+    float coneWidth)
 {
     surfhit_t surf;
     surf.type = hit.type;
@@ -1479,11 +2190,12 @@ pim_inline surfhit_t VEC_CALL GetSurface(
     }
     else
     {
+        const float lod = GetConeLod(scene, rd, hit, coneWidth);
         {
             texture_t const *const pim_noalias tex = texture_get(mat->normal);
             if (tex)
             {
-                float4 Nts = UvBilinearWrapPow2_xy16(tex->texels, tex->size, uv);
+                float4 Nts = TrilinearWrapPow2_xy16(tex->texels, tex->size, uv, GetTexMip(tex, lod));
                 surf.N = TanToWorld(surf.N, Nts);
             }
         }
@@ -1493,7 +2205,7 @@ pim_inline surfhit_t VEC_CALL GetSurface(
             texture_t const *const pim_noalias tex = texture_get(mat->albedo);
             if (tex)
             {
-                surf.albedo = UvBilinearWrapPow2_c32_fast(tex->texels, tex->size, uv);
+                surf.albedo = TrilinearWrapPow2_c32_fast(tex->texels, tex->size, uv, GetTexMip(tex, lod));
             }
         }
 
@@ -1502,7 +2214,7 @@ pim_inline surfhit_t VEC_CALL GetSurface(
             texture_t const *const pim_noalias tex = texture_get(mat->rome);
             if (tex)
             {
-                rome = UvBilinearWrapPow2_c32_fast(tex->texels, tex->size, uv);
+                rome = TrilinearWrapPow2_c32_fast(tex->texels, tex->size, uv, GetTexMip(tex, lod));
             }
         }
         surf.emission = UnpackEmission(surf.albedo, rome.w);
@@ -1601,7 +2313,7 @@ pim_inline rayhit_t VEC_CALL pt_intersect_local(
     ASSERT(rtcHit.hit.primID != RTC_INVALID_GEOMETRY_ID);
     i32 iVert = rtcHit.hit.primID * 3;
     ASSERT(iVert >= 0);
-    ASSERT(iVert < scene->vertCount);
+    ASSERT(iVert < scene->indexCount);
     float u = f1_sat(rtcHit.hit.u);
     float v = f1_sat(rtcHit.hit.v);
     float w = f1_sat(1.0f - (u + v));
@@ -1638,9 +2350,14 @@ static scatter_t VEC_CALL PortalScatter(
         i32 iVert = scene->portals[iPortal];
         float4 wuvt = SampleBaryCoord(Sample2D(sampler));
         float4 const *const pim_noalias positions = scene->positions;
-        float4 const *const pim_noalias normals = scene->normals;
-        float4 P = f4_blend(positions[iVert + 0], positions[iVert + 1], positions[iVert + 2], wuvt);
-        float4 N = f4_normalize3(f4_blend(normals[iVert + 0], normals[iVert + 1], normals[iVert + 2], wuvt));
+        i32 const *const pim_noalias indices = scene->indices;
+        short2 const *const pim_noalias normals = scene->normals;
+        float4 P = f4_blend(positions[indices[iVert + 0]], positions[indices[iVert + 1]], positions[indices[iVert + 2]], wuvt);
+        float4 N = f4_normalize3(f4_blend(
+            Oct16ToNormal(normals[indices[iVert + 0]]),
+            Oct16ToNormal(normals[indices[iVert + 1]]),
+            Oct16ToNormal(normals[indices[iVert + 2]]),
+            wuvt));
         P = f4_add(P, f4_mulvs(N, kMilli * 2.0f));
         float4 rd = I;
         if (f4_dot3(rd, N) < 0.0f)
@@ -1970,15 +2687,19 @@ pim_inline void VEC_CALL LightOnHit(
     float4 lum4,
     i32 iVert)
 {
-    i32 iList = scene->vertToEmit[iVert];
-    if (iList >= 0)
+    i32 iList = scene->triToEmit[iVert / 3];
+    if ((iList >= 0) && scene->lightCells && !scene->lightsFrozen)
     {
-        i32 iCell = grid_index(&scene->lightGrid, ro);
-        dist1d_t* dist = &scene->lightDists[iCell];
-        if (dist->length)
+        i32 slot;
+        dist1d_t* dist = LightCellFind(scene, ro, &slot);
+        if (dist && dist->length)
         {
             u32 amt = (u32)(f4_avglum(lum4) * 64.0f + 0.5f);
-            fetch_add_u32(dist->live + iList, amt, MO_Relaxed);
+            if (amt)
+            {
+                fetch_add_u32(dist->live + iList, amt, MO_Relaxed);
+                LightCellMarkDirty(scene, slot);
+            }
         }
     }
 }
@@ -1997,8 +2718,25 @@ pim_inline bool VEC_CALL LightSelect(
         return false;
     }
 
-    i32 iCell = grid_index(&scene->lightGrid, position);
-    const dist1d_t* dist = scene->lightDists + iCell;
+    const dist1d_t* dist = NULL;
+    if (scene->lightCells)
+    {
+        dist = LightCellGet(scene, position);
+    }
+    if (!dist)
+    {
+        // no grid, or its cell is not built yet
+        float pdf;
+        i32 iList = lighttree_sample(&scene->lightTree, position, LightSelectPrng(sampler), &pdf);
+        if (iList < 0)
+        {
+            return false;
+        }
+        *iVertOut = scene->emissives[iList];
+        *pdfOut = pdf;
+        return pdf > kEpsilon;
+    }
+
     if (!dist->length)
     {
         return false;
@@ -2020,12 +2758,19 @@ pim_inline float VEC_CALL LightSelectPdf(
     float4 ro)
 {
     float selectPdf = 1.0f;
-    i32 iCell = grid_index(&scene->lightGrid, ro);
-    i32 iList = scene->vertToEmit[iVert];
+    i32 iList = scene->triToEmit[iVert / 3];
     if (iList >= 0)
     {
-        const dist1d_t* dist = scene->lightDists + iCell;
-        if (dist->length)
+        const dist1d_t* dist = NULL;
+        if (scene->lightCells)
+        {
+            dist = LightCellFind(scene, ro, NULL);
+        }
+        if (!dist)
+        {
+            selectPdf = lighttree_pdf(&scene->lightTree, ro, iList);
+        }
+        else if (dist->length)
         {
             selectPdf = dist1d_pdfd(dist, iList);
         }
@@ -2045,9 +2790,10 @@ pim_inline lightsample_t VEC_CALL LightSample(
     float4 wuv = SampleBaryCoord(Sample2D(sampler));
 
     const float4* pim_noalias positions = scene->positions;
-    float4 A = positions[iVert + 0];
-    float4 B = positions[iVert + 1];
-    float4 C = positions[iVert + 2];
+    i32 const *const pim_noalias indices = scene->indices;
+    float4 A = positions[indices[iVert + 0]];
+    float4 B = positions[indices[iVert + 1]];
+    float4 C = positions[indices[iVert + 2]];
     float4 pt = f4_blend(A, B, C, wuv);
     float area = TriArea3D(A, B, C);
 
@@ -2061,6 +2807,7 @@ pim_inline lightsample_t VEC_CALL LightSample(
     sample.wuvt = wuv;
 
     rayhit_t hit = pt_intersect_local(scene, ro, rd, 0.0f, distance + 0.01f * kMilli);
+    StatAdd(&ThreadStats()->shadowRays, 1);
     if ((hit.type != hit_nothing) && (hit.index == iVert))
     {
         float cosTheta = f1_abs(f4_dot3(rd, hit.normal));
@@ -2088,9 +2835,10 @@ pim_inline lightsample_t VEC_CALL LightSampleRetro(
     float4 wuv = SampleBaryCoord(Sample2D(sampler));
 
     const float4* pim_noalias positions = scene->positions;
-    float4 A = positions[iVert + 0];
-    float4 B = positions[iVert + 1];
-    float4 C = positions[iVert + 2];
+    i32 const *const pim_noalias indices = scene->indices;
+    float4 A = positions[indices[iVert + 0]];
+    float4 B = positions[indices[iVert + 1]];
+    float4 C = positions[indices[iVert + 2]];
     float4 pt = f4_blend(A, B, C, wuv);
     float area = TriArea3D(A, B, C);
 
@@ -2104,6 +2852,7 @@ pim_inline lightsample_t VEC_CALL LightSampleRetro(
     sample.wuvt = wuv;
 
     rayhit_t hit = pt_intersect_local(scene, ro, rd, 0.0f, distance + 0.01f * kMilli);
+    StatAdd(&ThreadStats()->shadowRays, 1);
     if ((hit.type != hit_nothing) && (hit.index == iVert))
     {
         float cosTheta = f1_abs(f4_dot3(rd, hit.normal));
@@ -2123,6 +2872,7 @@ pim_inline float VEC_CALL LightEvalPdf(
 {
     ASSERT(IsUnitLength(rd));
     rayhit_t hit = pt_intersect_local(scene, ro, rd, 0.0f, 1 << 20);
+    StatAdd(&ThreadStats()->shadowRays, 1);
     float pdf = 0.0f;
     if (hit.type != hit_nothing)
     {
@@ -2311,8 +3061,6 @@ static void media_desc_update(media_desc_t *const desc)
     }
 
     desc->noiseRange = sum * noiseScale * 1.5f;
-
-    desc->rcpMajorant = 1.0f / f4_hmax3(CalcMajorant(desc));
 }
 
 static void media_desc_load(media_desc_t *const desc, const char* name)
@@ -2470,6 +3218,39 @@ pim_inline media_t VEC_CALL Media_Sample(media_desc_t const *const desc, float4
     return result;
 }
 
+// the media without height fog
+pim_inline media_t VEC_CALL Media_Constant(media_desc_t const *const desc)
+{
+    media_t result;
+    result.logAlbedo = desc->logConstantAlbedo;
+    result.scattering = desc->constantAmt;
+    result.extinction = desc->constantAmt * (1.0f + desc->absorption);
+    return result;
+}
+
+// bounds of the extinction within a range of heights
+// x: majorant across channels
+// y: majorant of the extinction above Media_Constant, 0 when homogeneous
+pim_inline float2 VEC_CALL Media_Bounds(
+    media_desc_t const *const desc,
+    float yLo,
+    float yHi)
+{
+    const float a = 1.0f + desc->absorption;
+    float4 majorant = f4_mulvs(desc->logConstantAlbedo, desc->constantAmt * a);
+    float residual = 0.0f;
+    // Media_Density only adds height fog within noiseRange of noiseHeight
+    float fogLo = desc->noiseHeight - desc->noiseRange;
+    float fogHi = desc->noiseHeight + desc->noiseRange;
+    if ((yHi >= fogLo) && (yLo <= fogHi))
+    {
+        float4 fog = f4_mulvs(desc->logNoiseAlbedo, desc->noiseAmt * a);
+        majorant = f4_add(majorant, fog);
+        residual = f4_hmax3(fog);
+    }
+    return f2_v(f4_hmax3(majorant), residual);
+}
+
 pim_inline float4 VEC_CALL AlbedoToLogAlbedo(float4 albedo)
 {
     // https://www.desmos.com/calculator/rqrl5xhtea
@@ -2596,6 +3377,168 @@ pim_inline float4 VEC_CALL SamplePhaseDir(
     return L;
 }
 
+// piecewise constant bounds of the media along a ray, stepped through
+// the media slabs. above and below the slabs the bounds of the whole fog
+// band are used.
+typedef struct mediatrack_s
+{
+    // ray time of the next slab boundary
+    float tNext;
+    // ray time across one slab
+    float tDelta;
+    i32 slab;
+    i32 step;
+    // current segment
+    float t;
+    float tEnd;
+    float2 bounds;
+    // ray times where the slabs are entered and exited
+    float tIn;
+    float tOut;
+    float rayLen;
+} mediatrack_t;
+
+pim_inline void VEC_CALL MediaTrack_Segment(
+    mediatrack_t *const pim_noalias track,
+    const pt_scene_t *const pim_noalias scene)
+{
+    const float t = track->t;
+    if (t < track->tIn)
+    {
+        track->tEnd = f1_min(track->tIn, track->rayLen);
+        track->bounds = Media_Bounds(&scene->mediaDesc, -FLT_MAX, FLT_MAX);
+    }
+    else if (t < track->tOut)
+    {
+        float tExit = f1_min(track->tNext, track->tOut);
+        track->tEnd = f1_min(tExit, track->rayLen);
+        track->bounds = scene->mediaSlabs[track->slab];
+    }
+    else
+    {
+        track->tEnd = track->rayLen;
+        track->bounds = Media_Bounds(&scene->mediaDesc, -FLT_MAX, FLT_MAX);
+    }
+}
+
+pim_inline void VEC_CALL MediaTrack_New(
+    mediatrack_t *const pim_noalias track,
+    const pt_scene_t *const pim_noalias scene,
+    float4 ro,
+    float4 rd,
+    float rayLen)
+{
+    track->t = 0.0f;
+    track->rayLen = rayLen;
+    track->tIn = FLT_MAX;
+    track->tOut = FLT_MAX;
+
+    if (scene->mediaSlabs)
+    {
+        const i32 count = scene->mediaSlabCount;
+        const float metersPerSlab = 1.0f / scene->mediaSlabsPerMeter;
+        const float lo = scene->mediaLo;
+        // the top slab may extend past the scene
+        const float hi = lo + count * metersPerSlab;
+
+        float t0 = 0.0f;
+        float t1 = rayLen;
+        if (rd.y != 0.0f)
+        {
+            float rcpD = 1.0f / rd.y;
+            float ta = (lo - ro.y) * rcpD;
+            float tb = (hi - ro.y) * rcpD;
+            t0 = f1_max(t0, f1_min(ta, tb));
+            t1 = f1_min(t1, f1_max(ta, tb));
+        }
+        else if ((ro.y < lo) || (ro.y > hi))
+        {
+            t1 = -1.0f;
+        }
+
+        if (t0 < t1)
+        {
+            track->tIn = t0;
+            track->tOut = t1;
+            float y = ro.y + rd.y * t0;
+            i32 slab = i1_clamp((i32)((y - lo) * scene->mediaSlabsPerMeter), 0, count - 1);
+            track->slab = slab;
+            if (rd.y != 0.0f)
+            {
+                float rcpD = 1.0f / rd.y;
+                i32 step = (rd.y > 0.0f) ? 1 : -1;
+                float edge = lo + (slab + ((step > 0) ? 1 : 0)) * metersPerSlab;
+                track->step = step;
+                track->tNext = (edge - ro.y) * rcpD;
+                track->tDelta = metersPerSlab * f1_abs(rcpD);
+            }
+            else
+            {
+                track->step = 0;
+                track->tNext = FLT_MAX;
+                track->tDelta = FLT_MAX;
+            }
+        }
+    }
+
+    MediaTrack_Segment(track, scene);
+}
+
+// moves to the next segment, returns false at the end of the ray
+pim_inline bool VEC_CALL MediaTrack_Next(
+    mediatrack_t *const pim_noalias track,
+    const pt_scene_t *const pim_noalias scene)
+{
+    const float t = track->tEnd;
+    track->t = t;
+    if (t >= track->rayLen)
+    {
+        return false;
+    }
+    if ((t >= track->tIn) && (t < track->tOut) && (t >= track->tNext))
+    {
+        i32 slab = track->slab + track->step;
+        track->slab = slab;
+        track->tNext += track->tDelta;
+        if ((slab < 0) || (slab >= scene->mediaSlabCount))
+        {
+            track->tOut = t;
+        }
+    }
+    MediaTrack_Segment(track, scene);
+    return true;
+}
+
+// samples the next tentative collision against the local majorant,
+// or against the residual majorant when 'residual' is set.
+// returns false when the ray ends first.
+pim_inline bool VEC_CALL MediaTrack_Collide(
+    mediatrack_t *const pim_noalias track,
+    pt_sampler_t *const pim_noalias sampler,
+    const pt_scene_t *const pim_noalias scene,
+    bool residual,
+    float *const pim_noalias tOut)
+{
+    float tau = -logf(1.0f - Sample1D(sampler));
+    while (true)
+    {
+        float u = residual ? track->bounds.y : track->bounds.x;
+        float tau1 = u * f1_max(0.0f, track->tEnd - track->t);
+        if (tau1 > tau)
+        {
+            StatAdd(&ThreadStats()->mediaSteps, 1);
+            track->t += tau / u;
+            *tOut = track->t;
+            return true;
+        }
+        tau -= tau1;
+        if (!MediaTrack_Next(track, scene))
+        {
+            return false;
+        }
+    }
+}
+
 pim_inline float4 VEC_CALL CalcTransmittance(
     pt_sampler_t *const pim_noalias sampler,
     const pt_scene_t *const pim_noalias scene,
@@ -2604,21 +3547,21 @@ pim_inline float4 VEC_CALL CalcTransmittance(
     float rayLen)
 {
     media_desc_t const *const pim_noalias desc = &scene->mediaDesc;
-    const float rcpU = desc->rcpMajorant;
-    float t = 0.0f;
-    float4 attenuation = f4_1;
-    while (true)
+
+    // the constant media is integrated analytically,
+    // ratio tracking only estimates the height fog on top of it
+    const float4 uC = Media_Extinction(Media_Constant(desc));
+    float4 attenuation = f4_exp(f4_mulvs(uC, -rayLen));
+
+    mediatrack_t track;
+    MediaTrack_New(&track, scene, ro, rd, rayLen);
+    float t;
+    while (MediaTrack_Collide(&track, sampler, scene, true, &t))
     {
         float4 P = f4_add(ro, f4_mulvs(rd, t));
-        float dt = SampleFreePath(Sample1D(sampler), rcpU);
-        t += dt;
-        if (t >= rayLen)
-        {
-            break;
-        }
         media_t media = Media_Sample(desc, P);
-        float4 uT = Media_Extinction(media);
-        float4 ratio = f4_inv(f4_mulvs(uT, rcpU));
+        float4 uR = f4_max(f4_0, f4_sub(Media_Extinction(media), uC));
+        float4 ratio = f4_inv(f4_divvs(uR, track.bounds.y));
         attenuation = f4_mul(attenuation, ratio);
     }
     return attenuation;
@@ -2636,21 +3579,22 @@ pim_inline scatter_t VEC_CALL ScatterRay(
     result.pdf = 0.0f;
 
     media_desc_t const *const pim_noalias desc = &scene->mediaDesc;
-    const float rcpU = desc->rcpMajorant;
 
-    float t = 0.0f;
+    mediatrack_t track;
+    MediaTrack_New(&track, scene, ro, rd, rayLen);
+    float tPrev = 0.0f;
+    float t;
     result.attenuation = f4_1;
-    while (true)
+    while (MediaTrack_Collide(&track, sampler, scene, false, &t))
     {
-        float4 P = f4_add(ro, f4_mulvs(rd, t));
-        float dt = SampleFreePath(Sample1D(sampler), rcpU);
-        t += dt;
-        if (t >= rayLen)
-        {
-            break;
-        }
+        const float rcpU = 1.0f / track.bounds.x;
+        const float dt = t - tPrev;
+        tPrev = t;
 
-        media_t media = Media_Sample(desc, P);
+        float4 P = f4_add(ro, f4_mulvs(rd, t));
+        // homogeneous cells skip the noise
+        media_t media = (track.bounds.y > 0.0f) ?
+            Media_Sample(desc, P) : Media_Constant(desc);
 
         float uS = Media_Scattering(media);
         bool scattered = ScatterPrng(sampler) < (uS * rcpU);
@@ -2666,7 +3610,7 @@ pim_inline scatter_t VEC_CALL ScatterRay(
                 result.luminance = lum;
             }
 
-            result.pos = f4_add(ro, f4_mulvs(rd, t));
+            result.pos = P;
             result.dir = SamplePhaseDir(sampler, desc, rd);
             result.pdf = result.dir.w;
             float ph = CalcPhase(desc, f4_dot3(rd, result.dir));
@@ -2686,18 +3630,21 @@ pim_inline scatter_t VEC_CALL ScatterRay(
     return result;
 }
 
-pt_result_t VEC_CALL pt_trace_ray_retro(
+// camera: the path starts at the camera, only used to count its rays
+static pt_result_t VEC_CALL TraceRayRetro(
     pt_sampler_t *const pim_noalias sampler,
     pt_scene_t *const pim_noalias scene,
     float4 ro,
-    float4 rd)
+    float4 rd,
+    bool camera)
 {
     pt_result_t result = { 0 };
     float4 luminance = f4_0;
     float4 attenuation = f4_1;
     u32 prevFlags = 0;
 
-    for (i32 b = 0; b < 666; ++b)
+    i32 b = 0;
+    for (; b < 666; ++b)
     {
         {
             float p = f1_sat(f4_avglum(attenuation));
@@ -2707,11 +3654,13 @@ pt_result_t VEC_CALL pt_trace_ray_retro(
             }
             else
             {
+                StatAdd(&ThreadStats()->rouletteKills, 1);
                 break;
             }
         }
 
         rayhit_t hit = pt_intersect_local(scene, ro, rd, 0.0f, 1 << 20);
+        StatPathRay(b, camera);
         if (hit.type == hit_nothing)
         {
             break;
@@ -2783,22 +3732,30 @@ pt_result_t VEC_CALL pt_trace_ray_retro(
         prevFlags = surf.flags;
     }
 
+    StatPathEnd(b);
     result.color = f4_f3(luminance);
     return result;
 }
 
-pt_result_t VEC_CALL pt_trace_ray(
+// coneSpread: angle in radians subtended by the ray, such as a pixel's,
+// used to pick texture mip levels. 0 samples mip 0 until the first bounce.
+// camera: the path starts at the camera, only used to count its rays
+static pt_result_t VEC_CALL TraceRay(
     pt_sampler_t *const pim_noalias sampler,
     pt_scene_t *const pim_noalias scene,
     float4 ro,
-    float4 rd)
+    float4 rd,
+    float coneSpread,
+    bool camera)
 {
     pt_result_t result = { 0 };
     float4 luminance = f4_0;
     float4 attenuation = f4_1;
     u32 prevFlags = 0;
+    float coneWidth = 0.0f;
 
-    for (i32 b = 0; b < 666; ++b)
+    i32 b = 0;
+    for (; b < 666; ++b)
     {
         {
             float p = f1_sat(f4_avglum(attenuation));
@@ -2808,17 +3765,20 @@ pt_result_t VEC_CALL pt_trace_ray(
             }
             else
             {
+                StatAdd(&ThreadStats()->rouletteKills, 1);
                 break;
             }
         }
 
         rayhit_t hit = pt_intersect_local(scene, ro, rd, 0.0f, 1 << 20);
+        StatPathRay(b, camera);
         if (hit.type == hit_nothing)
         {
             break;
         }
 
-        surfhit_t surf = GetSurface(scene, ro, rd, hit, b);
+        coneWidth += coneSpread * hit.wuvt.w;
+        surfhit_t surf = GetSurface(scene, ro, rd, hit, b, coneWidth);
         if (hit.type == hit_backface && !(surf.flags & matflag_refractive))
         {
             break;
@@ -2880,14 +3840,37 @@ pt_result_t VEC_CALL pt_trace_ray(
         ro = scatter.pos;
         rd = scatter.dir;
 
+        // widen the cone by the lobe's angular width, approximated by
+        // ggx alpha. surface curvature is ignored.
+        coneSpread += surf.roughness * surf.roughness;
+
         attenuation = f4_mul(attenuation, f4_divvs(scatter.attenuation, scatter.pdf));
         prevFlags = surf.flags;
     }
 
+    StatPathEnd(b);
     result.color = f4_f3(luminance);
     return result;
 }
 
+pt_result_t VEC_CALL pt_trace_ray(
+    pt_sampler_t *const pim_noalias sampler,
+    pt_scene_t *const pim_noalias scene,
+    float4 ro,
+    float4 rd)
+{
+    return TraceRay(sampler, scene, ro, rd, 0.0f, false);
+}
+
+pt_result_t VEC_CALL pt_trace_ray_retro(
+    pt_sampler_t *const pim_noalias sampler,
+    pt_scene_t *const pim_noalias scene,
+    float4 ro,
+    float4 rd)
+{
+    return TraceRayRetro(sampler, scene, ro, rd, false);
+}
+
 pim_inline float2 VEC_CALL SampleUv(
     pt_sampler_t*const pim_noalias sampler)
 {
@@ -2946,27 +3929,76 @@ typedef struct TaskUpdateDists
 
 static void UpdateDistsFn(void* pbase, i32 begin, i32 end)
 {
-    TaskUpdateDists*const pim_noalias task = pbase;
+    TaskUpdateDists*const pim_noalias task = (TaskUpdateDists*)pbase;
     pt_scene_t*const pim_noalias scene = task->scene;
-    dist1d_t*const pim_noalias dists = scene->lightDists;
+    dist1d_t** const pim_noalias cells = scene->lightCells;
+    i32* const pim_noalias dirty = scene->lightCellDirty;
+    i32 const *const pim_noalias slots = scene->lightDirtySlots;
     float alpha = task->alpha;
     u32 minSamples = task->minSamples;
     for (i32 i = begin; i < end; ++i)
     {
-        dist1d_livebake(&dists[i], alpha, minSamples);
+        i32 slot = slots[i];
+        dist1d_t* dist = LoadPtr(dist1d_t, cells[slot], MO_Acquire);
+        dist1d_livebake(dist, alpha, minSamples);
+        dirty[slot] = 0;
     }
 }
 
+typedef struct task_BuildLightCells
+{
+    task_t task;
+    pt_scene_t* scene;
+} task_BuildLightCells;
+
+static void BuildLightCellsFn(void* pbase, i32 begin, i32 end)
+{
+    task_BuildLightCells *const task = (task_BuildLightCells*)pbase;
+    pt_scene_t *const pim_noalias scene = task->scene;
+    i32 const *const pim_noalias keys = scene->lightCellKeys;
+    i32 const *const pim_noalias slots = scene->lightPendingSlots;
+    for (i32 i = begin; i < end; ++i)
+    {
+        const i32 slot = slots[i];
+        dist1d_t* dist = BuildLightCell(scene, keys[slot]);
+        StorePtr(dist1d_t, scene->lightCells[slot], dist, MO_Release);
+    }
+}
+
+// builds the cells claimed by lookups since the last call.
+// runs between traces, never during one, so light selection and its pdf
+// agree on which cells exist.
+ProfileMark(pm_buildcells, BuildLightCells)
+static void BuildLightCells(pt_scene_t*const pim_noalias scene)
+{
+    if (!scene->lightCells || !scene->lightPendingCount)
+    {
+        return;
+    }
+    ProfileBegin(pm_buildcells);
+    task_BuildLightCells *const task = tmp_calloc(sizeof(*task));
+    task->scene = scene;
+    task_run(&task->task, BuildLightCellsFn, scene->lightPendingCount);
+    scene->lightPendingCount = 0;
+    ProfileEnd(pm_buildcells);
+}
+
 ProfileMark(pm_updatedists, UpdateDists)
 static void UpdateDists(pt_scene_t*const pim_noalias scene)
 {
+    // only cells hit since the last update need a rebake
+    if (!scene->lightCells || !scene->lightDirtyCount)
+    {
+        return;
+    }
     ProfileBegin(pm_updatedists);
     TaskUpdateDists *const pim_noalias task = tmp_calloc(sizeof(*task));
     task->scene = scene;
     task->alpha = cvar_get_float(&cv_pt_dist_alpha);
     task->minSamples = cvar_get_int(&cv_pt_dist_samples);
-    i32 worklen = grid_len(&scene->lightGrid);
-    task_run(task, UpdateDistsFn, worklen);
+    i32 worklen = scene->lightDirtyCount;
+    task_run(&task->task, UpdateDistsFn, worklen);
+    scene->lightDirtyCount = 0;
     ProfileEnd(pm_updatedists);
 }
 
@@ -2988,11 +4020,239 @@ static void DofUpdate(pt_trace_t* trace, const camera_t* camera)
     }
 }
 
+// width and height of adaptive sampling tiles, in pixels
+#define kAdaptiveTile       16
+// most samples an adaptive tile receives per frame
+#define kAdaptiveMaxSpp     8
+// keeps relative error finite in dark pixels
+#define kAdaptiveBias       0.01f
+// normalized error assigned to unconverged pixels is clamped to this,
+// so that fireflies do not starve the rest of the image
+#define kAdaptiveMaxError   16.0f
+
+typedef struct adaptive_s
+{
+    i32 minSamples;
+    float maxError;
+} adaptive_t;
+
+// relative standard error of a pixel's mean luminance, over maxError.
+// 0 when converged.
+pim_inline float VEC_CALL PixelError(
+    const adaptive_t* adaptive,
+    float lum,
+    float m2,
+    float n)
+{
+    if (n < adaptive->minSamples)
+    {
+        return kAdaptiveMaxError;
+    }
+    float variance = m2 / (n - 1.0f);
+    float stdErr = sqrtf(variance / n);
+    float err = stdErr / ((lum + kAdaptiveBias) * adaptive->maxError);
+    if (err < 1.0f)
+    {
+        return 0.0f;
+    }
+    return f1_min(err, kAdaptiveMaxError);
+}
+
+pim_inline float VEC_CALL TexelError(
+    const pt_trace_t* trace,
+    const adaptive_t* adaptive,
+    i32 i)
+{
+    float lum = f4_perlum(f3_f4(trace->color[i], 0.0f));
+    return PixelError(adaptive, lum, trace->lumM2[i], trace->sampleCounts[i]);
+}
+
+typedef struct task_TileSpp
+{
+    task_t task;
+    const pt_trace_t* trace;
+    adaptive_t adaptive;
+    float* tileErrors;
+    i32 tilesX;
+} task_TileSpp;
+
+static void TileErrorFn(void* pbase, i32 begin, i32 end)
+{
+    task_TileSpp *const pim_noalias task = (task_TileSpp*)pbase;
+    const pt_trace_t* trace = task->trace;
+    const adaptive_t adaptive = task->adaptive;
+    float *const pim_noalias tileErrors = task->tileErrors;
+    const int2 size = trace->imageSize;
+    const i32 tilesX = task->tilesX;
+    for (i32 iTile = begin; iTile < end; ++iTile)
+    {
+        const i32 x0 = (iTile % tilesX) * kAdaptiveTile;
+        const i32 y0 = (iTile / tilesX) * kAdaptiveTile;
+        const i32 x1 = i1_min(x0 + kAdaptiveTile, size.x);
+        const i32 y1 = i1_min(y0 + kAdaptiveTile, size.y);
+        float sum = 0.0f;
+        for (i32 y = y0; y < y1; ++y)
+        {
+            for (i32 x = x0; x < x1; ++x)
+            {
+                sum += TexelError(trace, &adaptive, x + y * size.x);
+            }
+        }
+        tileErrors[iTile] = sum / ((x1 - x0) * (y1 - y0));
+    }
+}
+
+// returns samples to take per tile this frame, steered toward tiles
+// with high error. converged tiles receive none.
+ProfileMark(pm_tilespp, TileSpp)
+static u8* TileSpp(const pt_trace_t* trace, const adaptive_t* adaptive, i32 tilesX, i32 tileCount)
+{
+    ProfileBegin(pm_tilespp);
+
+    task_TileSpp *const pim_noalias task = tmp_calloc(sizeof(*task));
+    task->trace = trace;
+    task->adaptive = *adaptive;
+    task->tilesX = tilesX;
+    task->tileErrors = tmp_malloc(sizeof(task->tileErrors[0]) * tileCount);
+    task_run(&task->task, TileErrorFn, tileCount);
+
+    float const *const pim_noalias tileErrors = task->tileErrors;
+    float sum = 0.0f;
+    i32 active = 0;
+    for (i32 i = 0; i < tileCount; ++i)
+    {
+        sum += tileErrors[i];
+        active += tileErrors[i] > 0.0f ? 1 : 0;
+    }
+    const float rcpMean = active > 0 ? active / sum : 0.0f;
+
+    u8 *const pim_noalias tileSpp = tmp_malloc(sizeof(tileSpp[0]) * tileCount);
+    for (i32 i = 0; i < tileCount; ++i)
+    {
+        float err = tileErrors[i];
+        i32 spp = 0;
+        if (err > 0.0f)
+        {
+            spp = i1_clamp((i32)(err * rcpMean + 0.5f), 1, kAdaptiveMaxSpp);
+        }
+        tileSpp[i] = (u8)spp;
+    }
+
+    ProfileEnd(pm_tilespp);
+    return tileSpp;
+}
+
+// depth and triangle seen through a pixel center, for reprojection
+pim_inline void VEC_CALL PrimaryHit(
+    const pt_scene_t *const pim_noalias scene,
+    float4 ro,
+    float4 rd,
+    float *const pim_noalias depthOut,
+    i32 *const pim_noalias idOut)
+{
+    rayhit_t hit = pt_intersect_local(scene, ro, rd, 0.0f, 1 << 20);
+    StatAdd(&ThreadStats()->lookupRays, 1);
+    if (hit.type != hit_nothing)
+    {
+        *depthOut = hit.wuvt.w;
+        *idOut = hit.index;
+    }
+    else
+    {
+        *depthOut = -1.0f;
+        *idOut = -1;
+    }
+}
+
+// camera basis shared by every pixel of a frame
+typedef struct view_s
+{
+    float4 eye;
+    float4 right;
+    float4 up;
+    float4 fwd;
+    float2 slope;
+    float2 rcpSize;
+    float pixelSpread;
+    bool retro;
+    dofinfo_t dof;
+} view_t;
+
+static view_t VEC_CALL View_New(const camera_t* camera, const dofinfo_t* dof, int2 size)
+{
+    view_t view;
+    view.eye = camera->position;
+    view.right = quat_right(camera->rotation);
+    view.up = quat_up(camera->rotation);
+    view.fwd = quat_fwd(camera->rotation);
+    view.slope = proj_slope(f1_radians(camera->fovy), (float)size.x / (float)size.y);
+    view.rcpSize = f2_rcp(i2_f2(size));
+    view.pixelSpread = (2.0f * view.slope.y) / size.y;
+    view.retro = cvar_get_bool(&cv_pt_retro);
+    view.dof = *dof;
+    return view;
+}
+
+// sample number 'index' of pixel i, at coord.
+// seeded by i and index alone, see LdsBegin.
+pim_inline pt_result_t VEC_CALL TracePixel(
+    pt_sampler_t *const pim_noalias sampler,
+    pt_scene_t *const pim_noalias scene,
+    const view_t *const pim_noalias view,
+    int2 coord,
+    i32 i,
+    u32 index)
+{
+    LdsBegin(sampler, (u32)i, index);
+
+    // gaussian AA filter
+    float2 uv = { (coord.x + 0.5f), (coord.y + 0.5f) };
+    float2 Xi = SampleUv(sampler);
+    uv = f2_snorm(f2_mul(f2_add(uv, Xi), view->rcpSize));
+
+    ray_t ray = { view->eye, proj_dir(view->right, view->up, view->fwd, view->slope, uv) };
+    ray = CalculateDof(sampler, &view->dof, view->right, view->up, view->fwd, ray);
+
+    if (!view->retro)
+    {
+        return TraceRay(sampler, scene, ray.ro, ray.rd, view->pixelSpread, true);
+    }
+    return TraceRayRetro(sampler, scene, ray.ro, ray.rd, true);
+}
+
+// folds the n'th sample into a pixel's running means,
+// and into the running sum of squared luminance deviations (Welford)
+pim_inline void VEC_CALL Accumulate(
+    float3 *const pim_noalias color,
+    float3 *const pim_noalias albedo,
+    float3 *const pim_noalias normal,
+    float *const pim_noalias lumM2,
+    float n,
+    pt_result_t result)
+{
+    const float sampleWeight = 1.0f / n;
+    float lum = f4_perlum(f3_f4(result.color, 0.0f));
+    float prevMean = f4_perlum(f3_f4(*color, 0.0f));
+    *color = f3_lerp(*color, result.color, sampleWeight);
+    *albedo = f3_lerp(*albedo, result.albedo, sampleWeight);
+    *normal = f3_lerp(*normal, result.normal, sampleWeight);
+    float mean = f4_perlum(f3_f4(*color, 0.0f));
+    *lumM2 += (lum - prevMean) * (lum - mean);
+}
+
 typedef struct trace_task_s
 {
     task_t task;
     pt_trace_t* trace;
     camera_t camera;
+    // samples per tile, NULL for one sample everywhere
+    const u8* tileSpp;
+    i32 tilesX;
+    adaptive_t adaptive;
+    // work items are every stride'th pixel in x and y
+    i32 stride;
+    // skips pixels that were traced at stride * 2
+    bool skipCoarse;
 } trace_task_t;
 
 static void TraceFn(void* pbase, i32 begin, i32 end)
@@ -3006,47 +4266,67 @@ static void TraceFn(void* pbase, i32 begin, i32 end)
     float3 *const pim_noalias color = trace->color;
     float3 *const pim_noalias albedo = trace->albedo;
     float3 *const pim_noalias normal = trace->normal;
+    float *const pim_noalias sampleCounts = trace->sampleCounts;
+    float *const pim_noalias lumM2 = trace->lumM2;
+    float *const pim_noalias depth = trace->depth;
+    i32 *const pim_noalias primIds = trace->primIds;
 
     const int2 size = trace->imageSize;
-    const float2 rcpSize = f2_rcp(i2_f2(size));
-    const float sampleWeight = trace->sampleWeight;
+    const bool restart = trace->sampleWeight >= 1.0f;
+    u8 const *const pim_noalias tileSpp = task->tileSpp;
+    const i32 tilesX = task->tilesX;
+    const adaptive_t adaptive = task->adaptive;
+    const i32 stride = task->stride;
+    const i32 strideCols = (size.x + stride - 1) / stride;
+    const bool skipCoarse = task->skipCoarse;
 
-    const quat rot = camera.rotation;
-    const float4 eye = camera.position;
-    const float4 right = quat_right(rot);
-    const float4 up = quat_up(rot);
-    const float4 fwd = quat_fwd(rot);
-    const float2 slope = proj_slope(f1_radians(camera.fovy), (float)size.x / (float)size.y);
-    const dofinfo_t dof = trace->dofinfo;
-
-    const bool pt_retro = cvar_get_bool(&cv_pt_retro);
+    const view_t view = View_New(&camera, &trace->dofinfo, size);
 
     pt_sampler_t sampler = GetSampler();
-    for (i32 i = begin; i < end; ++i)
+    for (i32 k = begin; k < end; ++k)
     {
-        int2 coord = { i % size.x, i / size.x };
-
-        // gaussian AA filter
-        float2 uv = { (coord.x + 0.5f), (coord.y + 0.5f) };
-        float2 Xi = SampleUv(&sampler);
-        uv = f2_snorm(f2_mul(f2_add(uv, Xi), rcpSize));
+        int2 strideCoord = { k % strideCols, k / strideCols };
+        if (skipCoarse && !((strideCoord.x | strideCoord.y) & 1))
+        {
+            continue;
+        }
+        int2 coord = { strideCoord.x * stride, strideCoord.y * stride };
+        const i32 i = coord.x + coord.y * size.x;
 
-        ray_t ray = { eye, proj_dir(right, up, fwd, slope, uv) };
-        ray = CalculateDof(&sampler, &dof, right, up, fwd, ray);
+        if (restart)
+        {
+            sampleCounts[i] = 0.0f;
+            lumM2[i] = 0.0f;
+        }
+        if (sampleCounts[i] == 0.0f)
+        {
+            // a progressive restart can leave pixels untraced until a
+            // later frame, so the first sample records the primary hit
+            float2 uv = f2_snorm(f2_mul(f2_v(coord.x + 0.5f, coord.y + 0.5f), view.rcpSize));
+            float4 rd = proj_dir(view.right, view.up, view.fwd, view.slope, uv);
+            PrimaryHit(scene, view.eye, rd, depth + i, primIds + i);
+        }
 
-        pt_result_t result;
-        if (!pt_retro)
+        i32 spp = 1;
+        if (tileSpp)
         {
-            result = pt_trace_ray(&sampler, scene, ray.ro, ray.rd);
+            i32 iTile = (coord.x / kAdaptiveTile) + (coord.y / kAdaptiveTile) * tilesX;
+            spp = tileSpp[iTile];
+            if ((spp > 0) && (TexelError(trace, &adaptive, i) == 0.0f))
+            {
+                spp = 0;
+            }
         }
-        else
+
+        for (i32 s = 0; s < spp; ++s)
         {
-            result = pt_trace_ray_retro(&sampler, scene, ray.ro, ray.rd);
+            pt_result_t result = TracePixel(&sampler, scene, &view, coord, i, (u32)sampleCounts[i]);
+            float n = sampleCounts[i] + 1.0f;
+            sampleCounts[i] = n;
+            Accumulate(color + i, albedo + i, normal + i, lumM2 + i, n, result);
         }
-        color[i] = f3_lerp(color[i], result.color, sampleWeight);
-        albedo[i] = f3_lerp(albedo[i], result.albedo, sampleWeight);
-        normal[i] = f3_lerp(normal[i], result.normal, sampleWeight);
     }
+    LdsEnd(&sampler);
     SetSampler(sampler);
 }
 
@@ -3069,12 +4349,361 @@ void pt_trace(pt_trace_t* desc, const camera_t* camera)
     trace_task_t *const pim_noalias task = tmp_calloc(sizeof(*task));
     task->trace = desc;
     task->camera = *camera;
-    const i32 workSize = desc->imageSize.x * desc->imageSize.y;
+    task->adaptive.minSamples = cvar_get_int(&cv_pt_adaptive_min);
+    task->adaptive.maxError = cvar_get_float(&cv_pt_adaptive_error);
+    const int2 size = desc->imageSize;
+    task->tilesX = (size.x + kAdaptiveTile - 1) / kAdaptiveTile;
+    task->stride = 1;
+    desc->stride = 1;
+    if (cvar_get_bool(&cv_pt_adaptive) && (desc->sampleWeight < 1.0f))
+    {
+        const i32 tilesY = (size.y + kAdaptiveTile - 1) / kAdaptiveTile;
+        task->tileSpp = TileSpp(desc, &task->adaptive, task->tilesX, task->tilesX * tilesY);
+    }
+    const i32 workSize = size.x * size.y;
     task_run(task, TraceFn, workSize);
 
     ProfileEnd(pm_trace);
 }
 
+typedef struct task_TraceTile
+{
+    task_t task;
+    pt_scene_t* scene;
+    pt_tile_t* tile;
+    view_t view;
+} task_TraceTile;
+
+static void TraceTileFn(void* pbase, i32 begin, i32 end)
+{
+    task_TraceTile *const pim_noalias task = (task_TraceTile*)pbase;
+    pt_scene_t *const pim_noalias scene = task->scene;
+    pt_tile_t *const pim_noalias tile = task->tile;
+    const view_t view = task->view;
+
+    float3 *const pim_noalias color = tile->color;
+    float3 *const pim_noalias albedo = tile->albedo;
+    float3 *const pim_noalias normal = tile->normal;
+    float *const pim_noalias lumM2 = tile->lumM2;
+
+    const int2 size = tile->imageSize;
+    const int2 lo = tile->lo;
+    const i32 width = tile->hi.x - lo.x;
+    const i32 sampleBegin = tile->sampleBegin;
+    const i32 sampleEnd = tile->sampleEnd;
+
+    pt_sampler_t sampler = GetSampler();
+    for (i32 k = begin; k < end; ++k)
+    {
+        const int2 coord = { lo.x + (k % width), lo.y + (k / width) };
+        const i32 i = coord.x + coord.y * size.x;
+        color[k] = f3_0;
+        albedo[k] = f3_0;
+        normal[k] = f3_0;
+        lumM2[k] = 0.0f;
+        for (i32 s = sampleBegin; s < sampleEnd; ++s)
+        {
+            pt_result_t result = TracePixel(&sampler, scene, &view, coord, i, (u32)s);
+            Accumulate(color + k, albedo + k, normal + k, lumM2 + k, (float)(s - sampleBegin + 1), result);
+        }
+    }
+    LdsEnd(&sampler);
+    SetSampler(sampler);
+}
+
+ProfileMark(pm_tracetile, pt_trace_tile)
+void pt_trace_tile(pt_scene_t* scene, pt_tile_t* tile)
+{
+    ProfileBegin(pm_tracetile);
+
+    ASSERT(scene);
+    ASSERT(tile);
+    ASSERT(tile->color);
+    ASSERT(tile->albedo);
+    ASSERT(tile->normal);
+    ASSERT(tile->lumM2);
+
+    pt_scene_update(scene);
+
+    task_TraceTile *const pim_noalias task = tmp_calloc(sizeof(*task));
+    task->scene = scene;
+    task->tile = tile;
+    task->view = View_New(&tile->camera, &tile->dofinfo, tile->imageSize);
+    const int2 extent = i2_sub(tile->hi, tile->lo);
+    task_run(&task->task, TraceTileFn, extent.x * extent.y);
+
+    ProfileEnd(pm_tracetile);
+}
+
+// relative difference in depth beyond which history is disoccluded
+#define kReprojectDepthTol      0.05f
+// normals of a surface seen by both cameras, when triangles differ
+#define kReprojectNormalTol     0.9f
+
+typedef struct task_Reproject
+{
+    task_t task;
+    pt_trace_t* trace;
+    camera_t prevCamera;
+    camera_t camera;
+    float maxHistory;
+} task_Reproject;
+
+static void ReprojectFn(void* pbase, i32 begin, i32 end)
+{
+    task_Reproject *const pim_noalias task = (task_Reproject*)pbase;
+    pt_trace_t *const pim_noalias trace = task->trace;
+    const pt_scene_t *const pim_noalias scene = trace->scene;
+    const pt_history_t hist = trace->history;
+    const float maxHistory = task->maxHistory;
+
+    float3 *const pim_noalias color = trace->color;
+    float3 *const pim_noalias albedo = trace->albedo;
+    float3 *const pim_noalias normal = trace->normal;
+    float *const pim_noalias sampleCounts = trace->sampleCounts;
+    float *const pim_noalias lumM2 = trace->lumM2;
+    float *const pim_noalias depth = trace->depth;
+    i32 *const pim_noalias primIds = trace->primIds;
+
+    const int2 size = trace->imageSize;
+    const float2 sizef = i2_f2(size);
+    const float2 rcpSize = f2_rcp(sizef);
+    const float aspect = sizef.x / sizef.y;
+
+    const float4 eye = task->camera.position;
+    const float4 right = quat_right(task->camera.rotation);
+    const float4 up = quat_up(task->camera.rotation);
+    const float4 fwd = quat_fwd(task->camera.rotation);
+    const float2 slope = proj_slope(f1_radians(task->camera.fovy), aspect);
+
+    const float4 prevEye = task->prevCamera.position;
+    const float4 prevRight = quat_right(task->prevCamera.rotation);
+    const float4 prevUp = quat_up(task->prevCamera.rotation);
+    const float4 prevFwd = quat_fwd(task->prevCamera.rotation);
+    const float2 prevSlope = proj_slope(f1_radians(task->prevCamera.fovy), aspect);
+
+    for (i32 i = begin; i < end; ++i)
+    {
+        int2 coord = { i % size.x, i / size.x };
+        float2 uv = f2_snorm(f2_mul(f2_v(coord.x + 0.5f, coord.y + 0.5f), rcpSize));
+        float4 rd = proj_dir(right, up, fwd, slope, uv);
+        rayhit_t hit = pt_intersect_local(scene, eye, rd, 0.0f, 1 << 20);
+        StatAdd(&ThreadStats()->lookupRays, 1);
+        const bool sky = hit.type == hit_nothing;
+        depth[i] = sky ? -1.0f : hit.wuvt.w;
+        primIds[i] = sky ? -1 : hit.index;
+
+        // sky reprojects by direction, surfaces by position
+        float4 P = f4_add(eye, f4_mulvs(rd, hit.wuvt.w));
+        float4 v = sky ? rd : f4_sub(P, prevEye);
+        float z = f4_dot3(v, prevFwd);
+
+        i32 j = -1;
+        if (z > kEpsilon)
+        {
+            float2 prevUv =
+            {
+                f4_dot3(v, prevRight) / (z * prevSlope.x),
+                f4_dot3(v, prevUp) / (z * prevSlope.y),
+            };
+            float2 prevCoord = f2_mul(f2_unorm(prevUv), sizef);
+            i32 x = (i32)floorf(prevCoord.x);
+            i32 y = (i32)floorf(prevCoord.y);
+            if ((x >= 0) && (x < size.x) && (y >= 0) && (y < size.y))
+            {
+                j = x + y * size.x;
+            }
+        }
+
+        bool valid = j >= 0;
+        if (valid)
+        {
+            if (sky)
+            {
+                valid = hist.primIds[j] == -1;
+            }
+            else
+            {
+                float prevDepth = f4_distance3(P, prevEye);
+                valid = hist.primIds[j] != -1;
+                valid = valid && (f1_distance(hist.depth[j], prevDepth) <= prevDepth * kReprojectDepthTol);
+                valid = valid && (
+                    (hist.primIds[j] == hit.index) ||
+                    (f4_dot3(f4_normalize3(f3_f4(hist.normal[j], 0.0f)), hit.normal) >= kReprojectNormalTol));
+            }
+        }
+
+        if (valid)
+        {
+            float n = hist.sampleCounts[j];
+            float m = f1_min(n, maxHistory);
+            color[i] = hist.color[j];
+            albedo[i] = hist.albedo[j];
+            normal[i] = hist.normal[j];
+            sampleCounts[i] = m;
+            // keep the variance estimate of the shortened history
+            lumM2[i] = n > 0.0f ? hist.lumM2[j] * (m / n) : 0.0f;
+        }
+        else
+        {
+            // the next sample overwrites these at weight 1
+            sampleCounts[i] = 0.0f;
+            lumM2[i] = 0.0f;
+        }
+    }
+}
+
+// exchanges a buffer with its history, allocating the history on first use
+#define SWAP_HISTORY(T, field) do { \
+    if (!hist->field) { hist->field = tex_calloc(sizeof(T) * texelCount); } \
+    T* prev = desc->field; \
+    desc->field = hist->field; \
+    hist->field = prev; \
+} while(0)
+
+ProfileMark(pm_reproject, pt_trace_reproject)
+void pt_trace_reproject(
+    pt_trace_t* desc,
+    const camera_t* prevCamera,
+    const camera_t* camera)
+{
+    ProfileBegin(pm_reproject);
+
+    ASSERT(desc);
+    ASSERT(desc->scene);
+    ASSERT(prevCamera);
+    ASSERT(camera);
+
+    const int2 size = desc->imageSize;
+    const i32 texelCount = size.x * size.y;
+    pt_history_t* hist = &desc->history;
+    SWAP_HISTORY(float3, color);
+    SWAP_HISTORY(float3, albedo);
+    SWAP_HISTORY(float3, normal);
+    SWAP_HISTORY(float, sampleCounts);
+    SWAP_HISTORY(float, lumM2);
+    SWAP_HISTORY(float, depth);
+    SWAP_HISTORY(i32, primIds);
+
+    task_Reproject *const pim_noalias task = tmp_calloc(sizeof(*task));
+    task->trace = desc;
+    task->prevCamera = *prevCamera;
+    task->camera = *camera;
+    task->maxHistory = (float)cvar_get_int(&cv_pt_history_max);
+    task_run(&task->task, ReprojectFn, texelCount);
+
+    ProfileEnd(pm_reproject);
+}
+
+// coarsest pixel stride of a progressive trace
+#define kProgressiveStride 8
+
+ProfileMark(pm_trace_progressive, pt_trace_progressive)
+void pt_trace_progressive(pt_trace_t* desc, const camera_t* camera, float budgetMs)
+{
+    ProfileBegin(pm_trace_progressive);
+
+    ASSERT(desc);
+    ASSERT(desc->scene);
+    ASSERT(camera);
+
+    const u64 start = time_now();
+
+    DofUpdate(desc, camera);
+
+    pt_scene_update(desc->scene);
+
+    const int2 size = desc->imageSize;
+    const i32 texelCount = size.x * size.y;
+    if (desc->sampleWeight >= 1.0f)
+    {
+        // pixels skipped this frame must not keep the old image
+        memset(desc->sampleCounts, 0, sizeof(desc->sampleCounts[0]) * texelCount);
+        memset(desc->lumM2, 0, sizeof(desc->lumM2[0]) * texelCount);
+    }
+
+    i32 traced = 0;
+    i32 tracedStride = kProgressiveStride;
+    for (i32 stride = kProgressiveStride; stride >= 1; stride >>= 1)
+    {
+        const i32 cols = (size.x + stride - 1) / stride;
+        const i32 rows = (size.y + stride - 1) / stride;
+        const i32 workSize = cols * rows;
+        if (traced > 0)
+        {
+            // continue only if the new pixels of this level fit in the budget
+            double elapsed = time_milli(time_now() - start);
+            double predicted = elapsed + (elapsed / traced) * (workSize - traced);
+            if (predicted > budgetMs)
+            {
+                break;
+            }
+        }
+
+        trace_task_t *const pim_noalias task = tmp_calloc(sizeof(*task));
+        task->trace = desc;
+        task->camera = *camera;
+        task->tilesX = (size.x + kAdaptiveTile - 1) / kAdaptiveTile;
+        task->stride = stride;
+        task->skipCoarse = stride < kProgressiveStride;
+        task_run(task, TraceFn, workSize);
+
+        traced = workSize;
+        tracedStride = stride;
+    }
+    desc->stride = tracedStride;
+
+    ProfileEnd(pm_trace_progressive);
+}
+
+typedef struct task_Upsample
+{
+    task_t task;
+    const pt_trace_t* trace;
+    const float3* src;
+    float4* dst;
+} task_Upsample;
+
+static void UpsampleFn(void* pbase, i32 begin, i32 end)
+{
+    task_Upsample *const pim_noalias task = (task_Upsample*)pbase;
+    const pt_trace_t *const pim_noalias trace = task->trace;
+    const float3 *const pim_noalias src = task->src;
+    float4 *const pim_noalias dst = task->dst;
+    const float *const pim_noalias sampleCounts = trace->sampleCounts;
+    const int2 size = trace->imageSize;
+    const i32 mask = ~(trace->stride - 1);
+    for (i32 i = begin; i < end; ++i)
+    {
+        i32 j = i;
+        if (sampleCounts[i] == 0.0f)
+        {
+            i32 x = (i % size.x) & mask;
+            i32 y = (i / size.x) & mask;
+            j = x + y * size.x;
+        }
+        dst[i] = f3_f4(src[j], 1.0f);
+    }
+}
+
+ProfileMark(pm_upsample, pt_trace_upsample)
+void pt_trace_upsample(const pt_trace_t* desc, const float3* src, float4* dst)
+{
+    ProfileBegin(pm_upsample);
+
+    ASSERT(desc);
+    ASSERT(src);
+    ASSERT(dst);
+
+    task_Upsample *const pim_noalias task = tmp_calloc(sizeof(*task));
+    task->trace = desc;
+    task->src = src;
+    task->dst = dst;
+    task_run(&task->task, UpsampleFn, desc->imageSize.x * desc->imageSize.y);
+
+    ProfileEnd(pm_upsample);
+}
+
 typedef struct pt_raygen_s
 {
     task_t task;
@@ -3145,16 +4774,46 @@ pt_results_t pt_raygen(
     return results;
 }
 
+// each dimension of a sequence is an independently shuffled sobol sequence
+pim_inline u32 VEC_CALL LdsSeed(pt_sampler_t*const pim_noalias sampler)
+{
+    u32 dim = (u32)sampler->ldsDim++;
+    return HashMix32(sampler->ldsKey ^ HashMix32(dim));
+}
+
 pim_inline float VEC_CALL Sample1D(pt_sampler_t*const pim_noalias sampler)
 {
+    if (sampler->ldsDim >= 0)
+    {
+        return SobolOwen1D(sampler->ldsIndex, LdsSeed(sampler));
+    }
     return prng_f32(&sampler->rng);
 }
 
 pim_inline float2 VEC_CALL Sample2D(pt_sampler_t*const pim_noalias sampler)
 {
+    if (sampler->ldsDim >= 0)
+    {
+        return SobolOwen2D(sampler->ldsIndex, LdsSeed(sampler));
+    }
     return f2_rand(&sampler->rng);
 }
 
+pim_inline void VEC_CALL LdsBegin(pt_sampler_t*const pim_noalias sampler, u32 key, u32 index)
+{
+    sampler->ldsKey = HashMix32(key);
+    sampler->ldsIndex = index;
+    sampler->ldsDim = 0;
+    // the few draws made straight from rng are seeded the same way, so a
+    // sample never depends on which thread or process traced it
+    sampler->rng.state = ((u64)sampler->ldsKey << 32) | HashMix32(index ^ sampler->ldsKey);
+}
+
+pim_inline void VEC_CALL LdsEnd(pt_sampler_t*const pim_noalias sampler)
+{
+    sampler->ldsDim = -1;
+}
+
 pim_inline pt_sampler_t VEC_CALL GetSampler(void)
 {
     i32 tid = task_thread_id();
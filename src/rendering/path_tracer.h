@@ -3,11 +3,11 @@
 #include "common/macro.h"
 #include "math/types.h"
 #include "common/random.h"
+#include "rendering/camera.h"
 
 PIM_C_BEGIN
 
 typedef struct material_s material_t;
-typedef struct camera_s camera_t;
 typedef struct task_s task_t;
 
 typedef struct pt_scene_s pt_scene_t;
@@ -15,6 +15,11 @@ typedef struct pt_scene_s pt_scene_t;
 typedef struct pt_sampler_s
 {
     prng_t rng;
+    // scrambled sobol sequence, see pt_sampler_begin
+    u32 ldsKey;
+    u32 ldsIndex;
+    // next dimension to draw, -1 when no sequence is active
+    i32 ldsDim;
     float Xi[8];
 } pt_sampler_t;
 
@@ -47,14 +52,38 @@ typedef struct dofinfo_s
     bool autoFocus;
 } dofinfo_t;
 
+// accumulation buffers of a previous camera, for reprojection
+typedef struct pt_history_s
+{
+    float3* color;
+    float3* albedo;
+    float3* normal;
+    float* sampleCounts;
+    float* lumM2;
+    float* depth;
+    i32* primIds;
+} pt_history_t;
+
 typedef struct pt_trace_s
 {
     pt_scene_t* scene;
     float3* color;
     float3* albedo;
     float3* normal;
-    float3* denoised;
+    // samples accumulated per pixel
+    float* sampleCounts;
+    // per pixel running sum of squared luminance deviations (Welford)
+    float* lumM2;
+    // distance to the primary hit through each pixel center, -1 for sky
+    float* depth;
+    // first vertex of the primary hit triangle per pixel, -1 for sky
+    i32* primIds;
+    // spare buffers swapped in by pt_trace_reproject, NULL until first used
+    pt_history_t history;
     int2 imageSize;
+    // pixel stride of the finest level traced last frame, 1 at full resolution
+    i32 stride;
+    // 1 restarts accumulation
     float sampleWeight;
     dofinfo_t dofinfo;
 } pt_trace_t;
@@ -72,17 +101,63 @@ typedef struct pt_results_s
     float4* directions;
 } pt_results_t;
 
+// paths ending past this bounce share the last histogram bin
+#define kPtStatBounces 16
+
+// ray throughput, gathered per thread and summed once a frame
+typedef struct pt_stats_s
+{
+    // first rays of camera paths traced by pt_trace
+    u64 primaryRays;
+    // rays continuing a path after a bounce or media scattering
+    u64 secondaryRays;
+    // first rays of paths from lightmap texels, cubemaps and probes
+    u64 bakeRays;
+    // single hit lookups, such as reprojection and the inside test
+    u64 lookupRays;
+    // visibility rays toward sampled lights
+    u64 shadowRays;
+    // closest surface queries, such as the light grid inside test
+    u64 pointQueries;
+    // tentative collisions sampled by media tracking
+    u64 mediaSteps;
+    // paths ended by russian roulette
+    u64 rouletteKills;
+    // paths by the number of bounces made before they ended
+    u64 bounces[kPtStatBounces];
+    // wall time covered by the counts above
+    double seconds;
+} pt_stats_t;
+
 void pt_sys_init(void);
 void pt_sys_update(void);
 void pt_sys_shutdown(void);
 
+// counts from the last full frame
+const pt_stats_t* pt_stats_get(void);
+// millions of rays of all kinds per second
+double pt_stats_mrays(const pt_stats_t* stats);
+
 pt_sampler_t VEC_CALL pt_sampler_get(void);
 void VEC_CALL pt_sampler_set(pt_sampler_t sampler);
 float2 VEC_CALL pt_sample_2d(pt_sampler_t*const pim_noalias sampler);
 float VEC_CALL pt_sample_1d(pt_sampler_t*const pim_noalias sampler);
+// draws sample 'index' of a low discrepancy sequence keyed by 'key',
+// such as a pixel, until pt_sampler_end returns to white noise
+void VEC_CALL pt_sampler_begin(pt_sampler_t*const pim_noalias sampler, u32 key, u32 index);
+void VEC_CALL pt_sampler_end(pt_sampler_t*const pim_noalias sampler);
+// per thread sampler states, for checkpoints to resume their sequences.
+// pt_sampler_count entries are read or written.
+i32 pt_sampler_count(void);
+void pt_sampler_save(pt_sampler_t* dst);
+void pt_sampler_load(const pt_sampler_t* src, i32 count);
 
 pt_scene_t* pt_scene_new(void);
 void pt_scene_update(pt_scene_t*const pim_noalias scene);
+// builds the light grid cell of every grid index and stops hits from
+// adjusting them, so that light selection no longer depends on which pixels
+// this process traced. for the life of the scene.
+void pt_scene_freeze_lights(pt_scene_t*const pim_noalias scene);
 void pt_scene_del(pt_scene_t*const pim_noalias scene);
 void pt_scene_gui(pt_scene_t*const pim_noalias scene);
 
@@ -100,6 +175,13 @@ rayhit_t VEC_CALL pt_intersect(
     float tNear,
     float tFar);
 
+// true when a sphere at 'position' is near a surface, or when most rays
+// tossed from it hit front faces; the light grid's test for empty cells.
+bool VEC_CALL pt_inside_level(
+    pt_scene_t *const pim_noalias scene,
+    float4 position,
+    float radius);
+
 pt_result_t VEC_CALL pt_trace_ray(
     pt_sampler_t*const pim_noalias sampler,
     pt_scene_t*const pim_noalias scene,
@@ -113,6 +195,49 @@ pt_result_t VEC_CALL pt_trace_ray_retro(
     float4 rd);
 
 void pt_trace(pt_trace_t* traceDesc, const camera_t* camera);
+// traces at 1/8, 1/4, 1/2 and full resolution while budgetMs allows,
+// leaving the finest level reached in traceDesc->stride
+void pt_trace_progressive(
+    pt_trace_t* traceDesc,
+    const camera_t* camera,
+    float budgetMs);
+// copies src to dst, filling pixels without samples from the
+// last progressive trace's coarser levels
+void pt_trace_upsample(
+    const pt_trace_t* traceDesc,
+    const float3* src,
+    float4* dst);
+// a rectangle of an image and a range of sample indices to trace into it,
+// for splitting frames across processes
+typedef struct pt_tile_s
+{
+    camera_t camera;
+    dofinfo_t dofinfo;
+    int2 imageSize;
+    // pixel bounds, hi exclusive
+    int2 lo;
+    int2 hi;
+    // sample indices, end exclusive
+    i32 sampleBegin;
+    i32 sampleEnd;
+    // written by pt_trace_tile, row major within the tile
+    float3* color;
+    float3* albedo;
+    float3* normal;
+    float* lumM2;
+} pt_tile_t;
+
+// traces tile->sampleBegin..sampleEnd of each pixel in the tile from zero.
+// samples are seeded by pixel and sample index alone, so any split of an
+// image into tiles and sample ranges traces the same samples, as long as
+// the scene's lights are frozen (see pt_scene_freeze_lights).
+void pt_trace_tile(pt_scene_t* scene, pt_tile_t* tile);
+// moves accumulated samples from prevCamera's view into camera's view.
+// pixels whose primary hit was not visible to prevCamera restart at 0 samples.
+void pt_trace_reproject(
+    pt_trace_t* traceDesc,
+    const camera_t* prevCamera,
+    const camera_t* camera);
 
 pt_results_t pt_raygen(
     pt_scene_t*const pim_noalias scene,
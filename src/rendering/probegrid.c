@@ -0,0 +1,536 @@
+#include "rendering/probegrid.h"
+#include "rendering/path_tracer.h"
+#include "rendering/drawable.h"
+#include "rendering/vulkan/vkr_textable.h"
+#include "assets/crate.h"
+#include "allocator/allocator.h"
+#include "math/float4_funcs.h"
+#include "math/float3_funcs.h"
+#include "math/sampling.h"
+#include "math/color.h"
+#include "math/sh.h"
+#include "threading/task.h"
+#include "common/profiler.h"
+#include "common/console.h"
+#include <string.h>
+
+#define kMaxProbeCells (1<<18)
+// bricks are 4x4x4 cells
+#define kBrickShift 2
+#define kBrickMask ((1 << kBrickShift) - 1)
+#define kBrickLen (1 << (3 * kBrickShift))
+
+static probegrid_t ms_grid;
+probegrid_t* probegrid_get(void) { return &ms_grid; }
+
+static void AllocVolumes(probegrid_t* pg)
+{
+    const int3 size = pg->grid.size;
+    for (i32 i = 0; i < NELEM(pg->volumes); ++i)
+    {
+        pg->volumes[i] = vkrTexTable_Alloc(
+            VK_IMAGE_VIEW_TYPE_3D,
+            VK_FORMAT_R16G16B16A16_SFLOAT,
+            size.x,
+            size.y,
+            size.z,
+            1,
+            false);
+        // clamped like probegrid_sample, so edge cells extend outward
+        vkrTexTable_SetSampler(
+            pg->volumes[i],
+            VK_FILTER_LINEAR,
+            VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            0.0f);
+    }
+}
+
+pim_inline i32 VEC_CALL BrickIndex(int3 brickSize, i32 x, i32 y, i32 z)
+{
+    return
+        (x >> kBrickShift) +
+        (y >> kBrickShift) * brickSize.x +
+        (z >> kBrickShift) * brickSize.x * brickSize.y;
+}
+
+pim_inline i32 VEC_CALL BrickOffset(i32 x, i32 y, i32 z)
+{
+    return
+        (x & kBrickMask) +
+        ((y & kBrickMask) << kBrickShift) +
+        ((z & kBrickMask) << (2 * kBrickShift));
+}
+
+// sparse cell lookup from the probes' cells.
+// bricks are numbered in order of their first probe.
+static void NewBricks(probegrid_t* pg)
+{
+    const int3 size = pg->grid.size;
+    const int3 brickSize =
+    {
+        (size.x + kBrickMask) >> kBrickShift,
+        (size.y + kBrickMask) >> kBrickShift,
+        (size.z + kBrickMask) >> kBrickShift,
+    };
+    const i32 brickLen = brickSize.x * brickSize.y * brickSize.z;
+    i32* pim_noalias brickCells = perm_malloc(sizeof(brickCells[0]) * brickLen);
+    for (i32 i = 0; i < brickLen; ++i)
+    {
+        brickCells[i] = -1;
+    }
+
+    i32 const *const pim_noalias probeCells = pg->probeCells;
+    const i32 probeCount = pg->probeCount;
+    i32 brickCount = 0;
+    for (i32 i = 0; i < probeCount; ++i)
+    {
+        const i32 cell = probeCells[i];
+        const i32 x = cell % size.x;
+        const i32 y = (cell / size.x) % size.y;
+        const i32 z = cell / (size.x * size.y);
+        const i32 brick = BrickIndex(brickSize, x, y, z);
+        if (brickCells[brick] < 0)
+        {
+            brickCells[brick] = brickCount++ * kBrickLen;
+        }
+    }
+
+    i32* pim_noalias brickProbes = perm_malloc(sizeof(brickProbes[0]) * i1_max(1, brickCount * kBrickLen));
+    for (i32 i = 0; i < brickCount * kBrickLen; ++i)
+    {
+        brickProbes[i] = -1;
+    }
+    for (i32 i = 0; i < probeCount; ++i)
+    {
+        const i32 cell = probeCells[i];
+        const i32 x = cell % size.x;
+        const i32 y = (cell / size.x) % size.y;
+        const i32 z = cell / (size.x * size.y);
+        const i32 brick = BrickIndex(brickSize, x, y, z);
+        const i32 offset = BrickOffset(x, y, z);
+        brickProbes[brickCells[brick] + offset] = i;
+    }
+
+    pg->brickSize = brickSize;
+    pg->brickCount = brickCount;
+    pg->brickCells = brickCells;
+    pg->brickProbes = brickProbes;
+}
+
+// probe of cell (x, y, z), or -1 when it is outside the level
+pim_inline i32 VEC_CALL CellProbe(const probegrid_t* pg, i32 x, i32 y, i32 z)
+{
+    const i32 first = pg->brickCells[BrickIndex(pg->brickSize, x, y, z)];
+    return (first >= 0) ? pg->brickProbes[first + BrickOffset(x, y, z)] : -1;
+}
+
+// most rays from a point inside a wall, or behind the level's outer shell,
+// see the back of the faces around it. cells near a surface pass
+// pt_inside_level without casting any rays, so they are checked again here.
+static bool VEC_CALL Buried(pt_scene_t* scene, float4 position)
+{
+    const i32 kRays = 16;
+    i32 backfaces = 0;
+    for (i32 i = 0; i < kRays; ++i)
+    {
+        float4 rd = SampleUnitSphere(Hammersley2D(i, kRays));
+        rayhit_t hit = pt_intersect(scene, position, rd, 0.0f, 1 << 20);
+        if (hit.type == hit_backface)
+        {
+            ++backfaces;
+        }
+    }
+    return backfaces * 4 > kRays;
+}
+
+typedef struct task_PlaceProbes
+{
+    task_t task;
+    pt_scene_t* scene;
+    const grid_t* grid;
+    i32* inside;
+} task_PlaceProbes;
+
+static void PlaceProbesFn(void* pbase, i32 begin, i32 end)
+{
+    task_PlaceProbes* task = (task_PlaceProbes*)pbase;
+    pt_scene_t* scene = task->scene;
+    const grid_t* grid = task->grid;
+    i32* pim_noalias inside = task->inside;
+
+    const float radius = 0.666f / grid->cellsPerMeter;
+    for (i32 i = begin; i < end; ++i)
+    {
+        float4 position = grid_position(grid, i);
+        inside[i] =
+            pt_inside_level(scene, position, radius) &&
+            !Buried(scene, position);
+    }
+}
+
+ProfileMark(pm_New, probegrid_new)
+void probegrid_new(probegrid_t* pg, pt_scene_t* scene, float probesPerMeter)
+{
+    ASSERT(pg);
+    ASSERT(scene);
+    ASSERT(probesPerMeter > 0.0f);
+    ProfileBegin(pm_New);
+
+    memset(pg, 0, sizeof(*pg));
+
+    box_t bounds = drawables_bounds(drawables_get());
+    grid_t grid;
+    grid_new(&grid, bounds, probesPerMeter);
+    i32 len = grid_len(&grid);
+    if (len > kMaxProbeCells)
+    {
+        float metersPerCell = 1.0f / probesPerMeter;
+        metersPerCell *= 1.01f * cbrtf((float)len / kMaxProbeCells);
+        grid_new(&grid, bounds, 1.0f / metersPerCell);
+        len = grid_len(&grid);
+    }
+    pg->grid = grid;
+    if ((grid.size.x <= 0) || (grid.size.y <= 0) || (grid.size.z <= 0))
+    {
+        ProfileEnd(pm_New);
+        return;
+    }
+
+    task_PlaceProbes* task = tmp_calloc(sizeof(*task));
+    task->scene = scene;
+    task->grid = &pg->grid;
+    task->inside = tmp_malloc(sizeof(task->inside[0]) * len);
+    task_run(&task->task, PlaceProbesFn, len);
+
+    i32 const *const pim_noalias inside = task->inside;
+    i32 probeCount = 0;
+    for (i32 i = 0; i < len; ++i)
+    {
+        probeCount += inside[i] ? 1 : 0;
+    }
+    i32* pim_noalias probeCells = perm_malloc(sizeof(probeCells[0]) * i1_max(1, probeCount));
+    probeCount = 0;
+    for (i32 i = 0; i < len; ++i)
+    {
+        if (inside[i])
+        {
+            probeCells[probeCount++] = i;
+        }
+    }
+
+    pg->probeCount = probeCount;
+    pg->probeCells = probeCells;
+    NewBricks(pg);
+    pg->probes = perm_calloc(sizeof(pg->probes[0]) * i1_max(1, probeCount));
+    pg->accum = perm_calloc(sizeof(pg->accum[0]) * i1_max(1, probeCount));
+    AllocVolumes(pg);
+    probegrid_upload(pg);
+
+    ProfileEnd(pm_New);
+}
+
+void probegrid_del(probegrid_t* pg)
+{
+    if (pg)
+    {
+        for (i32 i = 0; i < NELEM(pg->volumes); ++i)
+        {
+            vkrTexTable_Free(pg->volumes[i]);
+        }
+        pim_free(pg->brickCells);
+        pim_free(pg->brickProbes);
+        pim_free(pg->probeCells);
+        pim_free(pg->probes);
+        pim_free(pg->accum);
+        memset(pg, 0, sizeof(*pg));
+    }
+}
+
+typedef struct task_BakeProbes
+{
+    task_t task;
+    probegrid_t* pg;
+    pt_scene_t* scene;
+    i32 spp;
+} task_BakeProbes;
+
+static void BakeProbesFn(void* pbase, i32 begin, i32 end)
+{
+    task_BakeProbes* task = (task_BakeProbes*)pbase;
+    probegrid_t* pg = task->pg;
+    pt_scene_t* scene = task->scene;
+    const i32 spp = task->spp;
+    const i32 sampleCount = pg->sampleCount;
+    const grid_t* grid = &pg->grid;
+    i32 const *const pim_noalias probeCells = pg->probeCells;
+    pgprobe_t* pim_noalias probes = pg->probes;
+    SH4v* pim_noalias accum = pg->accum;
+
+    pt_sampler_t sampler = pt_sampler_get();
+    for (i32 i = begin; i < end; ++i)
+    {
+        const float4 ro = grid_position(grid, probeCells[i]);
+        SH4v sh = accum[i];
+        for (i32 s = 0; s < spp; ++s)
+        {
+            float4 rd = SampleUnitSphere(pt_sample_2d(&sampler));
+            pt_result_t result = pt_trace_ray(&sampler, scene, ro, rd);
+            float weight = 1.0f / (sampleCount + s + 1);
+            sh = SH4v_fit(sh, f4_f3(rd), result.color, weight);
+        }
+        accum[i] = sh;
+
+        pgprobe_t probe;
+        probe.r = f4_half4(f4_v(sh.v[0].x, sh.v[1].x, sh.v[2].x, sh.v[3].x));
+        probe.g = f4_half4(f4_v(sh.v[0].y, sh.v[1].y, sh.v[2].y, sh.v[3].y));
+        probe.b = f4_half4(f4_v(sh.v[0].z, sh.v[1].z, sh.v[2].z, sh.v[3].z));
+        probes[i] = probe;
+    }
+    pt_sampler_set(sampler);
+}
+
+ProfileMark(pm_Bake, probegrid_bake)
+void probegrid_bake(probegrid_t* pg, pt_scene_t* scene, i32 spp)
+{
+    ASSERT(pg);
+    ASSERT(scene);
+    if ((pg->probeCount > 0) && (spp > 0))
+    {
+        ProfileBegin(pm_Bake);
+
+        pt_scene_update(scene);
+
+        task_BakeProbes* task = tmp_calloc(sizeof(*task));
+        task->pg = pg;
+        task->scene = scene;
+        task->spp = spp;
+        task_run(&task->task, BakeProbesFn, pg->probeCount);
+        pg->sampleCount += spp;
+
+        ProfileEnd(pm_Bake);
+    }
+}
+
+ProfileMark(pm_Upload, probegrid_upload)
+void probegrid_upload(probegrid_t* pg)
+{
+    ASSERT(pg);
+    const i32 len = grid_len(&pg->grid);
+    if ((len <= 0) || !pg->brickCells || !vkrTexTable_Exists(pg->volumes[0]))
+    {
+        return;
+    }
+    ProfileBegin(pm_Upload);
+
+    i32 const *const pim_noalias probeCells = pg->probeCells;
+    SH4v const *const pim_noalias accum = pg->accum;
+    const i32 probeCount = pg->probeCount;
+    // the volumes are dense; the upload copies out of this before returning
+    ushort4* pim_noalias texels = tmp_malloc(sizeof(texels[0]) * len);
+    for (i32 c = 0; c < NELEM(pg->volumes); ++c)
+    {
+        memset(texels, 0, sizeof(texels[0]) * len);
+        // alpha marks cells inside the level, in the first volume only
+        const float inside = (c == 0) ? 1.0f : 0.0f;
+        for (i32 i = 0; i < probeCount; ++i)
+        {
+            float4 value = f3_f4(accum[i].v[c], inside);
+            value = f4_clampvs(value, -65504.0f, 65504.0f);
+            texels[probeCells[i]] = f4_half4(value);
+        }
+        vkrTexTable_Upload(pg->volumes[c], 0, texels, sizeof(texels[0]) * len);
+    }
+    pg->uploadCount = pg->sampleCount;
+
+    ProfileEnd(pm_Upload);
+}
+
+bool probegrid_save(crate_t* crate, const probegrid_t* pg, bool bakeState)
+{
+    ASSERT(crate);
+    ASSERT(pg);
+    const i32 probeCount = pg->probeCount;
+    if ((probeCount <= 0) || !pg->brickCells)
+    {
+        // a grid saved earlier would load over this map's missing one
+        crate_rm(crate, guid_str("probegrid"));
+        return true;
+    }
+
+    dprobegrid_t dpg = { 0 };
+    dpg.version = kProbeGridVersion;
+    dpg.probeCount = probeCount;
+    dpg.sampleCount = pg->sampleCount;
+    dpg.bakeState = bakeState;
+    dpg.grid = pg->grid;
+
+    bool wrote = crate_set(crate, guid_str("probegrid"), &dpg, sizeof(dpg));
+    wrote &= crate_set(crate,
+        guid_str("probegrid.cells"), pg->probeCells, sizeof(pg->probeCells[0]) * probeCount);
+    wrote &= crate_set(crate,
+        guid_str("probegrid.probes"), pg->probes, sizeof(pg->probes[0]) * probeCount);
+    if (bakeState)
+    {
+        wrote &= crate_set(crate,
+            guid_str("probegrid.accum"), pg->accum, sizeof(pg->accum[0]) * probeCount);
+    }
+    return wrote;
+}
+
+static bool GetEntry(crate_t* crate, const char* name, void* dst, i32 size)
+{
+    const guid_t id = guid_str(name);
+    i32 offset = 0;
+    i32 stored = 0;
+    return crate_stat(crate, id, &offset, &stored) &&
+        (stored >= size) &&
+        crate_get(crate, id, dst, size);
+}
+
+ProfileMark(pm_Load, probegrid_load)
+bool probegrid_load(crate_t* crate, probegrid_t* pg)
+{
+    ASSERT(crate);
+    ASSERT(pg);
+    probegrid_del(pg);
+
+    dprobegrid_t dpg = { 0 };
+    if (!GetEntry(crate, "probegrid", &dpg, sizeof(dpg)))
+    {
+        return false;
+    }
+    const int3 size = dpg.grid.size;
+    const i64 len = (i64)size.x * size.y * size.z;
+    if ((dpg.version != kProbeGridVersion) ||
+        (size.x <= 0) || (size.y <= 0) || (size.z <= 0) ||
+        (len > 2 * kMaxProbeCells) ||
+        (dpg.probeCount <= 0) || (dpg.probeCount > len) ||
+        (dpg.sampleCount < 0) ||
+        !(dpg.grid.cellsPerMeter > 0.0f))
+    {
+        con_logf(LogSev_Error, "pg", "Probe grid in the crate does not match this build");
+        return false;
+    }
+    ProfileBegin(pm_Load);
+
+    const i32 probeCount = dpg.probeCount;
+    pg->grid = dpg.grid;
+    pg->probeCount = probeCount;
+    pg->sampleCount = dpg.sampleCount;
+    pg->probeCells = perm_malloc(sizeof(pg->probeCells[0]) * probeCount);
+    pg->probes = perm_calloc(sizeof(pg->probes[0]) * probeCount);
+    pg->accum = perm_calloc(sizeof(pg->accum[0]) * probeCount);
+
+    bool loaded = true;
+    loaded &= GetEntry(crate, "probegrid.cells",
+        pg->probeCells, sizeof(pg->probeCells[0]) * probeCount);
+    loaded &= GetEntry(crate, "probegrid.probes",
+        pg->probes, sizeof(pg->probes[0]) * probeCount);
+    for (i32 i = 0; loaded && (i < probeCount); ++i)
+    {
+        loaded = (pg->probeCells[i] >= 0) && (pg->probeCells[i] < len);
+    }
+
+    bool haveAccum = dpg.bakeState && loaded && GetEntry(crate, "probegrid.accum",
+        pg->accum, sizeof(pg->accum[0]) * probeCount);
+    if (loaded && !haveAccum)
+    {
+        // resume from the halves, close enough to keep converging
+        for (i32 i = 0; i < probeCount; ++i)
+        {
+            const pgprobe_t probe = pg->probes[i];
+            const float4 r = half4_f4(probe.r);
+            const float4 g = half4_f4(probe.g);
+            const float4 b = half4_f4(probe.b);
+            pg->accum[i].v[0] = f3_v(r.x, g.x, b.x);
+            pg->accum[i].v[1] = f3_v(r.y, g.y, b.y);
+            pg->accum[i].v[2] = f3_v(r.z, g.z, b.z);
+            pg->accum[i].v[3] = f3_v(r.w, g.w, b.w);
+        }
+    }
+
+    if (loaded)
+    {
+        NewBricks(pg);
+        AllocVolumes(pg);
+        probegrid_upload(pg);
+    }
+    else
+    {
+        con_logf(LogSev_Error, "pg", "Probe grid in the crate is incomplete");
+        probegrid_del(pg);
+    }
+
+    ProfileEnd(pm_Load);
+    return loaded;
+}
+
+bool VEC_CALL probegrid_sample(
+    const probegrid_t* pg,
+    float4 position,
+    SH4v* shOut)
+{
+    ASSERT(pg);
+    ASSERT(shOut);
+    memset(shOut, 0, sizeof(*shOut));
+    if ((pg->probeCount <= 0) || (pg->sampleCount <= 0))
+    {
+        return false;
+    }
+
+    const grid_t* grid = &pg->grid;
+    const int3 size = grid->size;
+    pgprobe_t const *const pim_noalias probes = pg->probes;
+
+    // cell centers sit half a cell in from the grid's corner
+    float4 offset = f4_mulvs(f4_sub(position, grid->bounds.lo), grid->cellsPerMeter);
+    offset = f4_subvs(offset, 0.5f);
+    const float4 lo = f4_floor(offset);
+    const float4 frac = f4_sub(offset, lo);
+    const i32 x0 = (i32)lo.x;
+    const i32 y0 = (i32)lo.y;
+    const i32 z0 = (i32)lo.z;
+
+    // blend the neighbours inside the level, renormalized over those found
+    float4 r = f4_0;
+    float4 g = f4_0;
+    float4 b = f4_0;
+    float wsum = 0.0f;
+    for (i32 i = 0; i < 8; ++i)
+    {
+        const i32 dx = i & 1;
+        const i32 dy = (i >> 1) & 1;
+        const i32 dz = (i >> 2) & 1;
+        const i32 x = i1_clamp(x0 + dx, 0, size.x - 1);
+        const i32 y = i1_clamp(y0 + dy, 0, size.y - 1);
+        const i32 z = i1_clamp(z0 + dz, 0, size.z - 1);
+        const i32 iProbe = CellProbe(pg, x, y, z);
+        if (iProbe >= 0)
+        {
+            float w =
+                (dx ? frac.x : 1.0f - frac.x) *
+                (dy ? frac.y : 1.0f - frac.y) *
+                (dz ? frac.z : 1.0f - frac.z);
+            const pgprobe_t probe = probes[iProbe];
+            r = f4_add(r, f4_mulvs(half4_f4(probe.r), w));
+            g = f4_add(g, f4_mulvs(half4_f4(probe.g), w));
+            b = f4_add(b, f4_mulvs(half4_f4(probe.b), w));
+            wsum += w;
+        }
+    }
+    if (wsum <= kEpsilon)
+    {
+        return false;
+    }
+
+    const float scale = 1.0f / wsum;
+    r = f4_mulvs(r, scale);
+    g = f4_mulvs(g, scale);
+    b = f4_mulvs(b, scale);
+    shOut->v[0] = f3_v(r.x, g.x, b.x);
+    shOut->v[1] = f3_v(r.y, g.y, b.y);
+    shOut->v[2] = f3_v(r.z, g.z, b.z);
+    shOut->v[3] = f3_v(r.w, g.w, b.w);
+    return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "common/macro.h"
+#include "math/types.h"
+#include "math/grid.h"
+#include "rendering/vulkan/vkr.h"
+
+PIM_C_BEGIN
+
+/*
+    Irradiance probes on a regular grid over the level, baked by the path
+    tracer, for lighting geometry that has no lightmap such as moving models.
+    Only cells inside the level hold a probe; the rest map to -1.
+    The cell to probe map is sparse: the grid is split into 4x4x4 bricks and
+    only bricks holding a probe store their 64 cells, so it grows with the
+    probe count rather than with the level's bounds.
+    Each probe is an L1 spherical harmonic of incoming radiance, stored as
+    half floats; sampling blends the nearest 8 probes, so no rays are traced
+    at draw time.
+    The GPU copy is one volume per SH coefficient in the 3D texture table,
+    zero outside the level, with the first volume's alpha set inside it.
+    Filtering all four and dividing by that alpha gives the same blend as
+    probegrid_sample.
+*/
+
+#define kProbeGridVersion   1
+
+typedef struct pt_scene_s pt_scene_t;
+typedef struct crate_s crate_t;
+
+// L1 SH coefficients of one color channel each
+typedef struct pgprobe_s
+{
+    ushort4 r;
+    ushort4 g;
+    ushort4 b;
+} pgprobe_t;
+
+typedef struct probegrid_s
+{
+    grid_t grid;
+    i32 probeCount;
+    // samples taken by every probe so far
+    i32 sampleCount;
+    int3 brickSize;
+    i32 brickCount;
+    // first cell of each brick in brickProbes, or -1 when the brick has no probe
+    i32* pim_noalias brickCells;
+    // probe of each cell of the stored bricks, or -1 when outside the level
+    i32* pim_noalias brickProbes;
+    // grid cell of each probe
+    i32* pim_noalias probeCells;
+    pgprobe_t* pim_noalias probes;
+    // full precision running means the probes are encoded from
+    SH4v* pim_noalias accum;
+    // sampleCount when the volumes were last uploaded
+    i32 uploadCount;
+    vkrTextureId volumes[4];
+} probegrid_t;
+
+typedef struct dprobegrid_s
+{
+    i32 version;
+    i32 probeCount;
+    i32 sampleCount;
+    // running means are saved, otherwise baking resumes from the halves
+    i32 bakeState;
+    grid_t grid;
+} dprobegrid_t;
+
+probegrid_t* probegrid_get(void);
+
+// places probes in the cells of a grid over the scene's drawables that are
+// inside the level and not buried in a wall
+void probegrid_new(probegrid_t* pg, pt_scene_t* scene, float probesPerMeter);
+void probegrid_del(probegrid_t* pg);
+
+// traces spp more samples of every probe
+void probegrid_bake(probegrid_t* pg, pt_scene_t* scene, i32 spp);
+// writes the probes to the GPU volumes
+void probegrid_upload(probegrid_t* pg);
+
+bool probegrid_save(crate_t* crate, const probegrid_t* pg, bool bakeState);
+// false when the crate has no grid, or one from another version
+bool probegrid_load(crate_t* crate, probegrid_t* pg);
+
+// blends the probes around 'position' into shOut.
+// returns false when no probe is near.
+bool VEC_CALL probegrid_sample(
+    const probegrid_t* pg,
+    float4 position,
+    SH4v* shOut);
+
+PIM_C_END
@@ -0,0 +1,772 @@
+#include "rendering/render_farm.h"
+#include "rendering/path_tracer.h"
+#include "rendering/camera.h"
+#include "os/socket.h"
+#include "math/float3_funcs.h"
+#include "math/float4_funcs.h"
+#include "math/int2_funcs.h"
+#include "math/color.h"
+#include "allocator/allocator.h"
+#include "threading/task.h"
+#include "threading/sleep.h"
+#include "common/atomics.h"
+#include "common/console.h"
+#include "common/cmd.h"
+#include "common/cvar.h"
+#include "common/time.h"
+#include "common/stringutil.h"
+#include "common/profiler.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define kFarmMagic          0x4d524146u // 'FARM'
+#define kFarmMaxWorkers     64
+#define kFarmTileSize       64
+#define kFarmJoinAttempts   20
+#define kFarmJoinWaitMs     500
+// longest a worker's farm_serve waits for jobs before returning to its frame
+#define kFarmServeMs        50
+#define kFarmTestPort       27501
+#define kFarmTestTileSize   8
+#define kFarmTestTimeoutMs  100
+
+typedef enum
+{
+    FarmMsg_Job = 1,
+    FarmMsg_Result,
+} FarmMsg;
+
+typedef enum
+{
+    TileState_Queued = 0,
+    TileState_Sent,
+    TileState_Done,
+} TileState;
+
+// coordinator to worker. both ends run the same build, so structs
+// go over the wire as they are.
+typedef struct farmjob_s
+{
+    u32 magic;
+    u32 msg;
+    char scene[64];
+    i32 tileId;
+    camera_t camera;
+    dofinfo_t dofinfo;
+    int2 imageSize;
+    int2 lo;
+    int2 hi;
+    i32 sampleBegin;
+    i32 sampleEnd;
+} farmjob_t;
+
+// worker to coordinator, followed by the tile's color, albedo,
+// normal and lumM2 arrays
+typedef struct farmresult_s
+{
+    u32 magic;
+    u32 msg;
+    i32 tileId;
+    i32 texelCount;
+} farmresult_t;
+
+typedef struct farmconn_s
+{
+    socket_t sock;
+    u32 addr;
+    bool alive;
+} farmconn_t;
+
+static cvar_t cv_farm_timeout =
+{
+    .type = cvart_int,
+    .name = "farm_timeout",
+    .value = "60",
+    .minInt = 1,
+    .maxInt = 3600,
+    .desc = "seconds without a reply before a farm peer counts as lost, including a worker's first map load",
+};
+
+static cmdstat_t CmdFarmHost(i32 argc, const char** argv);
+static cmdstat_t CmdFarmJoin(i32 argc, const char** argv);
+static cmdstat_t CmdFarmStop(i32 argc, const char** argv);
+static cmdstat_t CmdFarmTest(i32 argc, const char** argv);
+
+static farmconn_t ms_workers[kFarmMaxWorkers];
+static i32 ms_workerCount;
+// open while the coordinator waits for workers to connect
+static socket_t ms_listener;
+static i32 ms_workersWanted;
+static socket_t ms_coordinator;
+// samples per pixel merged since the last restart
+static i32 ms_samples;
+
+// ----------------------------------------------------------------------------
+
+static bool SendAll(socket_t sock, const void* src, i32 len)
+{
+    const u8* bytes = src;
+    while (len > 0)
+    {
+        i32 sent = socket_send(sock, bytes, len);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        bytes += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static i32 TimeoutMs(void)
+{
+    return cvar_get_int(&cv_farm_timeout) * 1000;
+}
+
+// fails when all of len has not arrived within timeoutMs
+static bool RecvAll(socket_t sock, void* dst, i32 len, i32 timeoutMs)
+{
+    u8* bytes = dst;
+    const u64 start = time_now();
+    while (len > 0)
+    {
+        const i32 waitMs = timeoutMs - (i32)time_milli(time_now() - start);
+        if ((waitMs <= 0) || (socket_poll(sock, waitMs) <= 0))
+        {
+            return false;
+        }
+        i32 recvd = socket_recv(sock, bytes, len);
+        if (recvd <= 0)
+        {
+            return false;
+        }
+        bytes += recvd;
+        len -= recvd;
+    }
+    return true;
+}
+
+static i32 TileTexels(int2 lo, int2 hi)
+{
+    int2 extent = i2_sub(hi, lo);
+    return extent.x * extent.y;
+}
+
+static void Tile_Alloc(pt_tile_t* tile, i32 texelCount)
+{
+    tile->color = tmp_malloc(sizeof(tile->color[0]) * texelCount);
+    tile->albedo = tmp_malloc(sizeof(tile->albedo[0]) * texelCount);
+    tile->normal = tmp_malloc(sizeof(tile->normal[0]) * texelCount);
+    tile->lumM2 = tmp_malloc(sizeof(tile->lumM2[0]) * texelCount);
+}
+
+static bool Tile_Send(socket_t sock, const pt_tile_t* tile, i32 texelCount)
+{
+    return SendAll(sock, tile->color, sizeof(tile->color[0]) * texelCount) &&
+        SendAll(sock, tile->albedo, sizeof(tile->albedo[0]) * texelCount) &&
+        SendAll(sock, tile->normal, sizeof(tile->normal[0]) * texelCount) &&
+        SendAll(sock, tile->lumM2, sizeof(tile->lumM2[0]) * texelCount);
+}
+
+static bool Tile_Recv(socket_t sock, pt_tile_t* tile, i32 texelCount, i32 timeoutMs)
+{
+    return RecvAll(sock, tile->color, sizeof(tile->color[0]) * texelCount, timeoutMs) &&
+        RecvAll(sock, tile->albedo, sizeof(tile->albedo[0]) * texelCount, timeoutMs) &&
+        RecvAll(sock, tile->normal, sizeof(tile->normal[0]) * texelCount, timeoutMs) &&
+        RecvAll(sock, tile->lumM2, sizeof(tile->lumM2[0]) * texelCount, timeoutMs);
+}
+
+// combines the tile's samples with those already in trace,
+// merging luminance variance with Chan et al's pairwise update.
+static void Tile_Merge(pt_trace_t* trace, const pt_tile_t* tile, bool restart)
+{
+    float3* pim_noalias color = trace->color;
+    float3* pim_noalias albedo = trace->albedo;
+    float3* pim_noalias normal = trace->normal;
+    float* pim_noalias sampleCounts = trace->sampleCounts;
+    float* pim_noalias lumM2 = trace->lumM2;
+
+    const i32 width = trace->imageSize.x;
+    const int2 lo = tile->lo;
+    const int2 hi = tile->hi;
+    const float nB = (float)(tile->sampleEnd - tile->sampleBegin);
+    i32 k = 0;
+    for (i32 y = lo.y; y < hi.y; ++y)
+    {
+        for (i32 x = lo.x; x < hi.x; ++x, ++k)
+        {
+            const i32 i = x + y * width;
+            const float nA = restart ? 0.0f : sampleCounts[i];
+            const float n = nA + nB;
+            const float wB = nB / n;
+            const float lumA = restart ? 0.0f : f4_perlum(f3_f4(color[i], 0.0f));
+            const float lumB = f4_perlum(f3_f4(tile->color[k], 0.0f));
+            const float dLum = lumB - lumA;
+            const float m2A = restart ? 0.0f : lumM2[i];
+            color[i] = f3_lerp(color[i], tile->color[k], wB);
+            albedo[i] = f3_lerp(albedo[i], tile->albedo[k], wB);
+            normal[i] = f3_lerp(normal[i], tile->normal[k], wB);
+            lumM2[i] = m2A + tile->lumM2[k] + dLum * dLum * nA * wB;
+            sampleCounts[i] = n;
+        }
+    }
+}
+
+static void Conn_Drop(farmconn_t* conn)
+{
+    if (conn->alive)
+    {
+        con_logf(LogSev_Warning, "farm", "Lost worker %08x", conn->addr);
+    }
+    conn->alive = false;
+    socket_close(&conn->sock);
+}
+
+static void StopFarm(void)
+{
+    for (i32 i = 0; i < ms_workerCount; ++i)
+    {
+        ms_workers[i].alive = false;
+        socket_close(&ms_workers[i].sock);
+    }
+    ms_workerCount = 0;
+    if (socket_isopen(ms_listener))
+    {
+        con_logf(LogSev_Info, "farm", "Stopped waiting for workers");
+    }
+    socket_close(&ms_listener);
+    ms_workersWanted = 0;
+    socket_close(&ms_coordinator);
+}
+
+// ----------------------------------------------------------------------------
+
+void farm_sys_init(void)
+{
+    cvar_reg(&cv_farm_timeout);
+    cmd_reg("farm_host", CmdFarmHost);
+    cmd_reg("farm_join", CmdFarmJoin);
+    cmd_reg("farm_stop", CmdFarmStop);
+    cmd_reg("farm_test", CmdFarmTest);
+}
+
+ProfileMark(pm_farmupdate, farm_update)
+void farm_update(void)
+{
+    if (!socket_isopen(ms_listener))
+    {
+        return;
+    }
+    ProfileBegin(pm_farmupdate);
+
+    // only accept connections already waiting, so the frame never blocks
+    while ((ms_workerCount < ms_workersWanted) && (socket_poll(ms_listener, 0) > 0))
+    {
+        farmconn_t* conn = &ms_workers[ms_workerCount];
+        conn->sock = socket_accept(ms_listener, &conn->addr);
+        if (!socket_isopen(conn->sock))
+        {
+            break;
+        }
+        // bounds sends; receives wait on their own deadline
+        socket_settimeout(conn->sock, TimeoutMs());
+        conn->alive = true;
+        ++ms_workerCount;
+        con_logf(LogSev_Info, "farm", "Worker %08x joined, %d of %d",
+            conn->addr, ms_workerCount, ms_workersWanted);
+    }
+    if (ms_workerCount >= ms_workersWanted)
+    {
+        socket_close(&ms_listener);
+        con_logf(LogSev_Info, "farm", "Hosting %d workers", ms_workerCount);
+    }
+
+    ProfileEnd(pm_farmupdate);
+}
+
+void farm_sys_shutdown(void)
+{
+    StopFarm();
+}
+
+bool farm_hosting(void)
+{
+    if (socket_isopen(ms_listener))
+    {
+        return false;
+    }
+    for (i32 i = 0; i < ms_workerCount; ++i)
+    {
+        if (ms_workers[i].alive)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool farm_joined(void)
+{
+    return socket_isopen(ms_coordinator);
+}
+
+// ----------------------------------------------------------------------------
+
+typedef struct task_FarmTrace
+{
+    task_t task;
+    pt_trace_t* trace;
+    farmjob_t job;
+    bool restart;
+    i32 tilesX;
+    i32 tileCount;
+    // next tile not yet handed out
+    i32 next;
+    // TileState per tile
+    i32* states;
+    // workers a tile was sent to, stolen tiles have 2
+    i32* copies;
+} task_FarmTrace;
+
+// a queued tile, or one still in flight on another worker,
+// or -1 when every tile is done or already duplicated
+static i32 NextTile(task_FarmTrace* task)
+{
+    i32 iTile = fetch_add_i32(&task->next, 1, MO_AcqRel);
+    if (iTile < task->tileCount)
+    {
+        store_i32(&task->copies[iTile], 1, MO_Release);
+        store_i32(&task->states[iTile], TileState_Sent, MO_Release);
+        return iTile;
+    }
+    for (i32 i = 0; i < task->tileCount; ++i)
+    {
+        if (load_i32(&task->states[i], MO_Acquire) == TileState_Sent)
+        {
+            i32 expected = 1;
+            if (cmpex_i32(&task->copies[i], &expected, 2, MO_AcqRel))
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static void Task_TileRect(const task_FarmTrace* task, i32 iTile, int2* loOut, int2* hiOut)
+{
+    const int2 size = task->job.imageSize;
+    int2 lo = { (iTile % task->tilesX) * kFarmTileSize, (iTile / task->tilesX) * kFarmTileSize };
+    int2 hi = { i1_min(lo.x + kFarmTileSize, size.x), i1_min(lo.y + kFarmTileSize, size.y) };
+    *loOut = lo;
+    *hiOut = hi;
+}
+
+static void FarmTraceFn(void* pbase, i32 begin, i32 end)
+{
+    task_FarmTrace* task = (task_FarmTrace*)pbase;
+    const i32 timeoutMs = TimeoutMs();
+
+    pt_tile_t tile = { 0 };
+    Tile_Alloc(&tile, kFarmTileSize * kFarmTileSize);
+
+    for (i32 w = begin; w < end; ++w)
+    {
+        farmconn_t* conn = &ms_workers[w];
+        while (conn->alive)
+        {
+            const i32 iTile = NextTile(task);
+            if (iTile < 0)
+            {
+                break;
+            }
+
+            farmjob_t job = task->job;
+            job.tileId = iTile;
+            Task_TileRect(task, iTile, &job.lo, &job.hi);
+            const i32 texelCount = TileTexels(job.lo, job.hi);
+
+            farmresult_t result = { 0 };
+            bool ok = SendAll(conn->sock, &job, sizeof(job)) &&
+                RecvAll(conn->sock, &result, sizeof(result), timeoutMs);
+            ok = ok &&
+                (result.magic == kFarmMagic) &&
+                (result.msg == FarmMsg_Result) &&
+                (result.tileId == iTile) &&
+                (result.texelCount == texelCount);
+            ok = ok && Tile_Recv(conn->sock, &tile, texelCount, timeoutMs);
+            if (!ok)
+            {
+                // includes a worker silent for longer than farm_timeout
+                Conn_Drop(conn);
+                break;
+            }
+
+            i32 expected = TileState_Sent;
+            if (cmpex_i32(&task->states[iTile], &expected, TileState_Done, MO_AcqRel))
+            {
+                tile.lo = job.lo;
+                tile.hi = job.hi;
+                tile.sampleBegin = job.sampleBegin;
+                tile.sampleEnd = job.sampleEnd;
+                Tile_Merge(task->trace, &tile, task->restart);
+            }
+        }
+    }
+}
+
+ProfileMark(pm_farmtrace, farm_trace)
+void farm_trace(
+    pt_trace_t* trace,
+    pt_scene_t* scene,
+    const camera_t* camera,
+    const char* sceneName,
+    i32 spp)
+{
+    ProfileBegin(pm_farmtrace);
+
+    ASSERT(trace);
+    ASSERT(camera);
+    ASSERT(sceneName);
+    ASSERT(spp > 0);
+
+    // workers freeze theirs too, so every process selects lights alike
+    pt_scene_freeze_lights(scene);
+
+    const bool restart = trace->sampleWeight >= 1.0f;
+    if (restart)
+    {
+        ms_samples = 0;
+    }
+
+    const int2 size = trace->imageSize;
+    task_FarmTrace* task = tmp_calloc(sizeof(*task));
+    task->trace = trace;
+    task->restart = restart;
+    task->tilesX = (size.x + kFarmTileSize - 1) / kFarmTileSize;
+    const i32 tilesY = (size.y + kFarmTileSize - 1) / kFarmTileSize;
+    task->tileCount = task->tilesX * tilesY;
+    task->states = tmp_calloc(sizeof(task->states[0]) * task->tileCount);
+    task->copies = tmp_calloc(sizeof(task->copies[0]) * task->tileCount);
+
+    farmjob_t* job = &task->job;
+    job->magic = kFarmMagic;
+    job->msg = FarmMsg_Job;
+    StrCpy(ARGS(job->scene), sceneName);
+    job->camera = *camera;
+    job->dofinfo = trace->dofinfo;
+    job->imageSize = size;
+    job->sampleBegin = ms_samples;
+    job->sampleEnd = ms_samples + spp;
+
+    // one work item per worker connection. they mostly wait on sockets,
+    // so this thread takes tiles from the same queue meanwhile.
+    ASSERT(ms_workerCount > 0);
+    task_submit(&task->task, FarmTraceFn, ms_workerCount);
+    task_sys_schedule();
+
+    pt_tile_t tile = { 0 };
+    tile.camera = job->camera;
+    tile.dofinfo = job->dofinfo;
+    tile.imageSize = size;
+    tile.sampleBegin = job->sampleBegin;
+    tile.sampleEnd = job->sampleEnd;
+    Tile_Alloc(&tile, kFarmTileSize * kFarmTileSize);
+    for (i32 iTile = NextTile(task); iTile >= 0; iTile = NextTile(task))
+    {
+        Task_TileRect(task, iTile, &tile.lo, &tile.hi);
+        pt_trace_tile(scene, &tile);
+        i32 expected = TileState_Sent;
+        if (cmpex_i32(&task->states[iTile], &expected, TileState_Done, MO_AcqRel))
+        {
+            Tile_Merge(trace, &tile, restart);
+        }
+    }
+
+    task_await(&task->task);
+
+    // tiles lost with a worker
+    for (i32 i = 0; i < task->tileCount; ++i)
+    {
+        if (task->states[i] != TileState_Done)
+        {
+            Task_TileRect(task, i, &tile.lo, &tile.hi);
+            pt_trace_tile(scene, &tile);
+            Tile_Merge(trace, &tile, restart);
+        }
+    }
+
+    ms_samples += spp;
+    trace->stride = 1;
+
+    ProfileEnd(pm_farmtrace);
+}
+
+// ----------------------------------------------------------------------------
+
+// receives, traces and returns one job.
+// returns false after losing the coordinator.
+static bool ServeJob(farm_scene_fn getScene)
+{
+    farmjob_t job = { 0 };
+    if (!RecvAll(ms_coordinator, &job, sizeof(job), TimeoutMs()) ||
+        (job.magic != kFarmMagic) ||
+        (job.msg != FarmMsg_Job))
+    {
+        con_logf(LogSev_Warning, "farm", "Lost coordinator");
+        socket_close(&ms_coordinator);
+        return false;
+    }
+
+    job.scene[NELEM(job.scene) - 1] = 0;
+    pt_scene_t* scene = getScene(job.scene);
+    if (!scene)
+    {
+        con_logf(LogSev_Error, "farm", "Failed to load scene '%s'", job.scene);
+        socket_close(&ms_coordinator);
+        return false;
+    }
+    pt_scene_freeze_lights(scene);
+
+    pt_tile_t tile = { 0 };
+    tile.camera = job.camera;
+    tile.dofinfo = job.dofinfo;
+    tile.imageSize = job.imageSize;
+    tile.lo = job.lo;
+    tile.hi = job.hi;
+    tile.sampleBegin = job.sampleBegin;
+    tile.sampleEnd = job.sampleEnd;
+    const i32 texelCount = TileTexels(job.lo, job.hi);
+    Tile_Alloc(&tile, texelCount);
+    pt_trace_tile(scene, &tile);
+
+    farmresult_t result = { 0 };
+    result.magic = kFarmMagic;
+    result.msg = FarmMsg_Result;
+    result.tileId = job.tileId;
+    result.texelCount = texelCount;
+    bool sent = SendAll(ms_coordinator, &result, sizeof(result)) &&
+        Tile_Send(ms_coordinator, &tile, texelCount);
+    if (!sent)
+    {
+        con_logf(LogSev_Warning, "farm", "Lost coordinator");
+        socket_close(&ms_coordinator);
+    }
+    return sent;
+}
+
+ProfileMark(pm_farmserve, farm_serve)
+bool farm_serve(farm_scene_fn getScene)
+{
+    ASSERT(getScene);
+    if (!farm_joined())
+    {
+        return false;
+    }
+
+    ProfileBegin(pm_farmserve);
+
+    // jobs arrive one at a time, each after the previous result,
+    // so wait briefly for the next rather than ending the frame
+    bool alive = true;
+    const u64 start = time_now();
+    while (alive)
+    {
+        const i32 waitMs = kFarmServeMs - (i32)time_milli(time_now() - start);
+        if (waitMs <= 0)
+        {
+            break;
+        }
+        const i32 ready = socket_poll(ms_coordinator, waitMs);
+        if (ready == 0)
+        {
+            break;
+        }
+        alive = (ready > 0) && ServeJob(getScene);
+    }
+    if (!alive && farm_joined())
+    {
+        con_logf(LogSev_Warning, "farm", "Lost coordinator");
+        socket_close(&ms_coordinator);
+    }
+
+    ProfileEnd(pm_farmserve);
+    return alive;
+}
+
+// ----------------------------------------------------------------------------
+
+static cmdstat_t CmdFarmHost(i32 argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        con_logf(LogSev_Error, "farm", "usage: farm_host <port> <worker count>");
+        return cmdstat_err;
+    }
+    const u16 port = (u16)atoi(argv[1]);
+    const i32 count = i1_clamp(atoi(argv[2]), 1, kFarmMaxWorkers);
+
+    StopFarm();
+
+    if (!socket_open(&ms_listener, SocketProto_TCP) ||
+        !socket_bind(ms_listener, 0, port) ||
+        !socket_listen(ms_listener))
+    {
+        con_logf(LogSev_Error, "farm", "Failed to listen on port %d", port);
+        socket_close(&ms_listener);
+        return cmdstat_err;
+    }
+
+    // farm_update accepts them as they arrive; frames trace locally until then
+    ms_workersWanted = count;
+    con_logf(LogSev_Info, "farm", "Waiting for %d workers on port %d, farm_stop cancels", count, port);
+    return cmdstat_ok;
+}
+
+static cmdstat_t CmdFarmJoin(i32 argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        con_logf(LogSev_Error, "farm", "usage: farm_join <address> <port>");
+        return cmdstat_err;
+    }
+    u32 addr = 0;
+    if (!network_url2addr(argv[1], &addr))
+    {
+        con_logf(LogSev_Error, "farm", "Unknown address '%s'", argv[1]);
+        return cmdstat_err;
+    }
+    const u16 port = (u16)atoi(argv[2]);
+
+    StopFarm();
+
+    // workers are usually launched alongside the coordinator,
+    // so give it time to start listening
+    for (i32 i = 0; i < kFarmJoinAttempts; ++i)
+    {
+        if (!socket_open(&ms_coordinator, SocketProto_TCP))
+        {
+            break;
+        }
+        if (socket_connect(ms_coordinator, addr, port))
+        {
+            // bounds sends; receives wait on their own deadline
+            socket_settimeout(ms_coordinator, TimeoutMs());
+            con_logf(LogSev_Info, "farm", "Joined %s:%d", argv[1], port);
+            return cmdstat_ok;
+        }
+        socket_close(&ms_coordinator);
+        intrin_sleep(kFarmJoinWaitMs);
+    }
+
+    con_logf(LogSev_Error, "farm", "Failed to join %s:%d", argv[1], port);
+    return cmdstat_err;
+}
+
+static cmdstat_t CmdFarmStop(i32 argc, const char** argv)
+{
+    StopFarm();
+    return cmdstat_ok;
+}
+
+static i32 FarmTestCheck(bool passed, const char* what)
+{
+    con_logf(passed ? LogSev_Info : LogSev_Error, "farm", "%s: %s", passed ? "pass" : "FAIL", what);
+    return passed ? 0 : 1;
+}
+
+static bool FarmTestTileEq(const pt_tile_t* lhs, const pt_tile_t* rhs, i32 texelCount)
+{
+    return !memcmp(lhs->color, rhs->color, sizeof(lhs->color[0]) * texelCount) &&
+        !memcmp(lhs->albedo, rhs->albedo, sizeof(lhs->albedo[0]) * texelCount) &&
+        !memcmp(lhs->normal, rhs->normal, sizeof(lhs->normal[0]) * texelCount) &&
+        !memcmp(lhs->lumM2, rhs->lumM2, sizeof(lhs->lumM2[0]) * texelCount);
+}
+
+// farm_test [port]
+// smoke tests the farm's transport over loopback within this process:
+// accepting without blocking, job and tile round trips, and a silent or
+// closed peer failing a receive, which is how workers get dropped.
+static cmdstat_t CmdFarmTest(i32 argc, const char** argv)
+{
+    const u16 port = (u16)((argc > 1) ? atoi(argv[1]) : kFarmTestPort);
+    u32 loopback = 0;
+    network_url2addr("127.0.0.1", &loopback);
+
+    i32 failures = 0;
+    socket_t listener = { 0 };
+    socket_t client = { 0 };
+    socket_t server = { 0 };
+    bool ok = socket_open(&listener, SocketProto_TCP) &&
+        socket_bind(listener, loopback, port) &&
+        socket_listen(listener);
+    failures += FarmTestCheck(ok, "listen on loopback");
+    if (ok)
+    {
+        failures += FarmTestCheck(socket_poll(listener, 0) == 0, "no pending connection, accept would block");
+        ok = socket_open(&client, SocketProto_TCP) && socket_connect(client, loopback, port);
+        failures += FarmTestCheck(ok, "connect");
+    }
+    if (ok)
+    {
+        ok = socket_poll(listener, kFarmTestTimeoutMs * 10) > 0;
+        failures += FarmTestCheck(ok, "pending connection polls ready");
+    }
+    if (ok)
+    {
+        u32 addr = 0;
+        server = socket_accept(listener, &addr);
+        ok = socket_isopen(server);
+        failures += FarmTestCheck(ok, "accept");
+    }
+    if (ok)
+    {
+        u8 byte = 0;
+        const u64 start = time_now();
+        const bool recvd = RecvAll(server, &byte, 1, kFarmTestTimeoutMs);
+        const double ms = time_milli(time_now() - start);
+        failures += FarmTestCheck(!recvd && (ms < kFarmTestTimeoutMs * 10), "silent peer times out");
+
+        farmjob_t job = { 0 };
+        job.magic = kFarmMagic;
+        job.msg = FarmMsg_Job;
+        StrCpy(ARGS(job.scene), "farm_test");
+        job.tileId = 7;
+        job.imageSize = i2_v(320, 240);
+        job.hi = i2_v(kFarmTestTileSize, kFarmTestTileSize);
+        job.sampleBegin = 3;
+        job.sampleEnd = 5;
+        farmjob_t echo = { 0 };
+        ok = SendAll(server, &job, sizeof(job)) &&
+            RecvAll(client, &echo, sizeof(echo), kFarmTestTimeoutMs * 10) &&
+            !memcmp(&job, &echo, sizeof(job));
+        failures += FarmTestCheck(ok, "job round trip");
+
+        const i32 texelCount = kFarmTestTileSize * kFarmTestTileSize;
+        pt_tile_t sent = { 0 };
+        pt_tile_t back = { 0 };
+        Tile_Alloc(&sent, texelCount);
+        Tile_Alloc(&back, texelCount);
+        for (i32 i = 0; i < texelCount; ++i)
+        {
+            sent.color[i] = f3_s((float)i);
+            sent.albedo[i] = f3_s(i * 0.5f);
+            sent.normal[i] = f3_s(-(float)i);
+            sent.lumM2[i] = i * 0.25f;
+        }
+        ok = Tile_Send(client, &sent, texelCount) &&
+            Tile_Recv(server, &back, texelCount, kFarmTestTimeoutMs * 10) &&
+            FarmTestTileEq(&sent, &back, texelCount);
+        failures += FarmTestCheck(ok, "tile round trip");
+
+        socket_close(&client);
+        failures += FarmTestCheck(!RecvAll(server, &byte, 1, kFarmTestTimeoutMs * 10), "closed peer fails recv");
+    }
+    socket_close(&server);
+    socket_close(&client);
+    socket_close(&listener);
+
+    con_logf(failures ? LogSev_Error : LogSev_Info, "farm", "farm_test: %d failures", failures);
+    return failures ? cmdstat_err : cmdstat_ok;
+}
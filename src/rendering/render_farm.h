@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common/macro.h"
+
+PIM_C_BEGIN
+
+/*
+    Splits path traced frames across processes over TCP.
+    A coordinator ('farm_host <port> <worker count>') accepts that many
+    worker processes ('farm_join <address> <port>') from farm_update, tracing
+    locally until they have joined; 'farm_stop' cancels. It then hands them
+    image tiles one at a time, and traces tiles from the same queue itself
+    while they work. Fast workers come back for more tiles sooner, and once
+    no tiles are left idle workers duplicate tiles still in flight on slower
+    ones; whichever copy returns first is merged.
+    A worker silent for farm_timeout seconds is dropped, and its tiles are
+    traced locally.
+    Samples are seeded per pixel and sample index (see pt_trace_tile), and
+    every process freezes its light grid (see pt_scene_freeze_lights), so the
+    image does not depend on which worker traced which tile. Processes must
+    share the pt_ cvars that shape the scene.
+    'farm_test [port]' smoke tests the transport over loopback.
+    Only path traced frames are farmed; lightmap bakes always run locally.
+*/
+
+typedef struct pt_trace_s pt_trace_t;
+typedef struct pt_scene_s pt_scene_t;
+typedef struct camera_s camera_t;
+
+// returns the scene for a map name, loading the map if needed
+typedef pt_scene_t* (*farm_scene_fn)(const char* name);
+
+void farm_sys_init(void);
+// coordinator: accepts workers that are waiting to join, without blocking
+void farm_update(void);
+void farm_sys_shutdown(void);
+
+// coordinator with at least one live worker
+bool farm_hosting(void);
+// worker connected to a coordinator
+bool farm_joined(void);
+
+// coordinator: traces spp more samples of each pixel on the workers and
+// this process, and merges them into trace. 'scene' names the map workers
+// should trace. tiles no worker returned are traced locally.
+void farm_trace(
+    pt_trace_t* trace,
+    pt_scene_t* scene,
+    const camera_t* camera,
+    const char* sceneName,
+    i32 spp);
+
+// worker: traces and sends back tiles as they arrive, waiting at most a few
+// milliseconds for each so the frame goes on while the coordinator is idle.
+// returns false once the coordinator is gone.
+bool farm_serve(farm_scene_fn getScene);
+
+PIM_C_END
@@ -41,11 +41,14 @@
 #include "rendering/resolve_tile.h"
 #include "rendering/screenblit.h"
 #include "rendering/path_tracer.h"
+#include "rendering/render_farm.h"
 #include "rendering/cubemap.h"
+#include "rendering/probegrid.h"
 #include "rendering/drawable.h"
 #include "rendering/model.h"
 #include "rendering/lightmap.h"
 #include "rendering/denoise.h"
+#include "rendering/checkpoint.h"
 #include "rendering/rtcdraw.h"
 #include "rendering/exposure.h"
 #include "rendering/mesh.h"
@@ -76,6 +79,46 @@ static cvar_t cv_pt_denoise =
     .desc = "denoise path tracing output",
 };
 
+static cvar_t cv_pt_denoise_atrous =
+{
+    .type = cvart_bool,
+    .name = "pt_denoise_atrous",
+    .value = "0",
+    .desc = "denoise with the built in a-trous filter instead of OpenImageDenoise",
+};
+
+// off by default because reused history lags view dependent shading by up
+// to pt_history_max samples. safe to enable for interactive viewing; leave
+// it off when rendering reference images.
+static cvar_t cv_pt_reproject =
+{
+    .type = cvart_bool,
+    .name = "pt_reproject",
+    .value = "0",
+    .desc = "reproject path tracing samples when the camera moves, instead of restarting",
+};
+
+// off by default so a moving camera shows full resolution, as before.
+// safe to enable, including with pt_reproject: pixels traced late record
+// their primary hit on their first sample.
+static cvar_t cv_pt_progressive =
+{
+    .type = cvart_bool,
+    .name = "pt_progressive",
+    .value = "0",
+    .desc = "path trace at reduced resolution while the camera moves",
+};
+
+static cvar_t cv_pt_progressive_ms =
+{
+    .type = cvart_float,
+    .name = "pt_progressive_ms",
+    .value = "16",
+    .minFloat = 1.0f,
+    .maxFloat = 1000.0f,
+    .desc = "milliseconds per frame a moving camera may spend refining the path tracer resolution",
+};
+
 static cvar_t cv_pt_normal =
 {
     .type = cvart_bool,
@@ -100,6 +143,44 @@ static cvar_t cv_cm_gen =
     .desc = "enable cubemap generation",
 };
 
+static cvar_t cv_pg_gen =
+{
+    .type = cvart_bool,
+    .name = "pg_gen",
+    .value = "0",
+    .desc = "enable irradiance probe grid generation, lights drawables without lightmaps",
+};
+
+static cvar_t cv_pg_density =
+{
+    .type = cvart_float,
+    .name = "pg_density",
+    .value = "0.5",
+    .minFloat = 0.05f,
+    .maxFloat = 4.0f,
+    .desc = "irradiance probes per meter",
+};
+
+static cvar_t cv_pg_spp =
+{
+    .type = cvart_int,
+    .name = "pg_spp",
+    .value = "4",
+    .minInt = 1,
+    .maxInt = 256,
+    .desc = "samples each irradiance probe takes per frame",
+};
+
+static cvar_t cv_pg_maxspp =
+{
+    .type = cvart_int,
+    .name = "pg_maxspp",
+    .value = "1024",
+    .minInt = 1,
+    .maxInt = 1 << 16,
+    .desc = "samples after which irradiance probes stop baking",
+};
+
 static cvar_t cv_lm_gen =
 {
     .type = cvart_bool,
@@ -125,7 +206,85 @@ static cvar_t cv_lm_timeslice =
     .value = "1",
     .minInt = 1,
     .maxInt = 1024,
-    .desc = "number of frames required to add 1 lighting sample to all lightmap texels",
+    .desc = "number of frames required to add 1 lighting sample to all unconverged lightmap texels",
+};
+
+static cvar_t cv_lm_error =
+{
+    .type = cvart_float,
+    .name = "lm_error",
+    .value = "0.02",
+    .minFloat = 0.001f,
+    .maxFloat = 1.0f,
+    .desc = "relative standard error of a lightmap texel's luminance at which it stops baking",
+};
+
+static cvar_t cv_lm_minspp =
+{
+    .type = cvart_int,
+    .name = "lm_minspp",
+    .value = "16",
+    .minInt = 2,
+    .maxInt = 1 << 16,
+    .desc = "samples every lightmap texel takes before its error is trusted",
+};
+
+static cvar_t cv_lm_maxspp =
+{
+    .type = cvart_int,
+    .name = "lm_maxspp",
+    .value = "8192",
+    .minInt = 2,
+    .maxInt = 1 << 20,
+    .desc = "samples at which a lightmap texel stops baking regardless of error",
+};
+
+// off by default because light carried further than lm_reach from an edit
+// stays stale until the next full bake. safe to enable while editing.
+static cvar_t cv_lm_incremental =
+{
+    .type = cvart_bool,
+    .name = "lm_incremental",
+    .value = "0",
+    .desc = "rebake only the lightmap texels affected by drawable edits instead of ignoring them",
+};
+
+static cvar_t cv_lm_reach =
+{
+    .type = cvart_float,
+    .name = "lm_reach",
+    .value = "4",
+    .minFloat = 0.0f,
+    .maxFloat = 1000.0f,
+    .desc = "meters from an edited non emissive drawable within which visible lightmap texels are rebaked",
+};
+
+static cvar_t cv_lm_upload_min =
+{
+    .type = cvart_float,
+    .name = "lm_upload_min",
+    .value = "0.25",
+    .minFloat = 0.0f,
+    .maxFloat = 60.0f,
+    .desc = "seconds between uploads of baked lightmap tiles when a bake starts",
+};
+
+static cvar_t cv_lm_upload_max =
+{
+    .type = cvart_float,
+    .name = "lm_upload_max",
+    .value = "4",
+    .minFloat = 0.0f,
+    .maxFloat = 60.0f,
+    .desc = "seconds between uploads of baked lightmap tiles as the bake converges",
+};
+
+static cvar_t cv_lm_savebake =
+{
+    .type = cvart_bool,
+    .name = "lm_savebake",
+    .value = "1",
+    .desc = "save lightmap positions, normals and sample statistics, and the irradiance probes' running means, with the map so baking can resume, otherwise only the probes",
 };
 
 static cvar_t cv_lm_spp =
@@ -138,6 +297,16 @@ static cvar_t cv_lm_spp =
     .desc = "lightmap samples per pixel",
 };
 
+static cvar_t cv_ckpt_interval =
+{
+    .type = cvart_float,
+    .name = "ckpt_interval",
+    .value = "300",
+    .minFloat = 0.0f,
+    .maxFloat = 86400.0f,
+    .desc = "seconds between checkpoints of path tracing and lightmap baking, 0 to disable",
+};
+
 static cvar_t cv_r_sun_dir =
 {
     .type = cvart_vector,
@@ -192,6 +361,10 @@ static void RegCVars(void)
 {
     cvar_reg(&cv_pt_trace);
     cvar_reg(&cv_pt_denoise);
+    cvar_reg(&cv_pt_denoise_atrous);
+    cvar_reg(&cv_pt_reproject);
+    cvar_reg(&cv_pt_progressive);
+    cvar_reg(&cv_pt_progressive_ms);
     cvar_reg(&cv_pt_normal);
     cvar_reg(&cv_pt_albedo);
 
@@ -199,9 +372,23 @@ static void RegCVars(void)
     cvar_reg(&cv_lm_density);
     cvar_reg(&cv_lm_timeslice);
     cvar_reg(&cv_lm_spp);
+    cvar_reg(&cv_lm_error);
+    cvar_reg(&cv_lm_minspp);
+    cvar_reg(&cv_lm_maxspp);
+    cvar_reg(&cv_lm_incremental);
+    cvar_reg(&cv_lm_reach);
+    cvar_reg(&cv_lm_upload_min);
+    cvar_reg(&cv_lm_upload_max);
+    cvar_reg(&cv_lm_savebake);
+    cvar_reg(&cv_ckpt_interval);
 
     cvar_reg(&cv_cm_gen);
 
+    cvar_reg(&cv_pg_gen);
+    cvar_reg(&cv_pg_density);
+    cvar_reg(&cv_pg_spp);
+    cvar_reg(&cv_pg_maxspp);
+
     cvar_reg(&cv_r_sun_dir);
     cvar_reg(&cv_r_sun_col);
     cvar_reg(&cv_r_sun_lum);
@@ -249,6 +436,8 @@ static vkrExposure ms_exposure =
 
 static camera_t ms_ptcam;
 static pt_scene_t* ms_ptscene;
+// name passed to the last successful mapload
+static char ms_mapname[PIM_PATH];
 static pt_trace_t ms_trace;
 
 static i32 ms_lmSampleCount;
@@ -336,10 +525,169 @@ static void EnsurePtTrace(void)
     }
 }
 
+// ----------------------------------------------------------------------------
+// Path tracer denoising runs as a background task on a snapshot of the
+// trace's color, albedo and normal, so tracing carries on while it filters.
+// A snapshot is taken once the camera comes to rest and again each time the
+// sample count doubles; the latest finished result stays on screen meanwhile.
+// The snapshot and both outputs keep their addresses between jobs, so the
+// OIDN filters cached per buffer set stay valid.
+
+typedef struct task_PtDenoise
+{
+    task_t task;
+    DenoiseType type;
+    int2 size;
+    bool success;
+    i32 generation;
+    // output[target] is written, output[target ^ 1] may be on screen
+    i32 target;
+    float3* color;
+    float3* albedo;
+    float3* normal;
+    float3* output[2];
+} task_PtDenoise;
+
+static task_PtDenoise ms_ptDenoise;
+static bool ms_ptDenoiseBusy;
+// bumped when history restarts, to drop results of stale snapshots
+static i32 ms_ptDenoiseGen;
+// sample count of the last snapshot
+static i32 ms_ptDenoiseSpp;
+// output on screen, -1 when there is none for the current history
+static i32 ms_ptDenoiseFront = -1;
+
+static void PtDenoiseFn(void* pbase, i32 begin, i32 end)
+{
+    task_PtDenoise *const task = (task_PtDenoise*)pbase;
+    task->success = Denoise(
+        task->type,
+        task->size,
+        task->color,
+        task->albedo,
+        task->normal,
+        task->output[task->target]);
+}
+
+static void PtDenoise_Retire(void)
+{
+    task_PtDenoise *const job = &ms_ptDenoise;
+    ms_ptDenoiseBusy = false;
+    if (!job->success)
+    {
+        cvar_set_bool(&cv_pt_denoise, false);
+    }
+    else if (job->generation == ms_ptDenoiseGen)
+    {
+        ms_ptDenoiseFront = job->target;
+    }
+}
+
+static void PtDenoise_Shutdown(void)
+{
+    task_PtDenoise *const job = &ms_ptDenoise;
+    if (ms_ptDenoiseBusy)
+    {
+        task_await(job);
+        ms_ptDenoiseBusy = false;
+    }
+    pim_free(job->color);
+    pim_free(job->albedo);
+    pim_free(job->normal);
+    pim_free(job->output[0]);
+    pim_free(job->output[1]);
+    memset(job, 0, sizeof(*job));
+    ms_ptDenoiseFront = -1;
+    ms_ptDenoiseSpp = 0;
+    ++ms_ptDenoiseGen;
+}
+
+static void PtDenoise_Ensure(int2 size)
+{
+    task_PtDenoise *const job = &ms_ptDenoise;
+    if (job->color && job->size.x == size.x && job->size.y == size.y)
+    {
+        return;
+    }
+    PtDenoise_Shutdown();
+    const i32 bytes = sizeof(float3) * size.x * size.y;
+    job->size = size;
+    job->color = tex_calloc(bytes);
+    job->albedo = tex_calloc(bytes);
+    job->normal = tex_calloc(bytes);
+    job->output[0] = tex_calloc(bytes);
+    job->output[1] = tex_calloc(bytes);
+}
+
+// returns the most recent denoised image of the current history, or NULL
+ProfileMark(pm_ptDenoise, Denoise)
+static const float3* PtDenoise(bool restarted, bool enabled)
+{
+    ProfileBegin(pm_ptDenoise);
+
+    task_PtDenoise *const job = &ms_ptDenoise;
+    const int2 size = ms_trace.imageSize;
+    if (job->color && ((job->size.x != size.x) || (job->size.y != size.y)))
+    {
+        PtDenoise_Shutdown();
+    }
+
+    restarted |= cvar_check_dirty(&cv_pt_denoise_atrous);
+    restarted |= ms_ptSampleCount <= ms_ptDenoiseSpp;
+    if (restarted)
+    {
+        ++ms_ptDenoiseGen;
+        ms_ptDenoiseFront = -1;
+        ms_ptDenoiseSpp = 0;
+    }
+    if (ms_ptDenoiseBusy && (task_stat(job) == TaskStatus_Complete))
+    {
+        PtDenoise_Retire();
+    }
+
+    if (enabled && !restarted && !ms_ptDenoiseBusy &&
+        (ms_ptSampleCount >= 2 * ms_ptDenoiseSpp))
+    {
+        PtDenoise_Ensure(size);
+        const i32 texCount = size.x * size.y;
+        taskcpy(job->color, ms_trace.color, sizeof(float3), texCount);
+        taskcpy(job->albedo, ms_trace.albedo, sizeof(float3), texCount);
+        taskcpy(job->normal, ms_trace.normal, sizeof(float3), texCount);
+        job->type = cvar_get_bool(&cv_pt_denoise_atrous) ?
+            DenoiseType_ATrous : DenoiseType_Image;
+        job->generation = ms_ptDenoiseGen;
+        job->target = ms_ptDenoiseFront == 0 ? 1 : 0;
+        memset(&job->task, 0, sizeof(job->task));
+        ms_ptDenoiseSpp = ms_ptSampleCount;
+        ms_ptDenoiseBusy = true;
+        task_submit(&job->task, PtDenoiseFn, 1);
+        task_sys_schedule();
+
+        // the camera just came to rest: wait this once rather than show
+        // noise until the first result lands
+        if (ms_ptDenoiseFront < 0)
+        {
+            task_await(job);
+            PtDenoise_Retire();
+        }
+    }
+
+    const float3* result = NULL;
+    if (enabled && (ms_ptDenoiseFront >= 0))
+    {
+        result = job->output[ms_ptDenoiseFront];
+    }
+
+    ProfileEnd(pm_ptDenoise);
+    return result;
+}
+
 static void ShutdownPtScene(void)
 {
+    PtDenoise_Shutdown();
     if (ms_ptscene)
     {
+        probegrid_del(probegrid_get());
         pt_scene_del(ms_ptscene);
         ms_ptscene = NULL;
         pt_trace_del(&ms_trace);
@@ -424,10 +772,78 @@ end:
     return cmdstat_ok;
 }
 
+static void LogBakeProgress(void)
+{
+    const lmbakestats_t* stats = lmpack_bake_stats();
+    if (stats->texels > 0)
+    {
+        const double total = stats->samples + stats->samplesLeft;
+        const double done = total > 0.0 ? stats->samples / total : 1.0;
+        con_logf(LogSev_Info, "LM", "Bake %.1f%%, %d of %d texels converged, %.2f Msamples/s, eta %.0fs",
+            100.0 * done,
+            stats->converged,
+            stats->texels,
+            stats->samplesPerSecond * 1e-6,
+            stats->eta);
+    }
+}
+
+static cmdstat_t CmdLmProgress(i32 argc, const char** argv)
+{
+    LogBakeProgress();
+    return cmdstat_ok;
+}
+
+// edits are picked up once they have been around for a second,
+// so dragging a drawable does not rebuild the scene every frame.
+// drawables are only diffed after they changed.
+static void LightmapRebake(void)
+{
+    static u32 s_version = 0;
+    static u64 s_firstSeen = 0;
+
+    const u32 version = drawables_version();
+    if (version == s_version)
+    {
+        return;
+    }
+    u64 now = time_now();
+    if (!s_firstSeen)
+    {
+        s_firstSeen = now;
+    }
+    if (time_sec(now - s_firstSeen) < 1.0)
+    {
+        return;
+    }
+    s_firstSeen = 0;
+    s_version = version;
+
+    bool needsRepack = false;
+    if (lmpack_edits(&needsRepack) == 0)
+    {
+        return;
+    }
+
+    // the path tracer scene is a copy of the drawables
+    ShutdownPtScene();
+    EnsurePtScene();
+    if (needsRepack)
+    {
+        con_logf(LogSev_Info, "LM", "Drawables were added, repacking lightmaps");
+        LightmapRepack();
+    }
+    else
+    {
+        lmpack_rebake(ms_ptscene, cvar_get_float(&cv_lm_reach));
+    }
+}
+
 ProfileMark(pm_Lightmap_Trace, Lightmap_Trace)
 static void Lightmap_Trace(void)
 {
     static u64 s_lastUpload = 0;
+    static u64 s_lastLog = 0;
 
     if (cvar_get_bool(&cv_lm_gen))
     {
@@ -435,24 +851,52 @@ static void Lightmap_Trace(void)
         EnsurePtScene();
 
         bool dirty = lmpack_get()->lmCount == 0;
+        dirty |= lmpack_get()->stripped;
         dirty |= cvar_check_dirty(&cv_lm_density);
         if (dirty)
         {
             LightmapRepack();
         }
+        else if (cvar_get_bool(&cv_lm_incremental))
+        {
+            LightmapRebake();
+        }
 
         float timeslice = 1.0f / cvar_get_int(&cv_lm_timeslice);
         i32 spp = cvar_get_int(&cv_lm_spp);
-        lmpack_bake(ms_ptscene, timeslice, spp);
-
+        lmpack_bake(
+            ms_ptscene,
+            timeslice,
+            spp,
+            cvar_get_float(&cv_lm_error),
+            cvar_get_int(&cv_lm_minspp),
+            cvar_get_int(&cv_lm_maxspp));
+
+        // only baked tiles are sent, often while most of the lightmap is
+        // still changing and less often as the bake converges
+        const lmbakestats_t* stats = lmpack_bake_stats();
+        const double total = stats->samples + stats->samplesLeft;
+        const double done = total > 0.0 ? stats->samples / total : 1.0;
+        const double interval = f1_lerp(
+            cvar_get_float(&cv_lm_upload_min),
+            cvar_get_float(&cv_lm_upload_max),
+            (float)done);
         u64 now = time_now();
-        if (time_sec(now - s_lastUpload) > 10.0)
+        if (time_sec(now - s_lastUpload) > interval)
         {
             s_lastUpload = now;
             lmpack_t* pack = lmpack_get();
             for (i32 i = 0; i < pack->lmCount; ++i)
             {
-                lightmap_upload(&pack->lightmaps[i]);
+                lightmap_upload_dirty(&pack->lightmaps[i]);
+            }
+        }
+        if (time_sec(now - s_lastLog) > 10.0)
+        {
+            s_lastLog = now;
+            if (stats->converged < stats->texels)
+            {
+                LogBakeProgress();
             }
         }
 
@@ -492,8 +936,38 @@ static void Cubemap_Trace(void)
     }
 }
 
+ProfileMark(pm_ProbegridTrace, Probegrid_Trace)
+static void Probegrid_Trace(void)
+{
+    if (cvar_get_bool(&cv_pg_gen))
+    {
+        ProfileBegin(pm_ProbegridTrace);
+        EnsurePtScene();
+
+        probegrid_t* pg = probegrid_get();
+        bool dirty = cvar_check_dirty(&cv_pg_gen);
+        dirty |= cvar_check_dirty(&cv_pg_density);
+        if (dirty || !pg->brickCells)
+        {
+            probegrid_del(pg);
+            probegrid_new(pg, ms_ptscene, cvar_get_float(&cv_pg_density));
+        }
+        const i32 maxSpp = cvar_get_int(&cv_pg_maxspp);
+        if (pg->sampleCount < maxSpp)
+        {
+            probegrid_bake(pg, ms_ptscene, cvar_get_int(&cv_pg_spp));
+            // probes settle quickly, so uploads grow further apart
+            if ((pg->sampleCount >= 2 * pg->uploadCount) || (pg->sampleCount >= maxSpp))
+            {
+                probegrid_upload(pg);
+            }
+        }
+
+        ProfileEnd(pm_ProbegridTrace);
+    }
+}
+
 ProfileMark(pm_PathTrace, PathTrace)
-ProfileMark(pm_ptDenoise, Denoise)
 ProfileMark(pm_ptBlit, Blit)
 static bool PathTrace(void)
 {
@@ -502,15 +976,23 @@ static bool PathTrace(void)
         ProfileBegin(pm_PathTrace);
         EnsurePtTrace();
 
+        bool moved = false;
         {
             camera_t camera;
             camera_get(&camera);
 
-            bool dirty = false;
-            dirty |= cvar_check_dirty(&cv_pt_trace);
-            dirty |= memcmp(&camera, &ms_ptcam, sizeof(camera));
+            bool dirty = cvar_check_dirty(&cv_pt_trace);
+            moved = memcmp(&camera, &ms_ptcam, sizeof(camera)) != 0;
 
-            if (dirty)
+            if (moved && !dirty && (ms_ptSampleCount > 0) && cvar_get_bool(&cv_pt_reproject) && !farm_hosting())
+            {
+                pt_trace_reproject(&ms_trace, &ms_ptcam, &camera);
+                ms_ptcam = camera;
+                // pixels carry their own history length in sampleCounts,
+                // so only avoid restarting them
+                ms_ptSampleCount = 1;
+            }
+            else if (moved || dirty)
             {
                 ms_ptcam = camera;
                 ms_ptSampleCount = 0;
@@ -520,27 +1002,26 @@ static bool PathTrace(void)
         ms_trace.sampleWeight = 1.0f / ++ms_ptSampleCount;
         const int2 size = ms_trace.imageSize;
         const i32 texCount = size.x * size.y;
-        pt_trace(&ms_trace, &ms_ptcam);
+        if (farm_hosting())
+        {
+            farm_trace(&ms_trace, ms_ptscene, &ms_ptcam, ms_mapname, 1);
+        }
+        else if (moved && cvar_get_bool(&cv_pt_progressive))
+        {
+            pt_trace_progressive(&ms_trace, &ms_ptcam, cvar_get_float(&cv_pt_progressive_ms));
+        }
+        else
+        {
+            pt_trace(&ms_trace, &ms_ptcam);
+        }
+        const bool partial = ms_trace.stride > 1;
 
-        float3* pim_noalias output3 = ms_trace.color;
-        if (cvar_get_bool(&cv_pt_denoise))
+        const float3* pim_noalias output3 = ms_trace.color;
+        const float3* denoised = PtDenoise(
+            moved, cvar_get_bool(&cv_pt_denoise) && !partial);
+        if (denoised)
         {
-            bool denoised = Denoise(
-                DenoiseType_Image,
-                size,
-                ms_trace.color,
-                ms_trace.albedo,
-                ms_trace.normal,
-                ms_trace.denoised);
-
-            if (!denoised)
-            {
-                cvar_set_bool(&cv_pt_denoise, false);
-            }
-            else
-            {
-                output3 = ms_trace.denoised;
-            }
+            output3 = denoised;
         }
         if (cvar_get_bool(&cv_pt_albedo))
         {
@@ -563,9 +1044,16 @@ static bool PathTrace(void)
         {
             ProfileBegin(pm_ptBlit);
             float4* pim_noalias output4 = GetFrontBuf()->light;
-            for (i32 i = 0; i < texCount; ++i)
+            if (partial)
+            {
+                pt_trace_upsample(&ms_trace, output3, output4);
+            }
+            else
             {
-                output4[i] = f3_f4(output3[i], 1.0f);
+                for (i32 i = 0; i < texCount; ++i)
+                {
+                    output4[i] = f3_f4(output3[i], 1.0f);
+                }
             }
             ProfileEnd(pm_ptBlit);
         }
@@ -576,6 +1064,129 @@ static bool PathTrace(void)
     return false;
 }
 
+// ----------------------------------------------------------------------------
+// checkpoints, see checkpoint.h
+
+static const char* CkptName(void)
+{
+    return ms_mapname[0] ? ms_mapname : "scene";
+}
+
+static bool CkptTrace(void)
+{
+    bool tracing = cvar_get_bool(&cv_pt_trace);
+    tracing &= ms_ptSampleCount > 0;
+    tracing &= ms_trace.stride == 1;
+    tracing &= !farm_joined();
+    return tracing && ckpt_trace_save(CkptName(), &ms_trace, &ms_ptcam, ms_ptSampleCount);
+}
+
+static bool CkptLightmap(void)
+{
+    bool baking = cvar_get_bool(&cv_lm_gen);
+    baking &= lmpack_get()->lmCount > 0;
+    return baking && ckpt_lightmap_save(CkptName(), lmpack_get());
+}
+
+// one write is in flight at a time, so a save refused while the other
+// kind is writing is retried next frame
+static void Checkpoint(void)
+{
+    static u64 s_lastTrace;
+    static u64 s_lastLightmap;
+
+    const double interval = cvar_get_float(&cv_ckpt_interval);
+    if (interval <= 0.0)
+    {
+        return;
+    }
+
+    const u64 now = time_now();
+    if (!s_lastTrace)
+    {
+        s_lastTrace = now;
+        s_lastLightmap = now;
+    }
+    if ((time_sec(now - s_lastTrace) > interval) && CkptTrace())
+    {
+        s_lastTrace = now;
+    }
+    if ((time_sec(now - s_lastLightmap) > interval) && CkptLightmap())
+    {
+        s_lastLightmap = now;
+    }
+}
+
+static cmdstat_t CmdCheckpoint(i32 argc, const char** argv)
+{
+    ckpt_flush();
+    bool saved = CkptTrace();
+    ckpt_flush();
+    saved |= CkptLightmap();
+    if (!saved)
+    {
+        con_logf(LogSev_Error, "ckpt", "Nothing to checkpoint, enable pt_trace or lm_gen");
+        return cmdstat_err;
+    }
+    return cmdstat_ok;
+}
+
+static cmdstat_t CmdPtResume(i32 argc, const char** argv)
+{
+    EnsurePtTrace();
+    camera_t camera;
+    i32 sampleCount = 0;
+    if (!ckpt_trace_load(CkptName(), &ms_trace, &camera, &sampleCount))
+    {
+        con_logf(LogSev_Error, "ckpt", "No path tracing checkpoint of '%s' to resume", CkptName());
+        return cmdstat_err;
+    }
+    camera_set(&camera);
+    ms_ptcam = camera;
+    ms_ptSampleCount = sampleCount;
+    cvar_set_bool(&cv_pt_trace, true);
+    // enabling pt_trace would otherwise restart accumulation
+    cvar_check_dirty(&cv_pt_trace);
+    con_logf(LogSev_Info, "ckpt", "Resumed path tracing at %d samples", sampleCount);
+    return cmdstat_ok;
+}
+
+static cmdstat_t CmdLmResume(i32 argc, const char** argv)
+{
+    EnsurePtScene();
+    bool dirty = lmpack_get()->lmCount == 0;
+    dirty |= lmpack_get()->stripped;
+    dirty |= cvar_check_dirty(&cv_lm_density);
+    if (dirty)
+    {
+        LightmapRepack();
+    }
+    if (!ckpt_lightmap_load(CkptName(), lmpack_get()))
+    {
+        con_logf(LogSev_Error, "ckpt", "No lightmap checkpoint of '%s' to resume", CkptName());
+        return cmdstat_err;
+    }
+    cvar_set_bool(&cv_lm_gen, true);
+    con_logf(LogSev_Info, "ckpt", "Resumed lightmap bake");
+    return cmdstat_ok;
+}
+
+// loads the map a farm coordinator asked for
+static pt_scene_t* FarmScene(const char* name)
+{
+    if (StrICmp(ARGS(ms_mapname), name))
+    {
+        char cmd[PIM_PATH] = { 0 };
+        SPrintf(ARGS(cmd), "mapload %s", name);
+        if (cmd_text(cmd) != cmdstat_ok)
+        {
+            return NULL;
+        }
+    }
+    EnsurePtScene();
+    return ms_ptscene;
+}
+
 static cmdstat_t CmdQuit(i32 argc, const char** argv)
 {
     window_close(true);
@@ -707,6 +1318,8 @@ static cmdstat_t CmdLoadMap(i32 argc, const char** argv)
         loaded = true;
         loaded &= drawables_load(crate, drawables_get());
         loaded &= lmpack_load(crate, lmpack_get());
+        // optional, maps saved without probes have none
+        probegrid_load(crate, probegrid_get());
         loaded &= crate_close(crate);
     }
 
@@ -720,6 +1333,7 @@ static cmdstat_t CmdLoadMap(i32 argc, const char** argv)
         drawables_updatetransforms(drawables_get());
         drawables_updatebounds(drawables_get());
         vkr_onload();
+        StrCpy(ARGS(ms_mapname), name);
         con_logf(LogSev_Info, "cmd", "mapload loaded '%s'.", mapname);
         return cmdstat_ok;
     }
@@ -758,7 +1372,8 @@ static cmdstat_t CmdSaveMap(i32 argc, const char** argv)
     {
         saved = true;
         saved &= drawables_save(crate, drawables_get());
-        saved &= lmpack_save(crate, lmpack_get());
+        saved &= lmpack_save(crate, lmpack_get(), cvar_get_bool(&cv_lm_savebake));
+        saved &= probegrid_save(crate, probegrid_get(), cvar_get_bool(&cv_lm_savebake));
         saved &= crate_close(crate);
     }
 
@@ -783,7 +1398,7 @@ typedef struct task_BakeSky
     i32 steps;
 } task_BakeSky;
 
-static void BakeSkyFn(task_t* pbase, i32 begin, i32 end)
+static void BakeSkyFn(void* pbase, i32 begin, i32 end)
 {
     task_BakeSky* task = (task_BakeSky*)pbase;
     cubemap_t* pim_noalias cm = task->cm;
@@ -859,6 +1474,10 @@ void render_sys_init(void)
     cmd_reg("quit", CmdQuit);
     cmd_reg("pt_test", CmdPtTest);
     cmd_reg("pt_stddev", CmdPtStdDev);
+    cmd_reg("checkpoint", CmdCheckpoint);
+    cmd_reg("pt_resume", CmdPtResume);
+    cmd_reg("lm_resume", CmdLmResume);
+    cmd_reg("lm_progress", CmdLmProgress);
     cmd_reg("loadtest", CmdLoadTest);
 
     vkr_init();
@@ -868,6 +1487,7 @@ void render_sys_init(void)
     mesh_sys_init();
     model_sys_init();
     pt_sys_init();
+    farm_sys_init();
     drawables_init();
     EnsureFramebuf();
 
@@ -905,9 +1525,20 @@ void render_sys_update(void)
     drawables_update();
 
     BakeSky();
+    lmpack_stream(false);
     Lightmap_Trace();
     Cubemap_Trace();
-    PathTrace();
+    Probegrid_Trace();
+    farm_update();
+    if (farm_joined())
+    {
+        farm_serve(FarmScene);
+    }
+    else
+    {
+        PathTrace();
+    }
+    Checkpoint();
     Present();
 
     vkr_update();
@@ -919,6 +1550,8 @@ void render_sys_update(void)
 
 void render_sys_shutdown(void)
 {
+    ckpt_flush();
+    farm_sys_shutdown();
     ShutdownPtScene();
 
     drawables_shutdown();
@@ -3,6 +3,7 @@
 #include "rendering/framebuffer.h"
 #include "rendering/sampler.h"
 #include "math/color.h"
+#include "math/color8.h"
 #include "rendering/tonemap.h"
 #include "common/profiler.h"
 #include "allocator/allocator.h"
@@ -24,13 +25,38 @@ pim_inline u32 VEC_CALL ToColor(prng_t *const pim_noalias rng, float4 linear)
     return color;
 }
 
+// ToColor for dst[0..7]
+pim_inline void VEC_CALL ToColor8(
+    prng_t *const pim_noalias rng,
+    u32 *const pim_noalias dst,
+    float4x8 linear)
+{
+    const float8 kWeight = f8_s(1.0f / 255.0f);
+    float4 noise[kFloat8Lanes];
+    for (i32 i = 0; i < kFloat8Lanes; ++i)
+    {
+        noise[i] = f4_rand(rng);
+    }
+    float4x8 dither = f4x8_load(noise);
+    float4x8 srgb = f4x8_tosrgb(linear);
+    srgb.x = f8_lerp(srgb.x, dither.x, kWeight);
+    srgb.y = f8_lerp(srgb.y, dither.y, kWeight);
+    srgb.z = f8_lerp(srgb.z, dither.z, kWeight);
+    f4x8_rgba8(dst, srgb);
+}
+
 static void VEC_CALL ResolveReinhard(
     i32 begin, i32 end, framebuf_t* target)
 {
     float4* pim_noalias light = target->light;
     u32* pim_noalias color = target->color;
     prng_t rng = prng_get();
-    for (i32 i = begin; i < end; ++i)
+    i32 i = begin;
+    for (; (i + kFloat8Lanes) <= end; i += kFloat8Lanes)
+    {
+        ToColor8(&rng, color + i, tmap4x8_reinhard(f4x8_load(light + i)));
+    }
+    for (; i < end; ++i)
     {
         color[i] = ToColor(&rng, tmap4_reinhard(light[i]));
     }
@@ -42,8 +68,14 @@ static void VEC_CALL ResolveUncharted2(
 {
     float4* pim_noalias light = target->light;
     u32* pim_noalias color = target->color;
+    const float4 params = { 0.15f, 0.5f, 0.1f, 0.2f };
     prng_t rng = prng_get();
-    for (i32 i = begin; i < end; ++i)
+    i32 i = begin;
+    for (; (i + kFloat8Lanes) <= end; i += kFloat8Lanes)
+    {
+        ToColor8(&rng, color + i, tmap4x8_hable(f4x8_load(light + i), 1.0f, params));
+    }
+    for (; i < end; ++i)
     {
         float4 hdr = light[i];
         hdr.w = 1.0f;
@@ -58,7 +90,12 @@ static void VEC_CALL ResolveHable(
     float4* pim_noalias light = target->light;
     u32* pim_noalias color = target->color;
     prng_t rng = prng_get();
-    for (i32 i = begin; i < end; ++i)
+    i32 i = begin;
+    for (; (i + kFloat8Lanes) <= end; i += kFloat8Lanes)
+    {
+        ToColor8(&rng, color + i, tmap4x8_hable(f4x8_load(light + i), 1.0f, params));
+    }
+    for (; i < end; ++i)
     {
         float4 hdr = light[i];
         hdr.w = 1.0f;
@@ -86,16 +123,21 @@ static void VEC_CALL ResolveACES(
     float4* pim_noalias light = target->light;
     u32* pim_noalias color = target->color;
     prng_t rng = prng_get();
-    for (i32 i = begin; i < end; ++i)
+    i32 i = begin;
+    for (; (i + kFloat8Lanes) <= end; i += kFloat8Lanes)
+    {
+        ToColor8(&rng, color + i, tmap4x8_aces(f4x8_load(light + i)));
+    }
+    for (; i < end; ++i)
     {
         color[i] = ToColor(&rng, tmap4_aces(light[i]));
     }
     prng_set(rng);
 }
 
-static void ResolveTileFn(task_t* task, i32 begin, i32 end)
+static void ResolveTileFn(void* pbase, i32 begin, i32 end)
 {
-    resolve_t* resolve = (resolve_t*)task;
+    resolve_t* resolve = (resolve_t*)pbase;
 
     framebuf_t* target = resolve->target;
     const float4 params = resolve->toneParams;
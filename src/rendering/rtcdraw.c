@@ -24,6 +24,7 @@
 #include "rendering/lights.h"
 #include "rendering/lightmap.h"
 #include "rendering/cubemap.h"
+#include "rendering/probegrid.h"
 #include "rendering/mesh.h"
 #include "rendering/material.h"
 
@@ -104,7 +105,7 @@ typedef struct task_DrawScene
     world_t* world;
 } task_DrawScene;
 
-static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
+static void DrawSceneFn(void* pbase, i32 begin, i32 end)
 {
     task_DrawScene* task = (task_DrawScene*)pbase;
     framebuf_t* target = task->target;
@@ -123,6 +124,7 @@ static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
     const pt_light_t* pim_noalias lights = lights_get()->ptLights;
 
     const lmpack_t* lmpack = lmpack_get();
+    const probegrid_t* probegrid = probegrid_get();
 
     const int2 size = { target->width, target->height };
     const float2 rcpSize = { 1.0f / size.x, 1.0f / size.y };
@@ -250,9 +252,9 @@ static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
                 lmUv = f2_subvs(lmUv, 0.5f / lmap.size);
                 float4 probe[kGiDirections];
                 float4 axii[kGiDirections];
+                lightmap_sample(&lmap, lmUv, probe);
                 for (i32 i = 0; i < kGiDirections; ++i)
                 {
-                    probe[i] = UvBilinearClamp_f4(lmap.probes[i], i2_s(lmap.size), lmUv);
                     float4 ax = lmpack->axii[i];
                     float sharpness = ax.w;
                     ax = TbnToWorld(TBN, ax);
@@ -273,6 +275,26 @@ static void DrawSceneFn(task_t* pbase, i32 begin, i32 end)
                     rome.y);
                 lighting = f4_add(lighting, indirect);
             }
+            else
+            {
+                SH4v sh;
+                if (probegrid_sample(probegrid, P, &sh))
+                {
+                    float4 R = f4_normalize3(f4_reflect3(rd, N));
+                    float4 diffuseGI = f4_max(f3_f4(SH4v_irradiance(sh, f4_f3(N)), 0.0f), f4_0);
+                    float4 specularGI = f4_max(f3_f4(SH4v_eval(sh, f4_f3(R)), 0.0f), f4_0);
+                    float4 indirect = IndirectBRDF(
+                        V,
+                        N,
+                        diffuseGI,
+                        specularGI,
+                        albedo,
+                        rome.x,
+                        rome.z,
+                        rome.y);
+                    lighting = f4_add(lighting, indirect);
+                }
+            }
         }
 
         dstLight[iTexel] = lighting;
@@ -305,7 +327,7 @@ typedef struct task_ClusterLights
     const lights_t* lights;
 } task_ClusterLights;
 
-static void ClusterLightsFn(task_t* pbase, i32 begin, i32 end)
+static void ClusterLightsFn(void* pbase, i32 begin, i32 end)
 {
     task_ClusterLights* task = (task_ClusterLights*)pbase;
     froxels_t* pim_noalias froxels = task->froxels;
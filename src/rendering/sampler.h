@@ -876,6 +876,60 @@ pim_inline float4 VEC_CALL TrilinearWrap_dir8(
     return f4_normalize3(N);
 }
 
+pim_inline float4 VEC_CALL TrilinearWrapPow2_c32_fast(
+    u32 const *const pim_noalias buffer,
+    int2 size,
+    float2 uv,
+    float mip)
+{
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
+    i32 m0 = (i32)f1_floor(mip);
+    i32 m1 = (i32)f1_ceil(mip);
+    float mfrac = f1_frac(mip);
+
+    int2 size0 = CalcMipSize(size, m0);
+    int2 size1 = CalcMipSize(size, m1);
+
+    i32 i0 = CalcMipOffset(size, m0);
+    i32 i1 = CalcMipOffset(size, m1);
+
+    float4 s0 = UvBilinearWrapPow2_c32_fast(buffer + i0, size0, uv);
+    if (m0 == m1)
+    {
+        return s0;
+    }
+    float4 s1 = UvBilinearWrapPow2_c32_fast(buffer + i1, size1, uv);
+
+    return f4_lerpvs(s0, s1, mfrac);
+}
+pim_inline float4 VEC_CALL TrilinearWrapPow2_xy16(
+    short2 const *const pim_noalias buffer,
+    int2 size,
+    float2 uv,
+    float mip)
+{
+    mip = f1_clamp(mip, 0.0f, (float)(CalcMipCount(size) - 1));
+    i32 m0 = (i32)f1_floor(mip);
+    i32 m1 = (i32)f1_ceil(mip);
+    float mfrac = f1_frac(mip);
+
+    int2 size0 = CalcMipSize(size, m0);
+    int2 size1 = CalcMipSize(size, m1);
+
+    i32 i0 = CalcMipOffset(size, m0);
+    i32 i1 = CalcMipOffset(size, m1);
+
+    float4 s0 = UvBilinearWrapPow2_xy16(buffer + i0, size0, uv);
+    if (m0 == m1)
+    {
+        return s0;
+    }
+    float4 s1 = UvBilinearWrapPow2_xy16(buffer + i1, size1, uv);
+
+    float4 N = f4_lerpvs(s0, s1, mfrac);
+    return f4_normalize3(N);
+}
+
 pim_inline void VEC_CALL Write_f4(
     float4 *const pim_noalias dst, int2 size, int2 coord, float4 src)
 {
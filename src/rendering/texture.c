@@ -4,6 +4,7 @@
 #include "math/color.h"
 #include "math/blending.h"
 #include "rendering/sampler.h"
+#include "rendering/mipmap.h"
 #include "rendering/material.h"
 #include "assets/asset_system.h"
 #include "quake/q_bspfile.h"
@@ -24,6 +25,7 @@ static table_t ms_table;
 static u8 ms_palette[256 * 3];
 
 static void ResizeToPow2(texture_t* tex);
+static void GenerateMips(texture_t* tex);
 
 static genid_t ToGenId(textureid_t tid)
 {
@@ -132,6 +134,7 @@ bool texture_new(
         else
         {
             ResizeToPow2(tex);
+            GenerateMips(tex);
             i32 width = tex->size.x;
             i32 height = tex->size.y;
             tex->slot = vkrTexTable_Alloc(
@@ -210,6 +213,7 @@ bool texture_getnamestr(textureid_t tid, char* dst, i32 size)
     return false;
 }
 
+// only mip 0 is stored, the chain is cheaper to rebuild than to load
 bool texture_save(crate_t* crate, textureid_t tid, guid_t* dst)
 {
     bool wasSet = false;
@@ -266,6 +270,7 @@ bool texture_load(crate_t* crate, guid_t name, textureid_t* dst)
                     memmove(dtexture, dtexture + 1, texelBytes);
                     texture.texels = (u32*)dtexture;
                     dtexture = NULL;
+                    // regenerates the mip chain texture_save dropped
                     loaded = texture_new(&texture, format, name, dst);
                 }
             }
@@ -687,6 +692,34 @@ static void ResizeToPow2(texture_t* tex)
     }
 }
 
+// extends texels with a full mip chain for the path tracer.
+// mip 0 stays first, so the gpu upload and serialization are unchanged.
+static void GenerateMips(texture_t* tex)
+{
+    const int2 size = tex->size;
+    const i32 bpp = vkrFormatToBpp(tex->format);
+    tex->texels = tex_realloc(tex->texels, (mipmap_len(size) * bpp) / 8);
+
+    switch (tex->format)
+    {
+    default:
+        ASSERT(false);
+        break;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        mipmap_f4(tex->texels, size);
+        break;
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        mipmap_c32(tex->texels, size);
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        mipmap_dir8(tex->texels, size);
+        break;
+    case VK_FORMAT_R16G16_SNORM:
+        mipmap_xy16(tex->texels, size);
+        break;
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 static bool gs_revSort;
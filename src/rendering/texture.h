@@ -26,6 +26,7 @@ typedef struct dtextureid_s
 typedef struct texture_s
 {
     int2 size;
+    // full mip chain, mip 0 first. see CalcMipOffset
     void* pim_noalias texels;
     VkFormat format;
     vkrTextureId slot;
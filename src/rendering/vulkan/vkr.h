@@ -29,6 +29,9 @@ enum
     kTextureTable3DSize = 64,
     kTextureTableCubeSize = 64,
     kTextureTable2DArraySize = 64,
+
+    // staging buffers for partial texture uploads
+    kTextureStageRingLen = 8,
 };
 
 // single descriptors
@@ -451,6 +454,10 @@ typedef struct vkrPerCamera
     float4x4 worldToClip;
     float4 eye;
     float exposure;
+    // irradiance probe volumes, sampled at uvw = P * pgScale + pgBias
+    float4 pgScale;
+    float4 pgBias;
+    uint4 pgVolumes;
 } vkrPerCamera;
 
 typedef struct vkrOpaquePc
@@ -16,6 +16,7 @@
 #include "rendering/material.h"
 #include "rendering/camera.h"
 #include "rendering/lightmap.h"
+#include "rendering/probegrid.h"
 
 #include "allocator/allocator.h"
 #include "common/profiler.h"
@@ -204,6 +205,27 @@ void vkrOpaquePass_Setup(vkrOpaquePass *const pass)
         perCamera->worldToClip = g_vkr.mainPass.depth.worldToClip;
         perCamera->eye = camera.position;
         perCamera->exposure = g_vkr.exposurePass.params.exposure;
+        {
+            // slot 0 of the table is black, its zero alpha means no probes
+            const probegrid_t* pg = probegrid_get();
+            const grid_t grid = pg->grid;
+            float4 scale = f4_0;
+            float4 bias = f4_0;
+            uint4 volumes = { 0 };
+            if ((pg->probeCount > 0) && (pg->sampleCount > 0))
+            {
+                const float4 size = f4_v((float)grid.size.x, (float)grid.size.y, (float)grid.size.z, 1.0f);
+                scale = f4_div(f4_s(grid.cellsPerMeter), size);
+                bias = f4_neg(f4_mul(grid.bounds.lo, scale));
+                volumes.x = pg->volumes[0].index;
+                volumes.y = pg->volumes[1].index;
+                volumes.z = pg->volumes[2].index;
+                volumes.w = pg->volumes[3].index;
+            }
+            perCamera->pgScale = scale;
+            perCamera->pgBias = bias;
+            perCamera->pgVolumes = volumes;
+        }
         vkrBuffer_Unmap(camBuffer);
         vkrBuffer_Flush(camBuffer);
     }
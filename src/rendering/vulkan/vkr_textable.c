@@ -3,6 +3,8 @@
 #include "rendering/vulkan/vkr_texture.h"
 #include "rendering/vulkan/vkr_image.h"
 #include "rendering/vulkan/vkr_sampler.h"
+#include "rendering/vulkan/vkr_buffer.h"
+#include "rendering/vulkan/vkr_sync.h"
 
 #include "allocator/allocator.h"
 #include "containers/idalloc.h"
@@ -297,6 +299,11 @@ SASSERT(NELEM(kTableBindIds) == TexTableType_COUNT);
 
 static TexTable ms_tables[TexTableType_COUNT];
 
+// a stage buffer is reused once the copy out of it has landed
+static vkrBuffer ms_stageRing[kTextureStageRingLen];
+static VkFence ms_stageFences[kTextureStageRingLen];
+static i32 ms_stageHead;
+
 static TexTable* GetTexTable(VkImageViewType viewType)
 {
     switch (viewType)
@@ -334,6 +341,12 @@ void vkrTexTable_Shutdown(void)
     {
         TexTable_Del(&ms_tables[i]);
     }
+    for (i32 i = 0; i < NELEM(ms_stageRing); ++i)
+    {
+        vkrBuffer_Del(&ms_stageRing[i]);
+        ms_stageFences[i] = NULL;
+    }
+    ms_stageHead = 0;
 }
 
 void vkrTexTable_Update(void)
@@ -445,6 +458,78 @@ VkFence vkrTexTable_Upload(
     return TexTable_Upload(GetTexTable(id.type), id, layer, data, bytes);
 }
 
+ProfileMark(pm_uploadregions, vkrTexTable_UploadRegions)
+VkFence vkrTexTable_UploadRegions(
+    vkrTextureId id,
+    i32 layer,
+    i32 layerCount,
+    int4 const *const rects,
+    i32 rectCount,
+    void const *const data,
+    i32 bytes)
+{
+    ASSERT(bytes >= 0);
+    ASSERT(data || !bytes);
+    switch (id.type)
+    {
+    default:
+        ASSERT(false);
+        return NULL;
+    case VK_IMAGE_VIEW_TYPE_1D:
+    case VK_IMAGE_VIEW_TYPE_2D:
+    case VK_IMAGE_VIEW_TYPE_3D:
+        layer = 0;
+        layerCount = 1;
+        break;
+    case VK_IMAGE_VIEW_TYPE_CUBE:
+        ASSERT(layer >= 0);
+        ASSERT((layer + layerCount) <= 6);
+        break;
+    case VK_IMAGE_VIEW_TYPE_2D_ARRAY:
+        ASSERT(layer >= 0);
+        ASSERT((layer + layerCount) <= 256);
+        break;
+    }
+
+    TexTable* tt = GetTexTable(id.type);
+    if ((bytes <= 0) || (rectCount <= 0) || !TexTable_Exists(tt, id))
+    {
+        return NULL;
+    }
+
+    ProfileBegin(pm_uploadregions);
+
+    const i32 slot = ms_stageHead;
+    ms_stageHead = (slot + 1) % kTextureStageRingLen;
+    if (ms_stageFences[slot])
+    {
+        vkrFence_Wait(ms_stageFences[slot]);
+        ms_stageFences[slot] = NULL;
+    }
+
+    VkFence fence = NULL;
+    vkrBuffer *const stage = &ms_stageRing[slot];
+    if (vkrBuffer_Reserve(
+        stage,
+        bytes,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        vkrMemUsage_CpuOnly))
+    {
+        vkrBuffer_Write(stage, data, bytes);
+        fence = vkrTexture_UploadRegions(
+            &tt->images[id.index],
+            stage,
+            layer,
+            layerCount,
+            rects,
+            rectCount);
+        ms_stageFences[slot] = fence;
+    }
+
+    ProfileEnd(pm_uploadregions);
+    return fence;
+}
+
 bool vkrTexTable_SetSampler(
     vkrTextureId id,
     VkFilter filter,
@@ -25,6 +25,17 @@ VkFence vkrTexTable_Upload(
     i32 layer,
     void const *const data,
     i32 bytes);
+// writes rects (x, y, width, height) of layers [layer, layer + layerCount)
+// through a ring of stage buffers, leaving the rest of the texture as is.
+// data holds each layer's rects packed row by row, one rect after another.
+VkFence vkrTexTable_UploadRegions(
+    vkrTextureId id,
+    i32 layer,
+    i32 layerCount,
+    int4 const *const rects,
+    i32 rectCount,
+    void const *const data,
+    i32 bytes);
 
 bool vkrTexTable_SetSampler(
     vkrTextureId id,
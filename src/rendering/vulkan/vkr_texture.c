@@ -211,6 +211,109 @@ void vkrTexture_Release(vkrImage *const image)
     vkrImage_Release(image);
 }
 
+// mip 0 of the layers is in transfer dst layout.
+// blits it down the mip chain and leaves every mip in shader read layout.
+static void GenerateMips(
+    VkCommandBuffer cmd,
+    vkrImage const *const image,
+    i32 layer,
+    i32 layerCount)
+{
+    const i32 width = image->width;
+    const i32 height = image->height;
+    const i32 depth = image->depth;
+    const i32 mipCount = image->mipLevels;
+    VkImage handle = image->handle;
+
+    VkImageMemoryBarrier barrier =
+    {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = handle,
+        .subresourceRange =
+        {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = layer,
+            .layerCount = layerCount,
+        },
+    };
+
+    for (i32 i = 1; i < mipCount; ++i)
+    {
+        // transition (i-1) to xfer src optimal
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkrCmdImageBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            &barrier);
+
+        // blit (i-1) into i
+        i32 srcWidth = i1_max(width >> (i - 1), 1);
+        i32 srcHeight = i1_max(height >> (i - 1), 1);
+        i32 srcDepth = i1_max(depth >> (i - 1), 1);
+        i32 dstWidth = i1_max(width >> i, 1);
+        i32 dstHeight = i1_max(height >> i, 1);
+        i32 dstDepth = i1_max(depth >> i, 1);
+        const VkImageBlit blit =
+        {
+            .srcOffsets[1] = { srcWidth, srcHeight, srcDepth, },
+            .dstOffsets[1] = { dstWidth, dstHeight, dstDepth, },
+            .srcSubresource =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = i - 1,
+                .baseArrayLayer = layer,
+                .layerCount = layerCount,
+            },
+            .dstSubresource =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = i,
+                .baseArrayLayer = layer,
+                .layerCount = layerCount,
+            },
+        };
+        vkCmdBlitImage(
+            cmd,
+            handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit,
+            VK_FILTER_LINEAR);
+
+        // transition (i-1) to shader read
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkrCmdImageBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            &barrier);
+    }
+
+    // transition last mip to shader read
+    barrier.subresourceRange.baseMipLevel = mipCount - 1;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkrCmdImageBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        &barrier);
+}
+
 VkFence vkrTexture_Upload(
     vkrImage *const image,
     i32 layer,
@@ -252,7 +355,6 @@ VkFence vkrTexture_Upload(
     const i32 width = image->width;
     const i32 height = image->height;
     const i32 depth = image->depth;
-    const i32 mipCount = image->mipLevels;
     VkImage handle = image->handle;
 
     VkFence fence = NULL;
@@ -305,83 +407,109 @@ VkFence vkrTexture_Upload(
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             1, &region);
 
-        barrier.subresourceRange.levelCount = 1;
-        // generate mips
-        for (i32 i = 1; i < mipCount; ++i)
-        {
-            // transition (i-1) to xfer src optimal
-            barrier.subresourceRange.baseMipLevel = i - 1;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            vkrCmdImageBarrier(
-                cmd,
-                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                &barrier);
+        GenerateMips(cmd, image, layer, 1);
+    }
+    vkrCmdEnd(cmd);
+    vkrCmdSubmit(queue, cmd, fence, NULL, 0x0, NULL);
+    vkrBuffer_Release(&stagebuf);
 
-            // blit (i-1) into i
-            i32 srcWidth = i1_max(width >> (i - 1), 1);
-            i32 srcHeight = i1_max(height >> (i - 1), 1);
-            i32 srcDepth = i1_max(depth >> (i - 1), 1);
-            i32 dstWidth = i1_max(width >> i, 1);
-            i32 dstHeight = i1_max(height >> i, 1);
-            i32 dstDepth = i1_max(depth >> i, 1);
-            const VkImageBlit blit =
-            {
-                .srcOffsets[1] = { srcWidth, srcHeight, srcDepth, },
-                .dstOffsets[1] = { dstWidth, dstHeight, dstDepth, },
-                .srcSubresource =
-                {
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .mipLevel = i - 1,
-                    .baseArrayLayer = layer,
-                    .layerCount = 1,
-                },
-                .dstSubresource =
-                {
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .mipLevel = i,
-                    .baseArrayLayer = layer,
-                    .layerCount = 1,
-                },
-            };
-            vkCmdBlitImage(
-                cmd,
-                handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1, &blit,
-                VK_FILTER_LINEAR);
+    image->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    return fence;
+}
+
+VkFence vkrTexture_UploadRegions(
+    vkrImage *const image,
+    vkrBuffer const *const stage,
+    i32 layer,
+    i32 layerCount,
+    int4 const *const pim_noalias rects,
+    i32 rectCount)
+{
+    ASSERT(image);
+    ASSERT(image->handle);
+    ASSERT(stage);
+    ASSERT(stage->handle);
+    ASSERT(rects || !rectCount);
+    ASSERT(layer >= 0);
+    ASSERT((layer + layerCount) <= image->arrayLayers);
+    if ((rectCount <= 0) || (layerCount <= 0))
+    {
+        return NULL;
+    }
 
-            // transition (i-1) to shader read
-            barrier.subresourceRange.baseMipLevel = i - 1;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            vkrCmdImageBarrier(
-                cmd,
-                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                &barrier);
+    const i32 texelBytes = vkrFormatToBpp(image->format) / 8;
+    const i32 regionCount = rectCount * layerCount;
+    VkBufferImageCopy *const regions = tmp_calloc(sizeof(regions[0]) * regionCount);
+    i32 offset = 0;
+    for (i32 iLayer = 0; iLayer < layerCount; ++iLayer)
+    {
+        for (i32 iRect = 0; iRect < rectCount; ++iRect)
+        {
+            const int4 rect = rects[iRect];
+            ASSERT((rect.x + rect.z) <= image->width);
+            ASSERT((rect.y + rect.w) <= image->height);
+            VkBufferImageCopy *const region = &regions[iLayer * rectCount + iRect];
+            region->bufferOffset = offset;
+            region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region->imageSubresource.mipLevel = 0;
+            region->imageSubresource.baseArrayLayer = layer + iLayer;
+            region->imageSubresource.layerCount = 1;
+            region->imageOffset.x = rect.x;
+            region->imageOffset.y = rect.y;
+            region->imageExtent.width = rect.z;
+            region->imageExtent.height = rect.w;
+            region->imageExtent.depth = 1;
+            offset += rect.z * rect.w * texelBytes;
         }
+    }
+    ASSERT(offset <= stage->size);
 
-        // transition last mip to shader read
-        barrier.subresourceRange.baseMipLevel = mipCount - 1;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkImage handle = image->handle;
+
+    VkFence fence = NULL;
+    VkQueue queue = NULL;
+    VkCommandBuffer cmd = vkrContext_GetTmpCmd(vkrQueueId_Gfx, &fence, &queue);
+    vkrCmdBegin(cmd);
+    {
+        // transition all mips to xfer dst, keeping the texels outside the rects
+        VkImageMemoryBarrier barrier =
+        {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .oldLayout = image->layout,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = handle,
+            .subresourceRange =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = layer,
+                .layerCount = layerCount,
+            },
+        };
         vkrCmdImageBarrier(
             cmd,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
             &barrier);
+        image->layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+        vkCmdCopyBufferToImage(
+            cmd,
+            stage->handle,
+            handle,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            regionCount, regions);
+
+        GenerateMips(cmd, image, layer, layerCount);
     }
     vkrCmdEnd(cmd);
     vkrCmdSubmit(queue, cmd, fence, NULL, 0x0, NULL);
-    vkrBuffer_Release(&stagebuf);
 
     image->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
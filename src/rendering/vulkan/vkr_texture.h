@@ -26,4 +26,15 @@ VkFence vkrTexture_Upload(
     void const *const data,
     i32 bytes);
 
+// copies rects (x, y, width, height) of mip 0 from stage and regenerates the
+// mips of the layers. stage holds each layer's rects packed row by row, one
+// rect after another, layer after layer.
+VkFence vkrTexture_UploadRegions(
+    vkrImage *const image,
+    vkrBuffer const *const stage,
+    i32 layer,
+    i32 layerCount,
+    int4 const *const pim_noalias rects,
+    i32 rectCount);
+
 PIM_C_END
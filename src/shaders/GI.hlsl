@@ -46,4 +46,45 @@ GISample SampleLightmap(
     return output;
 }
 
+// L1 SH basis scaled by the band factors b0 and b1, see SH4s_proj
+float4 SH4_Basis(float3 dir, float b0, float b1)
+{
+    return float4(
+        0.282095 * b0,
+        -0.488603 * dir.x * b1,
+        0.488603 * dir.y * b1,
+        -0.488603 * dir.z * b1);
+}
+
+float3 SH4_Dot(float3 sh[4], float4 basis)
+{
+    return sh[0] * basis.x + sh[1] * basis.y + sh[2] * basis.z + sh[3] * basis.w;
+}
+
+// blends the irradiance probes around P, for geometry without a lightmap.
+// the volumes hold zero outside the level and the first one's alpha
+// marks the inside, so dividing by it renormalizes over probes inside.
+GISample SampleProbeGrid(float3 P, float3 N, float3 R)
+{
+    GISample output;
+    output.diffuse = 0.0;
+    output.specular = 0.0;
+
+    uint4 volumes = cameraData.pgVolumes;
+    float3 uvw = P * cameraData.pgScale.xyz + cameraData.pgBias.xyz;
+    float4 c0 = SampleTable3D(volumes.x, uvw);
+    if (c0.w > kEpsilon)
+    {
+        float rcpWeight = 1.0 / c0.w;
+        float3 sh[4];
+        sh[0] = c0.xyz * rcpWeight;
+        sh[1] = SampleTable3D(volumes.y, uvw).xyz * rcpWeight;
+        sh[2] = SampleTable3D(volumes.z, uvw).xyz * rcpWeight;
+        sh[3] = SampleTable3D(volumes.w, uvw).xyz * rcpWeight;
+        output.diffuse = max(0.0, SH4_Dot(sh, SH4_Basis(N, kPi, kTau / 3.0)));
+        output.specular = max(0.0, SH4_Dot(sh, SH4_Basis(R, 1.0, 1.0)));
+    }
+    return output;
+}
+
 #endif // GI_HLSL
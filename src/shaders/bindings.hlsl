@@ -5,6 +5,11 @@ struct PerCamera
 {
     float4x4 worldToClip;
     float4 eye;
+    float exposure;
+    // irradiance probe volumes, sampled at uvw = P * pgScale + pgBias
+    float4 pgScale;
+    float4 pgBias;
+    uint4 pgVolumes;
 };
 
 // uniform buffer at binding 0
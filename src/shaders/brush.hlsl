@@ -80,7 +80,16 @@ PSOutput PSMain(PSInput input)
     {
         float2 uv1 = input.uv01.zw;
         float3 R = reflect(-V, N);
-        GISample gi = SampleLightmap(li, uv1, input.TBN, N, R);
+        GISample gi;
+        // slot 0 is the black default, drawables without a lightmap keep it
+        if (li != 0)
+        {
+            gi = SampleLightmap(li, uv1, input.TBN, N, R);
+        }
+        else
+        {
+            gi = SampleProbeGrid(P, N, R);
+        }
         float3 indirect = IndirectBRDF(V, N, gi.diffuse, gi.specular, albedo, roughness, metallic, occlusion);
         light += indirect;
     }
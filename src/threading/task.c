@@ -28,6 +28,7 @@ static thread_t ms_threads[kMaxThreads];
 static ptrqueue_t ms_queues[kMaxThreads];
 
 static pim_thread_local i32 ms_tid;
+static pim_thread_local i32 ms_depth;
 
 // ----------------------------------------------------------------------------
 
@@ -43,7 +44,9 @@ static bool ExecuteTask(task_t* task)
         i32 b = i1_min(a + gran, wsize);
         while (a < b)
         {
+            ++ms_depth;
             fn(task, a, b);
+            --ms_depth;
 
             const i32 count = b - a;
             const i32 prev = fetch_add_i32(&task->tail, count, MO_AcqRel);
@@ -102,6 +105,11 @@ i32 task_thread_ct(void)
     return ms_numthreads;
 }
 
+bool task_executing(void)
+{
+    return ms_depth > 0;
+}
+
 TaskStatus task_stat(const void* pbase)
 {
     ASSERT(pbase);
@@ -24,6 +24,9 @@ typedef struct task_s
 
 i32 task_thread_id(void);
 i32 task_thread_ct(void);
+// true while the calling thread is inside a task function.
+// task queues are shallow, so callers use this to avoid nesting tasks.
+bool task_executing(void);
 
 void task_submit(void* task, task_execute_fn execute, i32 worksize);
 TaskStatus task_stat(const void* task);